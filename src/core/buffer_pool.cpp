@@ -0,0 +1,102 @@
+#include "core/buffer_pool.h"
+
+#include <utility>
+
+namespace puml {
+
+// ---------------------- PooledBuffer ----------------------
+
+PooledBuffer::~PooledBuffer() {
+    Release();
+}
+
+PooledBuffer::PooledBuffer(PooledBuffer&& other) noexcept
+    : pool_(other.pool_), data_(other.data_), capacity_(other.capacity_) {
+    other.pool_ = nullptr;
+    other.data_ = nullptr;
+    other.capacity_ = 0;
+}
+
+PooledBuffer& PooledBuffer::operator=(PooledBuffer&& other) noexcept {
+    if (this != &other) {
+        Release();
+        std::swap(pool_, other.pool_);
+        std::swap(data_, other.data_);
+        std::swap(capacity_, other.capacity_);
+    }
+    return *this;
+}
+
+void PooledBuffer::Release() {
+    if (data_) {
+        pool_->Release(data_, capacity_);
+    }
+    pool_ = nullptr;
+    data_ = nullptr;
+    capacity_ = 0;
+}
+
+// ---------------------- BufferPool ----------------------
+
+BufferPool::BufferPool(uint64_t maxPooledBytes) : maxPooledBytes_(maxPooledBytes) {}
+
+BufferPool::~BufferPool() {
+    for (std::vector<unsigned char*>& buffers : free_) {
+        for (unsigned char* data : buffers) {
+            delete[] data;
+        }
+    }
+}
+
+BufferPool& BufferPool::Shared() {
+    static BufferPool* pool = new BufferPool(64ull * 1024 * 1024);
+    return *pool;
+}
+
+size_t BufferPool::ClassOf(size_t size) {
+    size_t index = 0;
+    for (size_t bytes = kMinClassBytes; bytes < size; bytes <<= 1) {
+        if (++index == kClassCount) break;
+    }
+    return index;
+}
+
+PooledBuffer BufferPool::Acquire(size_t minBytes) {
+    const size_t index = ClassOf(minBytes);
+    const size_t capacity = index < kClassCount ? kMinClassBytes << index : minBytes;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++stats_.acquired;
+        if (index < kClassCount && !free_[index].empty()) {
+            unsigned char* data = free_[index].back();
+            free_[index].pop_back();
+            stats_.pooledBytes -= capacity;
+            ++stats_.reused;
+            return PooledBuffer(this, data, capacity);
+        }
+        ++stats_.allocated;
+    }
+    return PooledBuffer(this, new unsigned char[capacity], capacity);
+}
+
+void BufferPool::Release(unsigned char* data, size_t capacity) {
+    const size_t index = ClassOf(capacity);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (index < kClassCount && stats_.pooledBytes + capacity <= maxPooledBytes_) {
+            free_[index].push_back(data);
+            stats_.pooledBytes += capacity;
+            if (stats_.pooledBytes > stats_.maxPooledBytes) stats_.maxPooledBytes = stats_.pooledBytes;
+            return;
+        }
+        ++stats_.discarded;
+    }
+    delete[] data;
+}
+
+BufferPoolStats BufferPool::Stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+} // namespace puml
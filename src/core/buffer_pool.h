@@ -0,0 +1,91 @@
+// Recycled byte buffers for the large, short-lived temporaries of a render:
+// pipe read chunks, spill blocks, the UTF-16 copy of a page for WebView2.
+// Buffers come in power-of-two size classes, so a buffer given back serves
+// the next request of a similar size and steady browsing stops allocating
+// them. What the pool keeps is bounded; beyond that, and above the largest
+// class, buffers are simply freed.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace puml {
+
+class BufferPool;
+
+// A buffer on loan from a pool, handed back when it goes out of scope.
+class PooledBuffer {
+public:
+    PooledBuffer() = default;
+    ~PooledBuffer();
+    PooledBuffer(PooledBuffer&& other) noexcept;
+    PooledBuffer& operator=(PooledBuffer&& other) noexcept;
+    PooledBuffer(const PooledBuffer&) = delete;
+    PooledBuffer& operator=(const PooledBuffer&) = delete;
+
+    unsigned char* Data() const { return data_; }
+    size_t         Capacity() const { return capacity_; }   // at least what was asked for
+    bool           Empty() const { return data_ == nullptr; }
+
+    template <typename T>
+    T* As() const { return reinterpret_cast<T*>(data_); }
+
+    // Gives the buffer back now; Empty() afterwards.
+    void Release();
+
+private:
+    friend class BufferPool;
+    PooledBuffer(BufferPool* pool, unsigned char* data, size_t capacity)
+        : pool_(pool), data_(data), capacity_(capacity) {}
+
+    BufferPool*    pool_ = nullptr;
+    unsigned char* data_ = nullptr;
+    size_t         capacity_ = 0;
+};
+
+struct BufferPoolStats {
+    uint64_t acquired = 0;
+    uint64_t reused = 0;       // served from a buffer given back earlier
+    uint64_t allocated = 0;
+    uint64_t discarded = 0;    // given back but freed: pool full or too large
+    uint64_t pooledBytes = 0;  // kept for reuse right now
+    uint64_t maxPooledBytes = 0;
+};
+
+class BufferPool {
+public:
+    static constexpr size_t kMinClassBytes = 4 * 1024;
+    static constexpr size_t kMaxClassBytes = 16 * 1024 * 1024;
+    static constexpr size_t kClassCount = 13;   // 4 KB, 8 KB, ... 16 MB
+
+    explicit BufferPool(uint64_t maxPooledBytes);
+    ~BufferPool();
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // The pool of the process, keeping up to 64 MB. Intentionally never
+    // destroyed: buffers may still be handed back while the DLL unloads.
+    static BufferPool& Shared();
+
+    // A buffer of at least minBytes, rounded up to its size class.
+    PooledBuffer Acquire(size_t minBytes);
+
+    BufferPoolStats Stats() const;
+
+private:
+    friend class PooledBuffer;
+    void Release(unsigned char* data, size_t capacity);
+
+    // Index of the smallest class holding size, kClassCount if none does.
+    static size_t ClassOf(size_t size);
+
+    const uint64_t              maxPooledBytes_;
+    mutable std::mutex          mutex_;
+    std::vector<unsigned char*> free_[kClassCount];
+    BufferPoolStats             stats_;
+};
+
+} // namespace puml
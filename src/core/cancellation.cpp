@@ -0,0 +1,37 @@
+#include "core/cancellation.h"
+
+namespace puml {
+
+void CancellationToken::Cancel() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (cancelled_.exchange(true, std::memory_order_acq_rel)) return;
+    for (auto& entry : callbacks_) {
+        entry.second();
+    }
+    callbacks_.clear();
+}
+
+uint64_t CancellationToken::Register(std::function<void()> fn) const {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!cancelled_.load(std::memory_order_acquire)) {
+            const uint64_t id = ++nextId_;
+            callbacks_.emplace_back(id, std::move(fn));
+            return id;
+        }
+    }
+    fn();
+    return 0;
+}
+
+void CancellationToken::Unregister(uint64_t id) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = callbacks_.begin(); it != callbacks_.end(); ++it) {
+        if (it->first == id) {
+            callbacks_.erase(it);
+            return;
+        }
+    }
+}
+
+} // namespace puml
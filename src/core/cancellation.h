@@ -0,0 +1,68 @@
+// Cooperative cancellation shared between whoever requests work and the code
+// doing it. Blocking operations register a callback (e.g. killing a child
+// process) that fires when the token is cancelled.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace puml {
+
+class CancellationToken {
+public:
+    CancellationToken() = default;
+    CancellationToken(const CancellationToken&) = delete;
+    CancellationToken& operator=(const CancellationToken&) = delete;
+
+    bool IsCancelled() const { return cancelled_.load(std::memory_order_acquire); }
+
+    // Runs the registered callbacks once. Callbacks run with the token's lock
+    // held, so they must be short and must not touch the token.
+    void Cancel();
+
+    // Runs fn right away if already cancelled. Returns 0 in that case.
+    // Observers only need a const token to register.
+    uint64_t Register(std::function<void()> fn) const;
+    // After this returns the callback is not running and will not run.
+    void Unregister(uint64_t id) const;
+
+private:
+    std::atomic<bool>  cancelled_{false};
+    mutable std::mutex mutex_;
+    mutable uint64_t   nextId_ = 0;
+    // A vector keeps its capacity, so a token registered with on every
+    // render stops allocating once warm. It rarely holds more than a few.
+    mutable std::vector<std::pair<uint64_t, std::function<void()>>> callbacks_;
+};
+
+using CancellationTokenPtr = std::shared_ptr<CancellationToken>;
+
+// Registers a callback for the lifetime of the object. A null token is allowed.
+class CancellationRegistration {
+public:
+    CancellationRegistration(const CancellationToken* token, std::function<void()> fn)
+        : token_(token) {
+        if (token_) id_ = token_->Register(std::move(fn));
+    }
+    ~CancellationRegistration() {
+        if (token_ && id_) token_->Unregister(id_);
+    }
+    CancellationRegistration(const CancellationRegistration&) = delete;
+    CancellationRegistration& operator=(const CancellationRegistration&) = delete;
+
+private:
+    const CancellationToken* token_;
+    uint64_t                 id_ = 0;
+};
+
+inline bool IsCancelled(const CancellationToken* token) {
+    return token && token->IsCancelled();
+}
+
+} // namespace puml
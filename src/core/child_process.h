@@ -0,0 +1,78 @@
+// Portable child-process interface used by the render engine.
+// Win32 (CreateProcessW + anonymous pipes) and POSIX (fork/exec + pipes)
+// implementations live in child_process_win32.cpp / child_process_posix.cpp.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace puml {
+
+// Limits for a child and every process it starts. Windows enforces them
+// with a job object per child; POSIX with rlimits and nice, plus a monitor
+// of the resident memory of the child's process group on Linux.
+struct ResourceLimits {
+    uint64_t memoryBytes = 0;     // 0 = unlimited
+    bool     lowPriority = false; // below-normal CPU priority from the start
+};
+
+enum class LimitViolation {
+    None,
+    Memory,     // killed for exceeding ResourceLimits::memoryBytes
+};
+
+inline const char* LimitViolationName(LimitViolation violation) {
+    switch (violation) {
+    case LimitViolation::None:   return "none";
+    case LimitViolation::Memory: return "memory limit exceeded";
+    }
+    return "unknown";
+}
+
+struct ProcessSpec {
+    std::string              executable;       // UTF-8 path of the program to run
+    std::vector<std::string> arguments;        // UTF-8, excluding argv[0]
+    std::string              workingDirectory; // UTF-8, empty = inherit
+    bool                     discardStderr = true;  // false: merge stderr into stdout
+    size_t                   pipeBufferSize = 0;    // hint for pipe capacity, 0 = default
+    ResourceLimits           limits;
+};
+
+// A running child with piped stdin/stdout.
+// WriteStdin and ReadStdout may be used from different threads at the same
+// time; Kill may be called from any thread to unblock both.
+class ChildProcess {
+public:
+    virtual ~ChildProcess() = default;
+
+    // Blocks until all bytes are written. Returns false on a broken pipe.
+    virtual bool WriteStdin(const void* data, size_t size) = 0;
+    // Signals EOF to the child. Must not race with WriteStdin.
+    virtual void CloseStdin() = 0;
+    // Blocks until data is available. Returns bytes read, 0 on EOF, -1 on error.
+    virtual std::ptrdiff_t ReadStdout(void* buffer, size_t capacity) = 0;
+    // Forcefully terminates the child and everything it started. Safe to
+    // call more than once.
+    virtual void Kill() = 0;
+    // Waits for the child to exit. Returns false on timeout.
+    virtual bool WaitForExit(uint32_t timeoutMs, int* exitCode) = 0;
+    virtual uint64_t Id() const = 0;
+    // Why the child was killed by its limits, if it was.
+    virtual LimitViolation Violation() const = 0;
+    // Lowers or restores the CPU priority of a running child. Windows only;
+    // on POSIX the priority is fixed by ResourceLimits::lowPriority at start.
+    virtual void SetLowPriority(bool low) = 0;
+};
+
+std::unique_ptr<ChildProcess> StartChildProcess(const ProcessSpec& spec, std::string* error);
+
+// Starts a program that is not tied to this process: no pipes (its output is
+// discarded) and, on POSIX, a session of its own, so it outlives the caller.
+// discardStderr, pipeBufferSize and limits are ignored.
+bool StartDetachedProcess(const ProcessSpec& spec, std::string* error);
+
+} // namespace puml
@@ -0,0 +1,410 @@
+// POSIX implementation of ChildProcess (fork/exec + pipes).
+
+#include "core/child_process.h"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace puml {
+
+namespace {
+
+// Writing to a pipe whose reader died raises SIGPIPE, which would take the
+// whole host process down. Ignore it once so write() reports EPIPE instead.
+void IgnoreSigpipeOnce() {
+    static std::once_flag once;
+    std::call_once(once, []() {
+        struct sigaction current{};
+        if (sigaction(SIGPIPE, nullptr, &current) == 0 && current.sa_handler == SIG_DFL) {
+            struct sigaction ignore{};
+            ignore.sa_handler = SIG_IGN;
+            sigemptyset(&ignore.sa_mask);
+            sigaction(SIGPIPE, &ignore, nullptr);
+        }
+    });
+}
+
+bool MakePipe(int fds[2]) {
+    if (pipe(fds) != 0) {
+        return false;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return true;
+}
+
+void CloseFd(int& fd) {
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+// Kills the process group of the child and everything in it.
+void KillGroup(pid_t pid) {
+    if (kill(-pid, SIGKILL) != 0) {
+        kill(pid, SIGKILL);
+    }
+}
+
+// State shared by a child and the memory monitor; the monitor sets violation.
+struct ChildLimits {
+    pid_t                       pid = 0;
+    uint64_t                    memoryBytes = 0;
+    std::atomic<LimitViolation> violation{LimitViolation::None};
+    std::mutex                  mutex;          // held while signalling, so a reaped pid is never hit
+    bool                        reaped = false;
+};
+
+#if defined(__linux__)
+// Samples the resident memory of every child with a memory limit, summed
+// over its process group so whatever the child started counts too, and
+// kills the groups over it, which the rlimit alone cannot attribute: a JVM
+// refused memory by the kernel dies like any crashing process.
+class MemoryMonitor {
+public:
+    static MemoryMonitor& Instance() {
+        static MemoryMonitor* monitor = new MemoryMonitor();
+        return *monitor;
+    }
+
+    void Watch(const std::shared_ptr<ChildLimits>& limits) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        children_[limits->pid] = limits;
+        if (!started_) {
+            started_ = true;
+            std::thread([this]() { Run(); }).detach();
+        }
+    }
+
+    void Forget(pid_t pid) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        children_.erase(pid);
+    }
+
+private:
+    static uint64_t ResidentBytes(pid_t pid) {
+        char path[64];
+        std::snprintf(path, sizeof(path), "/proc/%d/statm", static_cast<int>(pid));
+        FILE* file = std::fopen(path, "r");
+        if (!file) {
+            return 0;
+        }
+        unsigned long long size = 0, resident = 0;
+        const int fields = std::fscanf(file, "%llu %llu", &size, &resident);
+        std::fclose(file);
+        return fields == 2 ? resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE)) : 0;
+    }
+
+    // Adds the resident memory of every process to its group's entry in
+    // groups, if it has one. A child leads its group, so a group's id is
+    // the child's pid.
+    static void AddGroupResidentBytes(std::unordered_map<pid_t, uint64_t>& groups) {
+        DIR* proc = opendir("/proc");
+        if (!proc) {
+            return;
+        }
+        while (const struct dirent* entry = readdir(proc)) {
+            char* end = nullptr;
+            const long pid = std::strtol(entry->d_name, &end, 10);
+            if (pid <= 0 || *end != '\0') {
+                continue;
+            }
+            auto group = groups.find(getpgid(static_cast<pid_t>(pid)));
+            if (group != groups.end()) {
+                group->second += ResidentBytes(static_cast<pid_t>(pid));
+            }
+        }
+        closedir(proc);
+    }
+
+    void Run() {
+        std::unordered_map<pid_t, uint64_t> resident;   // group -> bytes
+        for (;;) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            resident.clear();
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                for (const auto& entry : children_) {
+                    resident.emplace(entry.first, 0);
+                }
+            }
+            if (resident.empty()) {
+                continue;
+            }
+            // Outside the lock: walking /proc takes a while on a busy machine.
+            AddGroupResidentBytes(resident);
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const auto& group : resident) {
+                auto found = children_.find(group.first);
+                if (found == children_.end()) {
+                    continue;   // forgotten meanwhile
+                }
+                ChildLimits& child = *found->second;
+                if (child.violation != LimitViolation::None || group.second <= child.memoryBytes) {
+                    continue;
+                }
+                std::lock_guard<std::mutex> childLock(child.mutex);
+                if (!child.reaped) {
+                    child.violation = LimitViolation::Memory;
+                    KillGroup(child.pid);
+                }
+            }
+        }
+    }
+
+    std::mutex mutex_;
+    std::unordered_map<pid_t, std::shared_ptr<ChildLimits>> children_;
+    bool       started_ = false;
+};
+#endif
+
+class PosixChildProcess final : public ChildProcess {
+public:
+    PosixChildProcess(pid_t pid, int stdinFd, int stdoutFd, uint64_t memoryBytes)
+        : pid_(pid), stdinFd_(stdinFd), stdoutFd_(stdoutFd), limits_(std::make_shared<ChildLimits>()) {
+        limits_->pid = pid;
+        limits_->memoryBytes = memoryBytes;
+#if defined(__linux__)
+        if (memoryBytes > 0) {
+            MemoryMonitor::Instance().Watch(limits_);
+        }
+#endif
+    }
+
+    ~PosixChildProcess() override {
+        CloseFd(stdinFd_);
+        CloseFd(stdoutFd_);
+        int code = 0;
+        if (!WaitForExit(0, &code)) {
+            Kill();
+            WaitForExit(1000, &code);
+        }
+#if defined(__linux__)
+        MemoryMonitor::Instance().Forget(pid_);
+#endif
+    }
+
+    bool WriteStdin(const void* data, size_t size) override {
+        const char* p = static_cast<const char*>(data);
+        while (size > 0) {
+            if (stdinFd_ < 0) {
+                return false;
+            }
+            ssize_t n = write(stdinFd_, p, size);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            p += n;
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    void CloseStdin() override {
+        CloseFd(stdinFd_);
+    }
+
+    std::ptrdiff_t ReadStdout(void* buffer, size_t capacity) override {
+        for (;;) {
+            ssize_t n = read(stdoutFd_, buffer, capacity);
+            if (n < 0 && errno == EINTR) continue;
+            return n < 0 ? -1 : static_cast<std::ptrdiff_t>(n);
+        }
+    }
+
+    void Kill() override {
+        std::lock_guard<std::mutex> lock(limits_->mutex);
+        if (!limits_->reaped) {
+            KillGroup(pid_);
+        }
+    }
+
+    bool WaitForExit(uint32_t timeoutMs, int* exitCode) override {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+        for (;;) {
+            {
+                std::lock_guard<std::mutex> lock(limits_->mutex);
+                if (!limits_->reaped) {
+                    int status = 0;
+                    pid_t r = waitpid(pid_, &status, WNOHANG);
+                    if (r == pid_) {
+                        limits_->reaped = true;
+                        exitCode_ = WIFEXITED(status) ? WEXITSTATUS(status)
+                                                      : (WIFSIGNALED(status) ? 128 + WTERMSIG(status) : -1);
+                    } else if (r < 0 && errno != EINTR) {
+                        limits_->reaped = true;
+                        exitCode_ = -1;
+                    }
+                }
+                if (limits_->reaped) {
+                    if (exitCode) *exitCode = exitCode_;
+                    return true;
+                }
+            }
+            if (std::chrono::steady_clock::now() >= deadline) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
+
+    uint64_t Id() const override {
+        return static_cast<uint64_t>(pid_);
+    }
+
+    LimitViolation Violation() const override {
+        return limits_->violation.load();
+    }
+
+    void SetLowPriority(bool) override {
+        // An unprivileged process cannot raise a nice value again, and on
+        // Linux it would only reach the child's main thread anyway.
+    }
+
+private:
+    pid_t      pid_;
+    int        stdinFd_;
+    int        stdoutFd_;
+    std::shared_ptr<ChildLimits> limits_;   // its mutex also guards reaping
+    int        exitCode_ = -1;
+};
+
+} // namespace
+
+std::unique_ptr<ChildProcess> StartChildProcess(const ProcessSpec& spec, std::string* error) {
+    IgnoreSigpipeOnce();
+
+    int inPipe[2]  = { -1, -1 };
+    int outPipe[2] = { -1, -1 };
+    if (!MakePipe(inPipe)) {
+        if (error) *error = "failed to create stdin pipe";
+        return nullptr;
+    }
+    if (!MakePipe(outPipe)) {
+        if (error) *error = "failed to create stdout pipe";
+        CloseFd(inPipe[0]); CloseFd(inPipe[1]);
+        return nullptr;
+    }
+#ifdef F_SETPIPE_SZ
+    if (spec.pipeBufferSize > 0) {
+        fcntl(inPipe[1], F_SETPIPE_SZ, static_cast<int>(spec.pipeBufferSize));
+        fcntl(outPipe[0], F_SETPIPE_SZ, static_cast<int>(spec.pipeBufferSize));
+    }
+#endif
+
+    // Build argv before forking: only async-signal-safe calls in the child.
+    std::vector<char*> argv;
+    argv.reserve(spec.arguments.size() + 2);
+    argv.push_back(const_cast<char*>(spec.executable.c_str()));
+    for (const std::string& arg : spec.arguments) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        if (error) *error = std::string("fork failed: ") + std::strerror(errno);
+        CloseFd(inPipe[0]); CloseFd(inPipe[1]);
+        CloseFd(outPipe[0]); CloseFd(outPipe[1]);
+        return nullptr;
+    }
+    if (pid == 0) {
+        // A group of its own, so Kill reaches everything the child starts.
+        setpgid(0, 0);
+        if (spec.limits.lowPriority) {
+            (void)!nice(10);
+        }
+        if (spec.limits.memoryBytes > 0) {
+            // The kernel's backstop. On Linux the monitor kills first, so a
+            // violation is reported as one, and RLIMIT_DATA leaves a JVM's
+            // reserved but uncommitted heap alone.
+            struct rlimit limit{};
+#if defined(__linux__)
+            limit.rlim_cur = limit.rlim_max = static_cast<rlim_t>(spec.limits.memoryBytes + spec.limits.memoryBytes / 4);
+#else
+            limit.rlim_cur = limit.rlim_max = static_cast<rlim_t>(spec.limits.memoryBytes);
+#endif
+            setrlimit(RLIMIT_DATA, &limit);
+        }
+        dup2(inPipe[0], STDIN_FILENO);
+        dup2(outPipe[1], STDOUT_FILENO);
+        if (spec.discardStderr) {
+            int devNull = open("/dev/null", O_WRONLY);
+            if (devNull >= 0) {
+                dup2(devNull, STDERR_FILENO);
+            }
+        } else {
+            dup2(outPipe[1], STDERR_FILENO);
+        }
+        if (!spec.workingDirectory.empty() && chdir(spec.workingDirectory.c_str()) != 0) {
+            _exit(126);
+        }
+        execvp(spec.executable.c_str(), argv.data());
+        _exit(127);
+    }
+
+    CloseFd(inPipe[0]);
+    CloseFd(outPipe[1]);
+    // Also from the parent: Kill may run before the child got to setpgid.
+    setpgid(pid, pid);
+    return std::unique_ptr<ChildProcess>(new PosixChildProcess(pid, inPipe[1], outPipe[0], spec.limits.memoryBytes));
+}
+
+bool StartDetachedProcess(const ProcessSpec& spec, std::string* error) {
+    std::vector<char*> argv;
+    argv.reserve(spec.arguments.size() + 2);
+    argv.push_back(const_cast<char*>(spec.executable.c_str()));
+    for (const std::string& arg : spec.arguments) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    // Double fork: the grandchild is adopted by init and never becomes a
+    // zombie of this process.
+    pid_t pid = fork();
+    if (pid < 0) {
+        if (error) *error = std::string("fork failed: ") + std::strerror(errno);
+        return false;
+    }
+    if (pid == 0) {
+        setsid();
+        if (fork() != 0) {
+            _exit(0);
+        }
+        int devNull = open("/dev/null", O_RDWR);
+        if (devNull >= 0) {
+            dup2(devNull, STDIN_FILENO);
+            dup2(devNull, STDOUT_FILENO);
+            dup2(devNull, STDERR_FILENO);
+        }
+        if (!spec.workingDirectory.empty() && chdir(spec.workingDirectory.c_str()) != 0) {
+            _exit(126);
+        }
+        execvp(spec.executable.c_str(), argv.data());
+        _exit(127);
+    }
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    return true;
+}
+
+} // namespace puml
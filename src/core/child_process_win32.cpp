@@ -0,0 +1,381 @@
+// Win32 implementation of ChildProcess (CreateProcessW + anonymous pipes).
+
+#include "core/child_process.h"
+
+#include "core/core_log.h"
+
+#include <windows.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace puml {
+
+namespace {
+
+std::wstring WidenUtf8(const std::string& s) {
+    if (s.empty()) return std::wstring();
+    int n = ::MultiByteToWideChar(CP_UTF8, 0, s.data(), (int)s.size(), nullptr, 0);
+    std::wstring w(n > 0 ? n : 0, L'\0');
+    if (n > 0) ::MultiByteToWideChar(CP_UTF8, 0, s.data(), (int)s.size(), w.data(), n);
+    return w;
+}
+
+// Quote one argument following the CommandLineToArgvW rules.
+void AppendQuotedArgument(std::wstring& cmd, const std::wstring& arg) {
+    if (!arg.empty() && arg.find_first_of(L" \t\n\v\"") == std::wstring::npos) {
+        cmd += arg;
+        return;
+    }
+    cmd.push_back(L'"');
+    for (size_t i = 0;; ++i) {
+        size_t backslashes = 0;
+        while (i < arg.size() && arg[i] == L'\\') {
+            ++i;
+            ++backslashes;
+        }
+        if (i == arg.size()) {
+            cmd.append(backslashes * 2, L'\\');
+            break;
+        }
+        if (arg[i] == L'"') {
+            cmd.append(backslashes * 2 + 1, L'\\');
+        } else {
+            cmd.append(backslashes, L'\\');
+        }
+        cmd.push_back(arg[i]);
+    }
+    cmd.push_back(L'"');
+}
+
+void CloseIfValid(HANDLE& h) {
+    if (h && h != INVALID_HANDLE_VALUE) {
+        CloseHandle(h);
+    }
+    h = nullptr;
+}
+
+// The job object holding one child and everything it starts.
+struct ChildJob {
+    HANDLE                      job = nullptr;
+    ULONG_PTR                   key = 0;       // completion key, 0 = not monitored
+    std::atomic<LimitViolation> violation{LimitViolation::None};
+};
+
+// One completion port for the jobs of every child with a memory limit. A
+// job over its limit only fails further allocations, which a JVM survives
+// as a stuck OutOfMemoryError, so the monitor kills the job instead and
+// records why.
+class JobMonitor {
+public:
+    static JobMonitor& Instance() {
+        static JobMonitor* monitor = new JobMonitor();
+        return *monitor;
+    }
+
+    bool Watch(const std::shared_ptr<ChildJob>& job) {
+        if (!port_) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        JOBOBJECT_ASSOCIATE_COMPLETION_PORT association{};
+        association.CompletionKey = reinterpret_cast<PVOID>(nextKey_);
+        association.CompletionPort = port_;
+        if (!SetInformationJobObject(job->job, JobObjectAssociateCompletionPortInformation,
+                                     &association, sizeof(association))) {
+            return false;
+        }
+        job->key = nextKey_++;
+        jobs_[job->key] = job;
+        if (!started_) {
+            started_ = true;
+            std::thread([this]() { Run(); }).detach();
+        }
+        return true;
+    }
+
+    void Forget(const ChildJob& job) {
+        if (job.key) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.erase(job.key);
+        }
+    }
+
+private:
+    JobMonitor() : port_(CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 1)) {}
+
+    void Run() {
+        for (;;) {
+            DWORD message = 0;
+            ULONG_PTR key = 0;
+            LPOVERLAPPED detail = nullptr;
+            if (!GetQueuedCompletionStatus(port_, &message, &key, &detail, INFINITE)) {
+                continue;
+            }
+            if (message != JOB_OBJECT_MSG_JOB_MEMORY_LIMIT && message != JOB_OBJECT_MSG_PROCESS_MEMORY_LIMIT) {
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            const auto found = jobs_.find(key);
+            if (found != jobs_.end()) {
+                found->second->violation = LimitViolation::Memory;
+                TerminateJobObject(found->second->job, 1);
+            }
+        }
+    }
+
+    HANDLE     port_;
+    std::mutex mutex_;
+    std::unordered_map<ULONG_PTR, std::shared_ptr<ChildJob>> jobs_;
+    ULONG_PTR  nextKey_ = 1;
+    bool       started_ = false;
+};
+
+// A job per child: closing it (or Kill) ends the whole process tree, and it
+// carries the memory limit. Nested jobs need Windows 8; without them the
+// child runs unconfined and only the child itself is killed.
+std::shared_ptr<ChildJob> CreateChildJob(const ResourceLimits& limits) {
+    auto job = std::make_shared<ChildJob>();
+    job->job = CreateJobObjectW(nullptr, nullptr);
+    if (!job->job) {
+        return nullptr;
+    }
+    JOBOBJECT_EXTENDED_LIMIT_INFORMATION info{};
+    info.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+    if (limits.memoryBytes > 0) {
+        info.BasicLimitInformation.LimitFlags |= JOB_OBJECT_LIMIT_JOB_MEMORY;
+        info.JobMemoryLimit = static_cast<SIZE_T>(limits.memoryBytes);
+    }
+    if (!SetInformationJobObject(job->job, JobObjectExtendedLimitInformation, &info, sizeof(info)) ||
+        (limits.memoryBytes > 0 && !JobMonitor::Instance().Watch(job))) {
+        CloseHandle(job->job);
+        return nullptr;
+    }
+    return job;
+}
+
+class Win32ChildProcess final : public ChildProcess {
+public:
+    Win32ChildProcess(HANDLE process, DWORD pid, HANDLE stdinWrite, HANDLE stdoutRead, std::shared_ptr<ChildJob> job)
+        : process_(process), pid_(pid), stdinWrite_(stdinWrite), stdoutRead_(stdoutRead), job_(std::move(job)) {}
+
+    ~Win32ChildProcess() override {
+        CloseIfValid(stdinWrite_);
+        CloseIfValid(stdoutRead_);
+        if (WaitForSingleObject(process_, 0) == WAIT_TIMEOUT) {
+            Kill();
+            WaitForSingleObject(process_, 1000);
+        }
+        CloseIfValid(process_);
+        if (job_) {
+            JobMonitor::Instance().Forget(*job_);
+            CloseIfValid(job_->job);   // kills what the child left running
+        }
+    }
+
+    bool WriteStdin(const void* data, size_t size) override {
+        const char* p = static_cast<const char*>(data);
+        while (size > 0) {
+            if (!stdinWrite_) {
+                return false;
+            }
+            const DWORD chunk = size > (1u << 30) ? (1u << 30) : static_cast<DWORD>(size);
+            DWORD written = 0;
+            if (!WriteFile(stdinWrite_, p, chunk, &written, nullptr)) {
+                return false;
+            }
+            p += written;
+            size -= written;
+        }
+        return true;
+    }
+
+    void CloseStdin() override {
+        CloseIfValid(stdinWrite_);
+    }
+
+    std::ptrdiff_t ReadStdout(void* buffer, size_t capacity) override {
+        const DWORD chunk = capacity > (1u << 30) ? (1u << 30) : static_cast<DWORD>(capacity);
+        DWORD got = 0;
+        if (!ReadFile(stdoutRead_, buffer, chunk, &got, nullptr)) {
+            return GetLastError() == ERROR_BROKEN_PIPE ? 0 : -1;
+        }
+        return static_cast<std::ptrdiff_t>(got);
+    }
+
+    void Kill() override {
+        if (job_) {
+            TerminateJobObject(job_->job, 1);
+        } else if (WaitForSingleObject(process_, 0) == WAIT_TIMEOUT) {
+            TerminateProcess(process_, 1);
+        }
+    }
+
+    bool WaitForExit(uint32_t timeoutMs, int* exitCode) override {
+        if (WaitForSingleObject(process_, timeoutMs) != WAIT_OBJECT_0) {
+            return false;
+        }
+        DWORD code = 1;
+        GetExitCodeProcess(process_, &code);
+        if (exitCode) *exitCode = static_cast<int>(code);
+        return true;
+    }
+
+    uint64_t Id() const override {
+        return pid_;
+    }
+
+    LimitViolation Violation() const override {
+        return job_ ? job_->violation.load() : LimitViolation::None;
+    }
+
+    void SetLowPriority(bool low) override {
+        SetPriorityClass(process_, low ? BELOW_NORMAL_PRIORITY_CLASS : NORMAL_PRIORITY_CLASS);
+    }
+
+private:
+    HANDLE process_;
+    DWORD  pid_;
+    HANDLE stdinWrite_;
+    HANDLE stdoutRead_;
+    std::shared_ptr<ChildJob> job_;
+};
+
+} // namespace
+
+std::unique_ptr<ChildProcess> StartChildProcess(const ProcessSpec& spec, std::string* error) {
+    auto fail = [&](const char* what) -> std::unique_ptr<ChildProcess> {
+        if (error) *error = std::string(what) + " (error=" + std::to_string(GetLastError()) + ")";
+        return nullptr;
+    };
+
+    SECURITY_ATTRIBUTES sa{ sizeof(SECURITY_ATTRIBUTES), nullptr, TRUE };
+    const DWORD pipeSize = static_cast<DWORD>(spec.pipeBufferSize);
+    HANDLE hInR = nullptr, hInW = nullptr;
+    HANDLE hOutR = nullptr, hOutW = nullptr;
+    HANDLE hErr = nullptr;
+
+    if (!CreatePipe(&hInR, &hInW, &sa, pipeSize)) {
+        return fail("failed to create stdin pipe");
+    }
+    if (!CreatePipe(&hOutR, &hOutW, &sa, pipeSize)) {
+        CloseIfValid(hInR); CloseIfValid(hInW);
+        return fail("failed to create stdout pipe");
+    }
+    SetHandleInformation(hInW,  HANDLE_FLAG_INHERIT, 0);
+    SetHandleInformation(hOutR, HANDLE_FLAG_INHERIT, 0);
+
+    if (spec.discardStderr) {
+        hErr = CreateFileW(L"NUL", GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, &sa,
+                           OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (hErr == INVALID_HANDLE_VALUE) hErr = nullptr;
+    }
+
+    // Only the three std handles may leak into this child. Without an explicit
+    // handle list, renders started concurrently on other threads would inherit
+    // each other's pipe ends and never see EOF.
+    HANDLE inherit[3] = { hInR, hOutW, hErr ? hErr : hOutW };
+    const DWORD inheritCount = hErr ? 3 : 2;
+
+    SIZE_T attrSize = 0;
+    InitializeProcThreadAttributeList(nullptr, 1, 0, &attrSize);
+    std::vector<unsigned char> attrStorage(attrSize);
+    auto* attrList = reinterpret_cast<LPPROC_THREAD_ATTRIBUTE_LIST>(attrStorage.data());
+    bool attrOk = InitializeProcThreadAttributeList(attrList, 1, 0, &attrSize) &&
+                  UpdateProcThreadAttribute(attrList, 0, PROC_THREAD_ATTRIBUTE_HANDLE_LIST,
+                                            inherit, inheritCount * sizeof(HANDLE), nullptr, nullptr);
+
+    STARTUPINFOEXW si{};
+    si.StartupInfo.cb = sizeof(si);
+    si.StartupInfo.dwFlags |= STARTF_USESTDHANDLES | STARTF_USESHOWWINDOW;
+    si.StartupInfo.wShowWindow = SW_HIDE;
+    si.StartupInfo.hStdInput  = hInR;
+    si.StartupInfo.hStdOutput = hOutW;
+    si.StartupInfo.hStdError  = hErr ? hErr : hOutW;
+    si.lpAttributeList = attrOk ? attrList : nullptr;
+
+    std::wstring cmdline;
+    AppendQuotedArgument(cmdline, WidenUtf8(spec.executable));
+    for (const std::string& arg : spec.arguments) {
+        cmdline.push_back(L' ');
+        AppendQuotedArgument(cmdline, WidenUtf8(arg));
+    }
+    const std::wstring cwd = WidenUtf8(spec.workingDirectory);
+
+    // Suspended until it is in its job, so nothing it starts escapes the job.
+    PROCESS_INFORMATION pi{};
+    DWORD flags = CREATE_NO_WINDOW | CREATE_SUSPENDED | (attrOk ? EXTENDED_STARTUPINFO_PRESENT : 0);
+    if (spec.limits.lowPriority) {
+        flags |= BELOW_NORMAL_PRIORITY_CLASS;
+    }
+    BOOL ok = CreateProcessW(nullptr, cmdline.data(), nullptr, nullptr, TRUE, flags,
+                             nullptr, cwd.empty() ? nullptr : cwd.c_str(),
+                             &si.StartupInfo, &pi);
+    DWORD createErr = ok ? ERROR_SUCCESS : GetLastError();
+    if (attrOk) {
+        DeleteProcThreadAttributeList(attrList);
+    }
+    CloseIfValid(hInR);
+    CloseIfValid(hOutW);
+    CloseIfValid(hErr);
+
+    if (!ok) {
+        CloseIfValid(hInW);
+        CloseIfValid(hOutR);
+        SetLastError(createErr);
+        return fail("CreateProcessW failed");
+    }
+    std::shared_ptr<ChildJob> job = CreateChildJob(spec.limits);
+    if (job && !AssignProcessToJobObject(job->job, pi.hProcess)) {
+        JobMonitor::Instance().Forget(*job);
+        CloseIfValid(job->job);
+        job.reset();
+    }
+    if (!job) {
+        static std::once_flag logged;
+        std::call_once(logged, []() {
+            Log("child process: cannot place children in a job object (error=" + std::to_string(GetLastError()) +
+                "); process trees and memory limits are not enforced");
+        });
+    }
+    ResumeThread(pi.hThread);
+    CloseHandle(pi.hThread);
+    return std::unique_ptr<ChildProcess>(new Win32ChildProcess(pi.hProcess, pi.dwProcessId, hInW, hOutR,
+                                                               std::move(job)));
+}
+
+bool StartDetachedProcess(const ProcessSpec& spec, std::string* error) {
+    std::wstring cmdline;
+    AppendQuotedArgument(cmdline, WidenUtf8(spec.executable));
+    for (const std::string& arg : spec.arguments) {
+        cmdline.push_back(L' ');
+        AppendQuotedArgument(cmdline, WidenUtf8(arg));
+    }
+    const std::wstring cwd = WidenUtf8(spec.workingDirectory);
+
+    STARTUPINFOW si{};
+    si.cb = sizeof(si);
+    si.dwFlags = STARTF_USESHOWWINDOW;
+    si.wShowWindow = SW_HIDE;
+    PROCESS_INFORMATION pi{};
+    // Leave the host's job if it may, so closing the host does not kill the
+    // program with it.
+    const DWORD flags = CREATE_NO_WINDOW | CREATE_NEW_PROCESS_GROUP;
+    BOOL ok = CreateProcessW(nullptr, cmdline.data(), nullptr, nullptr, FALSE, flags | CREATE_BREAKAWAY_FROM_JOB,
+                             nullptr, cwd.empty() ? nullptr : cwd.c_str(), &si, &pi);
+    if (!ok && GetLastError() == ERROR_ACCESS_DENIED) {
+        ok = CreateProcessW(nullptr, cmdline.data(), nullptr, nullptr, FALSE, flags,
+                            nullptr, cwd.empty() ? nullptr : cwd.c_str(), &si, &pi);
+    }
+    if (!ok) {
+        if (error) *error = "CreateProcessW failed (error=" + std::to_string(GetLastError()) + ")";
+        return false;
+    }
+    CloseHandle(pi.hThread);
+    CloseHandle(pi.hProcess);
+    return true;
+}
+
+} // namespace puml
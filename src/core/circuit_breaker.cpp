@@ -0,0 +1,92 @@
+#include "core/circuit_breaker.h"
+
+#include "core/core_log.h"
+
+namespace puml {
+
+const char* BreakerStateName(BreakerState state) {
+    switch (state) {
+    case BreakerState::Closed:   return "closed";
+    case BreakerState::Open:     return "open";
+    case BreakerState::HalfOpen: return "half-open";
+    }
+    return "unknown";
+}
+
+CircuitBreaker::CircuitBreaker(std::string name, BreakerSettings settings)
+    : name_(std::move(name)), settings_(settings), cooldownMs_(settings.cooldownMs) {}
+
+bool CircuitBreaker::Allow() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (state_ == BreakerState::Closed) {
+        return true;
+    }
+    ++stats_.refused;
+    return false;
+}
+
+void CircuitBreaker::RecordSuccess() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.successes;
+    consecutiveFailures_ = 0;
+}
+
+void CircuitBreaker::RecordFailure(const std::string& reason) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.failures;
+    if (state_ != BreakerState::Closed) {
+        return;
+    }
+    if (++consecutiveFailures_ >= settings_.failureThreshold) {
+        cooldownMs_ = settings_.cooldownMs;
+        OpenLocked(std::to_string(consecutiveFailures_) + " failures in a row, last: " + reason);
+    }
+}
+
+bool CircuitBreaker::BeginProbe() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (state_ != BreakerState::Open ||
+        Clock::now() - openedAt_ < std::chrono::milliseconds(cooldownMs_)) {
+        return false;
+    }
+    state_ = BreakerState::HalfOpen;
+    ++stats_.probes;
+    return true;
+}
+
+void CircuitBreaker::FinishProbe(bool healthy) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (state_ != BreakerState::HalfOpen) {
+        return;
+    }
+    if (healthy) {
+        state_ = BreakerState::Closed;
+        consecutiveFailures_ = 0;
+        cooldownMs_ = settings_.cooldownMs;
+        Log("CircuitBreaker[" + name_ + "]: health probe succeeded, closed");
+        return;
+    }
+    ++stats_.probeFailures;
+    const uint64_t doubled = static_cast<uint64_t>(cooldownMs_) * 2;
+    cooldownMs_ = static_cast<uint32_t>(doubled < settings_.maxCooldownMs ? doubled : settings_.maxCooldownMs);
+    OpenLocked("health probe failed");
+}
+
+void CircuitBreaker::OpenLocked(const std::string& reason) {
+    state_ = BreakerState::Open;
+    openedAt_ = Clock::now();
+    ++stats_.opened;
+    Log("CircuitBreaker[" + name_ + "]: open for " + std::to_string(cooldownMs_) + " ms (" + reason + ")");
+}
+
+BreakerState CircuitBreaker::State() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return state_;
+}
+
+BreakerStats CircuitBreaker::Stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+} // namespace puml
@@ -0,0 +1,79 @@
+// Stops sending renders to a backend that keeps failing or timing out.
+//
+// Closed: requests pass; consecutive failures are counted. After
+// failureThreshold of them the breaker opens: requests are refused and the
+// backend is left alone for the cool-down. Then one health probe may run
+// (half-open); its success closes the breaker, its failure opens it again
+// for twice the previous cool-down, up to maxCooldownMs. Real requests are
+// never the probe, so a dead backend does not delay anything on screen.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace puml {
+
+enum class BreakerState {
+    Closed,
+    Open,
+    HalfOpen,   // a health probe is running
+};
+
+const char* BreakerStateName(BreakerState state);
+
+struct BreakerSettings {
+    uint32_t failureThreshold = 3;
+    uint32_t cooldownMs = 30000;
+    uint32_t maxCooldownMs = 300000;
+};
+
+struct BreakerStats {
+    uint64_t successes = 0;
+    uint64_t failures = 0;
+    uint64_t refused = 0;      // requests not sent while open
+    uint64_t opened = 0;
+    uint64_t probes = 0;
+    uint64_t probeFailures = 0;
+};
+
+class CircuitBreaker {
+public:
+    CircuitBreaker(std::string name, BreakerSettings settings);
+
+    CircuitBreaker(const CircuitBreaker&) = delete;
+    CircuitBreaker& operator=(const CircuitBreaker&) = delete;
+
+    // True if a request may be sent. Counts a refusal otherwise.
+    bool Allow();
+    void RecordSuccess();
+    // A failed or timed-out request; cancelled ones are not reported.
+    void RecordFailure(const std::string& reason);
+
+    // True once per cool-down when the breaker is open and due for a probe;
+    // the caller then runs it and reports through FinishProbe.
+    bool BeginProbe();
+    void FinishProbe(bool healthy);
+
+    BreakerState State() const;
+    BreakerStats Stats() const;
+    const std::string& Name() const { return name_; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    void OpenLocked(const std::string& reason);
+
+    const std::string     name_;
+    const BreakerSettings settings_;
+    mutable std::mutex    mutex_;
+    BreakerState          state_ = BreakerState::Closed;
+    uint32_t              consecutiveFailures_ = 0;
+    uint32_t              cooldownMs_ = 0;
+    Clock::time_point     openedAt_;
+    BreakerStats          stats_;
+};
+
+} // namespace puml
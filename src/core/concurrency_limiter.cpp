@@ -0,0 +1,67 @@
+#include "core/concurrency_limiter.h"
+
+#include <algorithm>
+
+namespace puml {
+
+using Clock = std::chrono::steady_clock;
+
+ConcurrencyLimiter::ConcurrencyLimiter(size_t limit) : limit_(limit) {}
+
+bool ConcurrencyLimiter::Acquire(bool background, const CancellationToken* cancel, uint64_t* waitedMs) {
+    const Clock::time_point started = Clock::now();
+
+    // Declared before the lock below so it unregisters after that lock is
+    // released: the callback itself takes mutex_.
+    CancellationRegistration onCancel(cancel, [this]() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cv_.notify_all();
+    });
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto admissible = [&]() {
+        return limit_ == 0 ||
+               (stats_.running < limit_ && (!background || waitingForeground_ == 0));
+    };
+    bool waited = false;
+    if (!admissible()) {
+        waited = true;
+        if (!background) ++waitingForeground_;
+        cv_.wait(lock, [&]() { return IsCancelled(cancel) || admissible(); });
+        if (!background) --waitingForeground_;
+        // A foreground waiter leaving may unblock background ones.
+        cv_.notify_all();
+    }
+    if (IsCancelled(cancel)) {
+        ++stats_.cancelled;
+        return false;
+    }
+
+    ++stats_.admitted;
+    ++stats_.running;
+    stats_.maxRunning = std::max(stats_.maxRunning, stats_.running);
+    const uint64_t ms = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - started).count());
+    if (waited) {
+        ++stats_.waited;
+        stats_.waitMsTotal += ms;
+        stats_.waitMsMax = std::max(stats_.waitMsMax, ms);
+    }
+    if (waitedMs) *waitedMs = waited ? ms : 0;
+    return true;
+}
+
+void ConcurrencyLimiter::Release() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        --stats_.running;
+    }
+    cv_.notify_all();
+}
+
+ConcurrencyLimiterStats ConcurrencyLimiter::Stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+} // namespace puml
@@ -0,0 +1,74 @@
+// Global cap on renders working at the same time, shared by every path that
+// runs PlantUML: one-shot processes, resident daemons and the in-process JVM.
+// Scheduler threads and diagram workers only bound their own queues; this
+// bounds the sum, so e.g. prefetch plus a split diagram cannot start a JVM
+// per core. Waiting foreground work is admitted before background work.
+
+#pragma once
+
+#include "core/cancellation.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+namespace puml {
+
+struct ConcurrencyLimiterStats {
+    uint64_t admitted = 0;
+    uint64_t waited = 0;         // admissions that had to wait for a slot
+    uint64_t waitMsTotal = 0;
+    uint64_t waitMsMax = 0;
+    uint64_t cancelled = 0;      // gave up waiting
+    uint64_t running = 0;
+    uint64_t maxRunning = 0;
+};
+
+class ConcurrencyLimiter {
+public:
+    // 0 = unlimited.
+    explicit ConcurrencyLimiter(size_t limit);
+
+    ConcurrencyLimiter(const ConcurrencyLimiter&) = delete;
+    ConcurrencyLimiter& operator=(const ConcurrencyLimiter&) = delete;
+
+    // Blocks until a slot is free. Returns false when cancelled meanwhile.
+    bool Acquire(bool background, const CancellationToken* cancel, uint64_t* waitedMs = nullptr);
+    void Release();
+
+    size_t Limit() const { return limit_; }
+    ConcurrencyLimiterStats Stats() const;
+
+private:
+    const size_t            limit_;
+    mutable std::mutex      mutex_;
+    std::condition_variable cv_;
+    size_t                  waitingForeground_ = 0;
+    ConcurrencyLimiterStats stats_;
+};
+
+// Holds a slot for its lifetime. A null limiter admits at once.
+class ConcurrencySlot {
+public:
+    ConcurrencySlot(ConcurrencyLimiter* limiter, bool background, const CancellationToken* cancel)
+        : limiter_(limiter) {
+        acquired_ = !limiter_ || limiter_->Acquire(background, cancel, &waitedMs_);
+    }
+    ~ConcurrencySlot() {
+        if (limiter_ && acquired_) limiter_->Release();
+    }
+    ConcurrencySlot(const ConcurrencySlot&) = delete;
+    ConcurrencySlot& operator=(const ConcurrencySlot&) = delete;
+
+    bool Acquired() const { return acquired_; }
+    uint64_t WaitedMs() const { return waitedMs_; }
+
+private:
+    ConcurrencyLimiter* limiter_;
+    bool                acquired_ = false;
+    uint64_t            waitedMs_ = 0;
+};
+
+} // namespace puml
@@ -0,0 +1,141 @@
+#include "core/content_hash.h"
+
+#include <cstring>
+
+namespace puml {
+
+namespace {
+
+constexpr uint64_t kPrime1 = 11400714785074694791ULL;
+constexpr uint64_t kPrime2 = 14029467366897019727ULL;
+constexpr uint64_t kPrime3 = 1609587929392839161ULL;
+constexpr uint64_t kPrime4 = 9650029242287828579ULL;
+constexpr uint64_t kPrime5 = 2870177450012600261ULL;
+
+inline uint64_t Rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t Read64(const unsigned char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t Read32(const unsigned char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t Round(uint64_t acc, uint64_t input) {
+    acc += input * kPrime2;
+    acc = Rotl(acc, 31);
+    return acc * kPrime1;
+}
+
+inline uint64_t MergeRound(uint64_t acc, uint64_t val) {
+    acc ^= Round(0, val);
+    return acc * kPrime1 + kPrime4;
+}
+
+} // namespace
+
+Hasher64::Hasher64(uint64_t seed) : seed_(seed) {
+    v_[0] = seed + kPrime1 + kPrime2;
+    v_[1] = seed + kPrime2;
+    v_[2] = seed;
+    v_[3] = seed - kPrime1;
+}
+
+void Hasher64::Update(const void* data, size_t size) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    total_ += size;
+
+    if (buffered_ + size < 32) {
+        if (size) std::memcpy(buffer_ + buffered_, p, size);
+        buffered_ += size;
+        return;
+    }
+    if (buffered_) {
+        const size_t fill = 32 - buffered_;
+        std::memcpy(buffer_ + buffered_, p, fill);
+        for (int i = 0; i < 4; ++i) v_[i] = Round(v_[i], Read64(buffer_ + i * 8));
+        p += fill;
+        size -= fill;
+        buffered_ = 0;
+    }
+    while (size >= 32) {
+        v_[0] = Round(v_[0], Read64(p));
+        v_[1] = Round(v_[1], Read64(p + 8));
+        v_[2] = Round(v_[2], Read64(p + 16));
+        v_[3] = Round(v_[3], Read64(p + 24));
+        p += 32;
+        size -= 32;
+    }
+    if (size) {
+        std::memcpy(buffer_, p, size);
+        buffered_ = size;
+    }
+}
+
+uint64_t Hasher64::Digest() const {
+    uint64_t h;
+    if (total_ >= 32) {
+        h = Rotl(v_[0], 1) + Rotl(v_[1], 7) + Rotl(v_[2], 12) + Rotl(v_[3], 18);
+        for (int i = 0; i < 4; ++i) h = MergeRound(h, v_[i]);
+    } else {
+        h = seed_ + kPrime5;
+    }
+    h += total_;
+
+    const unsigned char* p = buffer_;
+    size_t left = buffered_;
+    while (left >= 8) {
+        h ^= Round(0, Read64(p));
+        h = Rotl(h, 27) * kPrime1 + kPrime4;
+        p += 8;
+        left -= 8;
+    }
+    if (left >= 4) {
+        h ^= static_cast<uint64_t>(Read32(p)) * kPrime1;
+        h = Rotl(h, 23) * kPrime2 + kPrime3;
+        p += 4;
+        left -= 4;
+    }
+    while (left--) {
+        h ^= (*p++) * kPrime5;
+        h = Rotl(h, 11) * kPrime1;
+    }
+
+    h ^= h >> 33;
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t Hash64(const void* data, size_t size, uint64_t seed) {
+    Hasher64 hasher(seed);
+    hasher.Update(data, size);
+    return hasher.Digest();
+}
+
+std::string HashToHex(uint64_t hash) {
+    std::string out;
+    AppendHashHex(out, hash);
+    return out;
+}
+
+void AppendHashHex(std::string& out, uint64_t hash) {
+    static const char digits[] = "0123456789abcdef";
+    char hex[16];
+    for (int i = 15; i >= 0; --i) {
+        hex[i] = digits[hash & 0xF];
+        hash >>= 4;
+    }
+    out.append(hex, sizeof(hex));
+}
+
+} // namespace puml
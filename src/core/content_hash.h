@@ -0,0 +1,34 @@
+// Fast non-cryptographic content hashing (XXH64) for cache keys.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace puml {
+
+// Streaming XXH64.
+class Hasher64 {
+public:
+    explicit Hasher64(uint64_t seed = 0);
+
+    void Update(const void* data, size_t size);
+    void Update(const std::string& text) { Update(text.data(), text.size()); }
+    uint64_t Digest() const;
+
+private:
+    uint64_t      seed_;
+    uint64_t      v_[4];
+    unsigned char buffer_[32];
+    size_t        buffered_ = 0;
+    uint64_t      total_ = 0;
+};
+
+uint64_t Hash64(const void* data, size_t size, uint64_t seed = 0);
+
+// Lower-case, zero-padded hexadecimal form of a 64-bit hash.
+std::string HashToHex(uint64_t hash);
+void AppendHashHex(std::string& out, uint64_t hash);
+
+} // namespace puml
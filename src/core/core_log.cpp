@@ -0,0 +1,26 @@
+#include "core/core_log.h"
+
+#include <mutex>
+
+namespace puml {
+
+static std::mutex g_sinkMutex;
+static LogSink    g_sink;
+
+void SetLogSink(LogSink sink) {
+    std::lock_guard<std::mutex> lock(g_sinkMutex);
+    g_sink = std::move(sink);
+}
+
+void Log(const std::string& utf8Message) {
+    LogSink sink;
+    {
+        std::lock_guard<std::mutex> lock(g_sinkMutex);
+        sink = g_sink;
+    }
+    if (sink) {
+        sink(utf8Message);
+    }
+}
+
+} // namespace puml
@@ -0,0 +1,17 @@
+// Logging hook for the portable render engine.
+// The plugin installs a sink that forwards to its log file; without a sink
+// messages are dropped.
+
+#pragma once
+
+#include <functional>
+#include <string>
+
+namespace puml {
+
+using LogSink = std::function<void(const std::string& utf8Message)>;
+
+void SetLogSink(LogSink sink);
+void Log(const std::string& utf8Message);
+
+} // namespace puml
@@ -0,0 +1,95 @@
+#include "core/diagram_markup.h"
+
+#include "core/render_arena.h"
+
+#include <algorithm>
+#include <charconv>
+
+namespace puml {
+
+void AppendBase64(std::string& out, const unsigned char* in, size_t n) {
+    static const char* tbl = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const size_t start = out.size();
+    out.resize(start + ((n + 2) / 3) * 4);
+    char* o = &out[start];
+    size_t i = 0;
+    while (i + 2 < n) {
+        unsigned v = (in[i] << 16) | (in[i+1] << 8) | in[i+2];
+        *o++ = tbl[(v >> 18) & 63];
+        *o++ = tbl[(v >> 12) & 63];
+        *o++ = tbl[(v >> 6) & 63];
+        *o++ = tbl[v & 63];
+        i += 3;
+    }
+    if (i + 1 == n) {
+        unsigned v = (in[i] << 16);
+        *o++ = tbl[(v >> 18) & 63];
+        *o++ = tbl[(v >> 12) & 63];
+        *o++ = '=';
+        *o++ = '=';
+    } else if (i + 2 == n) {
+        unsigned v = (in[i] << 16) | (in[i+1] << 8);
+        *o++ = tbl[(v >> 18) & 63];
+        *o++ = tbl[(v >> 12) & 63];
+        *o++ = tbl[(v >> 6) & 63];
+        *o++ = '=';
+    }
+}
+
+std::pmr::vector<std::pair<size_t, size_t>> SplitConcatenatedPngs(const unsigned char* png, size_t size) {
+    static const unsigned char kSignature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    std::pmr::vector<std::pair<size_t, size_t>> images(CurrentRenderArena());
+    size_t start = 0;
+    while (start < size) {
+        size_t pos = start + sizeof(kSignature);
+        bool complete = false;
+        if (pos <= size && std::equal(kSignature, kSignature + sizeof(kSignature), png + start)) {
+            while (pos + 12 <= size) {
+                const size_t length = (static_cast<size_t>(png[pos]) << 24) | (static_cast<size_t>(png[pos + 1]) << 16) |
+                                      (static_cast<size_t>(png[pos + 2]) << 8) | png[pos + 3];
+                const bool isEnd = std::equal(png + pos + 4, png + pos + 8, "IEND");
+                if (length > size - pos - 12) break;
+                pos += 12 + length;
+                if (isEnd) {
+                    complete = true;
+                    break;
+                }
+            }
+        }
+        if (!complete) {
+            images.emplace_back(start, size - start);
+            break;
+        }
+        images.emplace_back(start, pos - start);
+        start = pos;
+    }
+    return images;
+}
+
+void AppendPngImagesMarkup(std::string& out, const unsigned char* png, size_t size) {
+    static constexpr std::string_view kOpen = "<img alt=\"diagram\" src=\"data:image/png;base64,";
+    static constexpr std::string_view kClose = "\"/>";
+    const auto images = SplitConcatenatedPngs(png, size);
+    size_t total = out.size();
+    for (const auto& range : images) {
+        total += kOpen.size() + (range.second + 2) / 3 * 4 + kClose.size();
+    }
+    out.reserve(total);
+    for (const auto& range : images) {
+        out += kOpen;
+        AppendBase64(out, png + range.first, range.second);
+        out += kClose;
+    }
+}
+
+void AppendDiagramSlotMarkup(std::string& out, size_t index, std::string_view content) {
+    char digits[24];
+    const auto end = std::to_chars(digits, digits + sizeof(digits), index).ptr;
+    out += "<div class=\"diagram\" data-index=\"";
+    out.append(digits, static_cast<size_t>(end - digits));
+    out += "\">";
+    out += content;
+    out += "</div>";
+}
+
+} // namespace puml
@@ -0,0 +1,33 @@
+// Viewer markup for rendered diagrams: PNG output split into its images and
+// embedded as data URLs, and the numbered slot each diagram of a file is
+// shown in. Everything appends to a caller's string, which a render reuses,
+// and scratch lists come from the current render arena, so building the
+// markup of a render costs no heap allocations once its buffers are warm.
+
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace puml {
+
+// Appends the base64 encoding of data, with padding.
+void AppendBase64(std::string& out, const unsigned char* data, size_t size);
+
+// Byte ranges (offset, size) of the PNG files in a buffer holding several of
+// them back to back, the way the pipe returns a multi-diagram source. A
+// truncated or unrecognised tail is returned as one last range. Allocated
+// from CurrentRenderArena().
+std::pmr::vector<std::pair<size_t, size_t>> SplitConcatenatedPngs(const unsigned char* png, size_t size);
+
+// Appends an <img> with a data URL for every image in png.
+void AppendPngImagesMarkup(std::string& out, const unsigned char* png, size_t size);
+
+// Appends content wrapped in the slot of diagram image index (from 0).
+void AppendDiagramSlotMarkup(std::string& out, size_t index, std::string_view content);
+
+} // namespace puml
@@ -0,0 +1,106 @@
+#include "core/diagram_splitter.h"
+
+#include "core/render_arena.h"
+
+#include <algorithm>
+
+namespace puml {
+
+namespace {
+
+bool StartsWith(const char* p, const char* end, const char* prefix) {
+    for (; *prefix; ++prefix, ++p) {
+        if (p == end || *p != *prefix) return false;
+    }
+    return true;
+}
+
+// "newpage" alone or followed by a title.
+bool IsNewPage(const char* p, const char* end) {
+    if (!StartsWith(p, end, "newpage")) return false;
+    p += 7;
+    return p == end || *p == ' ' || *p == '\t' || *p == '\r';
+}
+
+} // namespace
+
+std::pmr::vector<DiagramBlock> SplitDiagramBlocks(std::string_view utf8Source) {
+    std::pmr::vector<DiagramBlock> blocks(CurrentRenderArena());
+
+    const char* begin = utf8Source.data();
+    const char* p = begin;
+    const char* end = p + utf8Source.size();
+    if (end - p >= 3 && (unsigned char)p[0] == 0xEF && (unsigned char)p[1] == 0xBB && (unsigned char)p[2] == 0xBF) {
+        p += 3;
+    }
+
+    DiagramBlock chunk;
+    chunk.offset = static_cast<size_t>(p - begin);
+    bool chunkHasContent = false;
+    bool chunkHasStart = false;
+    size_t line = 1;
+    for (; p < end; ++line) {
+        const char* eol = std::find(p, end, '\n');
+        const char* next = (eol == end) ? end : eol + 1;
+        const char* t = p;
+        while (t < eol && (*t == ' ' || *t == '\t')) ++t;
+        const bool blank = (t == eol) || (t + 1 == eol && *t == '\r');
+
+        if (StartsWith(t, eol, "@start")) {
+            chunk.offset = static_cast<size_t>(p - begin);
+            chunk.firstLine = line;
+            chunk.pages = 1;
+            chunkHasStart = true;
+        } else if (IsNewPage(t, eol)) {
+            ++chunk.pages;
+        }
+        chunk.length = static_cast<size_t>(next - begin) - chunk.offset;
+        chunk.addNewline = eol == end;
+
+        if (StartsWith(t, eol, "@end")) {
+            // Content closed by an @end line without an @start is wrapped
+            // like trailing content; a stray @end line on its own is not.
+            if (chunkHasStart || chunkHasContent) {
+                chunk.addStart = !chunkHasStart;
+                blocks.push_back(chunk);
+            }
+            chunk = DiagramBlock();
+            chunk.offset = static_cast<size_t>(next - begin);
+            chunk.firstLine = line + 1;
+            chunkHasContent = false;
+            chunkHasStart = false;
+        } else {
+            chunkHasContent = chunkHasContent || !blank;
+        }
+        p = next;
+    }
+
+    if (chunkHasContent) {
+        chunk.addStart = !chunkHasStart;
+        chunk.addEnd = true;
+        blocks.push_back(chunk);
+    }
+    return blocks;
+}
+
+DiagramBlockText BlockText(std::string_view utf8Source, const DiagramBlock& block) {
+    static constexpr std::string_view kStart = "@startuml\n";
+    static constexpr std::string_view kEnd = "\n@enduml\n";
+    // The newline that ends the range's last line, then the @end line.
+    const size_t from = block.addNewline ? 0 : 1;
+    const size_t to = block.addEnd ? kEnd.size() : 1;
+    DiagramBlockText text;
+    text.before = block.addStart ? kStart : std::string_view();
+    text.body = utf8Source.substr(block.offset, block.length);
+    text.after = kEnd.substr(from, to - from);
+    return text;
+}
+
+void AppendBlockText(std::string& out, std::string_view utf8Source, const DiagramBlock& block) {
+    const DiagramBlockText text = BlockText(utf8Source, block);
+    out.append(text.before);
+    out.append(text.body);
+    out.append(text.after);
+}
+
+} // namespace puml
@@ -0,0 +1,46 @@
+// Splits a PlantUML source into its @start ... @end diagram blocks without
+// the JVM, so each block can be rendered on its own.
+
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace puml {
+
+// A block is a range of the source it was split from, "@start..." through
+// "@end...", plus the lines PlantUML reads as if they were there: content
+// outside any @start line is wrapped in @startuml/@enduml and a missing
+// @end line is added, the way PlantUML reads a file.
+struct DiagramBlock {
+    size_t offset = 0;           // of the block's first line in the input
+    size_t length = 0;           // through the '\n' of its last line, if it has one
+    bool   addStart = false;     // "@startuml\n" goes before the range
+    bool   addEnd = false;       // "@enduml\n" goes after it
+    bool   addNewline = false;   // the last line of the range has no '\n'
+    size_t firstLine = 1;        // 1-based line in the input the block starts at
+    size_t pages = 1;            // 1 + the number of "newpage" lines
+};
+
+// Blocks in source order. Text before an @start line is dropped, like
+// PlantUML does, and so is an @end line closing nothing; a source without
+// any content yields no block. Allocated
+// from CurrentRenderArena().
+std::pmr::vector<DiagramBlock> SplitDiagramBlocks(std::string_view utf8Source);
+
+// The text PlantUML reads for a block, as the lines added before the range,
+// the range itself (a view of utf8Source) and the lines added after it.
+struct DiagramBlockText {
+    std::string_view before;
+    std::string_view body;
+    std::string_view after;
+};
+
+DiagramBlockText BlockText(std::string_view utf8Source, const DiagramBlock& block);
+// The same text in one string, every line terminated by '\n'.
+void AppendBlockText(std::string& out, std::string_view utf8Source, const DiagramBlock& block);
+
+} // namespace puml
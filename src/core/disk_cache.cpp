@@ -0,0 +1,242 @@
+#include "core/disk_cache.h"
+
+#include "core/core_log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace puml {
+
+namespace {
+
+std::string UniqueSuffix() {
+    static std::atomic<unsigned> counter{0};
+    const auto stamp = static_cast<unsigned long long>(std::chrono::steady_clock::now().time_since_epoch().count());
+    const auto thread = static_cast<unsigned long long>(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    return std::to_string(stamp ^ (thread << 17)) + "-" + std::to_string(++counter);
+}
+
+bool IsTempName(const std::string& name) {
+    return name.size() > 4 && name.compare(name.size() - 4, 4, ".tmp") == 0;
+}
+
+} // namespace
+
+DiskRenderCache::DiskRenderCache(const std::string& directoryUtf8, uint64_t maxBytes)
+    : directory_(fs::u8path(directoryUtf8)), maxBytes_(maxBytes) {}
+
+bool DiskRenderCache::Get(const std::string& key, const std::string& extension, std::vector<unsigned char>& out) {
+    return Read(key + "." + extension, out, true);
+}
+
+bool DiskRenderCache::Peek(const std::string& key, const std::string& extension, std::vector<unsigned char>& out) {
+    return Read(key + "." + extension, out, false);
+}
+
+bool DiskRenderCache::Read(const std::string& name, std::vector<unsigned char>& out, bool lookup) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        LoadIndexLocked();
+        if (index_.find(name) == index_.end() && !AdoptLocked(name)) {
+            if (lookup) ++stats_.misses;
+            return false;
+        }
+    }
+
+    const fs::path path = directory_ / name;
+    std::error_code ec;
+    const uintmax_t size = fs::file_size(path, ec);
+    bool ok = !ec;
+    if (ok) {
+        std::ifstream in(path, std::ios::binary);
+        out.resize(static_cast<size_t>(size));
+        ok = in && (size == 0 || in.read(reinterpret_cast<char*>(out.data()), static_cast<std::streamsize>(size)));
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(name);
+    if (!ok) {
+        // Evicted by another process since the index was built.
+        if (it != index_.end()) {
+            stats_.bytes -= std::min<uint64_t>(stats_.bytes, it->second.size);
+            index_.erase(it);
+        }
+        out.clear();
+        if (lookup) ++stats_.misses;
+        return false;
+    }
+    if (!lookup) {
+        return true;
+    }
+    const fs::file_time_type now = fs::file_time_type::clock::now();
+    fs::last_write_time(path, now, ec);
+    if (it != index_.end()) {
+        it->second.lastUse = now;
+    }
+    ++stats_.hits;
+    return true;
+}
+
+bool DiskRenderCache::Put(const std::string& key, const std::string& extension, const void* data, size_t size) {
+    return Write(key + "." + extension, data, size, false);
+}
+
+bool DiskRenderCache::Replace(const std::string& key, const std::string& extension, const void* data, size_t size) {
+    return Write(key + "." + extension, data, size, true);
+}
+
+bool DiskRenderCache::Write(const std::string& name, const void* data, size_t size, bool replace) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        LoadIndexLocked();
+        if (!replace && (index_.find(name) != index_.end() || AdoptLocked(name))) {
+            return true; // content-addressed: an existing entry has the same bytes
+        }
+    }
+
+    const fs::path finalPath = directory_ / name;
+    const fs::path tempPath = directory_ / (name + "." + UniqueSuffix() + ".tmp");
+    {
+        std::ofstream outFile(tempPath, std::ios::binary | std::ios::trunc);
+        if (!outFile) {
+            Log("DiskRenderCache: cannot create " + tempPath.u8string());
+            return false;
+        }
+        if (size) outFile.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+        outFile.close();
+        if (!outFile) {
+            std::error_code ignored;
+            fs::remove(tempPath, ignored);
+            Log("DiskRenderCache: failed to write " + tempPath.u8string());
+            return false;
+        }
+    }
+    std::error_code ec;
+    fs::rename(tempPath, finalPath, ec);
+    if (ec) {
+        std::error_code ignored;
+        fs::remove(tempPath, ignored);
+        // Another writer may have won the race with identical content.
+        if (replace || !fs::exists(finalPath, ignored)) {
+            Log("DiskRenderCache: failed to publish " + finalPath.u8string() + ": " + ec.message());
+            return false;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry& entry = index_[name];
+    stats_.bytes -= std::min<uint64_t>(stats_.bytes, entry.size);
+    entry.size = size;
+    entry.lastUse = fs::file_time_type::clock::now();
+    stats_.bytes += size;
+    ++stats_.writes;
+    EvictLocked();
+    return true;
+}
+
+bool DiskRenderCache::Contains(const std::string& key, const std::string& extension) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    LoadIndexLocked();
+    const std::string name = key + "." + extension;
+    return index_.find(name) != index_.end() || AdoptLocked(name);
+}
+
+DiskCacheStats DiskRenderCache::Stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    DiskCacheStats stats = stats_;
+    stats.entries = index_.size();
+    return stats;
+}
+
+bool DiskRenderCache::AdoptLocked(const std::string& name) {
+    std::error_code ec;
+    const fs::path path = directory_ / name;
+    if (!fs::is_regular_file(path, ec)) {
+        return false;
+    }
+    Entry entry;
+    entry.size = fs::file_size(path, ec);
+    if (ec) return false;
+    entry.lastUse = fs::last_write_time(path, ec);
+    if (ec) return false;
+    stats_.bytes += entry.size;
+    index_[name] = entry;
+    return true;
+}
+
+void DiskRenderCache::LoadIndexLocked() {
+    const auto now = std::chrono::steady_clock::now();
+    if (indexLoaded_ && now - lastScan_ < kRescanInterval) return;
+    indexLoaded_ = true;
+    lastScan_ = now;
+    index_.clear();
+    stats_.bytes = 0;
+
+    std::error_code ec;
+    fs::create_directories(directory_, ec);
+    const fs::file_time_type staleBefore = fs::file_time_type::clock::now() - std::chrono::hours(1);
+    for (fs::directory_iterator it(directory_, ec), end; !ec && it != end; it.increment(ec)) {
+        std::error_code entryEc;
+        if (!it->is_regular_file(entryEc)) continue;
+        const std::string name = it->path().filename().u8string();
+        const fs::file_time_type mtime = it->last_write_time(entryEc);
+        if (IsTempName(name)) {
+            // Left behind by a writer that died before renaming.
+            if (!entryEc && mtime < staleBefore) fs::remove(it->path(), entryEc);
+            continue;
+        }
+        Entry entry;
+        entry.size = it->file_size(entryEc);
+        entry.lastUse = mtime;
+        stats_.bytes += entry.size;
+        index_.emplace(name, entry);
+    }
+    Log("DiskRenderCache: indexed " + std::to_string(index_.size()) + " entries (" +
+        std::to_string(stats_.bytes) + " bytes) in " + directory_.u8string());
+    EvictLocked();
+}
+
+void DiskRenderCache::EvictLocked() {
+    if (stats_.bytes <= maxBytes_) return;
+
+    std::vector<std::pair<fs::file_time_type, std::string>> byAge;
+    byAge.reserve(index_.size());
+    for (const auto& item : index_) {
+        byAge.emplace_back(item.second.lastUse, item.first);
+    }
+    std::sort(byAge.begin(), byAge.end());
+
+    // Trim to 90% so a burst of writes does not evict on every Put.
+    const uint64_t target = maxBytes_ - maxBytes_ / 10;
+    for (const auto& victim : byAge) {
+        if (stats_.bytes <= target) break;
+        const fs::path path = directory_ / victim.second;
+        auto it = index_.find(victim.second);
+        std::error_code ec;
+        const fs::file_time_type mtime = fs::last_write_time(path, ec);
+        if (ec) {
+            // Already removed by another process.
+            stats_.bytes -= std::min<uint64_t>(stats_.bytes, it->second.size);
+            index_.erase(it);
+            continue;
+        }
+        if (mtime > it->second.lastUse) {
+            // Hit or rewritten by another process since it was indexed.
+            it->second.lastUse = mtime;
+            continue;
+        }
+        fs::remove(path, ec);
+        if (ec && fs::exists(path)) continue; // in use elsewhere
+        stats_.bytes -= std::min<uint64_t>(stats_.bytes, it->second.size);
+        index_.erase(it);
+        ++stats_.evictions;
+    }
+}
+
+} // namespace puml
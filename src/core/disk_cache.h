@@ -0,0 +1,78 @@
+// Persistent, size-bounded store of rendered artifacts.
+//
+// Entries are files named "<key>.<ext>" in one directory. Writes go to a
+// temporary file that is renamed into place, so readers in other Lister
+// windows or Total Commander processes never observe a partial artifact.
+// The file modification time doubles as the LRU timestamp: hits touch it and
+// eviction removes the oldest entries once the directory exceeds its budget.
+// Each process indexes the directory: a name missing from the index is
+// looked up on disk before it counts as a miss, and the directory is
+// re-scanned every few minutes, so entries written and removed by other
+// processes are seen and count against the shared budget.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace puml {
+
+struct DiskCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t writes = 0;
+    uint64_t evictions = 0;
+    uint64_t entries = 0;
+    uint64_t bytes = 0;
+};
+
+class DiskRenderCache {
+public:
+    DiskRenderCache(const std::string& directoryUtf8, uint64_t maxBytes);
+
+    bool Get(const std::string& key, const std::string& extension, std::vector<unsigned char>& out);
+    // Content-addressed: an entry already stored under key keeps its bytes.
+    bool Put(const std::string& key, const std::string& extension, const void* data, size_t size);
+    // Stores data under key whether or not an entry exists, for entries
+    // whose content changes, such as the last render of a path.
+    bool Replace(const std::string& key, const std::string& extension, const void* data, size_t size);
+    // Membership test that neither counts as a lookup nor refreshes recency.
+    bool Contains(const std::string& key, const std::string& extension);
+    // Get that neither counts as a lookup nor refreshes recency, for reads
+    // that do not stand for a render, such as a preview of the last one.
+    bool Peek(const std::string& key, const std::string& extension, std::vector<unsigned char>& out);
+
+    DiskCacheStats Stats() const;
+
+private:
+    struct Entry {
+        uint64_t                        size = 0;
+        std::filesystem::file_time_type lastUse;
+    };
+
+    static constexpr std::chrono::minutes kRescanInterval{5};
+
+    // A lookup counts as a hit or miss and refreshes the entry's timestamp.
+    bool Read(const std::string& name, std::vector<unsigned char>& out, bool lookup);
+    bool Write(const std::string& name, const void* data, size_t size, bool replace);
+    // Indexes name if another process stored it since the last scan.
+    bool AdoptLocked(const std::string& name);
+    void LoadIndexLocked();
+    void EvictLocked();
+
+    std::filesystem::path directory_;
+    uint64_t              maxBytes_;
+
+    mutable std::mutex                     mutex_;
+    bool                                   indexLoaded_ = false;
+    std::chrono::steady_clock::time_point  lastScan_;
+    std::unordered_map<std::string, Entry> index_;   // file name -> entry
+    DiskCacheStats                         stats_;
+};
+
+} // namespace puml
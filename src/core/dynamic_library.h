@@ -0,0 +1,23 @@
+// Portable run-time loading of shared libraries (jvm.dll / libjvm.so).
+// Win32 (LoadLibraryExW) and POSIX (dlopen) implementations live in
+// dynamic_library_win32.cpp / dynamic_library_posix.cpp.
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+namespace puml {
+
+class DynamicLibrary {
+public:
+    // Unloads the library.
+    virtual ~DynamicLibrary() = default;
+    // Address of an exported symbol, nullptr if there is none.
+    virtual void* Symbol(const char* name) const = 0;
+};
+
+// Libraries the loaded one depends on are looked up in its own directory too.
+std::unique_ptr<DynamicLibrary> LoadDynamicLibrary(const std::string& pathUtf8, std::string* error);
+
+} // namespace puml
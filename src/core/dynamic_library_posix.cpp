@@ -0,0 +1,35 @@
+// POSIX implementation of DynamicLibrary (dlopen).
+
+#include "core/dynamic_library.h"
+
+#include <dlfcn.h>
+
+namespace puml {
+
+namespace {
+
+class PosixDynamicLibrary final : public DynamicLibrary {
+public:
+    explicit PosixDynamicLibrary(void* handle) : handle_(handle) {}
+    ~PosixDynamicLibrary() override { dlclose(handle_); }
+
+    void* Symbol(const char* name) const override { return dlsym(handle_, name); }
+
+private:
+    void* handle_;
+};
+
+} // namespace
+
+std::unique_ptr<DynamicLibrary> LoadDynamicLibrary(const std::string& pathUtf8, std::string* error) {
+    // The library's own RPATH finds its dependencies.
+    void* handle = dlopen(pathUtf8.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        const char* reason = dlerror();
+        if (error) *error = "dlopen failed: " + std::string(reason ? reason : "unknown error");
+        return nullptr;
+    }
+    return std::make_unique<PosixDynamicLibrary>(handle);
+}
+
+} // namespace puml
@@ -0,0 +1,45 @@
+// Win32 implementation of DynamicLibrary (LoadLibraryExW).
+
+#include "core/dynamic_library.h"
+
+#include <windows.h>
+
+namespace puml {
+
+namespace {
+
+std::wstring WidenUtf8(const std::string& s) {
+    if (s.empty()) return std::wstring();
+    int n = ::MultiByteToWideChar(CP_UTF8, 0, s.data(), (int)s.size(), nullptr, 0);
+    std::wstring w(n > 0 ? n : 0, L'\0');
+    if (n > 0) ::MultiByteToWideChar(CP_UTF8, 0, s.data(), (int)s.size(), w.data(), n);
+    return w;
+}
+
+class Win32DynamicLibrary final : public DynamicLibrary {
+public:
+    explicit Win32DynamicLibrary(HMODULE module) : module_(module) {}
+    ~Win32DynamicLibrary() override { FreeLibrary(module_); }
+
+    void* Symbol(const char* name) const override {
+        return reinterpret_cast<void*>(GetProcAddress(module_, name));
+    }
+
+private:
+    HMODULE module_;
+};
+
+} // namespace
+
+std::unique_ptr<DynamicLibrary> LoadDynamicLibrary(const std::string& pathUtf8, std::string* error) {
+    // The altered search path starts in the library's own directory rather
+    // than in the host program's.
+    HMODULE module = LoadLibraryExW(WidenUtf8(pathUtf8).c_str(), nullptr, LOAD_WITH_ALTERED_SEARCH_PATH);
+    if (!module) {
+        if (error) *error = "LoadLibrary failed (error " + std::to_string(GetLastError()) + ")";
+        return nullptr;
+    }
+    return std::make_unique<Win32DynamicLibrary>(module);
+}
+
+} // namespace puml
@@ -0,0 +1,33 @@
+// Portable file change watcher used for auto-refresh.
+// Win32 (ReadDirectoryChangesW) and POSIX (inotify on Linux, polling
+// elsewhere) implementations live in file_watcher_win32.cpp /
+// file_watcher_posix.cpp.
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace puml {
+
+// Watches the directories of a set of files, so that editors saving through
+// a temporary file renamed over the original are seen too. A burst of
+// changes to any of the files is reported once, after they have been quiet
+// for debounceMs. onChange runs on the watcher's own thread.
+class FileWatcher {
+public:
+    // Stops watching and joins the thread; must not be called from onChange.
+    virtual ~FileWatcher() = default;
+};
+
+// Directories that cannot be watched (e.g. of a missing include) are
+// skipped; fails only when none of them can be.
+std::unique_ptr<FileWatcher> StartFileWatcher(const std::vector<std::string>& pathsUtf8,
+                                              uint32_t debounceMs,
+                                              std::function<void()> onChange,
+                                              std::string* error);
+
+} // namespace puml
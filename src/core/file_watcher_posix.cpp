@@ -0,0 +1,206 @@
+// POSIX implementation of FileWatcher: inotify on Linux, polling the files'
+// size and modification time elsewhere.
+
+#include "core/file_watcher.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#endif
+
+namespace puml {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+void CloseFd(int& fd) {
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+class PosixFileWatcher final : public FileWatcher {
+public:
+    PosixFileWatcher(const std::vector<std::string>& paths, uint32_t debounceMs, std::function<void()> onChange)
+        : paths_(paths), debounceMs_(debounceMs), onChange_(std::move(onChange)) {
+        for (const std::string& path : paths_) {
+            const size_t slash = path.find_last_of('/');
+            const std::string directory = slash == std::string::npos ? std::string(".") : path.substr(0, slash + 1);
+            const std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+            if (name.empty()) continue;
+            auto it = std::find_if(directories_.begin(), directories_.end(),
+                                   [&](const Directory& d) { return d.path == directory; });
+            if (it == directories_.end()) {
+                directories_.push_back({directory, {}, -1});
+                it = directories_.end() - 1;
+            }
+            it->names.push_back(name);
+        }
+    }
+
+    ~PosixFileWatcher() override {
+        if (stopPipe_[1] >= 0) {
+            const char byte = 0;
+            ssize_t ignored = write(stopPipe_[1], &byte, 1);
+            (void)ignored;
+        }
+        if (thread_.joinable()) thread_.join();
+        CloseFd(notifyFd_);
+        CloseFd(stopPipe_[0]);
+        CloseFd(stopPipe_[1]);
+    }
+
+    bool Start(std::string* error) {
+        if (directories_.empty()) {
+            if (error) *error = "no file path";
+            return false;
+        }
+        if (pipe(stopPipe_) != 0) {
+            if (error) *error = std::string("pipe failed: ") + std::strerror(errno);
+            return false;
+        }
+        fcntl(stopPipe_[0], F_SETFD, FD_CLOEXEC);
+        fcntl(stopPipe_[1], F_SETFD, FD_CLOEXEC);
+#if defined(__linux__)
+        notifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (notifyFd_ < 0) {
+            if (error) *error = std::string("inotify failed: ") + std::strerror(errno);
+            return false;
+        }
+        size_t watched = 0;
+        for (Directory& directory : directories_) {
+            directory.wd = inotify_add_watch(notifyFd_, directory.path.c_str(),
+                                             IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_ATTRIB);
+            if (directory.wd >= 0) ++watched;
+        }
+        if (watched == 0) {
+            if (error) *error = std::string("inotify failed: ") + std::strerror(errno);
+            return false;
+        }
+#endif
+        lastStamp_ = Stamp();
+        thread_ = std::thread([this]() { Run(); });
+        return true;
+    }
+
+private:
+    static constexpr int kPollIntervalMs = 500;   // without inotify
+
+    struct Directory {
+        std::string              path;
+        std::vector<std::string> names;
+        int                      wd;
+    };
+
+    std::string Stamp() const {
+        std::string stamp;
+        for (const std::string& path : paths_) {
+            struct stat st{};
+            if (stat(path.c_str(), &st) != 0) {
+                stamp += "-;";
+                continue;
+            }
+#if defined(__APPLE__)
+            const long nanoseconds = st.st_mtimespec.tv_nsec;
+#else
+            const long nanoseconds = st.st_mtim.tv_nsec;
+#endif
+            stamp += std::to_string(st.st_size) + ":" + std::to_string(st.st_mtime) + "." +
+                     std::to_string(nanoseconds) + ":" + std::to_string(st.st_ino) + ";";
+        }
+        return stamp;
+    }
+
+    bool Concerns(int wd, const char* name) const {
+        for (const Directory& directory : directories_) {
+            if (directory.wd == wd) {
+                return std::find(directory.names.begin(), directory.names.end(), name) != directory.names.end();
+            }
+        }
+        return false;
+    }
+
+    // Drains the notifications; true if one concerned the watched file.
+    bool ReadEvents() {
+        bool concerned = false;
+#if defined(__linux__)
+        alignas(struct inotify_event) char buffer[8192];
+        for (;;) {
+            const ssize_t n = read(notifyFd_, buffer, sizeof(buffer));
+            if (n <= 0) break;
+            for (char* p = buffer; p < buffer + n;) {
+                const auto* event = reinterpret_cast<const struct inotify_event*>(p);
+                if ((event->mask & IN_Q_OVERFLOW) || (event->len > 0 && Concerns(event->wd, event->name))) {
+                    concerned = true;
+                }
+                p += sizeof(struct inotify_event) + event->len;
+            }
+        }
+#else
+        const std::string stamp = Stamp();
+        concerned = stamp != lastStamp_;
+        lastStamp_ = stamp;
+#endif
+        return concerned;
+    }
+
+    void Run() {
+        bool pending = false;
+        Clock::time_point deadline;
+        for (;;) {
+            int timeout = notifyFd_ >= 0 ? -1 : kPollIntervalMs;
+            if (pending) {
+                const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+                const int wait = left > 0 ? static_cast<int>(left) : 0;
+                timeout = timeout < 0 || wait < timeout ? wait : timeout;
+            }
+            struct pollfd fds[2] = {{stopPipe_[0], POLLIN, 0}, {notifyFd_, POLLIN, 0}};
+            const int ready = poll(fds, notifyFd_ >= 0 ? 2 : 1, timeout);
+            if (ready < 0 && errno != EINTR) break;
+            if (fds[0].revents) break;
+            if ((notifyFd_ < 0 || fds[1].revents) && ReadEvents()) {
+                pending = true;
+                deadline = Clock::now() + std::chrono::milliseconds(debounceMs_);
+            } else if (pending && Clock::now() >= deadline) {
+                pending = false;
+                onChange_();
+            }
+        }
+    }
+
+    std::vector<std::string> paths_;
+    std::vector<Directory>   directories_;
+    uint32_t                 debounceMs_;
+    std::function<void()>    onChange_;
+    int                      notifyFd_ = -1;
+    int                      stopPipe_[2] = {-1, -1};
+    std::string              lastStamp_;
+    std::thread              thread_;
+};
+
+} // namespace
+
+std::unique_ptr<FileWatcher> StartFileWatcher(const std::vector<std::string>& pathsUtf8,
+                                              uint32_t debounceMs,
+                                              std::function<void()> onChange,
+                                              std::string* error) {
+    auto watcher = std::make_unique<PosixFileWatcher>(pathsUtf8, debounceMs, std::move(onChange));
+    if (!watcher->Start(error)) {
+        return nullptr;
+    }
+    return watcher;
+}
+
+} // namespace puml
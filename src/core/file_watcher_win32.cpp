@@ -0,0 +1,209 @@
+// Win32 implementation of FileWatcher (overlapped ReadDirectoryChangesW, one
+// per watched directory).
+
+#include "core/file_watcher.h"
+
+#include <windows.h>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace puml {
+
+namespace {
+
+std::wstring WidenUtf8(const std::string& s) {
+    if (s.empty()) return std::wstring();
+    int n = ::MultiByteToWideChar(CP_UTF8, 0, s.data(), (int)s.size(), nullptr, 0);
+    std::wstring w(n > 0 ? n : 0, L'\0');
+    if (n > 0) ::MultiByteToWideChar(CP_UTF8, 0, s.data(), (int)s.size(), w.data(), n);
+    return w;
+}
+
+void CloseIfValid(HANDLE& h) {
+    if (h && h != INVALID_HANDLE_VALUE) {
+        CloseHandle(h);
+    }
+    h = nullptr;
+}
+
+// One watched directory and the names of the files of interest in it.
+struct WatchedDirectory {
+    HANDLE                     handle = INVALID_HANDLE_VALUE;
+    std::vector<std::wstring>  names;
+    std::vector<unsigned char> buffer = std::vector<unsigned char>(16 * 1024);   // DWORD-aligned
+    OVERLAPPED                 overlapped{};
+    bool                       armed = false;
+
+    ~WatchedDirectory() {
+        if (armed) {
+            CancelIoEx(handle, &overlapped);
+            DWORD bytes = 0;
+            GetOverlappedResult(handle, &overlapped, &bytes, TRUE);
+        }
+        CloseIfValid(handle);
+        CloseIfValid(overlapped.hEvent);
+    }
+
+    bool Arm() {
+        ResetEvent(overlapped.hEvent);
+        armed = ReadDirectoryChangesW(handle, buffer.data(), static_cast<DWORD>(buffer.size()), FALSE,
+                                      FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE,
+                                      nullptr, &overlapped, nullptr) != FALSE;
+        return armed;
+    }
+
+    // An empty result means the buffer overflowed: assume a file changed.
+    bool ConcernsFiles(DWORD bytes) const {
+        if (bytes == 0) return true;
+        const unsigned char* p = buffer.data();
+        for (;;) {
+            const auto* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(p);
+            const int length = static_cast<int>(info->FileNameLength / sizeof(wchar_t));
+            for (const std::wstring& name : names) {
+                if (CompareStringOrdinal(info->FileName, length, name.c_str(), static_cast<int>(name.size()), TRUE) == CSTR_EQUAL) {
+                    return true;
+                }
+            }
+            if (info->NextEntryOffset == 0) return false;
+            p += info->NextEntryOffset;
+        }
+    }
+};
+
+class Win32FileWatcher final : public FileWatcher {
+public:
+    Win32FileWatcher(std::vector<std::unique_ptr<WatchedDirectory>> directories,
+                     uint32_t debounceMs, std::function<void()> onChange)
+        : directories_(std::move(directories)), debounceMs_(debounceMs), onChange_(std::move(onChange)) {
+        stopEvent_ = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    }
+
+    ~Win32FileWatcher() override {
+        if (stopEvent_) SetEvent(stopEvent_);
+        if (thread_.joinable()) thread_.join();
+        directories_.clear();
+        CloseIfValid(stopEvent_);
+    }
+
+    bool Start(std::string* error) {
+        if (!stopEvent_) {
+            if (error) *error = "CreateEvent failed (error " + std::to_string(GetLastError()) + ")";
+            return false;
+        }
+        thread_ = std::thread([this]() { Run(); });
+        return true;
+    }
+
+private:
+    void Run() {
+        bool pending = false;
+        ULONGLONG deadline = 0;
+        for (;;) {
+            // Directories that went away drop out; the last burst is still reported.
+            std::vector<HANDLE> handles = {stopEvent_};
+            std::vector<WatchedDirectory*> waiting;
+            for (const auto& directory : directories_) {
+                if (directory->armed) {
+                    handles.push_back(directory->overlapped.hEvent);
+                    waiting.push_back(directory.get());
+                }
+            }
+            DWORD timeout = INFINITE;
+            if (pending) {
+                const ULONGLONG now = GetTickCount64();
+                timeout = deadline > now ? static_cast<DWORD>(deadline - now) : 0;
+            }
+            const DWORD wait = WaitForMultipleObjects(static_cast<DWORD>(handles.size()), handles.data(), FALSE, timeout);
+            if (wait == WAIT_OBJECT_0) {
+                break;
+            }
+            if (wait == WAIT_TIMEOUT) {
+                pending = false;
+                onChange_();
+                continue;
+            }
+            if (wait >= WAIT_OBJECT_0 + handles.size()) {
+                break;
+            }
+            WatchedDirectory* directory = waiting[wait - WAIT_OBJECT_0 - 1];
+            DWORD bytes = 0;
+            if (GetOverlappedResult(directory->handle, &directory->overlapped, &bytes, FALSE) &&
+                directory->ConcernsFiles(bytes)) {
+                pending = true;
+                deadline = GetTickCount64() + debounceMs_;
+            }
+            directory->Arm();
+        }
+    }
+
+    std::vector<std::unique_ptr<WatchedDirectory>> directories_;
+    uint32_t                                       debounceMs_;
+    std::function<void()>                          onChange_;
+    HANDLE                                         stopEvent_ = nullptr;
+    std::thread                                    thread_;
+};
+
+} // namespace
+
+std::unique_ptr<FileWatcher> StartFileWatcher(const std::vector<std::string>& pathsUtf8,
+                                              uint32_t debounceMs,
+                                              std::function<void()> onChange,
+                                              std::string* error) {
+    std::vector<std::wstring> directoryPaths;
+    std::vector<std::unique_ptr<WatchedDirectory>> directories;
+    std::string firstError = "no file path";
+    for (const std::string& pathUtf8 : pathsUtf8) {
+        const std::wstring path = WidenUtf8(pathUtf8);
+        const size_t slash = path.find_last_of(L"\\/");
+        if (slash == std::wstring::npos || slash + 1 == path.size()) {
+            continue;
+        }
+        const std::wstring directoryPath = path.substr(0, slash + 1);
+        const std::wstring name = path.substr(slash + 1);
+        size_t i = 0;
+        while (i < directoryPaths.size() &&
+               CompareStringOrdinal(directoryPaths[i].c_str(), -1, directoryPath.c_str(), -1, TRUE) != CSTR_EQUAL) {
+            ++i;
+        }
+        if (i < directoryPaths.size()) {
+            if (directories[i]) directories[i]->names.push_back(name);
+            continue;
+        }
+        directoryPaths.push_back(directoryPath);
+        directories.emplace_back();
+        // One wait slot is the stop event.
+        if (directoryPaths.size() >= MAXIMUM_WAIT_OBJECTS) {
+            continue;
+        }
+        auto directory = std::make_unique<WatchedDirectory>();
+        directory->handle = CreateFileW(directoryPath.c_str(), FILE_LIST_DIRECTORY,
+                                        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                                        OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+        if (directory->handle == INVALID_HANDLE_VALUE) {
+            firstError = "cannot open directory (error " + std::to_string(GetLastError()) + ")";
+            continue;
+        }
+        directory->overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+        if (!directory->overlapped.hEvent || !directory->Arm()) {
+            firstError = "ReadDirectoryChangesW failed (error " + std::to_string(GetLastError()) + ")";
+            continue;
+        }
+        directory->names.push_back(name);
+        directories.back() = std::move(directory);
+    }
+    directories.erase(std::remove(directories.begin(), directories.end(), nullptr), directories.end());
+    if (directories.empty()) {
+        if (error) *error = firstError;
+        return nullptr;
+    }
+
+    auto watcher = std::make_unique<Win32FileWatcher>(std::move(directories), debounceMs, std::move(onChange));
+    if (!watcher->Start(error)) {
+        return nullptr;
+    }
+    return watcher;
+}
+
+} // namespace puml
@@ -0,0 +1,155 @@
+#include "core/hedged_render.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace puml {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+uint64_t ElapsedMs(Clock::time_point since) {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - since).count());
+}
+
+// Runs one backend and feeds its breaker and histogram. A render cancelled
+// because the other backend won says nothing about its health, unless it
+// had been running for longer than a render should take, and its elapsed
+// time is not a latency: recorded as one, the slow renders hedging cuts
+// short would drag the quantile, and so the hedge delay, down.
+bool RunAttempt(const HedgeBackend& backend,
+                const CancellationToken& attemptCancel,
+                const CancellationToken* callerCancel,
+                const HedgePolicy& policy,
+                std::string& error) {
+    const Clock::time_point started = Clock::now();
+    const bool ok = backend.render(attemptCancel, error);
+    const uint64_t elapsed = ElapsedMs(started);
+    if (ok) {
+        if (backend.latency) backend.latency->Record(elapsed);
+        if (backend.breaker) backend.breaker->RecordSuccess();
+        return true;
+    }
+    if (IsCancelled(callerCancel)) {
+        return false;
+    }
+    if (attemptCancel.IsCancelled()) {
+        if (backend.latency) backend.latency->RecordCensored();
+        if (elapsed >= policy.slowMs && backend.breaker) {
+            backend.breaker->RecordFailure("still running after " + std::to_string(elapsed) + " ms");
+        }
+        return false;
+    }
+    if (backend.breaker) backend.breaker->RecordFailure(error.empty() ? "failed" : error);
+    return false;
+}
+
+} // namespace
+
+uint32_t HedgeDelayMs(const LatencyHistogram& primaryLatency, const HedgePolicy& policy) {
+    if (primaryLatency.Count() < policy.minSamples) {
+        return policy.initialDelayMs;
+    }
+    const uint64_t quantile = primaryLatency.Quantile(policy.quantile);
+    if (quantile < policy.minDelayMs) return policy.minDelayMs;
+    if (quantile > policy.maxDelayMs) return policy.maxDelayMs;
+    return static_cast<uint32_t>(quantile);
+}
+
+HedgeOutcome RunHedged(const HedgeBackend& primary,
+                       const HedgeBackend& secondary,
+                       const HedgePolicy& policy,
+                       const CancellationToken* cancel) {
+    HedgeOutcome outcome;
+    const Clock::time_point started = Clock::now();
+
+    const bool primaryAllowed = !primary.breaker || primary.breaker->Allow();
+    const bool secondaryAllowed = !secondary.breaker || secondary.breaker->Allow();
+    if (!primaryAllowed && secondaryAllowed) {
+        outcome.failover = true;
+        CancellationToken attemptCancel;
+        CancellationRegistration onCancel(cancel, [&attemptCancel]() { attemptCancel.Cancel(); });
+        if (RunAttempt(secondary, attemptCancel, cancel, policy, outcome.secondaryError)) {
+            outcome.winner = HedgeWinner::Secondary;
+        }
+        outcome.elapsedMs = ElapsedMs(started);
+        return outcome;
+    }
+    if (!secondaryAllowed) {
+        CancellationToken attemptCancel;
+        CancellationRegistration onCancel(cancel, [&attemptCancel]() { attemptCancel.Cancel(); });
+        if (RunAttempt(primary, attemptCancel, cancel, policy, outcome.primaryError)) {
+            outcome.winner = HedgeWinner::Primary;
+        }
+        outcome.elapsedMs = ElapsedMs(started);
+        return outcome;
+    }
+
+    outcome.delayMs = primary.latency ? HedgeDelayMs(*primary.latency, policy) : policy.initialDelayMs;
+
+    std::mutex              mutex;
+    std::condition_variable cv;
+    bool                    primaryDone = false;
+    CancellationToken       primaryCancel;
+    CancellationToken       secondaryCancel;
+
+    // Declared before any use of mutex below so it unregisters after every
+    // lock is released: the callback itself takes mutex.
+    CancellationRegistration onCancel(cancel, [&]() {
+        primaryCancel.Cancel();
+        secondaryCancel.Cancel();
+        std::lock_guard<std::mutex> lock(mutex);
+        cv.notify_all();
+    });
+
+    std::thread hedge([&]() {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait_for(lock, std::chrono::milliseconds(outcome.delayMs),
+                        [&]() { return primaryDone || IsCancelled(cancel); });
+            // Not needed once the primary succeeded; a failed primary is
+            // replaced at once.
+            if (IsCancelled(cancel) || outcome.winner == HedgeWinner::Primary) {
+                return;
+            }
+            outcome.hedged = true;
+        }
+        std::string error;
+        const bool ok = RunAttempt(secondary, secondaryCancel, cancel, policy, error);
+        bool won = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            outcome.secondaryError = error;
+            if (ok && outcome.winner == HedgeWinner::None) {
+                outcome.winner = HedgeWinner::Secondary;
+                won = true;
+            }
+        }
+        if (won) primaryCancel.Cancel();
+    });
+
+    std::string error;
+    const bool ok = RunAttempt(primary, primaryCancel, cancel, policy, error);
+    bool won = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        primaryDone = true;
+        outcome.primaryError = error;
+        if (ok && outcome.winner == HedgeWinner::None) {
+            outcome.winner = HedgeWinner::Primary;
+            won = true;
+        }
+    }
+    cv.notify_all();
+    if (won) secondaryCancel.Cancel();
+    hedge.join();
+
+    outcome.elapsedMs = ElapsedMs(started);
+    return outcome;
+}
+
+} // namespace puml
@@ -0,0 +1,66 @@
+// Hedged rendering across two backends.
+//
+// The primary starts at once. If it has not succeeded after the hedge delay
+// (or fails before that), the secondary starts as well, and whichever
+// succeeds first wins; the other is cancelled. The delay follows the
+// primary's latency histogram, so only its slowest renders are hedged. Each
+// backend has a circuit breaker: a backend that keeps failing or timing out
+// is skipped (the other one renders alone) until its health probe passes.
+
+#pragma once
+
+#include "core/cancellation.h"
+#include "core/circuit_breaker.h"
+#include "core/latency_histogram.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace puml {
+
+struct HedgeBackend {
+    std::string       name;
+    CircuitBreaker*   breaker = nullptr;
+    LatencyHistogram* latency = nullptr;
+    // Renders into a result the callable owns; true on success. Must return
+    // promptly once cancel fires.
+    std::function<bool(const CancellationToken& cancel, std::string& error)> render;
+};
+
+struct HedgePolicy {
+    uint32_t initialDelayMs = 1500;  // until the primary has minSamples latencies
+    uint32_t minSamples = 20;
+    double   quantile = 0.95;        // of the primary's latencies
+    uint32_t minDelayMs = 100;
+    uint32_t maxDelayMs = 10000;
+    uint32_t slowMs = 10000;         // a loser still running this long counts as timed out
+};
+
+enum class HedgeWinner {
+    None,
+    Primary,
+    Secondary,
+};
+
+struct HedgeOutcome {
+    HedgeWinner winner = HedgeWinner::None;
+    bool        hedged = false;      // both backends were started
+    bool        failover = false;    // the primary's breaker was open; the secondary ran alone
+    uint32_t    delayMs = 0;
+    uint64_t    elapsedMs = 0;
+    std::string primaryError;
+    std::string secondaryError;
+};
+
+uint32_t HedgeDelayMs(const LatencyHistogram& primaryLatency, const HedgePolicy& policy);
+
+// Runs the primary on the calling thread and the secondary on a thread of
+// its own; returns once both are done. If both breakers are open the primary
+// renders alone anyway.
+HedgeOutcome RunHedged(const HedgeBackend& primary,
+                       const HedgeBackend& secondary,
+                       const HedgePolicy& policy,
+                       const CancellationToken* cancel);
+
+} // namespace puml
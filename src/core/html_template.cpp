@@ -0,0 +1,44 @@
+#include "core/html_template.h"
+
+namespace puml {
+
+namespace {
+
+// The entity for c, or nullptr if c is written as is.
+const char* HtmlEntity(char c) {
+    switch (c) {
+    case '&':  return "&amp;";
+    case '<':  return "&lt;";
+    case '>':  return "&gt;";
+    case '"':  return "&quot;";
+    case '\'': return "&#39;";
+    default:   return nullptr;
+    }
+}
+
+} // namespace
+
+size_t HtmlEscapeGrowth(std::string_view text) {
+    size_t growth = 0;
+    for (char c : text) {
+        if (const char* entity = HtmlEntity(c)) {
+            growth += std::char_traits<char>::length(entity) - 1;
+        }
+    }
+    return growth;
+}
+
+void AppendHtmlEscaped(std::string& out, std::string_view text) {
+    // Runs of plain text are copied whole; most of a diagram source is one.
+    size_t run = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (const char* entity = HtmlEntity(text[i])) {
+            out.append(text.data() + run, i - run);
+            out.append(entity);
+            run = i + 1;
+        }
+    }
+    out.append(text.data() + run, text.size() - run);
+}
+
+} // namespace puml
@@ -0,0 +1,141 @@
+// Pages built from a fixed template with "{{NAME}}" placeholders. The
+// template is split into literal text and slots once, at compile time, and
+// a page is rendered in a single pass into an output sized beforehand: the
+// page is never searched for placeholders, and a large slot (a diagram, the
+// diagram source) is written once instead of being shifted by every later
+// substitution. Slot contents can be HTML-escaped while they are copied, so
+// the escaped text never exists on its own.
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+
+namespace puml {
+
+// How many bytes HTML-escaping text adds to it; & < > " and ' are replaced.
+size_t HtmlEscapeGrowth(std::string_view text);
+
+// Appends text to out with those characters replaced by entities.
+void AppendHtmlEscaped(std::string& out, std::string_view text);
+
+enum class SlotEscape {
+    None,   // markup or text known to be safe
+    Html,   // text, escaped for element content and quoted attributes
+};
+
+struct SlotValue {
+    std::string_view text;
+    SlotEscape       escape = SlotEscape::None;
+};
+
+template <size_t SlotCount, size_t MaxSegments = 32>
+class HtmlTemplate {
+public:
+    using SlotNames = std::array<std::string_view, SlotCount>;
+    using SlotValues = std::array<SlotValue, SlotCount>;
+
+    // parts is the template text in pieces, as compilers limit the length of
+    // a string literal; a placeholder must not straddle two pieces. names
+    // lists the placeholders without their braces; slot i is names[i].
+    constexpr HtmlTemplate(std::initializer_list<std::string_view> parts, const SlotNames& names) {
+        for (std::string_view part : parts) {
+            size_t pos = 0;
+            while (valid_ && pos < part.size()) {
+                const size_t open = part.find("{{", pos);
+                if (open == std::string_view::npos) {
+                    AddLiteral(part.substr(pos));
+                    break;
+                }
+                if (open > pos) {
+                    AddLiteral(part.substr(pos, open - pos));
+                }
+                const size_t close = part.find("}}", open + 2);
+                if (close == std::string_view::npos) {
+                    valid_ = false;
+                    break;
+                }
+                AddSlot(names, part.substr(open + 2, close - open - 2));
+                pos = close + 2;
+            }
+        }
+    }
+
+    // False if the text has an unknown or unclosed placeholder or more than
+    // MaxSegments segments; meant for a static_assert next to the template.
+    constexpr bool Valid() const { return valid_; }
+    constexpr size_t LiteralSize() const { return literalSize_; }
+
+    // Size of the page for these slot contents, escaping included.
+    size_t RenderedSize(const SlotValues& values) const {
+        size_t size = literalSize_;
+        for (size_t i = 0; i < count_; ++i) {
+            if (segments_[i].slot < SlotCount) {
+                const SlotValue& value = values[segments_[i].slot];
+                size += value.text.size();
+                if (value.escape == SlotEscape::Html) size += HtmlEscapeGrowth(value.text);
+            }
+        }
+        return size;
+    }
+
+    // Replaces out with the page, reserving its final size up front.
+    void Render(const SlotValues& values, std::string& out) const {
+        out.clear();
+        out.reserve(RenderedSize(values));
+        for (size_t i = 0; i < count_; ++i) {
+            const Segment& segment = segments_[i];
+            if (segment.slot == SlotCount) {
+                out.append(segment.text);
+            } else if (values[segment.slot].escape == SlotEscape::Html) {
+                AppendHtmlEscaped(out, values[segment.slot].text);
+            } else {
+                out.append(values[segment.slot].text);
+            }
+        }
+    }
+
+    std::string Render(const SlotValues& values) const {
+        std::string out;
+        Render(values, out);
+        return out;
+    }
+
+private:
+    struct Segment {
+        std::string_view text;          // literal text, for slot == SlotCount
+        size_t           slot = SlotCount;
+    };
+
+    constexpr void AddLiteral(std::string_view text) {
+        if (count_ == MaxSegments) {
+            valid_ = false;
+            return;
+        }
+        segments_[count_].text = text;
+        segments_[count_].slot = SlotCount;
+        ++count_;
+        literalSize_ += text.size();
+    }
+
+    constexpr void AddSlot(const SlotNames& names, std::string_view name) {
+        size_t slot = 0;
+        while (slot < SlotCount && names[slot] != name) ++slot;
+        if (slot == SlotCount || count_ == MaxSegments) {
+            valid_ = false;
+            return;
+        }
+        segments_[count_].slot = slot;
+        ++count_;
+    }
+
+    Segment segments_[MaxSegments] = {};
+    size_t  count_ = 0;
+    size_t  literalSize_ = 0;
+    bool    valid_ = true;
+};
+
+} // namespace puml
@@ -0,0 +1,37 @@
+// Minimal blocking HTTP client for talking to a PlantUML server. Win32 uses
+// WinHTTP (http and https, system proxy settings); the POSIX build speaks
+// plain HTTP/1.1 only, enough for a local stand-in server. The
+// implementations live in http_client_win32.cpp / http_client_posix.cpp.
+
+#pragma once
+
+#include "core/cancellation.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace puml {
+
+struct HttpResponse {
+    int                        status = 0;
+    std::string                contentType;
+    std::vector<unsigned char> body;
+};
+
+// POSTs body to url and reads the whole response. True if any response was
+// received, whatever its status; false on connection errors, when the
+// exchange takes longer than timeoutMs, on cancellation, or when the
+// response body exceeds maxResponseBytes.
+bool HttpPost(const std::string& url,
+              const std::string& contentType,
+              std::string_view body,
+              uint32_t timeoutMs,
+              size_t maxResponseBytes,
+              HttpResponse& response,
+              std::string* error,
+              const CancellationToken* cancel = nullptr);
+
+} // namespace puml
@@ -0,0 +1,297 @@
+// POSIX implementation of the HTTP client: plain HTTP/1.1 over a socket.
+
+#include "core/http_client.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace puml {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const size_t kMaxHeaderBytes = 64 * 1024;
+const size_t kMinReadBytes = 16 * 1024;
+const int    kCancelPollMs = 50;
+
+std::string SystemError(const char* what) {
+    return std::string(what) + ": " + std::strerror(errno);
+}
+
+std::string Lower(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return text;
+}
+
+struct ParsedUrl {
+    std::string host;
+    std::string port = "80";
+    std::string path = "/";
+};
+
+bool ParseUrl(const std::string& url, ParsedUrl& parsed, std::string* error) {
+    static const std::string kScheme = "http://";
+    if (Lower(url.substr(0, kScheme.size())) != kScheme) {
+        if (error) *error = "only http:// URLs are supported on this platform: " + url;
+        return false;
+    }
+    const size_t hostStart = kScheme.size();
+    const size_t slash = url.find('/', hostStart);
+    std::string authority = url.substr(hostStart, slash == std::string::npos ? std::string::npos : slash - hostStart);
+    if (slash != std::string::npos) {
+        parsed.path = url.substr(slash);
+    }
+    const size_t colon = authority.rfind(':');
+    if (colon != std::string::npos && authority.find(']', colon) == std::string::npos) {
+        parsed.port = authority.substr(colon + 1);
+        authority.resize(colon);
+    }
+    if (authority.size() > 2 && authority.front() == '[' && authority.back() == ']') {
+        authority = authority.substr(1, authority.size() - 2);
+    }
+    parsed.host = authority;
+    if (parsed.host.empty() || parsed.port.empty()) {
+        if (error) *error = "malformed URL: " + url;
+        return false;
+    }
+    return true;
+}
+
+// Milliseconds left until deadline, at least 1 while time remains; 0 once past.
+int MsLeft(Clock::time_point deadline) {
+    const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+    if (left <= 0) return 0;
+    return left > 1000000 ? 1000000 : static_cast<int>(left);
+}
+
+// Polls in short slices so that cancellation is noticed within kCancelPollMs.
+bool WaitFor(int fd, short events, Clock::time_point deadline, const CancellationToken* cancel, std::string* error) {
+    for (;;) {
+        if (IsCancelled(cancel)) {
+            if (error) *error = "cancelled";
+            return false;
+        }
+        const int waitMs = MsLeft(deadline);
+        if (waitMs == 0) {
+            if (error) *error = "timed out";
+            return false;
+        }
+        pollfd entry{ fd, events, 0 };
+        const int ready = poll(&entry, 1, waitMs < kCancelPollMs ? waitMs : kCancelPollMs);
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready < 0) {
+            if (error) *error = SystemError("poll");
+            return false;
+        }
+        if (ready > 0) return true;
+    }
+}
+
+int Connect(const ParsedUrl& url, Clock::time_point deadline, const CancellationToken* cancel, std::string* error) {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addresses = nullptr;
+    const int rc = getaddrinfo(url.host.c_str(), url.port.c_str(), &hints, &addresses);
+    if (rc != 0) {
+        if (error) *error = "cannot resolve " + url.host + ": " + gai_strerror(rc);
+        return -1;
+    }
+    int fd = -1;
+    for (addrinfo* a = addresses; a && fd < 0 && !IsCancelled(cancel); a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd < 0) continue;
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        const int flags = fcntl(fd, F_GETFL, 0);
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+        if (connect(fd, a->ai_addr, a->ai_addrlen) != 0 && errno != EINPROGRESS) {
+            if (error) *error = SystemError(("cannot connect to " + url.host).c_str());
+            close(fd);
+            fd = -1;
+            continue;
+        }
+        int status = 0;
+        socklen_t length = sizeof(status);
+        if (!WaitFor(fd, POLLOUT, deadline, cancel, error) ||
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &status, &length) != 0 || status != 0) {
+            if (status != 0 && error) {
+                *error = "cannot connect to " + url.host + ": " + std::strerror(status);
+            }
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    return fd;
+}
+
+// Decodes a chunked body; false if it is malformed.
+bool Dechunk(const unsigned char* data, size_t size, std::vector<unsigned char>& out) {
+    size_t pos = 0;
+    for (;;) {
+        const unsigned char* lineEnd = static_cast<const unsigned char*>(std::memchr(data + pos, '\n', size - pos));
+        if (!lineEnd) return false;
+        const size_t chunk = std::strtoul(std::string(data + pos, lineEnd).c_str(), nullptr, 16);
+        pos = static_cast<size_t>(lineEnd - data) + 1;
+        if (chunk == 0) return true;
+        if (chunk > size - pos) return false;
+        out.insert(out.end(), data + pos, data + pos + chunk);
+        pos += chunk;
+        if (pos < size && data[pos] == '\r') ++pos;
+        if (pos < size && data[pos] == '\n') ++pos;
+    }
+}
+
+// A plain body is moved out of raw rather than copied.
+bool ParseResponse(std::vector<unsigned char>& raw, HttpResponse& response, std::string* error) {
+    static const char kEnd[] = "\r\n\r\n";
+    const auto headerEnd = std::search(raw.begin(), raw.end(), kEnd, kEnd + 4);
+    if (headerEnd == raw.end()) {
+        if (error) *error = "incomplete response headers";
+        return false;
+    }
+    const std::string headers(raw.begin(), headerEnd);
+    if (headers.compare(0, 5, "HTTP/") != 0) {
+        if (error) *error = "not an HTTP response";
+        return false;
+    }
+    const size_t space = headers.find(' ');
+    response.status = space == std::string::npos ? 0 : std::atoi(headers.c_str() + space + 1);
+
+    bool chunked = false;
+    long long contentLength = -1;
+    size_t lineStart = headers.find("\r\n");
+    while (lineStart != std::string::npos) {
+        lineStart += 2;
+        const size_t lineEnd = headers.find("\r\n", lineStart);
+        const std::string line = headers.substr(lineStart, lineEnd == std::string::npos ? std::string::npos : lineEnd - lineStart);
+        const size_t colon = line.find(':');
+        if (colon != std::string::npos) {
+            const std::string name = Lower(line.substr(0, colon));
+            const size_t valueStart = line.find_first_not_of(" \t", colon + 1);
+            const std::string value = valueStart == std::string::npos ? std::string() : line.substr(valueStart);
+            if (name == "content-type") response.contentType = value;
+            else if (name == "content-length") contentLength = std::atoll(value.c_str());
+            else if (name == "transfer-encoding") chunked = Lower(value).find("chunked") != std::string::npos;
+        }
+        lineStart = lineEnd;
+    }
+
+    const size_t bodyStart = static_cast<size_t>(headerEnd - raw.begin()) + 4;
+    response.body.clear();
+    if (chunked) {
+        if (!Dechunk(raw.data() + bodyStart, raw.size() - bodyStart, response.body)) {
+            if (error) *error = "malformed chunked response";
+            return false;
+        }
+        return true;
+    }
+    size_t bodySize = raw.size() - bodyStart;
+    if (contentLength >= 0) {
+        if (static_cast<unsigned long long>(contentLength) > bodySize) {
+            if (error) *error = "response shorter than its Content-Length";
+            return false;
+        }
+        bodySize = static_cast<size_t>(contentLength);
+    }
+    raw.erase(raw.begin(), raw.begin() + static_cast<std::ptrdiff_t>(bodyStart));
+    raw.resize(bodySize);
+    response.body.swap(raw);
+    return true;
+}
+
+} // namespace
+
+bool HttpPost(const std::string& url,
+              const std::string& contentType,
+              std::string_view body,
+              uint32_t timeoutMs,
+              size_t maxResponseBytes,
+              HttpResponse& response,
+              std::string* error,
+              const CancellationToken* cancel) {
+    ParsedUrl parsed;
+    if (!ParseUrl(url, parsed, error)) {
+        return false;
+    }
+    const Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+    const int fd = Connect(parsed, deadline, cancel, error);
+    if (fd < 0) {
+        return false;
+    }
+
+    std::vector<unsigned char> raw;
+    std::string request =
+        "POST " + parsed.path + " HTTP/1.1\r\n"
+        "Host: " + parsed.host + (parsed.port == "80" ? "" : ":" + parsed.port) + "\r\n"
+        "User-Agent: PlantUmlWebView\r\n"
+        "Accept: */*\r\n"
+        "Content-Type: " + contentType + "\r\n"
+        "Content-Length: " + std::to_string(body.size()) + "\r\n"
+        "Connection: close\r\n\r\n";
+    request.append(body.data(), body.size());
+    size_t sent = 0;
+    bool ok = true;
+    while (ok && sent < request.size()) {
+        ok = WaitFor(fd, POLLOUT, deadline, cancel, error);
+        if (!ok) break;
+        const ssize_t n = send(fd, request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) continue;
+        if (n <= 0) {
+            if (error) *error = SystemError("send");
+            ok = false;
+            break;
+        }
+        sent += static_cast<size_t>(n);
+    }
+
+    // Received straight into the unused tail of raw instead of a stack
+    // buffer whose bytes would then be copied over.
+    size_t received = 0;
+    while (ok) {
+        ok = WaitFor(fd, POLLIN, deadline, cancel, error);
+        if (!ok) break;
+        if (raw.size() - received < kMinReadBytes) {
+            raw.resize(std::max(raw.size() * 2, received + kMinReadBytes));
+        }
+        const ssize_t n = recv(fd, raw.data() + received, raw.size() - received, 0);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) continue;
+        if (n < 0) {
+            if (error) *error = SystemError("recv");
+            ok = false;
+            break;
+        }
+        if (n == 0) break;
+        received += static_cast<size_t>(n);
+        if (received > maxResponseBytes + kMaxHeaderBytes) {
+            if (error) *error = "response larger than " + std::to_string(maxResponseBytes) + " bytes";
+            ok = false;
+            break;
+        }
+    }
+    raw.resize(received);
+    close(fd);
+    if (IsCancelled(cancel)) {
+        if (error) *error = "cancelled";
+        return false;
+    }
+    return ok && ParseResponse(raw, response, error);
+}
+
+} // namespace puml
@@ -0,0 +1,186 @@
+// Win32 implementation of the HTTP client (WinHTTP, synchronous).
+
+#include "core/http_client.h"
+
+#include <windows.h>
+#include <winhttp.h>
+
+#include <chrono>
+#include <mutex>
+
+namespace puml {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+std::wstring WidenUtf8(const std::string& s) {
+    if (s.empty()) return std::wstring();
+    int n = ::MultiByteToWideChar(CP_UTF8, 0, s.data(), (int)s.size(), nullptr, 0);
+    std::wstring w(n > 0 ? n : 0, L'\0');
+    if (n > 0) ::MultiByteToWideChar(CP_UTF8, 0, s.data(), (int)s.size(), w.data(), n);
+    return w;
+}
+
+std::string NarrowUtf8(const std::wstring& w) {
+    if (w.empty()) return std::string();
+    int n = ::WideCharToMultiByte(CP_UTF8, 0, w.data(), (int)w.size(), nullptr, 0, nullptr, nullptr);
+    std::string s(n > 0 ? n : 0, '\0');
+    if (n > 0) ::WideCharToMultiByte(CP_UTF8, 0, w.data(), (int)w.size(), s.data(), n, nullptr, nullptr);
+    return s;
+}
+
+std::string LastError(const char* what) {
+    const DWORD code = GetLastError();
+    if (code == ERROR_WINHTTP_TIMEOUT) {
+        return std::string(what) + ": timed out";
+    }
+    return std::string(what) + " (error=" + std::to_string(code) + ")";
+}
+
+// One session per process, so WinHTTP keeps connections (and TLS sessions)
+// to the server alive between renders. Intentionally never closed.
+HINTERNET Session() {
+    static HINTERNET session = WinHttpOpen(L"PlantUmlWebView", WINHTTP_ACCESS_TYPE_AUTOMATIC_PROXY,
+                                           WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS, 0);
+    return session;
+}
+
+// Closing the handles from another thread is how a synchronous WinHTTP call
+// is aborted; the lock keeps the cancellation callback and the final
+// cleanup from closing them twice.
+struct RequestHandles {
+    std::mutex mutex;
+    HINTERNET  connection = nullptr;
+    HINTERNET  request = nullptr;
+
+    ~RequestHandles() { Close(); }
+
+    void Close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (request) WinHttpCloseHandle(request);
+        if (connection) WinHttpCloseHandle(connection);
+        request = nullptr;
+        connection = nullptr;
+    }
+};
+
+} // namespace
+
+bool HttpPost(const std::string& url,
+              const std::string& contentType,
+              std::string_view body,
+              uint32_t timeoutMs,
+              size_t maxResponseBytes,
+              HttpResponse& response,
+              std::string* error,
+              const CancellationToken* cancel) {
+    const std::wstring wideUrl = WidenUtf8(url);
+    URL_COMPONENTS parts{};
+    parts.dwStructSize = sizeof(parts);
+    parts.dwHostNameLength = static_cast<DWORD>(-1);
+    parts.dwUrlPathLength = static_cast<DWORD>(-1);
+    parts.dwExtraInfoLength = static_cast<DWORD>(-1);
+    if (!WinHttpCrackUrl(wideUrl.c_str(), 0, 0, &parts) ||
+        (parts.nScheme != INTERNET_SCHEME_HTTP && parts.nScheme != INTERNET_SCHEME_HTTPS)) {
+        if (error) *error = "malformed URL: " + url;
+        return false;
+    }
+    const std::wstring host(parts.lpszHostName, parts.dwHostNameLength);
+    std::wstring path(parts.lpszUrlPath, parts.dwUrlPathLength);
+    path.append(parts.lpszExtraInfo, parts.dwExtraInfoLength);
+    if (path.empty()) path = L"/";
+
+    HINTERNET session = Session();
+    if (!session) {
+        if (error) *error = LastError("WinHttpOpen");
+        return false;
+    }
+    const Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+
+    RequestHandles handles;
+    handles.connection = WinHttpConnect(session, host.c_str(), parts.nPort, 0);
+    if (!handles.connection) {
+        if (error) *error = LastError("WinHttpConnect");
+        return false;
+    }
+    handles.request = WinHttpOpenRequest(handles.connection, L"POST", path.c_str(), nullptr, WINHTTP_NO_REFERER,
+                                         WINHTTP_DEFAULT_ACCEPT_TYPES,
+                                         parts.nScheme == INTERNET_SCHEME_HTTPS ? WINHTTP_FLAG_SECURE : 0);
+    if (!handles.request) {
+        if (error) *error = LastError("WinHttpOpenRequest");
+        return false;
+    }
+    const HINTERNET request = handles.request;
+    const int stepMs = static_cast<int>(timeoutMs);
+    WinHttpSetTimeouts(request, stepMs, stepMs, stepMs, stepMs);
+
+    // Declared after handles so it unregisters before they are destroyed.
+    CancellationRegistration onCancel(cancel, [&handles]() { handles.Close(); });
+    auto failed = [&](const char* what) {
+        if (error) *error = IsCancelled(cancel) ? std::string("cancelled") : LastError(what);
+        return false;
+    };
+
+    const std::wstring headers = L"Content-Type: " + WidenUtf8(contentType) + L"\r\n";
+    if (!WinHttpSendRequest(request, headers.c_str(), static_cast<DWORD>(-1),
+                            const_cast<char*>(body.data()), static_cast<DWORD>(body.size()),
+                            static_cast<DWORD>(body.size()), 0)) {
+        return failed("WinHttpSendRequest");
+    }
+    if (!WinHttpReceiveResponse(request, nullptr)) {
+        return failed("WinHttpReceiveResponse");
+    }
+
+    DWORD status = 0;
+    DWORD size = sizeof(status);
+    if (!WinHttpQueryHeaders(request, WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER,
+                             WINHTTP_HEADER_NAME_BY_INDEX, &status, &size, WINHTTP_NO_HEADER_INDEX)) {
+        return failed("WinHttpQueryHeaders");
+    }
+    response.status = static_cast<int>(status);
+    size = 0;
+    WinHttpQueryHeaders(request, WINHTTP_QUERY_CONTENT_TYPE, WINHTTP_HEADER_NAME_BY_INDEX,
+                        WINHTTP_NO_OUTPUT_BUFFER, &size, WINHTTP_NO_HEADER_INDEX);
+    if (GetLastError() == ERROR_INSUFFICIENT_BUFFER && size > 0) {
+        std::wstring type(size / sizeof(wchar_t), L'\0');
+        if (WinHttpQueryHeaders(request, WINHTTP_QUERY_CONTENT_TYPE, WINHTTP_HEADER_NAME_BY_INDEX,
+                                &type[0], &size, WINHTTP_NO_HEADER_INDEX)) {
+            type.resize(size / sizeof(wchar_t));
+            response.contentType = NarrowUtf8(type);
+        }
+    }
+
+    response.body.clear();
+    for (;;) {
+        if (Clock::now() >= deadline) {
+            if (error) *error = "timed out";
+            return false;
+        }
+        DWORD available = 0;
+        if (!WinHttpQueryDataAvailable(request, &available)) {
+            return failed("WinHttpQueryDataAvailable");
+        }
+        if (available == 0) {
+            break;
+        }
+        const size_t used = response.body.size();
+        if (used + available > maxResponseBytes) {
+            if (error) *error = "response larger than " + std::to_string(maxResponseBytes) + " bytes";
+            return false;
+        }
+        response.body.resize(used + available);
+        DWORD read = 0;
+        if (!WinHttpReadData(request, response.body.data() + used, available, &read)) {
+            return failed("WinHttpReadData");
+        }
+        response.body.resize(used + read);
+    }
+    if (IsCancelled(cancel)) {
+        if (error) *error = "cancelled";
+        return false;
+    }
+    return true;
+}
+
+} // namespace puml
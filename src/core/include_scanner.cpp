@@ -0,0 +1,311 @@
+#include "core/include_scanner.h"
+
+#include "core/content_hash.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+namespace puml {
+
+namespace {
+
+// Included files larger than this are hashed but not scanned.
+constexpr unsigned long long kMaxScannedBytes = 8ull * 1024 * 1024;
+// Remembered files; the table is simply dropped when it grows beyond this.
+constexpr size_t kMaxEntries = 4096;
+
+bool IsSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+bool IsUrl(const std::string& path) {
+    return path.find("://") != std::string::npos;
+}
+
+// Paths built from variables or builtin functions need the preprocessor.
+bool NeedsPreprocessor(const std::string& path) {
+    return path.find('$') != std::string::npos || path.find('%') != std::string::npos;
+}
+
+// Trims [begin, end) and strips one pair of surrounding double quotes.
+void TrimArgument(const char*& begin, const char*& end) {
+    while (begin < end && IsSpace(*begin)) ++begin;
+    while (end > begin && IsSpace(end[-1])) --end;
+    if (end - begin >= 2 && *begin == '"' && end[-1] == '"') {
+        ++begin;
+        --end;
+    }
+}
+
+bool ParseDirective(const char* word, size_t length, ReferenceKind& kind) {
+    auto is = [&](const char* name) { return std::strlen(name) == length && std::memcmp(word, name, length) == 0; };
+    if (is("include") || is("include_many") || is("include_once")) {
+        kind = ReferenceKind::Include;
+    } else if (is("includesub")) {
+        kind = ReferenceKind::IncludeSub;
+    } else if (is("import")) {
+        kind = ReferenceKind::Import;
+    } else if (is("theme")) {
+        kind = ReferenceKind::Theme;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Dependencies that are PlantUML text and may reference further files.
+bool ScansText(ReferenceKind kind) {
+    return kind == ReferenceKind::Include || kind == ReferenceKind::IncludeSub || kind == ReferenceKind::Theme;
+}
+
+void ScanDirective(const char* base, const char* t, const char* eol, size_t line,
+                   std::vector<SourceReference>& out) {
+    const char* word = t + 1;
+    const char* wordEnd = word;
+    while (wordEnd < eol && ((*wordEnd >= 'a' && *wordEnd <= 'z') || *wordEnd == '_')) ++wordEnd;
+    ReferenceKind kind;
+    if (wordEnd == eol || !IsSpace(*wordEnd) || !ParseDirective(word, static_cast<size_t>(wordEnd - word), kind)) {
+        return;
+    }
+
+    const char* begin = wordEnd;
+    const char* end = eol;
+    TrimArgument(begin, end);
+    SourceReference ref;
+    ref.kind = kind;
+    ref.line = line;
+    if (kind == ReferenceKind::Theme) {
+        // "!theme name from directory"; a theme without "from" is built in.
+        const char* nameEnd = begin;
+        while (nameEnd < end && !IsSpace(*nameEnd)) ++nameEnd;
+        const char* from = nameEnd;
+        while (from < end && IsSpace(*from)) ++from;
+        if (end - from < 5 || std::memcmp(from, "from", 4) != 0 || !IsSpace(from[4])) {
+            return;
+        }
+        const std::string name(begin, nameEnd);
+        begin = from + 4;
+        TrimArgument(begin, end);
+        const std::string directory(begin, end);
+        if (directory.empty() || IsUrl(directory) || NeedsPreprocessor(directory) || NeedsPreprocessor(name)) {
+            return;
+        }
+        ref.path = directory + "/puml-theme-" + name + ".puml";
+    } else {
+        if (begin == end || *begin == '<') {
+            return;   // <stdlib/...> lives in the jar
+        }
+        if (kind != ReferenceKind::Import) {
+            // "file!1" or "file!NAME" selects a part of the file.
+            const char* part = std::find(begin + 1, end, '!');
+            end = part;
+        }
+        ref.path.assign(begin, end);
+        if (ref.path.empty() || IsUrl(ref.path) || NeedsPreprocessor(ref.path)) {
+            return;
+        }
+    }
+    ref.offset = static_cast<size_t>(begin - base);
+    ref.length = static_cast<size_t>(end - begin);
+    out.push_back(std::move(ref));
+}
+
+void ScanImages(const char* base, const char* p, const char* eol, size_t line, std::vector<SourceReference>& out) {
+    static const char kImg[] = "<img:";
+    for (;;) {
+        p = std::search(p, eol, kImg, kImg + sizeof(kImg) - 1);
+        if (p == eol) return;
+        const char* begin = p + sizeof(kImg) - 1;
+        const char* end = begin;
+        while (end < eol && *end != '>' && *end != '{') ++end;
+        p = end;
+        TrimArgument(begin, end);
+        SourceReference ref;
+        ref.kind = ReferenceKind::Image;
+        ref.path.assign(begin, end);
+        if (ref.path.empty() || IsUrl(ref.path) || NeedsPreprocessor(ref.path)) {
+            continue;
+        }
+        ref.offset = static_cast<size_t>(begin - base);
+        ref.length = static_cast<size_t>(end - begin);
+        ref.line = line;
+        out.push_back(std::move(ref));
+    }
+}
+
+std::string Resolve(const std::string& directoryUtf8, const std::string& pathUtf8) {
+    return (fs::u8path(directoryUtf8) / fs::u8path(pathUtf8)).lexically_normal().u8string();
+}
+
+bool IsAbsolute(const std::string& pathUtf8) {
+    const fs::path path = fs::u8path(pathUtf8);
+    return path.is_absolute() || path.has_root_directory();
+}
+
+} // namespace
+
+std::vector<SourceReference> ScanSourceReferences(std::string_view utf8Source) {
+    std::vector<SourceReference> refs;
+    const char* base = utf8Source.data();
+    const char* end = base + utf8Source.size();
+    size_t line = 1;
+    for (const char* p = base; p < end; ++line) {
+        const char* eol = std::find(p, end, '\n');
+        const char* t = p;
+        while (t < eol && (*t == ' ' || *t == '\t')) ++t;
+        if (t < eol && *t == '!') {
+            ScanDirective(base, t, eol, line, refs);
+        } else if (t < eol && *t != '\'') {
+            ScanImages(base, t, eol, line, refs);
+        }
+        p = (eol == end) ? end : eol + 1;
+    }
+    return refs;
+}
+
+DependencyScanner::Entry DependencyScanner::Load(const std::string& path, bool scanReferences) {
+    const fs::path fsPath = fs::u8path(path);
+    std::error_code ec;
+    Entry fresh;
+    const fs::file_status status = fs::status(fsPath, ec);
+    const bool isFile = !ec && fs::is_regular_file(status);
+    // Directories (!import of a folder) only count by their existence.
+    fresh.exists = isFile || (!ec && fs::is_directory(status));
+    if (isFile) {
+        fresh.size = fs::file_size(fsPath, ec);
+        fresh.modified = static_cast<long long>(fs::last_write_time(fsPath, ec).time_since_epoch().count());
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(path);
+        if (it != entries_.end() && it->second.exists == fresh.exists && it->second.size == fresh.size &&
+            it->second.modified == fresh.modified && (it->second.scanned || !scanReferences)) {
+            return it->second;
+        }
+    }
+
+    if (isFile) {
+        std::ifstream in(fsPath, std::ios::binary);
+        if (scanReferences && fresh.size <= kMaxScannedBytes) {
+            std::string text(static_cast<size_t>(fresh.size), '\0');
+            if (in && (text.empty() || in.read(&text[0], static_cast<std::streamsize>(text.size())))) {
+                fresh.contentHash = Hash64(text.data(), text.size());
+                fresh.references = ScanSourceReferences(text);
+                fresh.scanned = true;
+            }
+        } else {
+            Hasher64 hasher;
+            char buffer[64 * 1024];
+            while (in.read(buffer, sizeof(buffer)) || in.gcount() > 0) {
+                hasher.Update(buffer, static_cast<size_t>(in.gcount()));
+            }
+            fresh.contentHash = hasher.Digest();
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (entries_.size() >= kMaxEntries) {
+        entries_.clear();
+    }
+    entries_[path] = fresh;
+    return fresh;
+}
+
+DependencyGraph DependencyScanner::Scan(std::string_view utf8Source, const std::string& baseDirectoryUtf8) {
+    DependencyGraph graph;
+    std::unordered_map<std::string, size_t> index;
+    std::vector<std::vector<SourceReference>> references;
+
+    // Returns the file's index, or SIZE_MAX once the graph is full.
+    auto add = [&](const SourceReference& ref, const std::string& directory) -> size_t {
+        const std::string path = Resolve(directory, ref.path);
+        auto found = index.find(path);
+        if (found != index.end()) {
+            return found->second;
+        }
+        if (graph.files.size() >= kMaxFiles) {
+            graph.truncated = true;
+            return SIZE_MAX;
+        }
+        Entry entry = Load(path, ScansText(ref.kind));
+        DependencyFile file;
+        file.path = path;
+        file.exists = entry.exists;
+        file.contentHash = entry.contentHash;
+        graph.files.push_back(std::move(file));
+        references.push_back(ScansText(ref.kind) ? std::move(entry.references) : std::vector<SourceReference>());
+        index.emplace(path, graph.files.size() - 1);
+        return graph.files.size() - 1;
+    };
+    auto link = [](std::vector<size_t>& edges, size_t target) {
+        if (target != SIZE_MAX && std::find(edges.begin(), edges.end(), target) == edges.end()) {
+            edges.push_back(target);
+        }
+    };
+
+    for (const SourceReference& ref : ScanSourceReferences(utf8Source)) {
+        link(graph.roots, add(ref, baseDirectoryUtf8));
+    }
+    // Breadth first; files appended while walking are visited too.
+    for (size_t i = 0; i < graph.files.size(); ++i) {
+        const std::string directory = ParentDirectory(graph.files[i].path);
+        const std::vector<SourceReference> refs = std::move(references[i]);
+        for (const SourceReference& ref : refs) {
+            const size_t target = add(ref, directory);
+            link(graph.files[i].dependencies, target);
+        }
+    }
+
+    if (!graph.files.empty()) {
+        Hasher64 hasher;
+        for (const DependencyFile& file : graph.files) {
+            const uint64_t length = file.path.size();
+            const unsigned char exists = file.exists ? 1 : 0;
+            hasher.Update(&length, sizeof(length));
+            hasher.Update(file.path);
+            hasher.Update(&exists, sizeof(exists));
+            hasher.Update(&file.contentHash, sizeof(file.contentHash));
+        }
+        graph.combinedHash = hasher.Digest();
+        if (graph.combinedHash == 0) graph.combinedHash = 1;
+    }
+    return graph;
+}
+
+std::string ParentDirectory(const std::string& pathUtf8) {
+    const size_t slash = pathUtf8.find_last_of("/\\");
+    return slash == std::string::npos ? std::string() : pathUtf8.substr(0, slash + 1);
+}
+
+bool AbsolutizeReferences(std::string_view utf8Source, const std::string& baseDirectoryUtf8, std::string& out) {
+    if (baseDirectoryUtf8.empty()) {
+        return false;
+    }
+    std::string rewritten;
+    size_t copied = 0;
+    for (const SourceReference& ref : ScanSourceReferences(utf8Source)) {
+        const std::string written(utf8Source.substr(ref.offset, ref.length));
+        if (IsAbsolute(written)) {
+            continue;
+        }
+        if (copied == 0) {
+            rewritten.reserve(utf8Source.size() + 256);
+        }
+        rewritten.append(utf8Source.substr(copied, ref.offset - copied));
+        // Forward slashes work for the JVM on every platform.
+        rewritten += (fs::u8path(baseDirectoryUtf8) / fs::u8path(written)).lexically_normal().generic_u8string();
+        copied = ref.offset + ref.length;
+    }
+    if (copied == 0) {
+        return false;
+    }
+    rewritten.append(utf8Source.substr(copied));
+    out = std::move(rewritten);
+    return true;
+}
+
+} // namespace puml
@@ -0,0 +1,90 @@
+// Native scanner for the PlantUML preprocessor directives and image
+// references that pull local files into a diagram (!include, !includesub,
+// !import, !theme ... from, <img:...>), and the dependency graph built from
+// them, so caches and watchers can account for shared files.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace puml {
+
+enum class ReferenceKind {
+    Include,      // !include, !include_many, !include_once
+    IncludeSub,   // !includesub
+    Import,       // !import (archive or directory)
+    Theme,        // !theme name from <directory>
+    Image,        // <img:...>
+};
+
+struct SourceReference {
+    ReferenceKind kind = ReferenceKind::Include;
+    std::string   path;          // file named by the reference, as written
+    size_t        offset = 0;    // span of the path (the directory for !theme)
+    size_t        length = 0;    //   in the scanned source
+    size_t        line = 1;      // 1-based
+};
+
+// References to local files, in source order. URLs, <stdlib> includes,
+// built-in themes and paths built from preprocessor variables are skipped:
+// they cannot be resolved without running the preprocessor.
+std::vector<SourceReference> ScanSourceReferences(std::string_view utf8Source);
+
+struct DependencyFile {
+    std::string         path;            // lexically normalized, UTF-8
+    bool                exists = false;
+    uint64_t            contentHash = 0;
+    std::vector<size_t> dependencies;    // indexes of the files this one references
+};
+
+struct DependencyGraph {
+    // Every local file reachable from the source, in the order first
+    // reached. Included text files are scanned recursively, relative to
+    // their own directory, like PlantUML resolves them.
+    std::vector<DependencyFile> files;
+    std::vector<size_t>         roots;          // files the source references directly
+    uint64_t                    combinedHash = 0;   // 0 when there are no dependencies
+    bool                        truncated = false;  // more than kMaxFiles files
+};
+
+// Scans sources and their dependencies. Content hashes and references of
+// dependency files are remembered per path and reused while the file's
+// size and modification time are unchanged. Thread-safe.
+class DependencyScanner {
+public:
+    static constexpr size_t kMaxFiles = 256;
+
+    DependencyGraph Scan(std::string_view utf8Source, const std::string& baseDirectoryUtf8);
+
+private:
+    struct Entry {
+        long long                    modified = 0;
+        unsigned long long           size = 0;
+        bool                         exists = false;
+        bool                         scanned = false;   // references were collected
+        uint64_t                     contentHash = 0;
+        std::vector<SourceReference> references;
+    };
+
+    Entry Load(const std::string& path, bool scanReferences);
+
+    std::mutex                             mutex_;
+    std::unordered_map<std::string, Entry> entries_;
+};
+
+// Directory of a file path (with its trailing separator), UTF-8.
+std::string ParentDirectory(const std::string& pathUtf8);
+
+// Copies utf8Source to out with every relative reference rewritten to an
+// absolute path under baseDirectoryUtf8, for renderers that do not run in
+// that directory. False, leaving out alone, if nothing needs rewriting and
+// the source can be used as it is.
+bool AbsolutizeReferences(std::string_view utf8Source, const std::string& baseDirectoryUtf8, std::string& out);
+
+} // namespace puml
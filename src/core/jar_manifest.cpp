@@ -0,0 +1,404 @@
+#include "core/jar_manifest.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+namespace puml {
+
+namespace {
+
+constexpr uint32_t kEndOfCentralDirectory = 0x06054b50;
+constexpr uint32_t kCentralDirectoryEntry = 0x02014b50;
+constexpr uint32_t kLocalFileHeader = 0x04034b50;
+constexpr size_t   kMaxManifestSize = 1024 * 1024;
+constexpr size_t   kMaxCentralDirectory = 64 * 1024 * 1024;
+
+uint16_t ReadLe16(const unsigned char* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+uint32_t ReadLe32(const unsigned char* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+bool ReadAt(std::ifstream& in, uint64_t offset, size_t size, std::vector<unsigned char>& out) {
+    out.resize(size);
+    in.clear();
+    in.seekg(static_cast<std::streamoff>(offset));
+    return in.read(reinterpret_cast<char*>(out.data()), static_cast<std::streamsize>(size)).good();
+}
+
+bool EqualsIgnoreCase(const char* a, size_t size, const std::string& b) {
+    if (size != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < size; ++i) {
+        char x = a[i], y = b[i];
+        if (x >= 'A' && x <= 'Z') x = static_cast<char>(x - 'A' + 'a');
+        if (y >= 'A' && y <= 'Z') y = static_cast<char>(y - 'A' + 'a');
+        if (x != y) return false;
+    }
+    return true;
+}
+
+// Canonical Huffman decoding as in zlib's puff.c: slow per bit, but a
+// manifest is a few hundred bytes.
+class Inflater {
+public:
+    Inflater(const unsigned char* data, size_t size, size_t maxOutput, std::vector<unsigned char>& out)
+        : data_(data), size_(size), maxOutput_(maxOutput), out_(out) {}
+
+    bool Run() {
+        int last = 0;
+        do {
+            last = Bits(1);
+            const int type = Bits(2);
+            bool ok = false;
+            if (type == 0) ok = Stored();
+            else if (type == 1) ok = Fixed();
+            else if (type == 2) ok = Dynamic();
+            if (!ok || overrun_) {
+                return false;
+            }
+        } while (!last);
+        return true;
+    }
+
+private:
+    static constexpr int kMaxBits = 15;
+
+    struct Huffman {
+        uint16_t counts[kMaxBits + 1] = {};
+        uint16_t symbols[288] = {};
+    };
+
+    int Bits(int n) {
+        while (bitCount_ < n) {
+            if (pos_ >= size_) {
+                overrun_ = true;
+                return 0;
+            }
+            bitBuffer_ |= static_cast<uint32_t>(data_[pos_++]) << bitCount_;
+            bitCount_ += 8;
+        }
+        const int value = static_cast<int>(bitBuffer_ & ((1u << n) - 1));
+        bitBuffer_ >>= n;
+        bitCount_ -= n;
+        return value;
+    }
+
+    bool Emit(unsigned char byte) {
+        if (out_.size() >= maxOutput_) {
+            return false;
+        }
+        out_.push_back(byte);
+        return true;
+    }
+
+    // False for an over-subscribed code; incomplete codes are allowed.
+    static bool Build(Huffman& h, const uint8_t* lengths, int n) {
+        std::memset(h.counts, 0, sizeof(h.counts));
+        for (int symbol = 0; symbol < n; ++symbol) {
+            ++h.counts[lengths[symbol]];
+        }
+        int left = 1;
+        for (int length = 1; length <= kMaxBits; ++length) {
+            left = (left << 1) - h.counts[length];
+            if (left < 0) {
+                return false;
+            }
+        }
+        uint16_t offsets[kMaxBits + 1] = {};
+        for (int length = 1; length < kMaxBits; ++length) {
+            offsets[length + 1] = static_cast<uint16_t>(offsets[length] + h.counts[length]);
+        }
+        for (int symbol = 0; symbol < n; ++symbol) {
+            if (lengths[symbol] != 0) {
+                h.symbols[offsets[lengths[symbol]]++] = static_cast<uint16_t>(symbol);
+            }
+        }
+        return true;
+    }
+
+    int Decode(const Huffman& h) {
+        int code = 0, first = 0, index = 0;
+        for (int length = 1; length <= kMaxBits; ++length) {
+            code |= Bits(1);
+            const int count = h.counts[length];
+            if (code - count < first) {
+                return h.symbols[index + (code - first)];
+            }
+            index += count;
+            first = (first + count) << 1;
+            code <<= 1;
+            if (overrun_) break;
+        }
+        return -1;
+    }
+
+    bool Stored() {
+        bitBuffer_ = 0;
+        bitCount_ = 0;
+        if (pos_ + 4 > size_) {
+            return false;
+        }
+        const uint16_t length = ReadLe16(data_ + pos_);
+        const uint16_t complement = ReadLe16(data_ + pos_ + 2);
+        pos_ += 4;
+        if (length != static_cast<uint16_t>(~complement) || pos_ + length > size_) {
+            return false;
+        }
+        for (size_t i = 0; i < length; ++i) {
+            if (!Emit(data_[pos_ + i])) return false;
+        }
+        pos_ += length;
+        return true;
+    }
+
+    bool Codes(const Huffman& literals, const Huffman& distances) {
+        static const uint16_t kLengthBase[29] = {
+            3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+            35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+        static const uint8_t kLengthExtra[29] = {
+            0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+            3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+        static const uint16_t kDistanceBase[30] = {
+            1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+            257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+        static const uint8_t kDistanceExtra[30] = {
+            0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+            7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+        for (;;) {
+            int symbol = Decode(literals);
+            if (symbol < 0 || overrun_) {
+                return false;
+            }
+            if (symbol < 256) {
+                if (!Emit(static_cast<unsigned char>(symbol))) return false;
+                continue;
+            }
+            if (symbol == 256) {
+                return true;
+            }
+            symbol -= 257;
+            if (symbol >= 29) {
+                return false;
+            }
+            const size_t length = kLengthBase[symbol] + static_cast<size_t>(Bits(kLengthExtra[symbol]));
+            const int distanceSymbol = Decode(distances);
+            if (distanceSymbol < 0 || distanceSymbol >= 30) {
+                return false;
+            }
+            const size_t distance = kDistanceBase[distanceSymbol] +
+                                    static_cast<size_t>(Bits(kDistanceExtra[distanceSymbol]));
+            if (overrun_ || distance > out_.size()) {
+                return false;
+            }
+            for (size_t i = 0; i < length; ++i) {
+                if (!Emit(out_[out_.size() - distance])) return false;
+            }
+        }
+    }
+
+    bool Fixed() {
+        uint8_t lengths[288];
+        int symbol = 0;
+        for (; symbol < 144; ++symbol) lengths[symbol] = 8;
+        for (; symbol < 256; ++symbol) lengths[symbol] = 9;
+        for (; symbol < 280; ++symbol) lengths[symbol] = 7;
+        for (; symbol < 288; ++symbol) lengths[symbol] = 8;
+        Huffman literals, distances;
+        Build(literals, lengths, 288);
+        std::memset(lengths, 5, 30);
+        Build(distances, lengths, 30);
+        return Codes(literals, distances);
+    }
+
+    bool Dynamic() {
+        static const uint8_t kOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+        const int literalCount = Bits(5) + 257;
+        const int distanceCount = Bits(5) + 1;
+        const int codeCount = Bits(4) + 4;
+        if (literalCount > 286 || distanceCount > 30) {
+            return false;
+        }
+
+        uint8_t lengths[286 + 30] = {};
+        for (int i = 0; i < codeCount; ++i) {
+            lengths[kOrder[i]] = static_cast<uint8_t>(Bits(3));
+        }
+        Huffman lengthCode;
+        if (!Build(lengthCode, lengths, 19)) {
+            return false;
+        }
+
+        int index = 0;
+        while (index < literalCount + distanceCount) {
+            const int symbol = Decode(lengthCode);
+            if (symbol < 0 || overrun_) {
+                return false;
+            }
+            if (symbol < 16) {
+                lengths[index++] = static_cast<uint8_t>(symbol);
+                continue;
+            }
+            uint8_t value = 0;
+            int repeat = 0;
+            if (symbol == 16) {
+                if (index == 0) return false;
+                value = lengths[index - 1];
+                repeat = 3 + Bits(2);
+            } else if (symbol == 17) {
+                repeat = 3 + Bits(3);
+            } else {
+                repeat = 11 + Bits(7);
+            }
+            if (index + repeat > literalCount + distanceCount) {
+                return false;
+            }
+            while (repeat-- > 0) lengths[index++] = value;
+        }
+        if (lengths[256] == 0) {
+            return false;
+        }
+
+        Huffman literals, distances;
+        if (!Build(literals, lengths, literalCount) || !Build(distances, lengths + literalCount, distanceCount)) {
+            return false;
+        }
+        return Codes(literals, distances);
+    }
+
+    const unsigned char* data_;
+    size_t               size_;
+    size_t               pos_ = 0;
+    uint32_t             bitBuffer_ = 0;
+    int                  bitCount_ = 0;
+    bool                 overrun_ = false;
+    size_t               maxOutput_;
+    std::vector<unsigned char>& out_;
+};
+
+} // namespace
+
+bool InflateRaw(const unsigned char* data, size_t size, size_t maxOutput, std::vector<unsigned char>& out) {
+    out.clear();
+    return Inflater(data, size, maxOutput, out).Run();
+}
+
+bool ReadJarManifest(const std::string& jarPathUtf8, std::string& manifest, std::string* error) {
+    std::ifstream in(fs::u8path(jarPathUtf8), std::ios::binary);
+    if (!in) {
+        if (error) *error = "cannot open " + jarPathUtf8;
+        return false;
+    }
+    in.seekg(0, std::ios::end);
+    const uint64_t fileSize = static_cast<uint64_t>(in.tellg());
+
+    // The end record sits in the last 22 bytes plus a comment of up to 64 KB.
+    const size_t tailSize = static_cast<size_t>(std::min<uint64_t>(fileSize, 22 + 0xffff));
+    std::vector<unsigned char> tail;
+    if (tailSize < 22 || !ReadAt(in, fileSize - tailSize, tailSize, tail)) {
+        if (error) *error = "not a zip archive";
+        return false;
+    }
+    size_t end = tailSize - 22 + 1;
+    while (end-- > 0 && ReadLe32(tail.data() + end) != kEndOfCentralDirectory) {
+    }
+    if (end == static_cast<size_t>(-1)) {
+        if (error) *error = "not a zip archive";
+        return false;
+    }
+    const uint32_t directorySize = ReadLe32(tail.data() + end + 12);
+    const uint32_t directoryOffset = ReadLe32(tail.data() + end + 16);
+    std::vector<unsigned char> directory;
+    if (directorySize > kMaxCentralDirectory || directoryOffset == 0xffffffffu ||
+        static_cast<uint64_t>(directoryOffset) + directorySize > fileSize ||
+        !ReadAt(in, directoryOffset, directorySize, directory)) {
+        if (error) *error = "unsupported or damaged zip directory";
+        return false;
+    }
+
+    static const std::string kManifestName = "META-INF/MANIFEST.MF";
+    for (size_t pos = 0; pos + 46 <= directory.size();) {
+        const unsigned char* entry = directory.data() + pos;
+        if (ReadLe32(entry) != kCentralDirectoryEntry) {
+            break;
+        }
+        const uint16_t method = ReadLe16(entry + 10);
+        const uint32_t compressedSize = ReadLe32(entry + 20);
+        const uint32_t size = ReadLe32(entry + 24);
+        const uint16_t nameLength = ReadLe16(entry + 28);
+        const size_t next = pos + 46 + nameLength + ReadLe16(entry + 30) + ReadLe16(entry + 32);
+        if (pos + 46 + nameLength > directory.size() ||
+            !EqualsIgnoreCase(reinterpret_cast<const char*>(entry + 46), nameLength, kManifestName)) {
+            pos = next;
+            continue;
+        }
+
+        const uint32_t localOffset = ReadLe32(entry + 42);
+        std::vector<unsigned char> local;
+        if (compressedSize > kMaxManifestSize || size > kMaxManifestSize ||
+            !ReadAt(in, localOffset, 30, local) || ReadLe32(local.data()) != kLocalFileHeader) {
+            if (error) *error = "damaged manifest entry";
+            return false;
+        }
+        std::vector<unsigned char> stored;
+        if (!ReadAt(in, static_cast<uint64_t>(localOffset) + 30 + ReadLe16(local.data() + 26) +
+                        ReadLe16(local.data() + 28), compressedSize, stored)) {
+            if (error) *error = "damaged manifest entry";
+            return false;
+        }
+        std::vector<unsigned char> content;
+        if (method == 0) {
+            content.swap(stored);
+        } else if (method != 8 || !InflateRaw(stored.data(), stored.size(), kMaxManifestSize, content)) {
+            if (error) *error = "cannot unpack the manifest (method " + std::to_string(method) + ")";
+            return false;
+        }
+        manifest.assign(content.begin(), content.end());
+        return true;
+    }
+    if (error) *error = "the jar has no manifest";
+    return false;
+}
+
+std::string JarManifestAttribute(const std::string& manifest, const std::string& name) {
+    std::string value;
+    bool matched = false;
+    size_t pos = 0;
+    while (pos < manifest.size()) {
+        size_t lineEnd = manifest.find_first_of("\r\n", pos);
+        if (lineEnd == std::string::npos) lineEnd = manifest.size();
+        const std::string line = manifest.substr(pos, lineEnd - pos);
+        pos = lineEnd;
+        if (pos < manifest.size() && manifest[pos] == '\r') ++pos;
+        if (pos < manifest.size() && manifest[pos] == '\n') ++pos;
+
+        if (line.empty()) {
+            break;   // end of the main section
+        }
+        if (line[0] == ' ') {
+            if (matched) value += line.substr(1);
+            continue;
+        }
+        if (matched) {
+            break;
+        }
+        const size_t colon = line.find(": ");
+        if (colon != std::string::npos && EqualsIgnoreCase(line.data(), colon, name)) {
+            matched = true;
+            value = line.substr(colon + 2);
+        }
+    }
+    return value;
+}
+
+} // namespace puml
@@ -0,0 +1,24 @@
+// Reads META-INF/MANIFEST.MF out of a jar without starting a JVM: just
+// enough of the zip format (central directory, stored and deflated entries)
+// to unpack one small text entry.
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace puml {
+
+// False if the file is no zip archive or has no manifest.
+bool ReadJarManifest(const std::string& jarPathUtf8, std::string& manifest, std::string* error);
+
+// Value of an attribute of the manifest's main section, continuation lines
+// joined; empty if it is absent. Attribute names are case-insensitive.
+std::string JarManifestAttribute(const std::string& manifest, const std::string& name);
+
+// Inflates a raw deflate stream (RFC 1951). False on corrupt input or when
+// the output would exceed maxOutput bytes.
+bool InflateRaw(const unsigned char* data, size_t size, size_t maxOutput, std::vector<unsigned char>& out);
+
+} // namespace puml
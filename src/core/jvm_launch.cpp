@@ -0,0 +1,317 @@
+#include "core/jvm_launch.h"
+
+#include "core/content_hash.h"
+#include "core/core_log.h"
+#include "core/process_pump.h"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+namespace puml {
+
+namespace {
+
+// Touches the diagram types and both output paths most files use, so their
+// classes end up in the archive. Classes it misses are loaded as usual.
+const char kTrainingDiagrams[] =
+    "@startuml\n"
+    "actor User\n"
+    "participant \"Lister\" as L\n"
+    "database Cache\n"
+    "User -> L : open\n"
+    "activate L\n"
+    "L -> Cache : lookup\n"
+    "alt hit\n"
+    "  Cache --> L : image\n"
+    "else miss\n"
+    "  L -> L : render\n"
+    "end\n"
+    "note right of L : UTF-8 \xc3\xa4\xc3\xb6\xc3\xbc \xe2\x86\x92 \xe6\xbc\xa2\xe5\xad\x97\n"
+    "L --> User : diagram\n"
+    "deactivate L\n"
+    "@enduml\n"
+    "@startuml\n"
+    "skinparam monochrome true\n"
+    "package core {\n"
+    "  interface Renderer {\n"
+    "    +Render(source : String) : byte[]\n"
+    "  }\n"
+    "  abstract class Base <<abstract>>\n"
+    "  class Daemon {\n"
+    "    -instances : int\n"
+    "  }\n"
+    "  enum Format {\n"
+    "    SVG\n"
+    "    PNG\n"
+    "  }\n"
+    "}\n"
+    "Renderer <|.. Base\n"
+    "Base <|-- Daemon\n"
+    "Daemon \"1\" *-- \"many\" Format : emits >\n"
+    "@enduml\n"
+    "@startuml\n"
+    "start\n"
+    ":read file;\n"
+    "if (cached?) then (yes)\n"
+    "  :show;\n"
+    "else (no)\n"
+    "  fork\n"
+    "    :render SVG;\n"
+    "  fork again\n"
+    "    :render PNG;\n"
+    "  end fork\n"
+    "endif\n"
+    "stop\n"
+    "@enduml\n"
+    "@startuml\n"
+    "[*] --> Idle\n"
+    "Idle --> Rendering : request\n"
+    "Rendering --> Idle : done\n"
+    "state Rendering {\n"
+    "  [*] --> Layout\n"
+    "  Layout --> Draw\n"
+    "}\n"
+    "@enduml\n"
+    "@startuml\n"
+    "node Host {\n"
+    "  component Plugin\n"
+    "  component JVM\n"
+    "}\n"
+    "cloud Web\n"
+    "Plugin --> JVM : pipe\n"
+    "Plugin ..> Web : https\n"
+    "@enduml\n"
+    "@startmindmap\n"
+    "* render\n"
+    "** cache\n"
+    "** daemon\n"
+    "@endmindmap\n";
+
+std::string UniqueSuffix() {
+    static std::atomic<unsigned> counter{0};
+    const auto stamp = static_cast<unsigned long long>(std::chrono::steady_clock::now().time_since_epoch().count());
+    return std::to_string(stamp) + "-" + std::to_string(++counter);
+}
+
+bool EndsWith(const std::string& text, const std::string& suffix) {
+    return text.size() >= suffix.size() &&
+           text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+std::string CanonicalPath(const std::string& pathUtf8) {
+    std::error_code ec;
+    const fs::path canonical = fs::canonical(fs::u8path(pathUtf8), ec);
+    return ec ? pathUtf8 : canonical.u8string();
+}
+
+// Path, size and modification time: a replaced file is a different file.
+std::string DescribeFile(const std::string& pathUtf8) {
+    std::error_code ec;
+    const fs::path path = fs::u8path(pathUtf8);
+    std::string description = pathUtf8;
+    const uintmax_t size = fs::file_size(path, ec);
+    description += "|" + std::to_string(ec ? 0 : size);
+    const fs::file_time_type written = fs::last_write_time(path, ec);
+    description += "|" + std::to_string(ec ? 0 : static_cast<long long>(written.time_since_epoch().count()));
+    return description;
+}
+
+} // namespace
+
+bool IsKnownGcName(const std::string& gc) {
+    return gc.empty() || gc == "serial" || gc == "parallel" || gc == "g1" ||
+           gc == "shenandoah" || gc == "z" || gc == "epsilon";
+}
+
+std::vector<std::string> JvmProfileArguments(const JvmLaunchProfile& profile) {
+    std::vector<std::string> arguments;
+    if (profile.tieredStopAtLevel >= 1 && profile.tieredStopAtLevel <= 4) {
+        arguments.push_back("-XX:TieredStopAtLevel=" + std::to_string(profile.tieredStopAtLevel));
+    }
+    if (profile.initialHeapMb > 0) {
+        arguments.push_back("-Xms" + std::to_string(profile.initialHeapMb) + "m");
+    }
+    if (profile.maxHeapMb > 0) {
+        arguments.push_back("-Xmx" + std::to_string(profile.maxHeapMb) + "m");
+    }
+    if (profile.gc == "serial") arguments.push_back("-XX:+UseSerialGC");
+    else if (profile.gc == "parallel") arguments.push_back("-XX:+UseParallelGC");
+    else if (profile.gc == "g1") arguments.push_back("-XX:+UseG1GC");
+    else if (profile.gc == "shenandoah") arguments.push_back("-XX:+UseShenandoahGC");
+    else if (profile.gc == "z") arguments.push_back("-XX:+UseZGC");
+    else if (profile.gc == "epsilon") {
+        arguments.push_back("-XX:+UnlockExperimentalVMOptions");
+        arguments.push_back("-XX:+UseEpsilonGC");
+    }
+    arguments.insert(arguments.end(), profile.extraOptions.begin(), profile.extraOptions.end());
+    return arguments;
+}
+
+std::vector<std::string> SplitJvmOptions(const std::string& text) {
+    std::vector<std::string> options;
+    std::string current;
+    bool quoted = false;
+    bool pending = false;
+    for (char c : text) {
+        if (c == '"') {
+            quoted = !quoted;
+            pending = true;
+        } else if (!quoted && (c == ' ' || c == '\t' || c == '\r' || c == '\n')) {
+            if (pending) options.push_back(current);
+            current.clear();
+            pending = false;
+        } else {
+            current += c;
+            pending = true;
+        }
+    }
+    if (pending) options.push_back(current);
+    return options;
+}
+
+const char* ClassDataArchiveStateName(ClassDataArchiveState state) {
+    switch (state) {
+    case ClassDataArchiveState::Missing: return "missing";
+    case ClassDataArchiveState::Ready:   return "ready";
+    case ClassDataArchiveState::Failed:  return "failed";
+    }
+    return "unknown";
+}
+
+ClassDataArchive::ClassDataArchive(ClassDataArchiveOptions options) : options_(std::move(options)) {
+    const std::string java = CanonicalPath(options_.javaExecutable);
+    const std::string jar = CanonicalPath(options_.jarPath);
+    std::string identity = DescribeFile(java) + "\n" + DescribeFile(jar);
+    for (const std::string& option : options_.jvmOptions) {
+        identity += "\n" + option;
+    }
+    prefix_ = "plantuml-" + HashToHex(Hash64(jar.data(), jar.size(), Hash64(java.data(), java.size()))) + "-";
+    const fs::path base = fs::u8path(options_.directory) /
+                          fs::u8path(prefix_ + HashToHex(Hash64(identity.data(), identity.size())));
+    path_ = base.u8string() + ".jsa";
+    failedMarker_ = base.u8string() + ".failed";
+}
+
+ClassDataArchiveState ClassDataArchive::State() const {
+    std::error_code ec;
+    if (fs::file_size(fs::u8path(path_), ec) > 0 && !ec) {
+        return ClassDataArchiveState::Ready;
+    }
+    if (fs::exists(fs::u8path(failedMarker_), ec)) {
+        return ClassDataArchiveState::Failed;
+    }
+    return ClassDataArchiveState::Missing;
+}
+
+std::vector<std::string> ClassDataArchive::LaunchArguments() const {
+    if (State() != ClassDataArchiveState::Ready) {
+        return {};
+    }
+    // A JVM that cannot map the archive says so through unified logging, on
+    // stdout by default, which is where -pipe writes the images.
+    return { "-XX:SharedArchiveFile=" + path_, "-Xshare:auto", "-Xlog:disable" };
+}
+
+bool ClassDataArchive::Generate(std::string* error, const CancellationToken* cancel) {
+    std::lock_guard<std::mutex> lock(generateMutex_);
+    const ClassDataArchiveState state = State();
+    if (state == ClassDataArchiveState::Ready) {
+        return true;
+    }
+    if (state == ClassDataArchiveState::Failed) {
+        if (error) *error = "an earlier training run created no archive";
+        return false;
+    }
+
+    std::error_code ec;
+    fs::create_directories(fs::u8path(options_.directory), ec);
+    if (ec) {
+        if (error) *error = "cannot create " + options_.directory + ": " + ec.message();
+        return false;
+    }
+
+    const std::string temp = path_ + "." + UniqueSuffix() + ".tmp";
+    ProcessSpec spec;
+    spec.executable = options_.javaExecutable;
+    spec.arguments = options_.jvmOptions;
+    spec.arguments.push_back("-XX:ArchiveClassesAtExit=" + temp);
+    spec.arguments.insert(spec.arguments.end(), {
+        "-Djava.awt.headless=true", "-jar", options_.jarPath,
+        "-charset", "UTF-8", "-pipe", "-tsvg",
+    });
+    spec.limits = options_.trainingLimits;
+
+    SpillableBuffer output(16ull * 1024 * 1024, std::string());
+    PumpOptions pump;
+    pump.timeoutMs = options_.trainingTimeoutMs;
+    pump.limiter = options_.limiter;
+    pump.background = true;
+    std::string pumpError;
+    const PumpResult result = RunProcessPump(spec, kTrainingDiagrams, pump, output, &pumpError, cancel);
+    if (result.status != PumpStatus::Completed) {
+        // Timed out or cancelled: tried again next time.
+        fs::remove(fs::u8path(temp), ec);
+        if (error) {
+            *error = std::string("training run ") + PumpStatusName(result.status) +
+                     (pumpError.empty() ? std::string() : ": " + pumpError);
+        }
+        return false;
+    }
+
+    const uintmax_t size = fs::file_size(fs::u8path(temp), ec);
+    if (ec || size == 0) {
+        // The JVM predates dynamic archives (JDK 13) or has no base archive.
+        fs::remove(fs::u8path(temp), ec);
+        std::ofstream(fs::u8path(failedMarker_)) << "exitCode=" << result.exitCode << "\n";
+        Log(options_.name + ": training run exited with code " + std::to_string(result.exitCode) +
+            " and created no archive; not retried for this jar and java");
+        RemoveSupersededArchives();
+        if (error) *error = "the JVM created no archive (JDK 13 or later is needed)";
+        return false;
+    }
+
+    fs::rename(fs::u8path(temp), fs::u8path(path_), ec);
+    if (ec) {
+        fs::remove(fs::u8path(temp), ec);
+        // Another process may have renamed its archive in place first.
+        if (State() == ClassDataArchiveState::Ready) {
+            return true;
+        }
+        if (error) *error = "cannot move the archive to " + path_;
+        return false;
+    }
+    Log(options_.name + ": created " + path_ + " (" + std::to_string(size / 1024) + " KB) in " +
+        std::to_string(result.elapsedMs) + " ms");
+    RemoveSupersededArchives();
+    return true;
+}
+
+void ClassDataArchive::RemoveSupersededArchives() const {
+    const std::string current = fs::u8path(path_).filename().u8string();
+    const std::string marker = fs::u8path(failedMarker_).filename().u8string();
+    const auto abandoned = fs::file_time_type::clock::now() - std::chrono::hours(24);
+    std::error_code ec;
+    for (fs::directory_iterator it(fs::u8path(options_.directory), ec), end; !ec && it != end; it.increment(ec)) {
+        const std::string name = it->path().filename().u8string();
+        if (name.compare(0, prefix_.size(), prefix_) != 0 || name == current || name == marker) {
+            continue;
+        }
+        std::error_code fileEc;
+        if (EndsWith(name, ".tmp")) {
+            // Left behind by a training run that crashed, unless it is still running.
+            const fs::file_time_type written = fs::last_write_time(it->path(), fileEc);
+            if (fileEc || written > abandoned) continue;
+        } else if (!EndsWith(name, ".jsa") && !EndsWith(name, ".failed")) {
+            continue;
+        }
+        if (fs::remove(it->path(), fileEc)) {
+            Log(options_.name + ": removed superseded " + name);
+        }
+    }
+}
+
+} // namespace puml
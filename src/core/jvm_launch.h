@@ -0,0 +1,97 @@
+// JVM start-up tuning for the java processes that run plantuml.jar.
+//
+// A launch profile turns the tuning settings (JIT tiers, heap, collector)
+// into JVM options. A ClassDataArchive is an AppCDS archive of the classes
+// PlantUML loads: it is created once per jar by a training run (JDK 13+,
+// -XX:ArchiveClassesAtExit) and then mapped into every JVM started
+// afterwards, which skips most of the class loading and verification a
+// cold start spends its time on.
+
+#pragma once
+
+#include "core/cancellation.h"
+#include "core/child_process.h"
+#include "core/concurrency_limiter.h"
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace puml {
+
+struct JvmLaunchProfile {
+    int                      tieredStopAtLevel = 0;   // 1-4, 0 = JVM default
+    uint32_t                 initialHeapMb = 0;       // -Xms, 0 = JVM default
+    uint32_t                 maxHeapMb = 0;           // -Xmx, 0 = JVM default
+    std::string              gc;                      // "serial", "parallel", "g1", ... or empty
+    std::vector<std::string> extraOptions;            // passed through as they are
+};
+
+// False for a collector name it does not know.
+bool IsKnownGcName(const std::string& gc);
+
+// JVM options for profile, in a stable order.
+std::vector<std::string> JvmProfileArguments(const JvmLaunchProfile& profile);
+
+// Splits a command-line style option string on white space; double quotes
+// group an option containing spaces.
+std::vector<std::string> SplitJvmOptions(const std::string& text);
+
+struct ClassDataArchiveOptions {
+    std::string              directory;        // UTF-8, created on demand
+    std::string              javaExecutable;   // UTF-8
+    std::string              jarPath;          // UTF-8
+    // The launch profile the archive is created and used with. Part of the
+    // archive's identity: a JVM rejects an archive made with another heap
+    // layout.
+    std::vector<std::string> jvmOptions;
+    uint32_t                 trainingTimeoutMs = 60000;
+    ResourceLimits           trainingLimits;   // of the training run
+    ConcurrencyLimiter*      limiter = nullptr; // the training run takes a background slot
+    std::string              name = "cds";     // used in log messages
+};
+
+enum class ClassDataArchiveState {
+    Missing,     // not created yet
+    Ready,
+    Failed,      // the JVM could not create one; not retried for this jar and java
+};
+
+const char* ClassDataArchiveStateName(ClassDataArchiveState state);
+
+// The archive of one jar run by one java installation. Its file name is
+// derived from both, so a replaced jar or JDK gets a new archive; the
+// archives of earlier versions of the same jar are deleted once the new one
+// exists. Several processes may share the directory.
+class ClassDataArchive {
+public:
+    explicit ClassDataArchive(ClassDataArchiveOptions options);
+
+    ClassDataArchive(const ClassDataArchive&) = delete;
+    ClassDataArchive& operator=(const ClassDataArchive&) = delete;
+
+    // Checks the directory, so an archive another process created is seen.
+    ClassDataArchiveState State() const;
+
+    // Options mapping the archive into a JVM; empty while it is not Ready.
+    std::vector<std::string> LaunchArguments() const;
+
+    // Runs the training JVM (a few diagrams through -pipe) if the archive is
+    // Missing, and blocks until it exits. Returns true if the archive is
+    // Ready afterwards. Concurrent calls run one training.
+    bool Generate(std::string* error, const CancellationToken* cancel = nullptr);
+
+    const std::string& Path() const { return path_; }
+
+private:
+    void RemoveSupersededArchives() const;
+
+    ClassDataArchiveOptions options_;
+    std::string             prefix_;       // file name part shared by every version of the jar
+    std::string             path_;         // UTF-8
+    std::string             failedMarker_; // UTF-8
+    std::mutex              generateMutex_;
+};
+
+} // namespace puml
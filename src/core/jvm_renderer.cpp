@@ -0,0 +1,470 @@
+#include "core/jvm_renderer.h"
+
+#include "core/core_log.h"
+#include "core/diagram_splitter.h"
+#include "core/dynamic_library.h"
+
+#include <chrono>
+#include <filesystem>
+
+#if defined(PUML_HAVE_JNI)
+#include <jni.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace puml {
+
+using Clock = std::chrono::steady_clock;
+
+struct JvmRenderer::Request {
+    std::string                source;
+    bool                       svg = true;
+    size_t                     imageIndex = 0;
+    std::vector<unsigned char> output;
+    bool                       done = false;   // answered, or abandoned by the caller
+    bool                       ok = false;
+    std::string                error;
+};
+
+#if defined(PUML_HAVE_JNI)
+
+namespace {
+
+using CreateJavaVmFn = jint (JNICALL*)(JavaVM** vm, void** env, void* args);
+
+// Describes and clears the pending Java exception, if any.
+bool TakeException(JNIEnv* env, const char* what, std::string* error) {
+    if (!env->ExceptionCheck()) {
+        return false;
+    }
+    jthrowable thrown = env->ExceptionOccurred();
+    env->ExceptionClear();
+    std::string text;
+    if (thrown) {
+        jclass objectClass = env->FindClass("java/lang/Object");
+        jmethodID toString = objectClass ? env->GetMethodID(objectClass, "toString", "()Ljava/lang/String;") : nullptr;
+        jstring description = toString ? static_cast<jstring>(env->CallObjectMethod(thrown, toString)) : nullptr;
+        if (env->ExceptionCheck()) {
+            env->ExceptionClear();
+        } else if (description) {
+            if (const char* chars = env->GetStringUTFChars(description, nullptr)) {
+                text = chars;
+                env->ReleaseStringUTFChars(description, chars);
+            }
+        }
+    }
+    if (error) *error = std::string(what) + ": " + (text.empty() ? std::string("Java exception") : text);
+    return true;
+}
+
+} // namespace
+
+// Classes and methods looked up once, as global references.
+struct JvmRenderer::Java {
+    JavaVM*   vm = nullptr;
+    JNIEnv*   env = nullptr;            // of the JVM thread
+    jclass    stringClass = nullptr;
+    jmethodID stringInit = nullptr;     // String(byte[], String charsetName)
+    jstring   utf8 = nullptr;
+    jclass    streamClass = nullptr;
+    jmethodID streamInit = nullptr;
+    jmethodID streamToByteArray = nullptr;
+    jclass    readerClass = nullptr;
+    jmethodID readerInit = nullptr;     // SourceStringReader(String)
+    jmethodID outputImage = nullptr;    // outputImage(OutputStream, int, FileFormatOption)
+    jobject   svgOption = nullptr;
+    jobject   pngOption = nullptr;
+
+    jclass GlobalClass(const char* name, std::string* error) {
+        jclass local = env->FindClass(name);
+        if (!local) {
+            TakeException(env, name, error);
+            return nullptr;
+        }
+        auto global = static_cast<jclass>(env->NewGlobalRef(local));
+        env->DeleteLocalRef(local);
+        return global;
+    }
+
+    jobject NewFormatOption(jclass formatClass, jclass optionClass, jmethodID optionInit, const char* format,
+                            std::string* error) {
+        jfieldID field = env->GetStaticFieldID(formatClass, format, "Lnet/sourceforge/plantuml/FileFormat;");
+        jobject value = field ? env->GetStaticObjectField(formatClass, field) : nullptr;
+        jobject option = value ? env->NewObject(optionClass, optionInit, value) : nullptr;
+        if (!option) {
+            if (!TakeException(env, "FileFormatOption", error) && error) *error = "FileFormat." + std::string(format) + " missing";
+            return nullptr;
+        }
+        jobject global = env->NewGlobalRef(option);
+        env->DeleteLocalRef(option);
+        env->DeleteLocalRef(value);
+        return global;
+    }
+
+    bool Bind(std::string* error) {
+        stringClass = GlobalClass("java/lang/String", error);
+        streamClass = GlobalClass("java/io/ByteArrayOutputStream", error);
+        readerClass = GlobalClass("net/sourceforge/plantuml/SourceStringReader", error);
+        jclass formatClass = GlobalClass("net/sourceforge/plantuml/FileFormat", error);
+        jclass optionClass = GlobalClass("net/sourceforge/plantuml/FileFormatOption", error);
+        if (!stringClass || !streamClass || !readerClass || !formatClass || !optionClass) {
+            return false;
+        }
+        stringInit = env->GetMethodID(stringClass, "<init>", "([BLjava/lang/String;)V");
+        streamInit = env->GetMethodID(streamClass, "<init>", "()V");
+        streamToByteArray = env->GetMethodID(streamClass, "toByteArray", "()[B");
+        readerInit = env->GetMethodID(readerClass, "<init>", "(Ljava/lang/String;)V");
+        outputImage = env->GetMethodID(readerClass, "outputImage",
+            "(Ljava/io/OutputStream;ILnet/sourceforge/plantuml/FileFormatOption;)"
+            "Lnet/sourceforge/plantuml/core/DiagramDescription;");
+        jmethodID optionInit = env->GetMethodID(optionClass, "<init>", "(Lnet/sourceforge/plantuml/FileFormat;)V");
+        if (!stringInit || !streamInit || !streamToByteArray || !readerInit || !outputImage || !optionInit) {
+            TakeException(env, "PlantUML API lookup", error);
+            return false;
+        }
+        jstring utf8Local = env->NewStringUTF("UTF-8");
+        utf8 = utf8Local ? static_cast<jstring>(env->NewGlobalRef(utf8Local)) : nullptr;
+        svgOption = NewFormatOption(formatClass, optionClass, optionInit, "SVG", error);
+        pngOption = NewFormatOption(formatClass, optionClass, optionInit, "PNG", error);
+        env->DeleteGlobalRef(formatClass);
+        env->DeleteGlobalRef(optionClass);
+        return utf8 && svgOption && pngOption;
+    }
+
+    // A Java string decoded from UTF-8 by Java itself: JNI's NewStringUTF
+    // takes modified UTF-8, which differs for NUL and supplementary characters.
+    jstring NewUtf8String(const std::string& text) {
+        jbyteArray bytes = env->NewByteArray(static_cast<jsize>(text.size()));
+        if (!bytes) return nullptr;
+        env->SetByteArrayRegion(bytes, 0, static_cast<jsize>(text.size()), reinterpret_cast<const jbyte*>(text.data()));
+        auto string = static_cast<jstring>(env->NewObject(stringClass, stringInit, bytes, utf8));
+        env->DeleteLocalRef(bytes);
+        return string;
+    }
+};
+
+#else
+
+struct JvmRenderer::Java {};
+
+#endif
+
+std::string FindJvmLibrary(const std::string& javaExecutableOrHomeUtf8) {
+#if defined(_WIN32)
+    static const char* const kCandidates[] = {
+        "bin/server/jvm.dll", "bin/client/jvm.dll", "jre/bin/server/jvm.dll", "jre/bin/client/jvm.dll",
+    };
+#elif defined(__APPLE__)
+    static const char* const kCandidates[] = {
+        "lib/server/libjvm.dylib", "jre/lib/server/libjvm.dylib",
+    };
+#else
+    static const char* const kCandidates[] = {
+        "lib/server/libjvm.so", "lib/client/libjvm.so", "jre/lib/server/libjvm.so",
+        "jre/lib/amd64/server/libjvm.so", "jre/lib/aarch64/server/libjvm.so",
+    };
+#endif
+    if (javaExecutableOrHomeUtf8.empty()) {
+        return std::string();
+    }
+    std::error_code ec;
+    fs::path path = fs::u8path(javaExecutableOrHomeUtf8);
+    const fs::path resolved = fs::canonical(path, ec);
+    if (!ec) {
+        path = resolved;
+    }
+    // <home>/bin/java[.exe] -> <home>
+    const fs::path home = fs::is_directory(path, ec) ? path : path.parent_path().parent_path();
+    for (const char* candidate : kCandidates) {
+        const fs::path library = home / fs::u8path(candidate);
+        if (fs::is_regular_file(library, ec)) {
+            return library.u8string();
+        }
+    }
+    return std::string();
+}
+
+JvmRenderer::JvmRenderer(JvmRendererOptions options) : options_(std::move(options)) {}
+
+JvmRenderer::~JvmRenderer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) thread_.join();
+    if (java_) {
+        // Unloading the library under a live JVM would crash the process.
+        library_.release();
+    }
+}
+
+bool JvmRenderer::Render(std::string_view utf8Source,
+                         bool svg,
+                         size_t imageIndex,
+                         uint32_t timeoutMs,
+                         std::vector<unsigned char>& out,
+                         std::string* error,
+                         const CancellationToken* cancel) {
+    auto request = std::make_shared<Request>();
+    request->source.assign(utf8Source.data(), utf8Source.size());
+    request->svg = svg;
+    request->imageIndex = imageIndex;
+
+    // Declared before the wait lock below so it unregisters after that lock
+    // is released: the callback itself takes mutex_.
+    bool cancelled = false;
+    CancellationRegistration onCancel(cancel, [this, request, &cancelled]() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!request->done) {
+            request->done = true;
+            cancelled = true;
+        }
+        cv_.notify_all();
+    });
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (cancelled || IsCancelled(cancel)) {
+        request->done = true;
+        ++stats_.cancellations;
+        if (error) *error = "cancelled";
+        return false;
+    }
+    if (state_ == State::Failed || stopping_) {
+        ++stats_.failures;
+        if (error) *error = stopping_ ? std::string("renderer shut down") : startError_;
+        return false;
+    }
+    if (state_ == State::NotStarted) {
+        state_ = State::Starting;
+        thread_ = std::thread([this]() { ThreadMain(); });
+    }
+    queue_.push_back(request);
+    cv_.notify_all();
+
+    const Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+    if (!cv_.wait_until(lock, deadline, [&]() { return request->done; })) {
+        // Abandoned: the JVM thread skips it, or discards what it renders.
+        request->done = true;
+        ++stats_.timeouts;
+        if (error) *error = "timed out";
+        return false;
+    }
+    if (cancelled) {
+        ++stats_.cancellations;
+        if (error) *error = "cancelled";
+        return false;
+    }
+    if (!request->ok) {
+        if (error) *error = request->error;
+        return false;
+    }
+    out.swap(request->output);
+    return true;
+}
+
+bool JvmRenderer::Usable() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return state_ != State::Failed && !stopping_;
+}
+
+JvmRendererStats JvmRenderer::Stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void JvmRenderer::ThreadMain() {
+    const Clock::time_point begun = Clock::now();
+    std::string error;
+    const bool started = StartJvm(&error);
+    const auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - begun).count();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        state_ = started ? State::Running : State::Failed;
+        if (started) {
+            stats_.started = true;
+            stats_.startMs = static_cast<uint64_t>(elapsedMs);
+        } else {
+            startError_ = "in-process JVM unavailable: " + error;
+            for (const std::shared_ptr<Request>& request : queue_) {
+                if (!request->done) {
+                    request->done = true;
+                    request->error = startError_;
+                    ++stats_.failures;
+                }
+            }
+            queue_.clear();
+        }
+    }
+    cv_.notify_all();
+    if (!started) {
+        Log(options_.name + ": " + startError_);
+        DetachJvmThread();
+        return;
+    }
+    Log(options_.name + ": JVM started in-process in " + std::to_string(elapsedMs) + " ms (" +
+        options_.jvmLibrary + ")");
+
+    for (;;) {
+        std::shared_ptr<Request> request;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [&]() { return stopping_ || !queue_.empty(); });
+            if (stopping_) {
+                for (const std::shared_ptr<Request>& queued : queue_) {
+                    if (!queued->done) {
+                        queued->done = true;
+                        queued->error = "renderer shut down";
+                    }
+                }
+                queue_.clear();
+                break;
+            }
+            request = queue_.front();
+            queue_.pop_front();
+            if (request->done) {
+                continue;
+            }
+        }
+
+        std::vector<unsigned char> output;
+        std::string renderError;
+        const bool ok = RenderOnJvm(*request, output, &renderError);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (ok) {
+                ++stats_.renders;
+            } else {
+                ++stats_.failures;
+                Log(options_.name + ": render failed: " + renderError);
+            }
+            if (!request->done) {
+                request->done = true;
+                request->ok = ok;
+                request->output.swap(output);
+                request->error = renderError;
+            }
+        }
+        cv_.notify_all();
+    }
+    cv_.notify_all();
+    DetachJvmThread();
+}
+
+#if defined(PUML_HAVE_JNI)
+
+bool JvmRenderer::StartJvm(std::string* error) {
+    if (options_.jvmLibrary.empty()) {
+        if (error) *error = "no jvm library found";
+        return false;
+    }
+    library_ = LoadDynamicLibrary(options_.jvmLibrary, error);
+    if (!library_) {
+        return false;
+    }
+    auto createJavaVm = reinterpret_cast<CreateJavaVmFn>(library_->Symbol("JNI_CreateJavaVM"));
+    if (!createJavaVm) {
+        if (error) *error = "JNI_CreateJavaVM not exported by " + options_.jvmLibrary;
+        return false;
+    }
+
+    // -Xrs: the host process keeps its signal and console handlers.
+    std::vector<std::string> optionText = {
+        "-Djava.class.path=" + options_.jarPath, "-Djava.awt.headless=true", "-Xrs",
+    };
+    optionText.insert(optionText.end(), options_.jvmOptions.begin(), options_.jvmOptions.end());
+    std::vector<JavaVMOption> vmOptions(optionText.size());
+    for (size_t i = 0; i < optionText.size(); ++i) {
+        vmOptions[i].optionString = const_cast<char*>(optionText[i].c_str());
+        vmOptions[i].extraInfo = nullptr;
+    }
+    JavaVMInitArgs args{};
+    args.version = JNI_VERSION_1_8;
+    args.nOptions = static_cast<jint>(vmOptions.size());
+    args.options = vmOptions.data();
+    args.ignoreUnrecognized = JNI_FALSE;
+
+    auto java = std::make_unique<Java>();
+    const jint rc = createJavaVm(&java->vm, reinterpret_cast<void**>(&java->env), &args);
+    if (rc != JNI_OK) {
+        if (error) *error = "JNI_CreateJavaVM failed (" + std::to_string(rc) + ")";
+        return false;
+    }
+    java_ = std::move(java);
+    return java_->Bind(error);
+}
+
+bool JvmRenderer::RenderOnJvm(const Request& request, std::vector<unsigned char>& out, std::string* error) {
+    JNIEnv* env = java_->env;
+    const std::pmr::vector<DiagramBlock> blocks = SplitDiagramBlocks(request.source);
+    if (blocks.empty()) {
+        if (error) *error = "source contains no diagram";
+        return false;
+    }
+    if (env->PushLocalFrame(16) != JNI_OK) {
+        TakeException(env, "PushLocalFrame", error);
+        return false;
+    }
+    const jobject option = request.svg ? java_->svgOption : java_->pngOption;
+    jobject stream = env->NewObject(java_->streamClass, java_->streamInit);
+    bool ok = stream != nullptr;
+    std::string blockText;
+    for (size_t i = 0; ok && i < blocks.size(); ++i) {
+        // One reader per block, like the pipe: each block yields one image.
+        blockText.clear();
+        AppendBlockText(blockText, request.source, blocks[i]);
+        jstring text = java_->NewUtf8String(blockText);
+        jobject reader = text ? env->NewObject(java_->readerClass, java_->readerInit, text) : nullptr;
+        jobject description = reader ? env->CallObjectMethod(reader, java_->outputImage, stream,
+                                                             static_cast<jint>(request.imageIndex), option)
+                                     : nullptr;
+        if (TakeException(env, "SourceStringReader", error)) {
+            ok = false;
+        } else if (!description) {
+            if (error) *error = "diagram " + std::to_string(i + 1) + " has no image " + std::to_string(request.imageIndex);
+            ok = false;
+        }
+        if (description) env->DeleteLocalRef(description);
+        if (reader) env->DeleteLocalRef(reader);
+        if (text) env->DeleteLocalRef(text);
+    }
+    if (ok) {
+        auto bytes = static_cast<jbyteArray>(env->CallObjectMethod(stream, java_->streamToByteArray));
+        if (TakeException(env, "toByteArray", error) || !bytes) {
+            ok = false;
+        } else {
+            out.resize(static_cast<size_t>(env->GetArrayLength(bytes)));
+            env->GetByteArrayRegion(bytes, 0, static_cast<jsize>(out.size()), reinterpret_cast<jbyte*>(out.data()));
+        }
+    }
+    if (!ok && error && error->empty()) {
+        TakeException(env, "render", error);
+    }
+    env->PopLocalFrame(nullptr);
+    return ok;
+}
+
+void JvmRenderer::DetachJvmThread() {
+    if (java_) {
+        java_->vm->DetachCurrentThread();
+    }
+}
+
+#else // !PUML_HAVE_JNI
+
+bool JvmRenderer::StartJvm(std::string* error) {
+    if (error) *error = "built without JNI support";
+    return false;
+}
+
+bool JvmRenderer::RenderOnJvm(const Request&, std::vector<unsigned char>&, std::string* error) {
+    if (error) *error = "built without JNI support";
+    return false;
+}
+
+void JvmRenderer::DetachJvmThread() {}
+
+#endif
+
+} // namespace puml
@@ -0,0 +1,106 @@
+// In-process PlantUML renderer.
+//
+// The JVM is loaded into this process through JNI (jvm.dll / libjvm.so) and
+// PlantUML's SourceStringReader is called directly: a render costs neither
+// a process nor a pipe, and the images come back as byte arrays. The JVM is
+// created lazily on a dedicated thread, which then runs every render, one at
+// a time. A JVM cannot be unloaded or created twice in a process, so at most
+// one renderer may exist and it is meant to live until the process exits.
+//
+// Built with the JNI headers of a JDK (PUML_HAVE_JNI); without them every
+// render fails with "built without JNI support".
+
+#pragma once
+
+#include "core/cancellation.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace puml {
+
+class DynamicLibrary;
+
+struct JvmRendererOptions {
+    std::string              jvmLibrary;   // UTF-8 path of jvm.dll / libjvm.so
+    // Put on the class path. JVM options are in the platform's native
+    // encoding, so on Windows pass an ASCII (e.g. short 8.3) path.
+    std::string              jarPath;
+    std::vector<std::string> jvmOptions;   // e.g. "-Xmx512m"
+    std::string              name = "jvm"; // used in log messages
+};
+
+struct JvmRendererStats {
+    bool     started = false;
+    uint64_t startMs = 0;         // time JNI_CreateJavaVM and the class lookups took
+    uint64_t renders = 0;
+    uint64_t failures = 0;
+    uint64_t timeouts = 0;
+    uint64_t cancellations = 0;
+};
+
+// jvm.dll / libjvm.so of the Java installation a java executable belongs
+// to (symbolic links are followed), or of a Java home directory. Empty if
+// there is none.
+std::string FindJvmLibrary(const std::string& javaExecutableOrHomeUtf8);
+
+class JvmRenderer {
+public:
+    explicit JvmRenderer(JvmRendererOptions options);
+    // Stops the JVM thread. The JVM itself stays loaded.
+    ~JvmRenderer();
+
+    JvmRenderer(const JvmRenderer&) = delete;
+    JvmRenderer& operator=(const JvmRenderer&) = delete;
+
+    // Renders page imageIndex of every diagram in utf8Source, like
+    // "-pipe -pipeimageindex"; the images are concatenated into out in
+    // source order. Thread-safe; requests are served in FIFO order. The first
+    // call starts the JVM. Cancelling or timing out returns at once; a render
+    // already running on the JVM still finishes there, its output discarded.
+    bool Render(std::string_view utf8Source,
+                bool svg,
+                size_t imageIndex,
+                uint32_t timeoutMs,
+                std::vector<unsigned char>& out,
+                std::string* error,
+                const CancellationToken* cancel = nullptr);
+
+    // False once the JVM failed to start; it is not retried.
+    bool Usable() const;
+    JvmRendererStats Stats() const;
+
+private:
+    struct Java;
+    struct Request;
+
+    void ThreadMain();
+    bool StartJvm(std::string* error);     // on the JVM thread
+    bool RenderOnJvm(const Request& request, std::vector<unsigned char>& out, std::string* error);
+    void DetachJvmThread();
+
+    enum class State { NotStarted, Starting, Running, Failed };
+
+    JvmRendererOptions options_;
+
+    mutable std::mutex      mutex_;        // guards everything below but java_
+    std::condition_variable cv_;
+    std::deque<std::shared_ptr<Request>> queue_;
+    State                   state_ = State::NotStarted;
+    std::string             startError_;
+    bool                    stopping_ = false;
+    JvmRendererStats        stats_;
+
+    std::unique_ptr<DynamicLibrary> library_;   // JVM thread only
+    std::unique_ptr<Java>           java_;      // JVM thread only
+    std::thread                     thread_;
+};
+
+} // namespace puml
@@ -0,0 +1,84 @@
+#include "core/latency_histogram.h"
+
+#include <cmath>
+
+namespace puml {
+
+namespace {
+
+// Bucket i holds latencies up to 2^((i + 1) / 4) - 1 ms.
+size_t BucketOf(uint64_t ms, size_t buckets) {
+    const size_t index = static_cast<size_t>(std::floor(4.0 * std::log2(static_cast<double>(ms) + 1.0)));
+    return index < buckets ? index : buckets - 1;
+}
+
+uint64_t UpperBound(size_t bucket) {
+    return static_cast<uint64_t>(std::ceil(std::exp2((bucket + 1) / 4.0))) - 1;
+}
+
+} // namespace
+
+LatencyHistogram::LatencyHistogram(uint32_t window) : window_(window < 16 ? 16 : window) {}
+
+void LatencyHistogram::Record(uint64_t ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (total_ >= window_) {
+        total_ = 0;
+        for (uint32_t& count : counts_) {
+            count /= 2;
+            total_ += count;
+        }
+    }
+    ++counts_[BucketOf(ms, kBuckets)];
+    ++total_;
+}
+
+void LatencyHistogram::RecordCensored() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++censored_;
+}
+
+uint32_t LatencyHistogram::Count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return total_;
+}
+
+uint64_t LatencyHistogram::Censored() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return censored_;
+}
+
+uint64_t LatencyHistogram::Quantile(double q) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return QuantileLocked(q);
+}
+
+uint64_t LatencyHistogram::QuantileLocked(double q) const {
+    if (total_ == 0) {
+        return 0;
+    }
+    if (q < 0) q = 0;
+    if (q > 1) q = 1;
+    // The smallest bucket with at least ceil(q * total) samples at or below it.
+    uint32_t rank = static_cast<uint32_t>(std::ceil(q * total_));
+    if (rank == 0) rank = 1;
+    uint32_t seen = 0;
+    for (size_t i = 0; i < kBuckets; ++i) {
+        seen += counts_[i];
+        if (seen >= rank) {
+            return UpperBound(i);
+        }
+    }
+    return UpperBound(kBuckets - 1);
+}
+
+std::string LatencyHistogram::Describe() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return "n=" + std::to_string(total_) +
+           " p50=" + std::to_string(QuantileLocked(0.50)) +
+           " p90=" + std::to_string(QuantileLocked(0.90)) +
+           " p99=" + std::to_string(QuantileLocked(0.99)) +
+           (censored_ ? " censored=" + std::to_string(censored_) : std::string());
+}
+
+} // namespace puml
@@ -0,0 +1,50 @@
+// Render latencies of one backend in logarithmic buckets (four per doubling,
+// so any quantile is off by at most ~19%). Old samples fade: once the
+// histogram holds a window's worth, every count is halved, so quantiles
+// follow the backend as it warms up or degrades.
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace puml {
+
+class LatencyHistogram {
+public:
+    explicit LatencyHistogram(uint32_t window = 256);
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    void Record(uint64_t ms);
+    // A render cut short before it finished, e.g. a hedge that lost the
+    // race. Its latency is only a lower bound, so it is counted apart and
+    // leaves the quantiles alone.
+    void RecordCensored();
+
+    // Samples currently weighed; at most the window.
+    uint32_t Count() const;
+    uint64_t Censored() const;
+    // Upper bound of the bucket holding quantile q (0..1); 0 while empty.
+    uint64_t Quantile(double q) const;
+
+    // "n=40 p50=180 p90=420 p99=1300" (ms), plus " censored=3" once there
+    // are any, for the log.
+    std::string Describe() const;
+
+private:
+    static constexpr size_t kBuckets = 96;   // up to 2^24 ms, longer than any timeout
+
+    uint64_t QuantileLocked(double q) const;
+
+    const uint32_t                  window_;
+    mutable std::mutex              mutex_;
+    std::array<uint32_t, kBuckets>  counts_{};
+    uint32_t                        total_ = 0;
+    uint64_t                        censored_ = 0;
+};
+
+} // namespace puml
@@ -0,0 +1,58 @@
+// Portable local (same machine, same user) byte-stream channel used by the
+// shared render service. Win32 (named pipes) and POSIX (Unix domain
+// sockets) implementations live in local_channel_win32.cpp /
+// local_channel_posix.cpp.
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace puml {
+
+// One connected end. ReadAll and WriteAll may be used from different
+// threads at the same time; Shutdown may be called from any thread.
+class LocalConnection {
+public:
+    virtual ~LocalConnection() = default;
+
+    // Block until all size bytes are transferred. False on EOF, error,
+    // deadline or Shutdown.
+    virtual bool ReadAll(void* data, size_t size, std::chrono::steady_clock::time_point deadline) = 0;
+    virtual bool WriteAll(const void* data, size_t size) = 0;
+    // Blocks until the peer closes its end or sends data, until Shutdown, or
+    // until deadline, without reading anything. True when the peer is gone.
+    virtual bool WaitPeerClosed(std::chrono::steady_clock::time_point deadline) = 0;
+    // Makes pending and later transfers fail.
+    virtual void Shutdown() = 0;
+};
+
+class LocalListener {
+public:
+    // Stops listening; connections already accepted stay open.
+    virtual ~LocalListener() = default;
+
+    // Blocks until a client connects or until Close. nullptr after Close.
+    virtual std::unique_ptr<LocalConnection> Accept() = 0;
+    // Unblocks Accept; callable from any thread.
+    virtual void Close() = 0;
+};
+
+// Where endpoint name is reachable, scoped to the calling user (and on
+// Windows to the logon session): a named pipe path, or a socket path in a
+// directory only the user can enter.
+std::string LocalEndpointAddress(const std::string& name);
+
+// Fails with inUse set when another live process already listens on name.
+std::unique_ptr<LocalListener> ListenLocalEndpoint(const std::string& name, bool* inUse, std::string* error);
+
+// Connects to a listener of the same user, waiting up to timeoutMs for a
+// busy one. Fails at once if nobody listens.
+std::unique_ptr<LocalConnection> ConnectLocalEndpoint(const std::string& name,
+                                                      uint32_t timeoutMs,
+                                                      std::string* error);
+
+} // namespace puml
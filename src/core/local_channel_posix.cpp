@@ -0,0 +1,359 @@
+// POSIX implementation of the local channel (Unix domain sockets).
+
+#include "core/local_channel.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace puml {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+void CloseFd(int& fd) {
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+void SetCloseOnExec(int fd) {
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+
+std::string SystemError(const char* what) {
+    return std::string(what) + ": " + std::strerror(errno);
+}
+
+// $XDG_RUNTIME_DIR is private to the user already. The fallback under /tmp
+// is created private and must still be: another user could have made it.
+std::string SocketDirectory() {
+    const char* runtime = std::getenv("XDG_RUNTIME_DIR");
+    if (runtime && *runtime) {
+        return runtime;
+    }
+    return "/tmp/plantumlwebview-" + std::to_string(getuid());
+}
+
+bool PrepareSocketDirectory(const std::string& directory, std::string* error) {
+    if (mkdir(directory.c_str(), 0700) != 0 && errno != EEXIST) {
+        if (error) *error = SystemError(("cannot create " + directory).c_str());
+        return false;
+    }
+    struct stat st{};
+    if (lstat(directory.c_str(), &st) != 0 || !S_ISDIR(st.st_mode) || st.st_uid != getuid() ||
+        (st.st_mode & 077) != 0) {
+        if (error) *error = directory + " is not a private directory of this user";
+        return false;
+    }
+    return true;
+}
+
+bool MakeAddress(const std::string& path, sockaddr_un& address, std::string* error) {
+    address = sockaddr_un{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        if (error) *error = "socket path too long: " + path;
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+bool PeerIsThisUser(int fd) {
+#if defined(SO_PEERCRED)
+    struct ucred credentials{};
+    socklen_t length = sizeof(credentials);
+    return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) == 0 && credentials.uid == getuid();
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+    uid_t uid = 0;
+    gid_t gid = 0;
+    return getpeereid(fd, &uid, &gid) == 0 && uid == getuid();
+#else
+    (void)fd;
+    return true;   // the socket directory is private to the user
+#endif
+}
+
+class PosixLocalConnection final : public LocalConnection {
+public:
+    explicit PosixLocalConnection(int fd) : fd_(fd) {
+#if defined(SO_NOSIGPIPE)
+        int on = 1;
+        setsockopt(fd_, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+    }
+
+    ~PosixLocalConnection() override {
+        CloseFd(fd_);
+    }
+
+    bool ReadAll(void* data, size_t size, Clock::time_point deadline) override {
+        char* p = static_cast<char*>(data);
+        while (size > 0) {
+            if (shutdown_.load(std::memory_order_acquire)) {
+                return false;
+            }
+            int waitMs = -1;
+            if (deadline != Clock::time_point::max()) {
+                const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now());
+                if (left.count() <= 0) {
+                    return false;
+                }
+                waitMs = left.count() > 1000000 ? 1000000 : static_cast<int>(left.count());
+            }
+            pollfd entry{ fd_, POLLIN, 0 };
+            const int ready = poll(&entry, 1, waitMs);
+            if (ready < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            if (ready == 0) {
+                continue;   // the deadline check above ends the wait
+            }
+            const ssize_t n = recv(fd_, p, size, 0);
+            if (n < 0) {
+                if (errno == EINTR || errno == EAGAIN) continue;
+                return false;
+            }
+            if (n == 0) {
+                return false;
+            }
+            p += n;
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    bool WriteAll(const void* data, size_t size) override {
+        const char* p = static_cast<const char*>(data);
+        while (size > 0) {
+            if (shutdown_.load(std::memory_order_acquire)) {
+                return false;
+            }
+            const ssize_t n = send(fd_, p, size, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            p += n;
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    bool WaitPeerClosed(Clock::time_point deadline) override {
+        for (;;) {
+            if (shutdown_.load(std::memory_order_acquire)) {
+                return true;
+            }
+            int waitMs = -1;
+            if (deadline != Clock::time_point::max()) {
+                const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now());
+                if (left.count() <= 0) {
+                    return false;
+                }
+                waitMs = left.count() > 1000000 ? 1000000 : static_cast<int>(left.count());
+            }
+            pollfd entry{ fd_, POLLIN, 0 };
+            const int ready = poll(&entry, 1, waitMs);
+            if (ready < 0) {
+                if (errno == EINTR) continue;
+                return true;
+            }
+            if (ready == 0) {
+                continue;
+            }
+            char byte = 0;
+            const ssize_t n = recv(fd_, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+            if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+                continue;
+            }
+            return n <= 0;   // end of stream or an error; data is left for ReadAll
+        }
+    }
+
+    void Shutdown() override {
+        shutdown_.store(true, std::memory_order_release);
+        shutdown(fd_, SHUT_RDWR);
+    }
+
+private:
+    int               fd_;
+    std::atomic<bool> shutdown_{false};
+};
+
+class PosixLocalListener final : public LocalListener {
+public:
+    PosixLocalListener(int fd, int lockFd, int wake[2], std::string path)
+        : fd_(fd), lockFd_(lockFd), path_(std::move(path)) {
+        wake_[0] = wake[0];
+        wake_[1] = wake[1];
+    }
+
+    ~PosixLocalListener() override {
+        Close();
+        CloseFd(fd_);
+        unlink(path_.c_str());
+        CloseFd(wake_[0]);
+        CloseFd(wake_[1]);
+        CloseFd(lockFd_);   // releases the endpoint
+    }
+
+    std::unique_ptr<LocalConnection> Accept() override {
+        for (;;) {
+            if (closed_.load(std::memory_order_acquire)) {
+                return nullptr;
+            }
+            pollfd entries[2] = { { fd_, POLLIN, 0 }, { wake_[0], POLLIN, 0 } };
+            if (poll(entries, 2, -1) < 0) {
+                if (errno == EINTR) continue;
+                return nullptr;
+            }
+            if (entries[1].revents != 0) {
+                return nullptr;
+            }
+            const int client = accept(fd_, nullptr, nullptr);
+            if (client < 0) {
+                if (errno == EINTR || errno == ECONNABORTED || errno == EAGAIN) continue;
+                return nullptr;
+            }
+            SetCloseOnExec(client);
+            if (!PeerIsThisUser(client)) {
+                close(client);
+                continue;
+            }
+            return std::make_unique<PosixLocalConnection>(client);
+        }
+    }
+
+    void Close() override {
+        if (!closed_.exchange(true)) {
+            const char byte = 0;
+            (void)!write(wake_[1], &byte, 1);
+        }
+    }
+
+private:
+    int               fd_;
+    int               lockFd_;
+    int               wake_[2];
+    std::string       path_;
+    std::atomic<bool> closed_{false};
+};
+
+} // namespace
+
+std::string LocalEndpointAddress(const std::string& name) {
+    return SocketDirectory() + "/" + name + ".sock";
+}
+
+std::unique_ptr<LocalListener> ListenLocalEndpoint(const std::string& name, bool* inUse, std::string* error) {
+    if (inUse) *inUse = false;
+    if (!PrepareSocketDirectory(SocketDirectory(), error)) {
+        return nullptr;
+    }
+    const std::string path = LocalEndpointAddress(name);
+    sockaddr_un address;
+    if (!MakeAddress(path, address, error)) {
+        return nullptr;
+    }
+
+    // The lock decides which process owns the endpoint. Its owner may then
+    // replace a socket file a crashed owner left behind.
+    int lockFd = open((path + ".lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (lockFd < 0) {
+        if (error) *error = SystemError("cannot open the endpoint lock");
+        return nullptr;
+    }
+    if (flock(lockFd, LOCK_EX | LOCK_NB) != 0) {
+        if (inUse) *inUse = true;
+        if (error) *error = "another process listens on " + path;
+        CloseFd(lockFd);
+        return nullptr;
+    }
+    unlink(path.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        if (error) *error = SystemError("socket failed");
+        CloseFd(lockFd);
+        return nullptr;
+    }
+    SetCloseOnExec(fd);
+    if (bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || listen(fd, 64) != 0) {
+        if (error) *error = SystemError(("cannot listen on " + path).c_str());
+        CloseFd(fd);
+        CloseFd(lockFd);
+        return nullptr;
+    }
+    int wake[2] = { -1, -1 };
+    if (pipe(wake) != 0) {
+        if (error) *error = SystemError("pipe failed");
+        CloseFd(fd);
+        unlink(path.c_str());
+        CloseFd(lockFd);
+        return nullptr;
+    }
+    SetCloseOnExec(wake[0]);
+    SetCloseOnExec(wake[1]);
+    return std::make_unique<PosixLocalListener>(fd, lockFd, wake, path);
+}
+
+std::unique_ptr<LocalConnection> ConnectLocalEndpoint(const std::string& name,
+                                                      uint32_t timeoutMs,
+                                                      std::string* error) {
+    const std::string path = LocalEndpointAddress(name);
+    sockaddr_un address;
+    if (!MakeAddress(path, address, error)) {
+        return nullptr;
+    }
+    const Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+    for (;;) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) {
+            if (error) *error = SystemError("socket failed");
+            return nullptr;
+        }
+        SetCloseOnExec(fd);
+        if (connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0) {
+            if (!PeerIsThisUser(fd)) {
+                if (error) *error = path + " belongs to another user";
+                CloseFd(fd);
+                return nullptr;
+            }
+            return std::make_unique<PosixLocalConnection>(fd);
+        }
+        const int reason = errno;
+        CloseFd(fd);
+        // A full backlog (EAGAIN) is a busy listener; anything else is none.
+        if (reason != EAGAIN && reason != EINTR) {
+            errno = reason;
+            if (error) *error = SystemError(("cannot connect to " + path).c_str());
+            return nullptr;
+        }
+        if (Clock::now() >= deadline) {
+            if (error) *error = "timed out connecting to " + path;
+            return nullptr;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
+
+} // namespace puml
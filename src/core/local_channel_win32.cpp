@@ -0,0 +1,290 @@
+// Win32 implementation of the local channel (overlapped named pipes).
+
+#include "core/local_channel.h"
+
+#include <windows.h>
+
+#include <atomic>
+#include <vector>
+
+namespace puml {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+std::wstring WidenUtf8(const std::string& s) {
+    if (s.empty()) return std::wstring();
+    int n = ::MultiByteToWideChar(CP_UTF8, 0, s.data(), (int)s.size(), nullptr, 0);
+    std::wstring w(n > 0 ? n : 0, L'\0');
+    if (n > 0) ::MultiByteToWideChar(CP_UTF8, 0, s.data(), (int)s.size(), w.data(), n);
+    return w;
+}
+
+void CloseIfValid(HANDLE& h) {
+    if (h && h != INVALID_HANDLE_VALUE) {
+        CloseHandle(h);
+    }
+    h = nullptr;
+}
+
+std::string LastError(const char* what) {
+    return std::string(what) + " (error=" + std::to_string(GetLastError()) + ")";
+}
+
+DWORD MillisecondsUntil(Clock::time_point deadline) {
+    if (deadline == Clock::time_point::max()) {
+        return INFINITE;
+    }
+    const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+    return left <= 0 ? 0 : (left >= INFINITE ? INFINITE - 1 : static_cast<DWORD>(left));
+}
+
+std::vector<unsigned char> ProcessUserSid(HANDLE process) {
+    std::vector<unsigned char> sid;
+    HANDLE token = nullptr;
+    if (!OpenProcessToken(process, TOKEN_QUERY, &token)) {
+        return sid;
+    }
+    DWORD size = 0;
+    GetTokenInformation(token, TokenUser, nullptr, 0, &size);
+    std::vector<unsigned char> buffer(size);
+    if (size > 0 && GetTokenInformation(token, TokenUser, buffer.data(), size, &size)) {
+        const PSID user = reinterpret_cast<TOKEN_USER*>(buffer.data())->User.Sid;
+        const DWORD length = GetLengthSid(user);
+        sid.assign(static_cast<unsigned char*>(user), static_cast<unsigned char*>(user) + length);
+    }
+    CloseHandle(token);
+    return sid;
+}
+
+// The other end of a pipe is trusted only when it runs as this user: pipe
+// names are machine-wide, so another user could have created one first.
+bool ProcessIsThisUser(ULONG pid) {
+    static const std::vector<unsigned char> self = ProcessUserSid(GetCurrentProcess());
+    HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+    if (!process) {
+        return false;
+    }
+    const std::vector<unsigned char> other = ProcessUserSid(process);
+    CloseHandle(process);
+    return !self.empty() && other == self;
+}
+
+class Win32LocalConnection final : public LocalConnection {
+public:
+    explicit Win32LocalConnection(HANDLE pipe)
+        : pipe_(pipe), shutdownEvent_(CreateEventW(nullptr, TRUE, FALSE, nullptr)) {}
+
+    ~Win32LocalConnection() override {
+        CancelIoEx(pipe_, nullptr);
+        CloseIfValid(pipe_);
+        CloseIfValid(shutdownEvent_);
+    }
+
+    bool ReadAll(void* data, size_t size, Clock::time_point deadline) override {
+        char* p = static_cast<char*>(data);
+        while (size > 0) {
+            const DWORD chunk = size > (1u << 30) ? (1u << 30) : static_cast<DWORD>(size);
+            DWORD got = 0;
+            if (!Transfer(true, p, chunk, deadline, &got) || got == 0) {
+                return false;
+            }
+            p += got;
+            size -= got;
+        }
+        return true;
+    }
+
+    bool WriteAll(const void* data, size_t size) override {
+        const char* p = static_cast<const char*>(data);
+        while (size > 0) {
+            const DWORD chunk = size > (1u << 30) ? (1u << 30) : static_cast<DWORD>(size);
+            DWORD written = 0;
+            if (!Transfer(false, const_cast<char*>(p), chunk, Clock::time_point::max(), &written)) {
+                return false;
+            }
+            p += written;
+            size -= written;
+        }
+        return true;
+    }
+
+    // A named pipe signals nothing until a read completes, and a read would
+    // take the data; so it is peeked at every few milliseconds instead.
+    bool WaitPeerClosed(Clock::time_point deadline) override {
+        for (;;) {
+            DWORD available = 0;
+            if (!PeekNamedPipe(pipe_, nullptr, 0, nullptr, &available, nullptr)) {
+                return true;   // ERROR_BROKEN_PIPE: the client has gone
+            }
+            if (available > 0) {
+                return false;
+            }
+            const DWORD left = MillisecondsUntil(deadline);
+            if (left == 0) {
+                return false;
+            }
+            if (WaitForSingleObject(shutdownEvent_, left < 20 ? left : 20) == WAIT_OBJECT_0) {
+                return true;
+            }
+        }
+    }
+
+    void Shutdown() override {
+        SetEvent(shutdownEvent_);
+    }
+
+private:
+    bool Transfer(bool read, char* data, DWORD size, Clock::time_point deadline, DWORD* transferred) {
+        if (WaitForSingleObject(shutdownEvent_, 0) == WAIT_OBJECT_0) {
+            return false;
+        }
+        OVERLAPPED overlapped{};
+        overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+        if (!overlapped.hEvent) {
+            return false;
+        }
+        const BOOL started = read ? ReadFile(pipe_, data, size, nullptr, &overlapped)
+                                  : WriteFile(pipe_, data, size, nullptr, &overlapped);
+        if (!started && GetLastError() != ERROR_IO_PENDING) {
+            CloseHandle(overlapped.hEvent);
+            return false;
+        }
+        HANDLE waits[2] = { overlapped.hEvent, shutdownEvent_ };
+        const DWORD woke = WaitForMultipleObjects(2, waits, FALSE, MillisecondsUntil(deadline));
+        if (woke != WAIT_OBJECT_0) {
+            CancelIoEx(pipe_, &overlapped);
+        }
+        const BOOL done = GetOverlappedResult(pipe_, &overlapped, transferred, TRUE);
+        CloseHandle(overlapped.hEvent);
+        return done && woke == WAIT_OBJECT_0;
+    }
+
+    HANDLE pipe_;
+    HANDLE shutdownEvent_;
+};
+
+HANDLE CreatePipeInstance(const std::wstring& path, bool first) {
+    return CreateNamedPipeW(path.c_str(),
+                            PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED | (first ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0),
+                            PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+                            PIPE_UNLIMITED_INSTANCES, 64 * 1024, 64 * 1024, 0, nullptr);
+}
+
+class Win32LocalListener final : public LocalListener {
+public:
+    Win32LocalListener(std::wstring path, HANDLE first)
+        : path_(std::move(path)), next_(first), closeEvent_(CreateEventW(nullptr, TRUE, FALSE, nullptr)) {}
+
+    ~Win32LocalListener() override {
+        CloseIfValid(next_);
+        CloseIfValid(closeEvent_);
+    }
+
+    std::unique_ptr<LocalConnection> Accept() override {
+        for (;;) {
+            if (WaitForSingleObject(closeEvent_, 0) == WAIT_OBJECT_0) {
+                return nullptr;
+            }
+            if (!next_ || next_ == INVALID_HANDLE_VALUE) {
+                next_ = CreatePipeInstance(path_, false);
+                if (next_ == INVALID_HANDLE_VALUE) {
+                    next_ = nullptr;
+                    return nullptr;
+                }
+            }
+            OVERLAPPED overlapped{};
+            overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+            if (!overlapped.hEvent) {
+                return nullptr;
+            }
+            bool connected = ConnectNamedPipe(next_, &overlapped) != FALSE;
+            if (!connected) {
+                const DWORD error = GetLastError();
+                if (error == ERROR_PIPE_CONNECTED) {
+                    connected = true;
+                } else if (error == ERROR_IO_PENDING) {
+                    HANDLE waits[2] = { overlapped.hEvent, closeEvent_ };
+                    if (WaitForMultipleObjects(2, waits, FALSE, INFINITE) != WAIT_OBJECT_0) {
+                        CancelIoEx(next_, &overlapped);
+                    }
+                    DWORD ignored = 0;
+                    connected = GetOverlappedResult(next_, &overlapped, &ignored, TRUE) != FALSE;
+                }
+            }
+            CloseHandle(overlapped.hEvent);
+
+            HANDLE pipe = next_;
+            next_ = nullptr;
+            ULONG clientPid = 0;
+            if (!connected || !GetNamedPipeClientProcessId(pipe, &clientPid) || !ProcessIsThisUser(clientPid)) {
+                CloseIfValid(pipe);
+                continue;
+            }
+            return std::make_unique<Win32LocalConnection>(pipe);
+        }
+    }
+
+    void Close() override {
+        SetEvent(closeEvent_);
+    }
+
+private:
+    std::wstring path_;
+    HANDLE       next_;          // instance waiting for the next client
+    HANDLE       closeEvent_;
+};
+
+} // namespace
+
+std::string LocalEndpointAddress(const std::string& name) {
+    // Pipe names are machine-wide; terminal server sessions each get their own.
+    DWORD session = 0;
+    ProcessIdToSessionId(GetCurrentProcessId(), &session);
+    return "\\\\.\\pipe\\" + name + "-s" + std::to_string(session);
+}
+
+std::unique_ptr<LocalListener> ListenLocalEndpoint(const std::string& name, bool* inUse, std::string* error) {
+    if (inUse) *inUse = false;
+    const std::wstring path = WidenUtf8(LocalEndpointAddress(name));
+    HANDLE first = CreatePipeInstance(path, true);
+    if (first == INVALID_HANDLE_VALUE) {
+        const DWORD reason = GetLastError();
+        if (inUse) *inUse = reason == ERROR_ACCESS_DENIED || reason == ERROR_PIPE_BUSY;
+        if (error) *error = LastError("CreateNamedPipeW failed");
+        return nullptr;
+    }
+    return std::make_unique<Win32LocalListener>(path, first);
+}
+
+std::unique_ptr<LocalConnection> ConnectLocalEndpoint(const std::string& name,
+                                                      uint32_t timeoutMs,
+                                                      std::string* error) {
+    const std::wstring path = WidenUtf8(LocalEndpointAddress(name));
+    const Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+    for (;;) {
+        HANDLE pipe = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING,
+                                  FILE_FLAG_OVERLAPPED | SECURITY_SQOS_PRESENT | SECURITY_IDENTIFICATION, nullptr);
+        if (pipe != INVALID_HANDLE_VALUE) {
+            ULONG serverPid = 0;
+            if (!GetNamedPipeServerProcessId(pipe, &serverPid) || !ProcessIsThisUser(serverPid)) {
+                CloseHandle(pipe);
+                if (error) *error = "the pipe belongs to another user";
+                return nullptr;
+            }
+            return std::make_unique<Win32LocalConnection>(pipe);
+        }
+        if (GetLastError() != ERROR_PIPE_BUSY) {
+            if (error) *error = LastError("CreateFileW failed");
+            return nullptr;
+        }
+        const DWORD waitMs = MillisecondsUntil(deadline);
+        if (waitMs == 0 || !WaitNamedPipeW(path.c_str(), waitMs)) {
+            if (error) *error = "timed out connecting to the render service";
+            return nullptr;
+        }
+    }
+}
+
+} // namespace puml
@@ -0,0 +1,122 @@
+// Thread-safe least-recently-used map bounded by the total byte cost of its
+// values rather than by entry count.
+
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace puml {
+
+struct LruCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t insertions = 0;
+    uint64_t evictions = 0;
+    uint64_t entries = 0;
+    uint64_t bytes = 0;
+
+    double HitRatio() const {
+        const uint64_t lookups = hits + misses;
+        return lookups ? static_cast<double>(hits) / static_cast<double>(lookups) : 0.0;
+    }
+};
+
+// Value should be cheap to copy (e.g. a shared_ptr to an immutable artifact);
+// Get hands out copies so callers never hold the lock while using a value.
+template <typename Value>
+class ByteBudgetLruCache {
+public:
+    explicit ByteBudgetLruCache(uint64_t maxBytes) : maxBytes_(maxBytes) {}
+
+    ByteBudgetLruCache(const ByteBudgetLruCache&) = delete;
+    ByteBudgetLruCache& operator=(const ByteBudgetLruCache&) = delete;
+
+    bool Get(const std::string& key, Value& out) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(key);
+        if (it == index_.end()) {
+            ++stats_.misses;
+            return false;
+        }
+        entries_.splice(entries_.begin(), entries_, it->second);
+        out = it->second->value;
+        ++stats_.hits;
+        return true;
+    }
+
+    // Membership test that neither counts as a lookup nor refreshes recency.
+    bool Contains(const std::string& key) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return index_.find(key) != index_.end();
+    }
+
+    // Get that neither counts as a lookup nor refreshes recency.
+    bool Peek(const std::string& key, Value& out) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(key);
+        if (it == index_.end()) return false;
+        out = it->second->value;
+        return true;
+    }
+
+    // Values larger than the whole budget are not stored.
+    void Put(const std::string& key, Value value, uint64_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+            stats_.bytes -= it->second->bytes;
+            entries_.erase(it->second);
+            index_.erase(it);
+        }
+        if (bytes > maxBytes_) {
+            return;
+        }
+        entries_.push_front(Entry{ key, std::move(value), bytes });
+        index_.emplace(key, entries_.begin());
+        stats_.bytes += bytes;
+        ++stats_.insertions;
+        while (stats_.bytes > maxBytes_ && !entries_.empty()) {
+            const Entry& victim = entries_.back();
+            stats_.bytes -= victim.bytes;
+            index_.erase(victim.key);
+            entries_.pop_back();
+            ++stats_.evictions;
+        }
+    }
+
+    void Erase(const std::string& key) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(key);
+        if (it == index_.end()) return;
+        stats_.bytes -= it->second->bytes;
+        entries_.erase(it->second);
+        index_.erase(it);
+    }
+
+    LruCacheStats Stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        LruCacheStats stats = stats_;
+        stats.entries = index_.size();
+        return stats;
+    }
+
+private:
+    struct Entry {
+        std::string key;
+        Value       value;
+        uint64_t    bytes;
+    };
+
+    const uint64_t     maxBytes_;
+    mutable std::mutex mutex_;
+    std::list<Entry>   entries_;   // most recently used first
+    std::unordered_map<std::string, typename std::list<Entry>::iterator> index_;
+    LruCacheStats      stats_;
+};
+
+} // namespace puml
@@ -0,0 +1,641 @@
+#include "core/plantuml_daemon.h"
+
+#include "core/core_log.h"
+#include "core/diagram_splitter.h"
+#include "core/render_arena.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string_view>
+#include <thread>
+
+namespace puml {
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+// Splits the daemon's stdout into frames terminated by "<delimiter>\n"
+// (PlantUML uses println, so the newline may be "\r\n").
+class FrameSplitter {
+public:
+    explicit FrameSplitter(std::string delimiter) : delimiter_(std::move(delimiter)) {}
+
+    template <typename Fn>
+    void Feed(const unsigned char* data, size_t size, Fn&& onFrame) {
+        size_t i = 0;
+        while (i < size && skip_ != Skip::None) {
+            if (skip_ == Skip::NewLine) {
+                if (data[i] == '\r') { skip_ = Skip::LineFeed; ++i; }
+                else if (data[i] == '\n') { skip_ = Skip::None; ++i; }
+                else skip_ = Skip::None;
+            } else {
+                if (data[i] == '\n') ++i;
+                skip_ = Skip::None;
+            }
+        }
+        if (i == size) return;
+
+        // Only the bytes through the delimiter join the frame, so the frame
+        // buffer holds one image, not whatever else the read returned.
+        const std::string_view delimiter = delimiter_;
+        const std::string_view incoming(reinterpret_cast<const char*>(data + i), size - i);
+        size_t frameBytes = frame_.size();
+        size_t consumed = std::string_view::npos;   // of incoming, through the delimiter
+        // A delimiter begun in the bytes held before; the earliest start wins.
+        for (size_t held = std::min(frame_.size(), delimiter.size() - 1); held > 0; --held) {
+            const size_t start = frame_.size() - held;
+            if (std::equal(frame_.begin() + start, frame_.end(), delimiter.begin()) &&
+                incoming.substr(0, delimiter.size() - held) == delimiter.substr(held)) {
+                frameBytes = start;
+                consumed = delimiter.size() - held;
+                break;
+            }
+        }
+        if (consumed == std::string_view::npos) {
+            const size_t at = incoming.find(delimiter);
+            const size_t take = at == std::string_view::npos ? incoming.size() : at;
+            frame_.insert(frame_.end(), data + i, data + i + take);
+            if (at == std::string_view::npos) return;
+            frameBytes = frame_.size();
+            consumed = at + delimiter.size();
+        }
+
+        frame_.resize(frameBytes);
+        skip_ = Skip::NewLine;
+        // onFrame may swap in an emptied buffer of its own to keep the
+        // capacity, so the next frame needs no allocation.
+        onFrame(frame_);
+        frame_.clear();
+        if (consumed < incoming.size()) {
+            Feed(data + i + consumed, incoming.size() - consumed, onFrame);
+        }
+    }
+
+private:
+    enum class Skip { None, NewLine, LineFeed };
+    std::string                delimiter_;
+    std::vector<unsigned char> frame_;
+    Skip                       skip_ = Skip::None;
+};
+
+std::string MakeDelimiter() {
+    static std::atomic<unsigned> counter{0};
+    const auto stamp = static_cast<unsigned long long>(Clock::now().time_since_epoch().count());
+    return "~~PUMLWLX-" + std::to_string(stamp) + "-" + std::to_string(++counter) + "~~";
+}
+
+} // namespace
+
+size_t PreparePipeRequest(std::string_view utf8Source, std::pmr::vector<std::string_view>& outPieces) {
+    outPieces.clear();
+    const std::pmr::vector<DiagramBlock> blocks = SplitDiagramBlocks(utf8Source);
+    outPieces.reserve(3 * blocks.size());
+    for (const DiagramBlock& block : blocks) {
+        const DiagramBlockText text = BlockText(utf8Source, block);
+        for (std::string_view piece : {text.before, text.body, text.after}) {
+            if (piece.empty()) continue;
+            // Blocks next to each other in the source go out in one write.
+            if (!outPieces.empty() && outPieces.back().data() + outPieces.back().size() == piece.data()) {
+                outPieces.back() = std::string_view(outPieces.back().data(), outPieces.back().size() + piece.size());
+            } else {
+                outPieces.push_back(piece);
+            }
+        }
+    }
+    return blocks.size();
+}
+
+struct PlantUmlDaemon::Pending {
+    size_t                     expectedFrames = 0;
+    size_t                     receivedFrames = 0;
+    std::vector<unsigned char> output;
+    Clock::time_point          deadline;
+    bool                       done = false;
+    bool                       ok = false;
+    bool                       timedOut = false;
+    bool                       cancelled = false;
+    bool                       overLimit = false;   // the renderer was killed by its memory limit
+    bool                       background = false;
+    std::string                error;
+
+    // Ready for another request; the buffers keep their capacity.
+    void Reset() {
+        expectedFrames = 0;
+        receivedFrames = 0;
+        output.clear();
+        done = false;
+        ok = false;
+        timedOut = false;
+        cancelled = false;
+        overLimit = false;
+        background = false;
+        error.clear();
+    }
+};
+
+struct PlantUmlDaemon::Instance {
+    std::unique_ptr<ChildProcess>         process;
+    // Oldest first. A vector, unlike a deque, stops allocating once warm;
+    // it rarely holds more than a few requests.
+    std::vector<std::shared_ptr<Pending>> inflight;
+    std::thread                           reader;
+    std::thread                           watchdog;
+    Clock::time_point                     started;
+    Clock::time_point                     lastActivity;
+    bool                                  answered = false;   // first image received
+    bool                                  lowPriority = false;
+    bool                                  alive = true;
+    bool                                  retired = false;
+    bool                                  readerDone = false;
+    bool                                  watchdogDone = false;
+    // Held across a write to this stdin, so requests reach it in the order
+    // they join inflight; taken before the daemon's mutex_. A replacement
+    // process is written to while a write to a dying one is still blocked.
+    std::mutex                            writeMutex;
+    size_t                                writers = 0;   // Render calls about to write; not reaped before 0
+};
+
+PlantUmlDaemon::PlantUmlDaemon(DaemonOptions options)
+    : options_(std::move(options)), delimiter_(MakeDelimiter()) {}
+
+PlantUmlDaemon::~PlantUmlDaemon() {
+    Shutdown();
+}
+
+bool PlantUmlDaemon::Render(std::string_view utf8Source,
+                            uint32_t timeoutMs,
+                            std::vector<unsigned char>& out,
+                            std::string* error,
+                            const CancellationToken* cancel,
+                            bool background) {
+    ReapRetired();
+
+    std::pmr::vector<std::string_view> request(CurrentRenderArena());
+    const size_t frames = PreparePipeRequest(utf8Source, request);
+    if (frames == 0) {
+        if (error) *error = "source contains no diagram";
+        return false;
+    }
+
+    ConcurrencySlot slot(options_.limiter, background, cancel);
+    if (!slot.Acquired()) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++stats_.cancellations;
+        if (error) *error = "cancelled";
+        return false;
+    }
+    const Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        std::shared_ptr<Pending> pending;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending = AcquirePendingLocked();
+        }
+        pending->expectedFrames = frames;
+        pending->deadline = deadline;
+        pending->background = background;
+
+        // Declared before the wait lock below so it unregisters after that
+        // lock is released: the callback itself takes mutex_. It is gone
+        // before pending, so a plain pointer will do (and fits in the
+        // std::function without an allocation).
+        Pending* raw = pending.get();
+        CancellationRegistration onCancel(cancel, [this, raw]() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!raw->done) {
+                raw->done = true;
+                raw->cancelled = true;
+                raw->error = "cancelled";
+            }
+            cv_.notify_all();
+        });
+
+        Instance* inst = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (IsCancelled(cancel)) {
+                ++stats_.cancellations;
+                if (error) *error = "cancelled";
+                return false;
+            }
+            inst = EnsureInstanceLocked(error);
+            if (!inst) {
+                ++stats_.failures;
+                return false;
+            }
+            ++inst->writers;
+        }
+        bool cancelled = false;
+        {
+            std::lock_guard<std::mutex> writeLock(inst->writeMutex);
+            bool queued = false;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (IsCancelled(cancel)) {
+                    cancelled = true;   // while waiting for the write lock
+                } else if (!inst->alive) {
+                    // Died while we waited for its stdin; never sent, so lost.
+                    pending->done = true;
+                    pending->error = "renderer process exited";
+                } else {
+                    inst->inflight.push_back(pending);
+                    inst->lastActivity = Clock::now();
+                    UpdatePriorityLocked(inst);
+                    queued = true;
+                }
+            }
+            if (queued) {
+                cv_.notify_all();
+                bool written = true;
+                for (std::string_view piece : request) {
+                    written = written && inst->process->WriteStdin(piece.data(), piece.size());
+                }
+                if (!written) {
+                    // The reader thread fails everything in flight once it sees EOF.
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    Log(options_.name + " daemon: write to stdin failed");
+                    RetireLocked(inst);
+                }
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--inst->writers == 0) cv_.notify_all();
+            if (cancelled) {
+                ++stats_.cancellations;
+                if (error) *error = "cancelled";
+                return false;
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [&]() { return pending->done; });
+        if (pending->ok) {
+            out.swap(pending->output);
+            ++stats_.renders;
+            return true;
+        }
+        if (pending->cancelled) {
+            ++stats_.cancellations;
+            if (error) *error = pending->error;
+            return false;
+        }
+        if (pending->overLimit) {
+            // A fresh process would only run out of memory again.
+            ++stats_.failures;
+            if (error) *error = pending->error;
+            return false;
+        }
+        if (pending->timedOut || Clock::now() >= deadline) {
+            ++stats_.failures;
+            if (error) *error = pending->error.empty() ? std::string("timed out") : pending->error;
+            return false;
+        }
+        if (attempt == 0) {
+            Log(options_.name + " daemon: request lost (" + pending->error + "), retrying on a fresh process");
+        } else {
+            ++stats_.failures;
+            if (error) *error = pending->error;
+        }
+    }
+    return false;
+}
+
+void PlantUmlDaemon::Shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& inst : instances_) {
+            RetireLocked(inst.get());
+        }
+    }
+    cv_.notify_all();
+
+    std::list<std::unique_ptr<Instance>> all;
+    {
+        // The processes are dead, so a blocked write returns promptly.
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this]() {
+            return std::none_of(instances_.begin(), instances_.end(),
+                                [](const std::unique_ptr<Instance>& inst) { return inst->writers > 0; });
+        });
+        all.swap(instances_);
+    }
+    for (auto& inst : all) {
+        if (inst->reader.joinable()) inst->reader.join();
+        if (inst->watchdog.joinable()) inst->watchdog.join();
+    }
+}
+
+DaemonStats PlantUmlDaemon::Stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+bool PlantUmlDaemon::IsRunning() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return current_ && current_->alive;
+}
+
+std::shared_ptr<PlantUmlDaemon::Pending> PlantUmlDaemon::AcquirePendingLocked() {
+    // Every copy of a pooled record is made or dropped under mutex_ except
+    // the one its Render call drops on return, so a count of 1 means free:
+    // no Render uses it and no instance has it in flight any more.
+    static const size_t kPooled = 16;
+    for (const std::shared_ptr<Pending>& pending : pendingPool_) {
+        if (pending.use_count() == 1) {
+            pending->Reset();
+            return pending;
+        }
+    }
+    auto pending = std::make_shared<Pending>();
+    if (pendingPool_.size() < kPooled) pendingPool_.push_back(pending);
+    return pending;
+}
+
+PlantUmlDaemon::Instance* PlantUmlDaemon::EnsureInstanceLocked(std::string* error) {
+    if (current_ && current_->alive) {
+        return current_;
+    }
+
+    ProcessSpec spec = options_.process;
+    if (options_.launchOptions) {
+        const std::vector<std::string> launchOptions = options_.launchOptions();
+        spec.arguments.insert(spec.arguments.begin(), launchOptions.begin(), launchOptions.end());
+    }
+    spec.arguments.push_back("-pipedelimitor");
+    spec.arguments.push_back(delimiter_);
+    spec.discardStderr = true;
+
+    std::string startError;
+    std::unique_ptr<ChildProcess> process = StartChildProcess(spec, &startError);
+    if (!process) {
+        Log(options_.name + " daemon: failed to start renderer: " + startError);
+        if (error) *error = "failed to start renderer: " + startError;
+        return nullptr;
+    }
+
+    auto inst = std::make_unique<Instance>();
+    inst->process = std::move(process);
+    inst->started = Clock::now();
+    inst->lastActivity = inst->started;
+    Instance* raw = inst.get();
+    raw->reader = std::thread([this, raw]() { ReaderLoop(raw); });
+    raw->watchdog = std::thread([this, raw]() { WatchdogLoop(raw); });
+    instances_.push_back(std::move(inst));
+    current_ = raw;
+    ++stats_.starts;
+    Log(options_.name + " daemon: started renderer pid=" + std::to_string(raw->process->Id()) +
+        " (start #" + std::to_string(stats_.starts) + ")");
+    return raw;
+}
+
+void PlantUmlDaemon::RetireLocked(Instance* inst) {
+    if (!inst || inst->retired) return;
+    inst->retired = true;
+    inst->alive = false;
+    if (current_ == inst) current_ = nullptr;
+    inst->process->Kill();
+    cv_.notify_all();
+}
+
+void PlantUmlDaemon::FailInflightLocked(Instance* inst, const std::string& reason) {
+    for (auto& pending : inst->inflight) {
+        if (!pending->done) {
+            pending->done = true;
+            pending->ok = false;
+            pending->error = reason;
+        }
+    }
+    inst->inflight.clear();
+    cv_.notify_all();
+}
+
+void PlantUmlDaemon::UpdatePriorityLocked(Instance* inst) {
+    bool low = !inst->inflight.empty();
+    for (const auto& pending : inst->inflight) {
+        low = low && pending->background;
+    }
+    if (low != inst->lowPriority) {
+        inst->lowPriority = low;
+        inst->process->SetLowPriority(low);
+    }
+}
+
+void PlantUmlDaemon::ReaderLoop(Instance* inst) {
+    FrameSplitter splitter(delimiter_);
+    std::vector<unsigned char> chunk(64 * 1024);
+    for (;;) {
+        const std::ptrdiff_t got = inst->process->ReadStdout(chunk.data(), chunk.size());
+        if (got <= 0) break;
+        splitter.Feed(chunk.data(), static_cast<size_t>(got), [&](std::vector<unsigned char>& frame) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (inst->inflight.empty()) {
+                Log(options_.name + " daemon: dropping unexpected output frame (" +
+                    std::to_string(frame.size()) + " bytes)");
+                return;
+            }
+            std::shared_ptr<Pending>& pending = inst->inflight.front();
+            if (!pending->done) {
+                if (pending->output.empty()) {
+                    // The splitter gets the emptied buffer back.
+                    pending->output.swap(frame);
+                } else {
+                    pending->output.insert(pending->output.end(), frame.begin(), frame.end());
+                }
+            }
+            if (!inst->answered) {
+                // JVM start-up plus the first render: what a cold start costs.
+                inst->answered = true;
+                const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - inst->started);
+                Log(options_.name + " daemon: renderer pid=" + std::to_string(inst->process->Id()) +
+                    " delivered its first image " + std::to_string(ms.count()) + " ms after start");
+            }
+            if (++pending->receivedFrames >= pending->expectedFrames) {
+                if (!pending->done) {
+                    pending->done = true;
+                    pending->ok = true;
+                }
+                inst->inflight.erase(inst->inflight.begin());
+                inst->lastActivity = Clock::now();
+                UpdatePriorityLocked(inst);
+                cv_.notify_all();
+            }
+        });
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    const bool overLimit = inst->process->Violation() == LimitViolation::Memory;
+    if (overLimit) {
+        ++stats_.limitKills;
+        Log(options_.name + " daemon: renderer pid=" + std::to_string(inst->process->Id()) +
+            " killed: memory limit of " + std::to_string(options_.process.limits.memoryBytes / (1024 * 1024)) +
+            " MB exceeded");
+        inst->retired = true;
+    } else if (!inst->retired) {
+        ++stats_.crashes;
+        int exitCode = -1;
+        inst->process->WaitForExit(0, &exitCode);
+        Log(options_.name + " daemon: renderer pid=" + std::to_string(inst->process->Id()) +
+            " exited unexpectedly (exitCode=" + std::to_string(exitCode) + ")");
+        inst->retired = true;
+    }
+    inst->alive = false;
+    if (current_ == inst) current_ = nullptr;
+    for (auto& pending : inst->inflight) {
+        pending->overLimit = overLimit;
+    }
+    FailInflightLocked(inst, overLimit ? "renderer exceeded its memory limit" : "renderer process exited");
+    inst->readerDone = true;
+    cv_.notify_all();
+}
+
+void PlantUmlDaemon::WatchdogLoop(Instance* inst) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    bool closeGracefully = false;
+    while (inst->alive) {
+        const Clock::time_point now = Clock::now();
+        Clock::time_point wake = Clock::time_point::max();
+        bool expired = false;
+        for (auto& pending : inst->inflight) {
+            if (pending->done) continue;
+            if (pending->deadline <= now) {
+                pending->done = true;
+                pending->timedOut = true;
+                pending->error = "timed out";
+                expired = true;
+            } else {
+                wake = std::min(wake, pending->deadline);
+            }
+        }
+        if (expired) {
+            ++stats_.timeouts;
+            Log(options_.name + " daemon: render timed out, killing renderer pid=" +
+                std::to_string(inst->process->Id()));
+            RetireLocked(inst);
+            break;
+        }
+        if (inst->inflight.empty() && inst->writers == 0) {
+            const Clock::time_point idleAt = inst->lastActivity + std::chrono::milliseconds(options_.idleShutdownMs);
+            if (idleAt <= now) {
+                ++stats_.idleShutdowns;
+                Log(options_.name + " daemon: idle for " + std::to_string(options_.idleShutdownMs) +
+                    " ms, stopping renderer pid=" + std::to_string(inst->process->Id()));
+                inst->retired = true;
+                inst->alive = false;
+                if (current_ == inst) current_ = nullptr;
+                closeGracefully = true;
+                break;
+            }
+            wake = std::min(wake, idleAt);
+        }
+        if (wake == Clock::time_point::max()) {
+            cv_.wait(lock);
+        } else {
+            cv_.wait_until(lock, wake);
+        }
+    }
+    lock.unlock();
+
+    if (closeGracefully) {
+        {
+            // A writer that picked this instance before it retired finds it
+            // dead under this lock and does not write.
+            std::lock_guard<std::mutex> writeLock(inst->writeMutex);
+            inst->process->CloseStdin();
+        }
+        if (!inst->process->WaitForExit(3000, nullptr)) {
+            inst->process->Kill();
+        }
+    }
+
+    lock.lock();
+    inst->watchdogDone = true;
+}
+
+void PlantUmlDaemon::ReapRetired() {
+    std::list<std::unique_ptr<Instance>> finished;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = instances_.begin(); it != instances_.end();) {
+            if ((*it)->readerDone && (*it)->watchdogDone && (*it)->writers == 0) {
+                finished.push_back(std::move(*it));
+                it = instances_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    for (auto& inst : finished) {
+        if (inst->reader.joinable()) inst->reader.join();
+        if (inst->watchdog.joinable()) inst->watchdog.join();
+    }
+}
+
+PlantUmlDaemonPool::PlantUmlDaemonPool(const DaemonOptions& options, size_t instances) {
+    if (instances == 0) instances = 1;
+    for (size_t i = 0; i < instances; ++i) {
+        DaemonOptions copy = options;
+        if (instances > 1) copy.name += "#" + std::to_string(i + 1);
+        daemons_.push_back(std::make_unique<PlantUmlDaemon>(std::move(copy)));
+    }
+    busy_.assign(instances, 0);
+}
+
+bool PlantUmlDaemonPool::Render(std::string_view utf8Source,
+                                uint32_t timeoutMs,
+                                std::vector<unsigned char>& out,
+                                std::string* error,
+                                const CancellationToken* cancel,
+                                bool background) {
+    size_t chosen = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const size_t none = daemons_.size();
+        size_t idleRunning = none;
+        size_t stopped = none;
+        size_t leastBusy = 0;
+        for (size_t i = 0; i < daemons_.size(); ++i) {
+            if (busy_[i] < busy_[leastBusy]) leastBusy = i;
+            if (busy_[i] != 0) continue;
+            if (daemons_[i]->IsRunning()) {
+                if (idleRunning == none) idleRunning = i;
+            } else if (stopped == none) {
+                stopped = i;
+            }
+        }
+        chosen = idleRunning != none ? idleRunning : stopped != none ? stopped : leastBusy;
+        ++busy_[chosen];
+    }
+
+    const bool ok = daemons_[chosen]->Render(utf8Source, timeoutMs, out, error, cancel, background);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    --busy_[chosen];
+    return ok;
+}
+
+void PlantUmlDaemonPool::Shutdown() {
+    for (auto& daemon : daemons_) {
+        daemon->Shutdown();
+    }
+}
+
+DaemonStats PlantUmlDaemonPool::Stats() const {
+    DaemonStats total;
+    for (const auto& daemon : daemons_) {
+        const DaemonStats stats = daemon->Stats();
+        total.starts += stats.starts;
+        total.renders += stats.renders;
+        total.failures += stats.failures;
+        total.timeouts += stats.timeouts;
+        total.crashes += stats.crashes;
+        total.idleShutdowns += stats.idleShutdowns;
+        total.cancellations += stats.cancellations;
+        total.limitKills += stats.limitKills;
+    }
+    return total;
+}
+
+} // namespace puml
@@ -0,0 +1,141 @@
+// Long-lived "java -jar plantuml.jar -pipe" renderer.
+//
+// One JVM stays resident and serves many diagrams over the same stdin/stdout
+// using PlantUML's -pipedelimitor framing. Requests are pipelined: writers
+// append to stdin while a reader thread splits stdout into frames and hands
+// them back in FIFO order. The process is restarted after a crash or a
+// timeout and shut down after an idle period.
+
+#pragma once
+
+#include "core/cancellation.h"
+#include "core/child_process.h"
+#include "core/concurrency_limiter.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace puml {
+
+struct DaemonOptions {
+    // java + JVM options + "-jar <jar> -pipe -t<fmt>"; the daemon appends the
+    // -pipedelimitor argument itself.
+    ProcessSpec process;
+    // Asked at every start for JVM options to put in front of
+    // process.arguments, so a JVM started later picks up e.g. a class data
+    // archive created since. Called with the daemon's lock held, like the
+    // start itself: it may check files and log, but must not wait for a
+    // render or call back into the daemon.
+    std::function<std::vector<std::string>()> launchOptions;
+    uint32_t    idleShutdownMs = 120000;
+    std::string name = "plantuml";          // used in log messages
+    // Shared cap on renders working at once; a slot is held per request.
+    ConcurrencyLimiter* limiter = nullptr;
+};
+
+struct DaemonStats {
+    uint64_t starts = 0;
+    uint64_t renders = 0;
+    uint64_t failures = 0;
+    uint64_t timeouts = 0;
+    uint64_t crashes = 0;
+    uint64_t idleShutdowns = 0;
+    uint64_t cancellations = 0;
+    uint64_t limitKills = 0;        // renderers killed for exceeding their memory limit
+};
+
+// What to write to the pipe for a source so that every diagram it contains
+// is terminated by an @end line (PlantUML only flushes a pipe diagram when
+// it sees one): views of the source and of the lines added to it, in order,
+// so the source itself is never copied. Returns the number of images the
+// pipe will produce for it.
+size_t PreparePipeRequest(std::string_view utf8Source, std::pmr::vector<std::string_view>& outPieces);
+
+class PlantUmlDaemon {
+public:
+    explicit PlantUmlDaemon(DaemonOptions options);
+    ~PlantUmlDaemon();
+
+    PlantUmlDaemon(const PlantUmlDaemon&) = delete;
+    PlantUmlDaemon& operator=(const PlantUmlDaemon&) = delete;
+
+    // Renders every diagram in utf8Source; the images are concatenated into
+    // out in source order. Thread-safe; concurrent calls are pipelined.
+    // Cancelling returns at once; a request already written to the shared
+    // JVM still runs there and its output is discarded. The JVM runs at
+    // lowered priority while only background requests are in flight. The
+    // timeout starts once the request has a concurrency slot.
+    bool Render(std::string_view utf8Source,
+                uint32_t timeoutMs,
+                std::vector<unsigned char>& out,
+                std::string* error,
+                const CancellationToken* cancel = nullptr,
+                bool background = false);
+
+    void Shutdown();
+    DaemonStats Stats() const;
+    bool IsRunning() const;        // a JVM is up right now
+
+private:
+    struct Pending;
+    struct Instance;
+
+    std::shared_ptr<Pending> AcquirePendingLocked();
+    Instance* EnsureInstanceLocked(std::string* error);
+    void RetireLocked(Instance* inst);
+    void FailInflightLocked(Instance* inst, const std::string& reason);
+    void UpdatePriorityLocked(Instance* inst);
+    void ReaderLoop(Instance* inst);
+    void WatchdogLoop(Instance* inst);
+    void ReapRetired();
+
+    DaemonOptions options_;
+    std::string   delimiter_;
+
+    mutable std::mutex      mutex_;        // guards everything below
+    std::condition_variable cv_;
+    std::list<std::unique_ptr<Instance>> instances_;
+    Instance*               current_ = nullptr;
+    DaemonStats             stats_;
+    // Request records kept for reuse with their output buffers; one is free
+    // when nothing else holds it.
+    std::vector<std::shared_ptr<Pending>> pendingPool_;
+};
+
+// Several daemons for the same output format, so that independent diagrams
+// render in parallel JVMs. JVMs start on demand: a request goes to an idle
+// running daemon first, then to one not started yet, then to the least busy.
+class PlantUmlDaemonPool {
+public:
+    PlantUmlDaemonPool(const DaemonOptions& options, size_t instances);
+
+    PlantUmlDaemonPool(const PlantUmlDaemonPool&) = delete;
+    PlantUmlDaemonPool& operator=(const PlantUmlDaemonPool&) = delete;
+
+    // Same contract as PlantUmlDaemon::Render.
+    bool Render(std::string_view utf8Source,
+                uint32_t timeoutMs,
+                std::vector<unsigned char>& out,
+                std::string* error,
+                const CancellationToken* cancel = nullptr,
+                bool background = false);
+
+    void Shutdown();
+    DaemonStats Stats() const;     // summed over all daemons
+    size_t Size() const { return daemons_.size(); }
+
+private:
+    std::vector<std::unique_ptr<PlantUmlDaemon>> daemons_;
+    mutable std::mutex  mutex_;
+    std::vector<size_t> busy_;     // Render calls in progress per daemon
+};
+
+} // namespace puml
@@ -0,0 +1,262 @@
+#include "core/process_pump.h"
+
+#include "core/core_log.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace puml {
+
+using Clock = std::chrono::steady_clock;
+
+// ---------------------- SpillableBuffer ----------------------
+
+SpillableBuffer::SpillableBuffer(uint64_t memoryLimit, std::string spillDirectoryUtf8)
+    : memoryLimit_(memoryLimit), spillDirectory_(std::move(spillDirectoryUtf8)) {}
+
+SpillableBuffer::~SpillableBuffer() {
+    if (spillFile_.is_open()) {
+        spillFile_.close();
+    }
+    if (!spillPath_.empty()) {
+        std::error_code ec;
+        fs::remove(fs::u8path(spillPath_), ec);
+    }
+}
+
+unsigned char* SpillableBuffer::WritableTail(size_t* capacity) {
+    if (blocks_.empty() || tailUsed_ == kBlockSize) {
+        // Once spilled, the single block is a staging area flushed on Commit.
+        if (spilled_ && !blocks_.empty()) {
+            tailUsed_ = 0;
+        } else {
+            blocks_.push_back(BufferPool::Shared().Acquire(kBlockSize));
+            tailUsed_ = 0;
+        }
+    }
+    *capacity = kBlockSize - tailUsed_;
+    return blocks_.back().Data() + tailUsed_;
+}
+
+bool SpillableBuffer::Commit(size_t size) {
+    if (failed_) return false;
+    tailUsed_ += size;
+    size_ += size;
+    if (spilled_) {
+        return FlushTail();
+    }
+    if (!spillDirectory_.empty() && size_ > memoryLimit_) {
+        return SpillToFile();
+    }
+    return true;
+}
+
+bool SpillableBuffer::Append(const void* data, size_t size) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    while (size > 0) {
+        size_t capacity = 0;
+        unsigned char* tail = WritableTail(&capacity);
+        const size_t n = size < capacity ? size : capacity;
+        std::memcpy(tail, p, n);
+        if (!Commit(n)) return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool SpillableBuffer::SpillToFile() {
+    static std::atomic<unsigned> counter{0};
+    const auto stamp = static_cast<unsigned long long>(Clock::now().time_since_epoch().count());
+    const fs::path path = fs::u8path(spillDirectory_) /
+        ("puml-spill-" + std::to_string(stamp) + "-" + std::to_string(++counter) + ".tmp");
+    spillFile_.open(path, std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc);
+    if (!spillFile_) {
+        Log("SpillableBuffer: cannot create " + path.u8string());
+        failed_ = true;
+        return false;
+    }
+    spillPath_ = path.u8string();
+    for (size_t i = 0; i < blocks_.size(); ++i) {
+        const size_t used = (i + 1 == blocks_.size()) ? tailUsed_ : kBlockSize;
+        spillFile_.write(reinterpret_cast<const char*>(blocks_[i].Data()), static_cast<std::streamsize>(used));
+    }
+    blocks_.resize(1);
+    tailUsed_ = 0;
+    spilled_ = true;
+    if (!spillFile_) {
+        Log("SpillableBuffer: failed to write " + spillPath_);
+        failed_ = true;
+        return false;
+    }
+    Log("SpillableBuffer: output exceeded " + std::to_string(memoryLimit_) + " bytes, spilling to " + spillPath_);
+    return true;
+}
+
+bool SpillableBuffer::FlushTail() {
+    if (tailUsed_ == kBlockSize) {
+        spillFile_.write(reinterpret_cast<const char*>(blocks_.back().Data()), static_cast<std::streamsize>(tailUsed_));
+        tailUsed_ = 0;
+        if (!spillFile_) {
+            failed_ = true;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SpillableBuffer::ReadAll(std::vector<unsigned char>& out) {
+    out.clear();
+    if (failed_) return false;
+    out.resize(static_cast<size_t>(size_));
+    if (!spilled_) {
+        size_t offset = 0;
+        for (size_t i = 0; i < blocks_.size(); ++i) {
+            const size_t used = (i + 1 == blocks_.size()) ? tailUsed_ : kBlockSize;
+            std::memcpy(out.data() + offset, blocks_[i].Data(), used);
+            offset += used;
+        }
+        return true;
+    }
+
+    const uint64_t onDisk = size_ - tailUsed_;
+    spillFile_.flush();
+    spillFile_.seekg(0);
+    if (onDisk) spillFile_.read(reinterpret_cast<char*>(out.data()), static_cast<std::streamsize>(onDisk));
+    if (!spillFile_) {
+        Log("SpillableBuffer: failed to read back " + spillPath_);
+        out.clear();
+        return false;
+    }
+    if (tailUsed_) std::memcpy(out.data() + onDisk, blocks_.back().Data(), tailUsed_);
+    return true;
+}
+
+// ---------------------- RunProcessPump ----------------------
+
+const char* PumpStatusName(PumpStatus status) {
+    switch (status) {
+    case PumpStatus::Completed:      return "completed";
+    case PumpStatus::StartFailed:    return "start failed";
+    case PumpStatus::TimedOut:       return "timed out";
+    case PumpStatus::OutputTooLarge: return "output too large";
+    case PumpStatus::ReadFailed:     return "read failed";
+    case PumpStatus::SpillFailed:    return "spill failed";
+    case PumpStatus::Cancelled:      return "cancelled";
+    case PumpStatus::MemoryLimit:    return "memory limit exceeded";
+    }
+    return "unknown";
+}
+
+PumpResult RunProcessPump(const ProcessSpec& spec,
+                          std::string_view input,
+                          const PumpOptions& options,
+                          SpillableBuffer& output,
+                          std::string* error,
+                          const CancellationToken* cancel) {
+    PumpResult result;
+    ConcurrencySlot slot(options.limiter, options.background, cancel);
+    result.waitMs = slot.WaitedMs();
+    const Clock::time_point started = Clock::now();
+    const Clock::time_point deadline = started + std::chrono::milliseconds(options.timeoutMs);
+
+    if (!slot.Acquired() || IsCancelled(cancel)) {
+        result.status = PumpStatus::Cancelled;
+        if (error) *error = "cancelled before start";
+        return result;
+    }
+    std::unique_ptr<ChildProcess> child = StartChildProcess(spec, error);
+    if (!child) {
+        return result;
+    }
+    CancellationRegistration onCancel(cancel, [&child]() { child->Kill(); });
+
+    // Kills the child at the deadline, which unblocks both pipe ends.
+    std::mutex timerMutex;
+    std::condition_variable timerCv;
+    bool finished = false;
+    std::atomic<bool> timedOut{false};
+    std::thread timer([&]() {
+        std::unique_lock<std::mutex> lock(timerMutex);
+        if (!timerCv.wait_until(lock, deadline, [&]() { return finished; })) {
+            timedOut = true;
+            child->Kill();
+        }
+    });
+
+    std::atomic<bool> stdinComplete{false};
+    std::thread writer([&]() {
+        if (input.empty() || child->WriteStdin(input.data(), input.size())) {
+            stdinComplete = true;
+        }
+        child->CloseStdin();
+    });
+
+    result.status = PumpStatus::Completed;
+    for (;;) {
+        size_t capacity = 0;
+        unsigned char* tail = output.WritableTail(&capacity);
+        const std::ptrdiff_t n = child->ReadStdout(tail, capacity);
+        if (n == 0) break;
+        if (n < 0) {
+            result.status = PumpStatus::ReadFailed;
+            break;
+        }
+        if (!output.Commit(static_cast<size_t>(n))) {
+            result.status = PumpStatus::SpillFailed;
+            break;
+        }
+        if (output.Size() > options.maxOutputBytes) {
+            result.status = PumpStatus::OutputTooLarge;
+            break;
+        }
+    }
+
+    if (result.status != PumpStatus::Completed) {
+        child->Kill();
+    }
+    const auto now = Clock::now();
+    const uint32_t remainingMs = now < deadline
+        ? static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count())
+        : 0;
+    if (!child->WaitForExit(remainingMs, &result.exitCode)) {
+        // Closed stdout but kept running past the deadline.
+        timedOut = true;
+        child->Kill();
+        child->WaitForExit(1000, &result.exitCode);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(timerMutex);
+        finished = true;
+    }
+    timerCv.notify_one();
+    timer.join();
+    writer.join();
+
+    if (IsCancelled(cancel)) {
+        result.status = PumpStatus::Cancelled;
+    } else if (child->Violation() == LimitViolation::Memory) {
+        result.status = PumpStatus::MemoryLimit;
+    } else if (timedOut) {
+        result.status = PumpStatus::TimedOut;
+    }
+    result.stdinComplete = stdinComplete;
+    result.outputBytes = output.Size();
+    result.elapsedMs = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - started).count());
+    if (error && result.status != PumpStatus::Completed) {
+        *error = std::string("child process ") + PumpStatusName(result.status) +
+                 " after " + std::to_string(result.elapsedMs) + " ms";
+    }
+    return result;
+}
+
+} // namespace puml
@@ -0,0 +1,98 @@
+// Runs a child process to completion with its stdin and stdout serviced at
+// the same time, so neither side can fill a pipe and stall the other, and a
+// deadline that holds even while a read or write is blocked.
+
+#pragma once
+
+#include "core/buffer_pool.h"
+#include "core/cancellation.h"
+#include "core/child_process.h"
+#include "core/concurrency_limiter.h"
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace puml {
+
+// Append-only byte store that grows in fixed-size blocks instead of
+// reallocating, and moves its contents to a temporary file once it exceeds
+// the memory limit. The blocks are borrowed from the shared BufferPool.
+class SpillableBuffer {
+public:
+    static constexpr size_t kBlockSize = 64 * 1024;
+
+    // An empty spill directory keeps everything in memory.
+    SpillableBuffer(uint64_t memoryLimit, std::string spillDirectoryUtf8);
+    ~SpillableBuffer();
+
+    SpillableBuffer(const SpillableBuffer&) = delete;
+    SpillableBuffer& operator=(const SpillableBuffer&) = delete;
+
+    // Space to read into directly; Commit the number of bytes filled.
+    unsigned char* WritableTail(size_t* capacity);
+    bool Commit(size_t size);
+    bool Append(const void* data, size_t size);
+
+    uint64_t Size() const { return size_; }
+    bool Spilled() const { return spilled_; }
+
+    // Copies everything into out with a single allocation.
+    bool ReadAll(std::vector<unsigned char>& out);
+
+private:
+    bool SpillToFile();
+    bool FlushTail();
+
+    uint64_t    memoryLimit_;
+    std::string spillDirectory_;
+    std::string spillPath_;
+    std::fstream spillFile_;
+    bool        spilled_ = false;
+    bool        failed_ = false;
+    uint64_t    size_ = 0;
+    std::vector<PooledBuffer> blocks_;   // from BufferPool::Shared()
+    size_t      tailUsed_ = 0;   // bytes used in blocks_.back()
+};
+
+struct PumpOptions {
+    uint32_t timeoutMs = 8000;                        // from the start of the child
+    uint64_t maxOutputBytes = 256ull * 1024 * 1024;   // exceeded output fails the run
+    ConcurrencyLimiter* limiter = nullptr;            // slot held while the child runs
+    bool     background = false;                      // waits behind foreground work for a slot
+};
+
+enum class PumpStatus {
+    Completed,
+    StartFailed,
+    TimedOut,
+    OutputTooLarge,
+    ReadFailed,
+    SpillFailed,
+    Cancelled,
+    MemoryLimit,    // killed for exceeding spec.limits.memoryBytes
+};
+
+struct PumpResult {
+    PumpStatus status = PumpStatus::StartFailed;
+    int        exitCode = -1;
+    bool       stdinComplete = false;   // false if the child stopped reading early
+    uint64_t   outputBytes = 0;
+    uint64_t   elapsedMs = 0;
+    uint64_t   waitMs = 0;              // spent waiting for a concurrency slot
+};
+
+const char* PumpStatusName(PumpStatus status);
+
+// Cancelling kills the child.
+PumpResult RunProcessPump(const ProcessSpec& spec,
+                          std::string_view input,
+                          const PumpOptions& options,
+                          SpillableBuffer& output,
+                          std::string* error,
+                          const CancellationToken* cancel = nullptr);
+
+} // namespace puml
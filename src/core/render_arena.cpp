@@ -0,0 +1,61 @@
+#include "core/render_arena.h"
+
+#include <utility>
+
+namespace puml {
+
+RenderArena::RenderArena(BufferPool& pool) : pool_(pool) {}
+
+RenderArena::~RenderArena() = default;   // the chunks go back to the pool
+
+void* RenderArena::do_allocate(size_t bytes, size_t alignment) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    allocated_ += bytes;
+    if (chunkCount_ > 0) {
+        PooledBuffer& chunk = Current();
+        const size_t start = (used_ + alignment - 1) & ~(alignment - 1);
+        if (start <= chunk.Capacity() && bytes <= chunk.Capacity() - start) {
+            used_ = start + bytes;
+            return chunk.Data() + start;
+        }
+    }
+    // Pool buffers come from new[], aligned for any fundamental type. Larger
+    // requests get a chunk of their own, rounded up to a pool size class.
+    PooledBuffer chunk = pool_.Acquire(bytes > kChunkBytes ? bytes : kChunkBytes);
+    if (chunkCount_ < kInlineChunks) {
+        inline_[chunkCount_] = std::move(chunk);
+    } else {
+        overflow_.push_back(std::move(chunk));
+    }
+    ++chunkCount_;
+    used_ = bytes;
+    return Current().Data();
+}
+
+uint64_t RenderArena::AllocatedBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return allocated_;
+}
+
+size_t RenderArena::ChunkCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return chunkCount_;
+}
+
+namespace {
+thread_local std::pmr::memory_resource* t_currentArena = nullptr;
+} // namespace
+
+std::pmr::memory_resource* CurrentRenderArena() {
+    return t_currentArena ? t_currentArena : std::pmr::get_default_resource();
+}
+
+RenderArenaScope::RenderArenaScope(std::pmr::memory_resource* arena) : previous_(t_currentArena) {
+    t_currentArena = arena;
+}
+
+RenderArenaScope::~RenderArenaScope() {
+    t_currentArena = previous_;
+}
+
+} // namespace puml
@@ -0,0 +1,74 @@
+// Scratch memory for one render. Temporaries that die with the render (the
+// list of images, byte ranges, markup assembled before it becomes the page)
+// are bump-allocated from chunks borrowed from the shared BufferPool and
+// all given back together when the render ends, so a render in the steady
+// state costs no heap allocations for them.
+//
+// Use it through std::pmr containers. Nothing allocated from an arena may
+// outlive it: results that are cached or handed to the window are plain
+// std::string / std::vector.
+
+#pragma once
+
+#include "core/buffer_pool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <mutex>
+#include <vector>
+
+namespace puml {
+
+class RenderArena : public std::pmr::memory_resource {
+public:
+    static constexpr size_t kChunkBytes = 64 * 1024;
+    // Chunks tracked without a heap allocation; a render needing more (over
+    // a megabyte of scratch) lists the rest in a vector.
+    static constexpr size_t kInlineChunks = 16;
+
+    explicit RenderArena(BufferPool& pool = BufferPool::Shared());
+    ~RenderArena() override;
+    RenderArena(const RenderArena&) = delete;
+    RenderArena& operator=(const RenderArena&) = delete;
+
+    uint64_t AllocatedBytes() const;   // handed out, including what was freed
+    size_t   ChunkCount() const;
+
+private:
+    // Diagram workers of the same render allocate concurrently, hence the lock.
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    // Freed memory is only reclaimed when the arena goes away.
+    void do_deallocate(void*, size_t, size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    PooledBuffer& Current() { return chunkCount_ <= kInlineChunks ? inline_[chunkCount_ - 1] : overflow_.back(); }
+
+    BufferPool&               pool_;
+    mutable std::mutex        mutex_;
+    PooledBuffer              inline_[kInlineChunks];
+    std::vector<PooledBuffer> overflow_;
+    size_t                    chunkCount_ = 0;
+    size_t                    used_ = 0;   // bytes used in the current chunk
+    uint64_t                  allocated_ = 0;
+};
+
+// The arena of the render running on this thread, or the default heap
+// resource outside one, so code deep in a render can use it without
+// threading it through every call.
+std::pmr::memory_resource* CurrentRenderArena();
+
+// Makes an arena current on this thread, e.g. on a worker rendering one
+// diagram of the render's file. The arena must outlive the scope.
+class RenderArenaScope {
+public:
+    explicit RenderArenaScope(std::pmr::memory_resource* arena);
+    ~RenderArenaScope();
+    RenderArenaScope(const RenderArenaScope&) = delete;
+    RenderArenaScope& operator=(const RenderArenaScope&) = delete;
+
+private:
+    std::pmr::memory_resource* previous_;
+};
+
+} // namespace puml
@@ -0,0 +1,44 @@
+#include "core/render_artifact.h"
+
+#include "core/content_hash.h"
+
+namespace puml {
+
+const char* ArtifactFormatName(ArtifactFormat format) {
+    switch (format) {
+    case ArtifactFormat::Svg:  return "svg";
+    case ArtifactFormat::Png:  return "png";
+    case ArtifactFormat::Html: return "html";
+    }
+    return "?";
+}
+
+RenderArtifact::RenderArtifact(ArtifactFormat format, std::string bytes)
+    : text_(std::move(bytes)), format_(format) {
+    data_ = reinterpret_cast<const unsigned char*>(text_.data());
+    size_ = text_.size();
+    hash_ = Hash64(data_, size_);
+}
+
+RenderArtifact::RenderArtifact(ArtifactFormat format, std::vector<unsigned char> bytes)
+    : binary_(std::move(bytes)), format_(format) {
+    data_ = binary_.data();
+    size_ = binary_.size();
+    hash_ = Hash64(data_, size_);
+}
+
+ArtifactPtr MakeArtifact(ArtifactFormat format, std::string bytes) {
+    if (bytes.empty()) {
+        return nullptr;
+    }
+    return std::make_shared<const RenderArtifact>(format, std::move(bytes));
+}
+
+ArtifactPtr MakeArtifact(ArtifactFormat format, std::vector<unsigned char> bytes) {
+    if (bytes.empty()) {
+        return nullptr;
+    }
+    return std::make_shared<const RenderArtifact>(format, std::move(bytes));
+}
+
+} // namespace puml
@@ -0,0 +1,64 @@
+// Immutable, reference-counted render outputs: an SVG document, PNG images
+// or a viewer page. The window showing a render, the memory cache, Copy and
+// Save As all hold the same artifact, so handing one over is a pointer copy
+// and its bytes exist once however many places refer to them.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace puml {
+
+enum class ArtifactFormat {
+    Svg,
+    Png,    // one or more concatenated PNG images
+    Html,   // UTF-8
+};
+
+const char* ArtifactFormatName(ArtifactFormat format);
+
+class RenderArtifact {
+public:
+    RenderArtifact(ArtifactFormat format, std::string bytes);
+    RenderArtifact(ArtifactFormat format, std::vector<unsigned char> bytes);
+
+    RenderArtifact(const RenderArtifact&) = delete;
+    RenderArtifact& operator=(const RenderArtifact&) = delete;
+
+    ArtifactFormat       Format() const { return format_; }
+    const unsigned char* Data() const { return data_; }
+    size_t               Size() const { return size_; }
+    std::string_view     View() const { return std::string_view(reinterpret_cast<const char*>(data_), size_); }
+    uint64_t             Hash() const { return hash_; }   // XXH64 of the bytes
+
+private:
+    // Whichever container the producer had is kept; the other stays empty.
+    std::string                text_;
+    std::vector<unsigned char> binary_;
+    ArtifactFormat             format_;
+    const unsigned char*       data_ = nullptr;
+    size_t                     size_ = 0;
+    uint64_t                   hash_ = 0;
+};
+
+using ArtifactPtr = std::shared_ptr<const RenderArtifact>;
+
+// Takes the bytes over without copying them. Empty content gives nullptr, so
+// "no artifact" and "empty artifact" need not be told apart.
+ArtifactPtr MakeArtifact(ArtifactFormat format, std::string bytes);
+ArtifactPtr MakeArtifact(ArtifactFormat format, std::vector<unsigned char> bytes);
+
+inline size_t ArtifactSize(const ArtifactPtr& artifact) {
+    return artifact ? artifact->Size() : 0;
+}
+
+inline std::string_view ArtifactView(const ArtifactPtr& artifact) {
+    return artifact ? artifact->View() : std::string_view();
+}
+
+} // namespace puml
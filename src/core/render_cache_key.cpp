@@ -0,0 +1,40 @@
+#include "core/render_cache_key.h"
+
+#include "core/content_hash.h"
+
+namespace puml {
+
+namespace {
+
+// Bump when the artifact layout or key derivation changes.
+constexpr char kKeySchema[] = "puml-render-v2";
+
+void HashField(Hasher64& a, Hasher64& b, const void* data, size_t size) {
+    const uint64_t length = size;
+    a.Update(&length, sizeof(length));
+    b.Update(&length, sizeof(length));
+    a.Update(data, size);
+    b.Update(data, size);
+}
+
+} // namespace
+
+std::string DeriveRenderCacheKey(const RenderCacheKeyInput& input) {
+    // Two independently seeded XXH64 streams give a 128-bit key, which keeps
+    // accidental collisions out of reach even for very large caches.
+    Hasher64 low(0x9E3779B97F4A7C15ULL);
+    Hasher64 high(0xC2B2AE3D27D4EB4FULL);
+    HashField(low, high, kKeySchema, sizeof(kKeySchema) - 1);
+    HashField(low, high, input.format.data(), input.format.size());
+    HashField(low, high, input.rendererIdentity.data(), input.rendererIdentity.size());
+    HashField(low, high, input.settings.data(), input.settings.size());
+    HashField(low, high, &input.dependencyHash, sizeof(input.dependencyHash));
+    HashField(low, high, input.source, input.sourceSize);
+    std::string key;
+    key.reserve(32);
+    AppendHashHex(key, high.Digest());
+    AppendHashHex(key, low.Digest());
+    return key;
+}
+
+} // namespace puml
@@ -0,0 +1,25 @@
+// Content-addressed keys for rendered artifacts.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace puml {
+
+// Views of the caller's strings, so deriving a key copies none of them.
+struct RenderCacheKeyInput {
+    const char*      source = nullptr;   // UTF-8 diagram source
+    size_t           sourceSize = 0;
+    std::string_view format;             // "svg" or "png"
+    std::string_view rendererIdentity;   // e.g. jar path + size + mtime
+    std::string_view settings;           // every other setting that changes the output
+    uint64_t         dependencyHash = 0; // combined hash of the files the source includes
+};
+
+// 128-bit key rendered as 32 hex characters, safe to use as a file name.
+// The returned string is the only allocation.
+std::string DeriveRenderCacheKey(const RenderCacheKeyInput& input);
+
+} // namespace puml
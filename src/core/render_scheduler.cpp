@@ -0,0 +1,166 @@
+#include "core/render_scheduler.h"
+
+#include "core/core_log.h"
+
+#include <algorithm>
+
+namespace puml {
+
+using Clock = std::chrono::steady_clock;
+
+const char* RenderPriorityName(RenderPriority priority) {
+    switch (priority) {
+    case RenderPriority::Foreground:   return "foreground";
+    case RenderPriority::FormatSwitch: return "format-switch";
+    case RenderPriority::Speculative:  return "speculative";
+    }
+    return "unknown";
+}
+
+namespace {
+thread_local RenderPriority t_currentPriority = RenderPriority::Foreground;
+} // namespace
+
+RenderPriority CurrentRenderPriority() {
+    return t_currentPriority;
+}
+
+RenderPriorityScope::RenderPriorityScope(RenderPriority priority) : previous_(t_currentPriority) {
+    t_currentPriority = priority;
+}
+
+RenderPriorityScope::~RenderPriorityScope() {
+    t_currentPriority = previous_;
+}
+
+RenderScheduler::RenderScheduler(size_t threadCount, std::string name)
+    : name_(std::move(name)), pool_(threadCount, name_) {}
+
+CancellationTokenPtr RenderScheduler::Submit(RenderPriority priority,
+                                             const std::string& coalesceKey,
+                                             RenderTask task) {
+    auto token = std::make_shared<CancellationToken>();
+    std::vector<RenderTask> dropped;   // destroyed outside the lock
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!coalesceKey.empty()) {
+            DropQueuedLocked(coalesceKey, true, dropped);
+            auto running = running_.find(coalesceKey);
+            if (running != running_.end()) {
+                running->second->Cancel();
+                ++stats_.cancelled;
+            }
+        }
+        Item item;
+        item.sequence = ++nextSequence_;
+        item.key = coalesceKey;
+        item.token = token;
+        item.task = std::move(task);
+        item.enqueued = Clock::now();
+        queues_[static_cast<size_t>(priority)].push_back(std::move(item));
+        ++stats_.submitted;
+        ++stats_.queueDepth;
+        stats_.maxQueueDepth = std::max(stats_.maxQueueDepth, stats_.queueDepth);
+    }
+    // Each pool task runs whatever is most urgent by the time a thread frees up.
+    pool_.Submit([this]() { RunNext(); });
+    return token;
+}
+
+void RenderScheduler::CancelKey(const std::string& coalesceKey) {
+    if (coalesceKey.empty()) return;
+    std::vector<RenderTask> dropped;
+    std::lock_guard<std::mutex> lock(mutex_);
+    DropQueuedLocked(coalesceKey, false, dropped);
+    auto running = running_.find(coalesceKey);
+    if (running != running_.end()) {
+        running->second->Cancel();
+        ++stats_.cancelled;
+    }
+}
+
+void RenderScheduler::SetConcurrencyLimit(RenderPriority priority, size_t limit) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        limits_[static_cast<size_t>(priority)] = limit ? limit : 1;
+    }
+    pool_.Submit([this]() { RunNext(); });
+}
+
+RenderSchedulerStats RenderScheduler::Stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void RenderScheduler::DropQueuedLocked(const std::string& key, bool coalesced, std::vector<RenderTask>& dropped) {
+    for (auto& queue : queues_) {
+        for (auto it = queue.begin(); it != queue.end();) {
+            if (it->key == key) {
+                it->token->Cancel();
+                dropped.push_back(std::move(it->task));
+                it = queue.erase(it);
+                --stats_.queueDepth;
+                ++(coalesced ? stats_.coalesced : stats_.cancelled);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
+
+void RenderScheduler::RunNext() {
+    Item item;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t priority = 0;
+        while (priority < kRenderPriorityCount &&
+               (queues_[priority].empty() || runningCount_[priority] >= limits_[priority])) {
+            ++priority;
+        }
+        if (priority == kRenderPriorityCount) {
+            // The task this pool slot was queued for has been dropped, or its
+            // class is at its limit and will be resumed when a slot frees up.
+            return;
+        }
+        item = std::move(queues_[priority].front());
+        queues_[priority].pop_front();
+        --stats_.queueDepth;
+
+        const uint64_t waitMs = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - item.enqueued).count());
+        stats_.waitMsTotal[priority] += waitMs;
+        stats_.waitMsMax[priority] = std::max(stats_.waitMsMax[priority], waitMs);
+        ++stats_.startedByPriority[priority];
+        ++stats_.started;
+        ++runningCount_[priority];
+        item.priority = priority;
+        if (!item.key.empty()) {
+            running_[item.key] = item.token;
+        }
+    }
+
+    {
+        RenderPriorityScope scope(static_cast<RenderPriority>(item.priority));
+        item.task(*item.token);
+        item.task = nullptr;
+    }
+
+    bool resume = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++stats_.completed;
+        --runningCount_[item.priority];
+        if (!item.key.empty()) {
+            auto running = running_.find(item.key);
+            if (running != running_.end() && running->second == item.token) {
+                running_.erase(running);
+            }
+        }
+        resume = limits_[item.priority] != SIZE_MAX && !queues_[item.priority].empty();
+    }
+    if (resume) {
+        pool_.Submit([this]() { RunNext(); });
+    }
+}
+
+} // namespace puml
@@ -0,0 +1,114 @@
+// Priority queue of render tasks in front of a WorkerPool.
+//
+// Tasks run highest priority class first, FIFO within a class. Tasks sharing
+// a coalescing key (typically one Lister window) are latest-wins: submitting
+// a new one drops the queued one and cancels the running one, so holding a
+// cursor key only renders the file the cursor stops on.
+
+#pragma once
+
+#include "core/cancellation.h"
+#include "core/worker_pool.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace puml {
+
+enum class RenderPriority {
+    Foreground = 0,     // the file the user is looking at
+    FormatSwitch = 1,   // re-render of a visible diagram in another format
+    Speculative = 2,    // prefetch and other work nobody waits for yet
+};
+
+constexpr size_t kRenderPriorityCount = 3;
+
+const char* RenderPriorityName(RenderPriority priority);
+
+// Priority of the scheduler task running on this thread, so code deep in a
+// render can treat speculative work differently without threading it
+// through every call. Foreground outside any task.
+RenderPriority CurrentRenderPriority();
+
+// Carries a task's priority onto another thread, e.g. a worker rendering
+// one diagram of the task's file.
+class RenderPriorityScope {
+public:
+    explicit RenderPriorityScope(RenderPriority priority);
+    ~RenderPriorityScope();
+    RenderPriorityScope(const RenderPriorityScope&) = delete;
+    RenderPriorityScope& operator=(const RenderPriorityScope&) = delete;
+
+private:
+    RenderPriority previous_;
+};
+
+struct RenderSchedulerStats {
+    uint64_t submitted = 0;
+    uint64_t started = 0;
+    uint64_t completed = 0;
+    uint64_t coalesced = 0;        // dropped from the queue by a newer request
+    uint64_t cancelled = 0;        // dropped from the queue or cancelled while running
+    uint64_t queueDepth = 0;
+    uint64_t maxQueueDepth = 0;
+    uint64_t waitMsTotal[kRenderPriorityCount] = {};
+    uint64_t waitMsMax[kRenderPriorityCount] = {};
+    uint64_t startedByPriority[kRenderPriorityCount] = {};
+};
+
+using RenderTask = std::function<void(const CancellationToken& cancel)>;
+
+class RenderScheduler {
+public:
+    RenderScheduler(size_t threadCount, std::string name);
+
+    RenderScheduler(const RenderScheduler&) = delete;
+    RenderScheduler& operator=(const RenderScheduler&) = delete;
+
+    // An empty key opts out of coalescing. The returned token cancels this
+    // task only. A dropped task is destroyed without running.
+    CancellationTokenPtr Submit(RenderPriority priority,
+                                const std::string& coalesceKey,
+                                RenderTask task);
+
+    // Drops queued tasks and cancels the running task for coalesceKey.
+    void CancelKey(const std::string& coalesceKey);
+
+    // Caps how many tasks of one class run at once (default: unlimited).
+    // Tasks over the cap wait in the queue without occupying a thread.
+    void SetConcurrencyLimit(RenderPriority priority, size_t limit);
+
+    RenderSchedulerStats Stats() const;
+
+private:
+    struct Item {
+        uint64_t             sequence = 0;
+        size_t               priority = 0;
+        std::string          key;
+        CancellationTokenPtr token;
+        RenderTask           task;
+        std::chrono::steady_clock::time_point enqueued;
+    };
+
+    void RunNext();
+    void DropQueuedLocked(const std::string& key, bool coalesced, std::vector<RenderTask>& dropped);
+
+    std::string        name_;
+    mutable std::mutex mutex_;
+    std::deque<Item>   queues_[kRenderPriorityCount];
+    size_t             runningCount_[kRenderPriorityCount] = {};
+    size_t             limits_[kRenderPriorityCount] = { SIZE_MAX, SIZE_MAX, SIZE_MAX };
+    std::unordered_map<std::string, CancellationTokenPtr> running_;   // key -> token
+    uint64_t           nextSequence_ = 0;
+    RenderSchedulerStats stats_;
+    WorkerPool         pool_;   // last: its threads must stop before the queues go away
+};
+
+} // namespace puml
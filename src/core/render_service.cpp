@@ -0,0 +1,395 @@
+#include "core/render_service.h"
+
+#include "core/core_log.h"
+
+#include <cstring>
+
+namespace puml {
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+constexpr char     kMagic[4] = { 'P', 'U', 'M', 'R' };
+constexpr size_t   kHeaderBytes = 12;
+constexpr uint16_t kKindRequest = 1;
+constexpr uint16_t kKindResponse = 2;
+// The service's JVMs may be busy with other clients' diagrams.
+constexpr uint32_t kAnswerMarginMs = 5000;
+
+class PayloadWriter {
+public:
+    void U8(uint8_t value) { bytes_.push_back(value); }
+    void U32(uint32_t value) {
+        for (int shift = 0; shift < 32; shift += 8) bytes_.push_back(static_cast<unsigned char>(value >> shift));
+    }
+    void Bytes(const void* data, size_t size) {
+        U32(static_cast<uint32_t>(size));
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        bytes_.insert(bytes_.end(), p, p + size);
+    }
+    void String(const std::string& text) { Bytes(text.data(), text.size()); }
+    std::vector<unsigned char>& Result() { return bytes_; }
+
+private:
+    std::vector<unsigned char> bytes_;
+};
+
+class PayloadReader {
+public:
+    PayloadReader(const unsigned char* data, size_t size) : data_(data), size_(size) {}
+
+    bool U8(uint8_t& value) {
+        if (size_ - offset_ < 1) return false;
+        value = data_[offset_++];
+        return true;
+    }
+    bool U32(uint32_t& value) {
+        if (size_ - offset_ < 4) return false;
+        value = 0;
+        for (int i = 0; i < 4; ++i) value |= static_cast<uint32_t>(data_[offset_ + i]) << (8 * i);
+        offset_ += 4;
+        return true;
+    }
+    template <typename Container>
+    bool Bytes(Container& out) {
+        uint32_t length = 0;
+        if (!U32(length) || size_ - offset_ < length) return false;
+        out.assign(data_ + offset_, data_ + offset_ + length);
+        offset_ += length;
+        return true;
+    }
+    bool AtEnd() const { return offset_ == size_; }
+
+private:
+    const unsigned char* data_;
+    size_t               size_;
+    size_t               offset_ = 0;
+};
+
+void PutU16(unsigned char* p, uint16_t value) {
+    p[0] = static_cast<unsigned char>(value);
+    p[1] = static_cast<unsigned char>(value >> 8);
+}
+
+void PutU32(unsigned char* p, uint32_t value) {
+    for (int i = 0; i < 4; ++i) p[i] = static_cast<unsigned char>(value >> (8 * i));
+}
+
+uint16_t GetU16(const unsigned char* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+uint32_t GetU32(const unsigned char* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+bool WriteFrame(LocalConnection& connection, uint16_t kind, const std::vector<unsigned char>& payload) {
+    unsigned char header[kHeaderBytes];
+    std::memcpy(header, kMagic, 4);
+    PutU16(header + 4, kRenderServiceProtocolVersion);
+    PutU16(header + 6, kind);
+    PutU32(header + 8, static_cast<uint32_t>(payload.size()));
+    return connection.WriteAll(header, sizeof(header)) &&
+           (payload.empty() || connection.WriteAll(payload.data(), payload.size()));
+}
+
+enum class FrameRead { Ok, Closed, Malformed, OtherVersion };
+
+FrameRead ReadFrame(LocalConnection& connection, uint16_t expectedKind, Clock::time_point deadline,
+                    std::vector<unsigned char>& payload) {
+    unsigned char header[kHeaderBytes];
+    if (!connection.ReadAll(header, sizeof(header), deadline)) {
+        return FrameRead::Closed;
+    }
+    if (std::memcmp(header, kMagic, 4) != 0) {
+        return FrameRead::Malformed;
+    }
+    if (GetU16(header + 4) != kRenderServiceProtocolVersion) {
+        return FrameRead::OtherVersion;
+    }
+    const uint32_t size = GetU32(header + 8);
+    if (GetU16(header + 6) != expectedKind || size > kRenderServiceMaxFrameBytes) {
+        return FrameRead::Malformed;
+    }
+    payload.resize(size);
+    if (size > 0 && !connection.ReadAll(payload.data(), size, deadline)) {
+        return FrameRead::Closed;
+    }
+    return FrameRead::Ok;
+}
+
+} // namespace
+
+std::vector<unsigned char> EncodeRenderRequest(const RenderServiceRequest& request) {
+    PayloadWriter writer;
+    writer.U8((request.svg ? 1 : 0) | (request.background ? 2 : 0));
+    writer.U32(request.imageIndex);
+    writer.U32(request.timeoutMs);
+    writer.String(request.workingDirectory);
+    writer.String(request.source);
+    return std::move(writer.Result());
+}
+
+bool DecodeRenderRequest(const unsigned char* data, size_t size, RenderServiceRequest& request) {
+    PayloadReader reader(data, size);
+    uint8_t flags = 0;
+    if (!reader.U8(flags) || flags > 3 || !reader.U32(request.imageIndex) || !reader.U32(request.timeoutMs) ||
+        !reader.Bytes(request.workingDirectory) || !reader.Bytes(request.source)) {
+        return false;
+    }
+    request.svg = (flags & 1) != 0;
+    request.background = (flags & 2) != 0;
+    return reader.AtEnd();
+}
+
+std::vector<unsigned char> EncodeRenderResponse(const RenderServiceResponse& response) {
+    PayloadWriter writer;
+    writer.U8(static_cast<uint8_t>(response.status));
+    writer.String(response.error);
+    writer.Bytes(response.image.data(), response.image.size());
+    return std::move(writer.Result());
+}
+
+bool DecodeRenderResponse(const unsigned char* data, size_t size, RenderServiceResponse& response) {
+    PayloadReader reader(data, size);
+    uint8_t status = 0;
+    if (!reader.U8(status) || status > static_cast<uint8_t>(RenderServiceStatus::BadRequest) ||
+        !reader.Bytes(response.error) || !reader.Bytes(response.image)) {
+        return false;
+    }
+    response.status = static_cast<RenderServiceStatus>(status);
+    return reader.AtEnd();
+}
+
+const char* RenderServiceOutcomeName(RenderServiceOutcome outcome) {
+    switch (outcome) {
+    case RenderServiceOutcome::Rendered:    return "rendered";
+    case RenderServiceOutcome::Failed:      return "failed";
+    case RenderServiceOutcome::Unavailable: return "unavailable";
+    case RenderServiceOutcome::Cancelled:   return "cancelled";
+    }
+    return "unknown";
+}
+
+RenderServiceOutcome RequestRender(const std::string& endpoint,
+                                   const RenderServiceRequest& request,
+                                   uint32_t connectTimeoutMs,
+                                   std::vector<unsigned char>& out,
+                                   std::string* error,
+                                   const CancellationToken* cancel) {
+    std::unique_ptr<LocalConnection> connection = ConnectLocalEndpoint(endpoint, connectTimeoutMs, error);
+    if (!connection) {
+        return RenderServiceOutcome::Unavailable;
+    }
+    LocalConnection* raw = connection.get();
+    CancellationRegistration onCancel(cancel, [raw]() { raw->Shutdown(); });
+    auto interrupted = [&](RenderServiceOutcome otherwise, const char* reason) {
+        if (IsCancelled(cancel)) {
+            if (error) *error = "cancelled";
+            return RenderServiceOutcome::Cancelled;
+        }
+        if (error) *error = reason;
+        return otherwise;
+    };
+    if (IsCancelled(cancel)) {
+        return interrupted(RenderServiceOutcome::Cancelled, "cancelled");
+    }
+
+    if (!WriteFrame(*connection, kKindRequest, EncodeRenderRequest(request))) {
+        return interrupted(RenderServiceOutcome::Unavailable, "the render service closed the connection");
+    }
+    const Clock::time_point deadline =
+        Clock::now() + std::chrono::milliseconds(static_cast<uint64_t>(request.timeoutMs) + kAnswerMarginMs);
+    std::vector<unsigned char> payload;
+    const FrameRead read = ReadFrame(*connection, kKindResponse, deadline, payload);
+    if (read == FrameRead::Closed) {
+        if (Clock::now() >= deadline) {
+            return interrupted(RenderServiceOutcome::Failed, "the render service did not answer in time");
+        }
+        return interrupted(RenderServiceOutcome::Unavailable, "the render service closed the connection");
+    }
+    RenderServiceResponse response;
+    if (read != FrameRead::Ok || !DecodeRenderResponse(payload.data(), payload.size(), response)) {
+        if (error) *error = "the render service speaks another protocol version";
+        return RenderServiceOutcome::Unavailable;
+    }
+    switch (response.status) {
+    case RenderServiceStatus::Rendered:
+        out.swap(response.image);
+        return RenderServiceOutcome::Rendered;
+    case RenderServiceStatus::Failed:
+        if (error) *error = response.error;
+        return RenderServiceOutcome::Failed;
+    case RenderServiceStatus::BadRequest:
+        break;
+    }
+    if (error) *error = "the render service rejected the request: " + response.error;
+    return RenderServiceOutcome::Unavailable;
+}
+
+struct RenderServiceServer::Client {
+    std::unique_ptr<LocalConnection> connection;
+    std::thread                      thread;
+    bool                             done = false;
+};
+
+RenderServiceServer::RenderServiceServer(RenderServiceServerOptions options, RenderServiceHandler handler)
+    : options_(std::move(options)), handler_(std::move(handler)), lastActivity_(Clock::now()) {}
+
+RenderServiceServer::~RenderServiceServer() {
+    Stop();
+}
+
+bool RenderServiceServer::Start(bool* inUse, std::string* error) {
+    listener_ = ListenLocalEndpoint(options_.endpoint, inUse, error);
+    if (!listener_) {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        lastActivity_ = Clock::now();
+    }
+    acceptThread_ = std::thread([this]() { AcceptLoop(); });
+    Log(options_.name + ": listening on " + LocalEndpointAddress(options_.endpoint));
+    return true;
+}
+
+void RenderServiceServer::Wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        if (connected_ > 0) {
+            cv_.wait(lock);
+            continue;
+        }
+        const Clock::time_point idleUntil = lastActivity_ + std::chrono::milliseconds(options_.idleExitMs);
+        if (Clock::now() >= idleUntil) {
+            Log(options_.name + ": no client for " + std::to_string(options_.idleExitMs) + " ms, exiting");
+            return;
+        }
+        cv_.wait_until(lock, idleUntil);
+    }
+}
+
+void RenderServiceServer::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        for (auto& client : clients_) {
+            client->connection->Shutdown();
+        }
+    }
+    cv_.notify_all();
+    if (listener_) listener_->Close();
+    if (acceptThread_.joinable()) acceptThread_.join();
+
+    std::list<std::unique_ptr<Client>> all;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        all.swap(clients_);
+    }
+    for (auto& client : all) {
+        if (client->thread.joinable()) client->thread.join();
+    }
+    listener_.reset();
+}
+
+RenderServiceStats RenderServiceServer::Stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void RenderServiceServer::ReapFinishedLocked(std::list<std::unique_ptr<Client>>& finished) {
+    for (auto it = clients_.begin(); it != clients_.end();) {
+        if ((*it)->done) {
+            finished.push_back(std::move(*it));
+            it = clients_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void RenderServiceServer::AcceptLoop() {
+    for (;;) {
+        std::unique_ptr<LocalConnection> connection = listener_->Accept();
+        if (!connection) {
+            return;
+        }
+        std::list<std::unique_ptr<Client>> finished;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ReapFinishedLocked(finished);
+            if (stopping_) {
+                connection->Shutdown();
+            } else {
+                auto client = std::make_unique<Client>();
+                client->connection = std::move(connection);
+                Client* raw = client.get();
+                ++connected_;
+                ++stats_.connections;
+                lastActivity_ = Clock::now();
+                clients_.push_back(std::move(client));
+                raw->thread = std::thread([this, raw]() { ServeClient(raw); });
+            }
+        }
+        for (auto& client : finished) {
+            client->thread.join();
+        }
+    }
+}
+
+void RenderServiceServer::ServeClient(Client* client) {
+    LocalConnection& connection = *client->connection;
+    std::vector<unsigned char> payload;
+    // Watches for the client leaving during a render. A client sends nothing
+    // until it has its answer, so the watch of a request ends when the next
+    // request arrives or the connection closes.
+    std::thread watcher;
+    for (;;) {
+        const FrameRead read = ReadFrame(connection, kKindRequest, Clock::time_point::max(), payload);
+        if (watcher.joinable()) watcher.join();
+        if (read == FrameRead::Closed) {
+            break;
+        }
+        RenderServiceRequest request;
+        if (read != FrameRead::Ok || !DecodeRenderRequest(payload.data(), payload.size(), request)) {
+            RenderServiceResponse rejection;
+            rejection.status = RenderServiceStatus::BadRequest;
+            rejection.error = read == FrameRead::OtherVersion ? "unsupported protocol version" : "malformed request";
+            WriteFrame(connection, kKindResponse, EncodeRenderResponse(rejection));
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++stats_.badRequests;
+            break;
+        }
+
+        auto cancel = std::make_shared<CancellationToken>();
+        watcher = std::thread([&connection, cancel]() {
+            if (connection.WaitPeerClosed(Clock::time_point::max())) cancel->Cancel();
+        });
+        const RenderServiceResponse response = handler_(request, *cancel);
+        const bool abandoned = cancel->IsCancelled();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++stats_.requests;
+            if (abandoned) ++stats_.abandoned;
+            else if (response.status != RenderServiceStatus::Rendered) ++stats_.failures;
+            lastActivity_ = Clock::now();
+        }
+        if (abandoned || !WriteFrame(connection, kKindResponse, EncodeRenderResponse(response))) {
+            break;
+        }
+    }
+    // Ends a watch the client has not ended.
+    connection.Shutdown();
+    if (watcher.joinable()) watcher.join();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    --connected_;
+    lastActivity_ = Clock::now();
+    client->done = true;
+    cv_.notify_all();
+}
+
+} // namespace puml
@@ -0,0 +1,138 @@
+// Shared render service: one process per user session owns the PlantUML
+// JVMs and renders for every plugin instance that connects to it over a
+// local channel, so JVM memory and cold starts scale with sessions rather
+// than with Total Commander processes.
+//
+// Protocol: every message is one frame,
+//     "PUMR"  u16 version  u16 kind  u32 payload size  payload
+// integers little-endian. A connection carries any number of request /
+// response pairs, one at a time. Strings and byte blocks in a payload are a
+// u32 length followed by the bytes.
+
+#pragma once
+
+#include "core/cancellation.h"
+#include "core/local_channel.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace puml {
+
+constexpr uint16_t kRenderServiceProtocolVersion = 2;
+constexpr uint32_t kRenderServiceMaxFrameBytes = 256u * 1024 * 1024;
+
+struct RenderServiceRequest {
+    std::string source;             // UTF-8, references already absolute
+    std::string workingDirectory;   // UTF-8, may be empty
+    bool        svg = true;
+    uint32_t    imageIndex = 0;     // as -pipeimageindex
+    uint32_t    timeoutMs = 8000;
+    bool        background = false;     // speculative: lower priority, behind foreground work
+};
+
+enum class RenderServiceStatus : uint8_t {
+    Rendered = 0,
+    Failed = 1,         // the diagram did not render (bad source, timeout, ...)
+    BadRequest = 2,
+};
+
+struct RenderServiceResponse {
+    RenderServiceStatus        status = RenderServiceStatus::Failed;
+    std::string                error;
+    std::vector<unsigned char> image;
+};
+
+// Payload encoding, without the frame header. Decoding fails on truncated
+// or trailing bytes.
+std::vector<unsigned char> EncodeRenderRequest(const RenderServiceRequest& request);
+bool DecodeRenderRequest(const unsigned char* data, size_t size, RenderServiceRequest& request);
+std::vector<unsigned char> EncodeRenderResponse(const RenderServiceResponse& response);
+bool DecodeRenderResponse(const unsigned char* data, size_t size, RenderServiceResponse& response);
+
+enum class RenderServiceOutcome {
+    Rendered,
+    Failed,         // the service answered: no image for this source
+    Unavailable,    // no service, or it went away; render locally instead
+    Cancelled,
+};
+
+const char* RenderServiceOutcomeName(RenderServiceOutcome outcome);
+
+// Sends one request on a fresh connection. The wait for the answer is
+// bounded by the request's timeout plus a margin for the service's queue.
+RenderServiceOutcome RequestRender(const std::string& endpoint,
+                                   const RenderServiceRequest& request,
+                                   uint32_t connectTimeoutMs,
+                                   std::vector<unsigned char>& out,
+                                   std::string* error,
+                                   const CancellationToken* cancel = nullptr);
+
+// cancel fires when the client closes its connection before the answer: it
+// cancelled the render, or a newer request of its window replaced it.
+using RenderServiceHandler =
+    std::function<RenderServiceResponse(const RenderServiceRequest&, const CancellationToken& cancel)>;
+
+struct RenderServiceServerOptions {
+    std::string endpoint;
+    uint32_t    idleExitMs = 600000;   // Wait returns after this long without a connection
+    std::string name = "render service";
+};
+
+struct RenderServiceStats {
+    uint64_t connections = 0;
+    uint64_t requests = 0;
+    uint64_t failures = 0;
+    uint64_t badRequests = 0;
+    uint64_t abandoned = 0;   // the client went away before the answer
+};
+
+// One thread per connected client runs the handler, so requests of
+// different clients render concurrently. While it runs, a second thread
+// watches the connection and cancels the request when the client leaves.
+class RenderServiceServer {
+public:
+    RenderServiceServer(RenderServiceServerOptions options, RenderServiceHandler handler);
+    // Stops and joins every thread.
+    ~RenderServiceServer();
+
+    RenderServiceServer(const RenderServiceServer&) = delete;
+    RenderServiceServer& operator=(const RenderServiceServer&) = delete;
+
+    // Fails with inUse set when another server owns the endpoint.
+    bool Start(bool* inUse, std::string* error);
+    // Blocks until Stop, or until no client was connected for idleExitMs.
+    void Wait();
+    void Stop();
+
+    RenderServiceStats Stats() const;
+
+private:
+    struct Client;
+
+    void AcceptLoop();
+    void ServeClient(Client* client);
+    void ReapFinishedLocked(std::list<std::unique_ptr<Client>>& finished);
+
+    RenderServiceServerOptions     options_;
+    RenderServiceHandler           handler_;
+    std::unique_ptr<LocalListener> listener_;
+    std::thread                    acceptThread_;
+
+    mutable std::mutex             mutex_;      // guards everything below
+    std::condition_variable        cv_;
+    std::list<std::unique_ptr<Client>> clients_;
+    size_t                         connected_ = 0;
+    std::chrono::steady_clock::time_point lastActivity_;
+    bool                           stopping_ = false;
+    RenderServiceStats             stats_;
+};
+
+} // namespace puml
@@ -0,0 +1,112 @@
+// Collapses concurrent identical work into one execution.
+//
+// The first caller for a key runs the work; callers arriving while it is in
+// flight wait for it and receive a copy of the same result. The work is
+// cancelled only once every attached caller has been cancelled, so one
+// window moving on does not abort a render another window is waiting for.
+
+#pragma once
+
+#include "core/cancellation.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace puml {
+
+struct SingleFlightStats {
+    uint64_t executed = 0;   // calls that ran the work
+    uint64_t joined = 0;     // calls served by another call's work
+    uint64_t abandoned = 0;  // calls cancelled before a result was available
+    uint64_t inFlight = 0;
+};
+
+template <typename Result>
+class SingleFlight {
+public:
+    using Work = std::function<Result(const CancellationToken& cancel)>;
+
+    SingleFlight() = default;
+    SingleFlight(const SingleFlight&) = delete;
+    SingleFlight& operator=(const SingleFlight&) = delete;
+
+    // Returns false if cancel fired before a result was available. *joined
+    // tells whether the result came from another caller's work.
+    bool Do(const std::string& key, const CancellationToken* cancel, const Work& work,
+            Result& out, bool* joined = nullptr) {
+        std::shared_ptr<Flight> flight;
+        bool leader = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = flights_.find(key);
+            if (it != flights_.end() && !it->second->token.IsCancelled()) {
+                flight = it->second;
+                ++flight->interested;
+            } else {
+                flight = std::make_shared<Flight>();
+                flights_[key] = flight;
+                leader = true;
+            }
+        }
+        if (joined) *joined = !leader;
+
+        // Registered outside mutex_: the callback takes mutex_ itself.
+        CancellationRegistration onCancel(cancel, [this, flight]() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!flight->done && --flight->interested == 0) {
+                flight->token.Cancel();
+            }
+            cv_.notify_all();
+        });
+
+        if (leader) {
+            Result result = work(flight->token);
+            std::lock_guard<std::mutex> lock(mutex_);
+            flight->result = std::move(result);
+            flight->done = true;
+            auto it = flights_.find(key);
+            if (it != flights_.end() && it->second == flight) {
+                flights_.erase(it);
+            }
+            ++stats_.executed;
+            cv_.notify_all();
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [&]() { return flight->done || IsCancelled(cancel); });
+        if (IsCancelled(cancel)) {
+            ++stats_.abandoned;
+            return false;
+        }
+        if (!leader) ++stats_.joined;
+        out = flight->result;
+        return true;
+    }
+
+    SingleFlightStats Stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        SingleFlightStats stats = stats_;
+        stats.inFlight = flights_.size();
+        return stats;
+    }
+
+private:
+    struct Flight {
+        CancellationToken token;
+        size_t            interested = 1;
+        bool              done = false;
+        Result            result{};
+    };
+
+    mutable std::mutex      mutex_;
+    std::condition_variable cv_;
+    std::unordered_map<std::string, std::shared_ptr<Flight>> flights_;
+    SingleFlightStats       stats_;
+};
+
+} // namespace puml
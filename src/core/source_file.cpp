@@ -0,0 +1,117 @@
+#include "core/source_file.h"
+
+#include <cstring>
+
+namespace puml {
+
+const char* SourceEncodingName(SourceEncoding encoding) {
+    switch (encoding) {
+    case SourceEncoding::Utf8:    return "utf-8";
+    case SourceEncoding::Utf8Bom: return "utf-8 (bom)";
+    case SourceEncoding::Utf16Le: return "utf-16le";
+    case SourceEncoding::Legacy:  return "ansi";
+    }
+    return "?";
+}
+
+bool IsValidUtf8(std::string_view bytes) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(bytes.data());
+    const unsigned char* end = p + bytes.size();
+    while (p < end) {
+        // Sources are mostly ASCII: skip it eight bytes at a time.
+        while (end - p >= 8) {
+            uint64_t word;
+            std::memcpy(&word, p, sizeof(word));
+            if (word & 0x8080808080808080ull) break;
+            p += 8;
+        }
+        if (p == end) break;
+        const unsigned char lead = *p;
+        if (lead < 0x80) {
+            ++p;
+            continue;
+        }
+        size_t length;
+        unsigned char low = 0x80, high = 0xBF;   // range of the second byte
+        if (lead >= 0xC2 && lead <= 0xDF) {
+            length = 2;
+        } else if (lead >= 0xE0 && lead <= 0xEF) {
+            length = 3;
+            if (lead == 0xE0) low = 0xA0;         // overlong
+            else if (lead == 0xED) high = 0x9F;   // surrogates
+        } else if (lead >= 0xF0 && lead <= 0xF4) {
+            length = 4;
+            if (lead == 0xF0) low = 0x90;         // overlong
+            else if (lead == 0xF4) high = 0x8F;   // above U+10FFFF
+        } else {
+            return false;
+        }
+        if (static_cast<size_t>(end - p) < length || p[1] < low || p[1] > high) {
+            return false;
+        }
+        for (size_t i = 2; i < length; ++i) {
+            if ((p[i] & 0xC0) != 0x80) return false;
+        }
+        p += length;
+    }
+    return true;
+}
+
+SourceEncoding DetectSourceEncoding(std::string_view bytes, size_t* bomLength) {
+    size_t bom = 0;
+    SourceEncoding encoding;
+    if (bytes.size() >= 3 && bytes.compare(0, 3, "\xEF\xBB\xBF") == 0) {
+        bom = 3;
+        encoding = SourceEncoding::Utf8Bom;
+    } else if (bytes.size() >= 2 && bytes.compare(0, 2, "\xFF\xFE") == 0) {
+        bom = 2;
+        encoding = SourceEncoding::Utf16Le;
+    } else {
+        encoding = IsValidUtf8(bytes) ? SourceEncoding::Utf8 : SourceEncoding::Legacy;
+    }
+    if (bomLength) *bomLength = bom;
+    return encoding;
+}
+
+SourceFile::~SourceFile() {
+    Close();
+}
+
+bool SourceFile::Open(const std::string& pathUtf8, std::string* error) {
+    Close();
+    if (!Load(pathUtf8, error)) {
+        Close();
+        return false;
+    }
+    bytes_ = view_ ? std::string_view(static_cast<const char*>(view_), viewSize_) : std::string_view(buffer_);
+    encoding_ = DetectSourceEncoding(bytes_, &bomLength_);
+    return true;
+}
+
+void SourceFile::ReleaseMapping() {
+    if (!view_) {
+        return;
+    }
+    buffer_.assign(bytes_.data(), bytes_.size());
+    Unmap();
+    bytes_ = buffer_;
+}
+
+void SourceFile::Close() {
+    if (view_) {
+        Unmap();
+    }
+    bytes_ = std::string_view();
+    std::string().swap(buffer_);
+    encoding_ = SourceEncoding::Utf8;
+    bomLength_ = 0;
+}
+
+std::string_view SourceFile::Utf8() const {
+    if (encoding_ != SourceEncoding::Utf8 && encoding_ != SourceEncoding::Utf8Bom) {
+        return std::string_view();
+    }
+    return bytes_.substr(bomLength_);
+}
+
+} // namespace puml
@@ -0,0 +1,76 @@
+// Read-only access to a diagram source without copying it. Large files are
+// memory mapped and their encoding is sniffed in place, so UTF-8 content can
+// be hashed, scanned and handed to the renderer straight from the view.
+// Small files, files of 4 GB and more, and files that cannot be mapped (some
+// network shares) are read into a buffer in chunks instead.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace puml {
+
+enum class SourceEncoding {
+    Utf8,       // no BOM; valid UTF-8, which includes plain ASCII
+    Utf8Bom,
+    Utf16Le,    // FF FE
+    Legacy,     // no BOM and not UTF-8: the ANSI code page
+};
+
+const char* SourceEncodingName(SourceEncoding encoding);
+
+// Looks at the BOM and, without one, validates the bytes as UTF-8. bomLength
+// receives the size of the BOM (0, 2 or 3).
+SourceEncoding DetectSourceEncoding(std::string_view bytes, size_t* bomLength);
+
+bool IsValidUtf8(std::string_view bytes);
+
+class SourceFile {
+public:
+    // Below this a read is cheaper than setting up a mapping.
+    static constexpr uint64_t kMinMappedBytes = 64 * 1024;
+    // From here on the file is read in chunks; a view this large would not
+    // fit a 32-bit address space and is rarely worth it in a 64-bit one.
+    static constexpr uint64_t kMaxMappedBytes = 0xFFFFFFFFull;
+    static constexpr size_t   kReadChunkBytes = 1024 * 1024;
+
+    SourceFile() = default;
+    ~SourceFile();
+    SourceFile(const SourceFile&) = delete;
+    SourceFile& operator=(const SourceFile&) = delete;
+
+    // Maps or reads the whole file and detects its encoding. The file handle
+    // is closed again before Open returns; a mapping keeps only its view.
+    bool Open(const std::string& pathUtf8, std::string* error);
+
+    // Copies a mapped view into a buffer of its own and unmaps it. Windows
+    // refuses to truncate a file while a view of it exists, so an editor
+    // saving during a long render would fail if the render held the mapping.
+    void ReleaseMapping();
+
+    void Close();
+
+    // Everything in the file, BOM included.
+    std::string_view Bytes() const { return bytes_; }
+    // The content after the BOM if the file is UTF-8; empty otherwise.
+    std::string_view Utf8() const;
+    SourceEncoding   Encoding() const { return encoding_; }
+    bool             Mapped() const { return view_ != nullptr; }
+
+private:
+    // Platform parts, in source_file_win32.cpp / source_file_posix.cpp.
+    bool Load(const std::string& pathUtf8, std::string* error);
+    void Unmap();
+
+    std::string_view bytes_;
+    std::string      buffer_;          // the content when it is not mapped
+    void*            view_ = nullptr;
+    size_t           viewSize_ = 0;
+    SourceEncoding   encoding_ = SourceEncoding::Utf8;
+    size_t           bomLength_ = 0;
+};
+
+} // namespace puml
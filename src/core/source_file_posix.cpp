@@ -0,0 +1,85 @@
+// POSIX implementation of SourceFile (mmap, read).
+
+#include "core/source_file.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace puml {
+
+namespace {
+
+std::string SystemError(const char* what) {
+    return std::string(what) + ": " + std::strerror(errno);
+}
+
+} // namespace
+
+bool SourceFile::Load(const std::string& pathUtf8, std::string* error) {
+    const int fd = ::open(pathUtf8.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (error) *error = SystemError("open");
+        return false;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        if (error) *error = SystemError("fstat");
+        ::close(fd);
+        return false;
+    }
+    const uint64_t size = static_cast<uint64_t>(st.st_size);
+    if (size > std::numeric_limits<size_t>::max()) {
+        if (error) *error = "file too large (" + std::to_string(size) + " bytes)";
+        ::close(fd);
+        return false;
+    }
+
+    if (size >= kMinMappedBytes && size <= kMaxMappedBytes) {
+        void* view = ::mmap(nullptr, static_cast<size_t>(size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view != MAP_FAILED) {
+            ::madvise(view, static_cast<size_t>(size), MADV_SEQUENTIAL);
+            view_ = view;
+            viewSize_ = static_cast<size_t>(size);
+            ::close(fd);
+            return true;
+        }
+        // Not every file system can map; read it like a small file.
+    }
+
+    buffer_.resize(static_cast<size_t>(size));
+    size_t filled = 0;
+    while (filled < buffer_.size()) {
+        const size_t chunk = std::min(buffer_.size() - filled, kReadChunkBytes);
+        const ssize_t n = ::read(fd, &buffer_[filled], chunk);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            if (error) *error = SystemError("read");
+            ::close(fd);
+            return false;
+        }
+        if (n == 0) {
+            break;   // shrank since fstat
+        }
+        filled += static_cast<size_t>(n);
+    }
+    buffer_.resize(filled);
+    ::close(fd);
+    return true;
+}
+
+void SourceFile::Unmap() {
+    ::munmap(view_, viewSize_);
+    view_ = nullptr;
+    viewSize_ = 0;
+}
+
+} // namespace puml
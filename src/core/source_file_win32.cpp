@@ -0,0 +1,92 @@
+// Win32 implementation of SourceFile (CreateFileMapping/MapViewOfFile,
+// ReadFile).
+
+#include "core/source_file.h"
+
+#include <windows.h>
+
+#include <algorithm>
+#include <limits>
+
+namespace puml {
+
+namespace {
+
+std::wstring WidenUtf8(const std::string& s) {
+    if (s.empty()) return std::wstring();
+    int n = ::MultiByteToWideChar(CP_UTF8, 0, s.data(), (int)s.size(), nullptr, 0);
+    std::wstring w(n > 0 ? n : 0, L'\0');
+    if (n > 0) ::MultiByteToWideChar(CP_UTF8, 0, s.data(), (int)s.size(), w.data(), n);
+    return w;
+}
+
+std::string SystemError(const char* what) {
+    return std::string(what) + " failed (error " + std::to_string(::GetLastError()) + ")";
+}
+
+} // namespace
+
+bool SourceFile::Load(const std::string& pathUtf8, std::string* error) {
+    // Editors keep the file open for writing and may replace it while we look.
+    HANDLE file = ::CreateFileW(WidenUtf8(pathUtf8).c_str(), GENERIC_READ,
+                                FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        if (error) *error = SystemError("CreateFile");
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!::GetFileSizeEx(file, &fileSize)) {
+        if (error) *error = SystemError("GetFileSizeEx");
+        ::CloseHandle(file);
+        return false;
+    }
+    const uint64_t size = static_cast<uint64_t>(fileSize.QuadPart);
+    if (size > std::numeric_limits<size_t>::max()) {
+        if (error) *error = "file too large (" + std::to_string(size) + " bytes)";
+        ::CloseHandle(file);
+        return false;
+    }
+
+    if (size >= kMinMappedBytes && size <= kMaxMappedBytes) {
+        HANDLE mapping = ::CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        void* view = mapping ? ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (mapping) {
+            ::CloseHandle(mapping);   // the view keeps the section alive
+        }
+        if (view) {
+            view_ = view;
+            viewSize_ = static_cast<size_t>(size);
+            ::CloseHandle(file);
+            return true;
+        }
+        // Some network redirectors cannot map; read it like a small file.
+    }
+
+    buffer_.resize(static_cast<size_t>(size));
+    size_t filled = 0;
+    while (filled < buffer_.size()) {
+        const DWORD chunk = static_cast<DWORD>(std::min(buffer_.size() - filled, kReadChunkBytes));
+        DWORD read = 0;
+        if (!::ReadFile(file, &buffer_[filled], chunk, &read, nullptr)) {
+            if (error) *error = SystemError("ReadFile");
+            ::CloseHandle(file);
+            return false;
+        }
+        if (read == 0) {
+            break;   // shrank since GetFileSizeEx
+        }
+        filled += read;
+    }
+    buffer_.resize(filled);
+    ::CloseHandle(file);
+    return true;
+}
+
+void SourceFile::Unmap() {
+    ::UnmapViewOfFile(view_);
+    view_ = nullptr;
+    viewSize_ = 0;
+}
+
+} // namespace puml
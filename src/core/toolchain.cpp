@@ -0,0 +1,243 @@
+#include "core/toolchain.h"
+
+#include "core/process_pump.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace puml {
+
+namespace {
+
+const char kRecordHeader[] = "plantuml-toolchain 1";
+
+std::string UniqueSuffix() {
+    static std::atomic<unsigned> counter{0};
+    const auto stamp = static_cast<unsigned long long>(std::chrono::steady_clock::now().time_since_epoch().count());
+    return std::to_string(stamp) + "-" + std::to_string(++counter);
+}
+
+std::string Trim(const std::string& text) {
+    const size_t first = text.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos) {
+        return std::string();
+    }
+    return text.substr(first, text.find_last_not_of(" \t\r\n") - first + 1);
+}
+
+// "1.8" is Java 8; from 9 on the first number is the feature release.
+int FeatureVersion(const std::string& version) {
+    const int major = std::atoi(version.c_str());
+    if (major == 1) {
+        const size_t dot = version.find('.');
+        return dot == std::string::npos ? 0 : std::atoi(version.c_str() + dot + 1);
+    }
+    return major;
+}
+
+// "3.85G", "512.00M", ...
+uint64_t ParseHeapSize(const std::string& text) {
+    char* end = nullptr;
+    const double value = std::strtod(text.c_str(), &end);
+    if (end == text.c_str() || value <= 0) {
+        return 0;
+    }
+    double scale = 1;
+    switch (*end) {
+    case 'K': case 'k': scale = 1024.0; break;
+    case 'M': case 'm': scale = 1024.0 * 1024; break;
+    case 'G': case 'g': scale = 1024.0 * 1024 * 1024; break;
+    case 'T': case 't': scale = 1024.0 * 1024 * 1024 * 1024; break;
+    default: break;
+    }
+    return static_cast<uint64_t>(value * scale);
+}
+
+// The MODULES line of the runtime's release file. A Java 8 runtime has no
+// modules and no such line; its java.home is the jre directory inside a JDK.
+bool ReadReleaseModules(const std::string& home, std::string& modules) {
+    for (const fs::path& path : { fs::u8path(home) / "release", fs::u8path(home).parent_path() / "release" }) {
+        std::ifstream in(path);
+        std::string line;
+        while (in && std::getline(in, line)) {
+            if (line.compare(0, 8, "MODULES=") == 0) {
+                modules = line.substr(8);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+bool ParseJavaSettings(const std::string& output, JavaCapabilities& capabilities) {
+    std::string specification;
+    std::istringstream lines(output);
+    std::string line;
+    while (std::getline(lines, line)) {
+        const std::string text = Trim(line);
+        static const std::string kMaxHeap = "Max. Heap Size (Estimated):";
+        if (text.compare(0, kMaxHeap.size(), kMaxHeap) == 0) {
+            capabilities.defaultMaxHeapBytes = ParseHeapSize(Trim(text.substr(kMaxHeap.size())));
+            continue;
+        }
+        const size_t equals = text.find(" = ");
+        if (equals == std::string::npos) {
+            // The banner of -version: openjdk version "17.0.9" 2023-10-17
+            const size_t quote = text.find(" version \"");
+            if (capabilities.version.empty() && quote != std::string::npos) {
+                const size_t start = quote + 10;
+                const size_t close = text.find('"', start);
+                if (close != std::string::npos) capabilities.version = text.substr(start, close - start);
+            }
+            continue;
+        }
+        const std::string key = text.substr(0, equals);
+        const std::string value = text.substr(equals + 3);
+        if (key == "java.version") capabilities.version = value;
+        else if (key == "java.vendor") capabilities.vendor = value;
+        else if (key == "java.home") capabilities.home = value;
+        else if (key == "java.specification.version") specification = value;
+    }
+    if (capabilities.version.empty()) {
+        return false;
+    }
+    capabilities.featureVersion = FeatureVersion(specification.empty() ? capabilities.version : specification);
+    capabilities.dynamicArchive = capabilities.featureVersion >= 13;
+    return true;
+}
+
+bool ProbeJava(const std::string& javaExecutable,
+               uint32_t timeoutMs,
+               JavaCapabilities& capabilities,
+               std::string* error,
+               const CancellationToken* cancel) {
+    ProcessSpec spec;
+    spec.executable = javaExecutable;
+    spec.arguments = { "-XshowSettings:all", "-version" };
+    spec.discardStderr = false;   // where both settings and version go
+
+    SpillableBuffer output(1024 * 1024, std::string());
+    PumpOptions options;
+    options.timeoutMs = timeoutMs;
+    options.maxOutputBytes = 1024 * 1024;
+    std::string pumpError;
+    const PumpResult result = RunProcessPump(spec, std::string(), options, output, &pumpError, cancel);
+    std::vector<unsigned char> bytes;
+    output.ReadAll(bytes);
+    if (result.status != PumpStatus::Completed) {
+        if (error) {
+            *error = std::string(PumpStatusName(result.status)) + (pumpError.empty() ? "" : ": " + pumpError);
+        }
+        return false;
+    }
+    JavaCapabilities probed;
+    if (result.exitCode != 0 || !ParseJavaSettings(std::string(bytes.begin(), bytes.end()), probed)) {
+        if (error) *error = "exited with code " + std::to_string(result.exitCode) + " without naming a version";
+        return false;
+    }
+    std::string modules;
+    if (!probed.home.empty() && ReadReleaseModules(probed.home, modules)) {
+        probed.desktop = modules.find("java.desktop") != std::string::npos;
+    }
+    capabilities = probed;
+    return true;
+}
+
+std::string DescribeFileStamp(const std::string& pathUtf8) {
+    std::error_code ec;
+    const fs::path path = fs::u8path(pathUtf8);
+    const fs::file_time_type written = fs::last_write_time(path, ec);
+    if (pathUtf8.empty() || ec) {
+        return std::string();
+    }
+    const uintmax_t size = fs::is_directory(path, ec) ? 0 : fs::file_size(path, ec);
+    return pathUtf8 + "|" + std::to_string(ec ? 0 : size) + "|" +
+           std::to_string(static_cast<long long>(written.time_since_epoch().count()));
+}
+
+bool LoadToolchain(const std::string& pathUtf8, const std::string& snapshot, Toolchain& toolchain) {
+    std::ifstream in(fs::u8path(pathUtf8), std::ios::binary);
+    std::string line;
+    if (!in || !std::getline(in, line) || Trim(line) != kRecordHeader) {
+        return false;
+    }
+    std::map<std::string, std::string> fields;
+    while (std::getline(in, line)) {
+        const size_t equals = line.find('=');
+        if (equals != std::string::npos) {
+            fields[line.substr(0, equals)] = Trim(line.substr(equals + 1));
+        }
+    }
+    if (fields["snapshot"] != snapshot) {
+        return false;
+    }
+
+    Toolchain loaded;
+    loaded.snapshot = snapshot;
+    loaded.javaExecutable = fields["java"];
+    loaded.javaStamp = fields["javaStamp"];
+    loaded.jarPath = fields["jar"];
+    loaded.jarStamp = fields["jarStamp"];
+    loaded.plantUmlVersion = fields["plantumlVersion"];
+    loaded.java.version = fields["javaVersion"];
+    loaded.java.featureVersion = std::atoi(fields["javaFeatureVersion"].c_str());
+    loaded.java.vendor = fields["javaVendor"];
+    loaded.java.home = fields["javaHome"];
+    loaded.java.defaultMaxHeapBytes = std::strtoull(fields["javaDefaultMaxHeapBytes"].c_str(), nullptr, 10);
+    loaded.java.desktop = fields["javaDesktop"] != "0";
+    loaded.java.dynamicArchive = fields["javaDynamicArchive"] == "1";
+    if (loaded.javaExecutable.empty() || loaded.java.version.empty() ||
+        DescribeFileStamp(loaded.javaExecutable) != loaded.javaStamp ||
+        DescribeFileStamp(loaded.jarPath) != loaded.jarStamp) {
+        return false;
+    }
+    toolchain = loaded;
+    return true;
+}
+
+bool SaveToolchain(const std::string& pathUtf8, const Toolchain& toolchain) {
+    const fs::path path = fs::u8path(pathUtf8);
+    std::error_code ec;
+    fs::create_directories(path.parent_path(), ec);
+    const fs::path temp = fs::u8path(pathUtf8 + "." + UniqueSuffix() + ".tmp");
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        out << kRecordHeader << "\n"
+            << "snapshot=" << toolchain.snapshot << "\n"
+            << "java=" << toolchain.javaExecutable << "\n"
+            << "javaStamp=" << toolchain.javaStamp << "\n"
+            << "jar=" << toolchain.jarPath << "\n"
+            << "jarStamp=" << toolchain.jarStamp << "\n"
+            << "plantumlVersion=" << toolchain.plantUmlVersion << "\n"
+            << "javaVersion=" << toolchain.java.version << "\n"
+            << "javaFeatureVersion=" << toolchain.java.featureVersion << "\n"
+            << "javaVendor=" << toolchain.java.vendor << "\n"
+            << "javaHome=" << toolchain.java.home << "\n"
+            << "javaDefaultMaxHeapBytes=" << toolchain.java.defaultMaxHeapBytes << "\n"
+            << "javaDesktop=" << (toolchain.java.desktop ? 1 : 0) << "\n"
+            << "javaDynamicArchive=" << (toolchain.java.dynamicArchive ? 1 : 0) << "\n";
+        if (!out.flush()) {
+            out.close();
+            fs::remove(temp, ec);
+            return false;
+        }
+    }
+    fs::rename(temp, path, ec);
+    if (ec) {
+        fs::remove(temp, ec);
+        return false;
+    }
+    return true;
+}
+
+} // namespace puml
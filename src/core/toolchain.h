@@ -0,0 +1,58 @@
+// Toolchain discovery: which java and plantuml.jar the renders use, and
+// what they can do. Finding out means searching PATH, starting a JVM and
+// unpacking the jar's manifest, so a discovered toolchain is kept in a small
+// record file and reused by later sessions with the same configuration for
+// as long as the java and the jar it names are unchanged.
+
+#pragma once
+
+#include "core/cancellation.h"
+
+#include <cstdint>
+#include <string>
+
+namespace puml {
+
+struct JavaCapabilities {
+    std::string version;                  // java.version, e.g. "17.0.9"
+    int         featureVersion = 0;       // 8, 11, 17, ...; 0 if unknown
+    std::string vendor;                   // java.vendor
+    std::string home;                     // java.home, UTF-8
+    uint64_t    defaultMaxHeapBytes = 0;  // what -Xmx defaults to on this machine
+    bool        desktop = true;           // has java.desktop (AWT), which PlantUML needs even headless
+    bool        dynamicArchive = false;   // can create class data archives at exit (JDK 13+)
+};
+
+// Parses what "java -XshowSettings:all -version" prints. False if it names
+// no Java version.
+bool ParseJavaSettings(const std::string& output, JavaCapabilities& capabilities);
+
+// Runs java once to fill capabilities, then reads the runtime's release file
+// for its module list. False if java cannot be started or is no usable JVM.
+bool ProbeJava(const std::string& javaExecutable,
+               uint32_t timeoutMs,
+               JavaCapabilities& capabilities,
+               std::string* error,
+               const CancellationToken* cancel = nullptr);
+
+// Path, size and modification time; empty if the file does not exist.
+std::string DescribeFileStamp(const std::string& pathUtf8);
+
+struct Toolchain {
+    std::string      snapshot;           // the configuration it was discovered for
+    std::string      javaExecutable;     // UTF-8
+    std::string      javaStamp;          // DescribeFileStamp(javaExecutable)
+    std::string      jarPath;            // UTF-8
+    std::string      jarStamp;           // DescribeFileStamp(jarPath)
+    std::string      plantUmlVersion;    // Implementation-Version of the jar's manifest, or empty
+    JavaCapabilities java;
+};
+
+// False if the record is missing, was written for another snapshot, or the
+// java or jar it names has changed since.
+bool LoadToolchain(const std::string& pathUtf8, const std::string& snapshot, Toolchain& toolchain);
+
+// Replaces the record atomically; several processes may share it.
+bool SaveToolchain(const std::string& pathUtf8, const Toolchain& toolchain);
+
+} // namespace puml
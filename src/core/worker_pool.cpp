@@ -0,0 +1,62 @@
+#include "core/worker_pool.h"
+
+#include "core/core_log.h"
+
+namespace puml {
+
+WorkerPool::WorkerPool(size_t threadCount, std::string name) : name_(std::move(name)) {
+    if (threadCount == 0) threadCount = 1;
+    threads_.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; ++i) {
+        threads_.emplace_back(&WorkerPool::WorkerLoop, this);
+    }
+    Log(name_ + ": started " + std::to_string(threadCount) + " worker thread(s)");
+}
+
+WorkerPool::~WorkerPool() {
+    Shutdown();
+}
+
+bool WorkerPool::Submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) return false;
+        queue_.push_back(std::move(task));
+    }
+    cv_.notify_one();
+    return true;
+}
+
+void WorkerPool::Shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) return;
+        stopping_ = true;
+        queue_.clear();
+    }
+    cv_.notify_all();
+    for (std::thread& t : threads_) {
+        if (t.joinable()) t.join();
+    }
+}
+
+size_t WorkerPool::QueueDepth() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queue_.size();
+}
+
+void WorkerPool::WorkerLoop() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+            if (stopping_) return;
+            task = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        task();
+    }
+}
+
+} // namespace puml
@@ -0,0 +1,44 @@
+// Fixed-size pool of threads running queued tasks in FIFO order.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace puml {
+
+class WorkerPool {
+public:
+    WorkerPool(size_t threadCount, std::string name);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // Returns false once the pool is shutting down; the task is not run.
+    bool Submit(std::function<void()> task);
+
+    // Discards queued tasks and joins the threads after their current task.
+    void Shutdown();
+
+    size_t ThreadCount() const { return threads_.size(); }
+    size_t QueueDepth() const;
+
+private:
+    void WorkerLoop();
+
+    std::string                       name_;
+    mutable std::mutex                mutex_;
+    std::condition_variable           cv_;
+    std::deque<std::function<void()>> queue_;
+    std::vector<std::thread>          threads_;
+    bool                              stopping_ = false;
+};
+
+} // namespace puml
@@ -0,0 +1,443 @@
+// Stand-in for "java -jar plantuml.jar -pipe" without Java.
+//
+// Speaks the same protocol as PlantUML's pipe mode: diagrams are read from
+// stdin, and every @start...@end block produces one image on stdout as soon
+// as its @end line arrives, followed by "<delimiter>\n" with -pipedelimitor.
+// The images are small but valid SVG or PNG files naming the diagram, so the
+// engine's daemons, pumps, schedulers and caches can be load-tested and their
+// timeouts, restarts and cancellation exercised on machines without a JDK.
+// Point [plantuml] java (or a test's ProcessSpec) at it: JVM options, -jar
+// and -charset are accepted and ignored.
+//
+// Behavior is set with -Dsim.<name>=<value> options, which also pass through
+// [jvm] options, or with PUML_SIM_<NAME> environment variables:
+//   startup_ms         delay before stdin is read (JVM start-up)
+//   latency            per diagram: MS, uniform:MIN:MAX, exp:MEAN or
+//                      lognormal:MEDIAN:SIGMA (milliseconds)
+//   latency_per_kb_ms  extra latency per KB of diagram source
+//   output_bytes       pad every image to this size
+//   memory_mb          memory touched while a diagram renders
+//   fail_rate          share of diagrams rendered as a syntax error image
+//   hang_rate          share of diagrams that never finish
+//   crash_rate         share of diagrams that end the process mid-image
+//   crash_after        crash on the diagram after this many (0 = never)
+//   seed               random seed; the same seed replays the same run
+//   log                file to append one line per diagram to
+// A diagram overrides them for itself with comment lines PlantUML ignores:
+//   ' sim: fail | hang | crash | sleep MS | size BYTES | memory MB
+//
+// "-version" prints java-like settings, so toolchain probes accept it; and
+// -XX:ArchiveClassesAtExit=PATH leaves a placeholder archive there.
+
+#include "core/content_hash.h"
+
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+struct SimulatorOptions {
+    std::map<std::string, std::string> settings;    // sim.* without the prefix
+    std::string format = "png";
+    std::string delimiter;                          // empty: images back to back
+    size_t      imageIndex = 0;
+    std::string maxHeap;                            // -Xmx as given
+    std::string archivePath;                        // -XX:ArchiveClassesAtExit
+    bool        version = false;
+
+    std::string Get(const std::string& name, const std::string& fallback = std::string()) const {
+        auto it = settings.find(name);
+        return it == settings.end() ? fallback : it->second;
+    }
+    double Number(const std::string& name, double fallback = 0) const {
+        const std::string value = Get(name);
+        return value.empty() ? fallback : std::strtod(value.c_str(), nullptr);
+    }
+};
+
+const char* const kSettingNames[] = {
+    "startup_ms", "latency", "latency_per_kb_ms", "output_bytes", "memory_mb",
+    "fail_rate", "hang_rate", "crash_rate", "crash_after", "seed", "log",
+};
+
+SimulatorOptions ParseArguments(const std::vector<std::string>& args) {
+    SimulatorOptions options;
+    for (const char* name : kSettingNames) {
+        std::string variable = "PUML_SIM_";
+        for (const char* c = name; *c; ++c) variable += static_cast<char>(std::toupper(static_cast<unsigned char>(*c)));
+        if (const char* value = std::getenv(variable.c_str())) {
+            options.settings[name] = value;
+        }
+    }
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& arg = args[i];
+        const bool hasValue = i + 1 < args.size();
+        if (arg.compare(0, 6, "-Dsim.") == 0) {
+            const size_t equals = arg.find('=');
+            if (equals != std::string::npos) options.settings[arg.substr(6, equals - 6)] = arg.substr(equals + 1);
+        } else if (arg.compare(0, 2, "-t") == 0 && arg.size() > 2) {
+            options.format = arg.substr(2);
+        } else if (arg == "-pipedelimitor" && hasValue) {
+            options.delimiter = args[++i];
+        } else if (arg == "-pipeimageindex" && hasValue) {
+            options.imageIndex = std::strtoul(args[++i].c_str(), nullptr, 10);
+        } else if ((arg == "-jar" || arg == "-charset") && hasValue) {
+            ++i;
+        } else if (arg.compare(0, 4, "-Xmx") == 0) {
+            options.maxHeap = arg.substr(4);
+        } else if (arg.compare(0, 25, "-XX:ArchiveClassesAtExit=") == 0) {
+            options.archivePath = arg.substr(25);
+        } else if (arg == "-version" || arg == "--version") {
+            options.version = true;
+        }
+        // Everything else (JVM options, -pipe, ...) is accepted as it is.
+    }
+    return options;
+}
+
+// splitmix64: the same sequence on every platform, unlike <random>'s
+// distributions.
+class Random {
+public:
+    explicit Random(uint64_t seed) : state_(seed) {}
+
+    uint64_t Next() {
+        uint64_t z = (state_ += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+    double Uniform() {
+        return static_cast<double>(Next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+    double Normal() {
+        const double u = 1.0 - Uniform();
+        return std::sqrt(-2.0 * std::log(u)) * std::cos(6.283185307179586 * Uniform());
+    }
+
+private:
+    uint64_t state_;
+};
+
+double SampleLatencyMs(const std::string& spec, Random& random) {
+    std::vector<double> values;
+    std::string kind = spec;
+    const size_t colon = spec.find(':');
+    if (colon != std::string::npos) {
+        kind = spec.substr(0, colon);
+        for (size_t pos = colon; pos != std::string::npos;) {
+            values.push_back(std::strtod(spec.c_str() + pos + 1, nullptr));
+            pos = spec.find(':', pos + 1);
+        }
+    }
+    if (kind == "uniform" && values.size() == 2) {
+        return values[0] + (values[1] - values[0]) * random.Uniform();
+    }
+    if (kind == "exp" && values.size() == 1) {
+        return -values[0] * std::log(1.0 - random.Uniform());
+    }
+    if (kind == "lognormal" && values.size() == 2) {
+        return values[0] * std::exp(values[1] * random.Normal());
+    }
+    return std::strtod(spec.c_str(), nullptr);
+}
+
+uint32_t Crc32(const unsigned char* data, size_t size, uint32_t crc = 0) {
+    static uint32_t table[256] = {};
+    if (table[1] == 0) {
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+void AppendBe32(std::string& out, uint32_t value) {
+    out += static_cast<char>(value >> 24);
+    out += static_cast<char>(value >> 16);
+    out += static_cast<char>(value >> 8);
+    out += static_cast<char>(value);
+}
+
+void AppendPngChunk(std::string& out, const char* type, const std::string& data) {
+    AppendBe32(out, static_cast<uint32_t>(data.size()));
+    const std::string typed = std::string(type, 4) + data;
+    out += typed;
+    AppendBe32(out, Crc32(reinterpret_cast<const unsigned char*>(typed.data()), typed.size()));
+}
+
+// A 1x1 grayscale PNG whose tEXt comment carries the label, padded to at
+// least minSize bytes.
+std::string MakePng(const std::string& label, size_t minSize) {
+    const unsigned char gray = static_cast<unsigned char>(puml::Hash64(label.data(), label.size()) & 0xff);
+    std::string header;
+    AppendBe32(header, 1);
+    AppendBe32(header, 1);
+    header += std::string("\x08\x00\x00\x00\x00", 5);   // 8 bit gray, no interlace
+    // zlib stream with one stored block: filter byte and the pixel.
+    std::string pixels("\x78\x01\x01\x02\x00\xfd\xff\x00", 8);
+    pixels += static_cast<char>(gray);
+    const uint32_t a = 1 + 0 + gray, b = 1 + (1 + gray);   // Adler-32 of { 0, gray }
+    AppendBe32(pixels, (b << 16) | a);
+
+    std::string text = "Comment" + std::string(1, '\0') + label;
+    const size_t fixed = 8 + (12 + 13) + (12 + pixels.size()) + 12 + 12;
+    if (fixed + text.size() < minSize) {
+        text.append(minSize - fixed - text.size(), '.');
+    }
+    std::string png("\x89PNG\r\n\x1a\n", 8);
+    AppendPngChunk(png, "IHDR", header);
+    AppendPngChunk(png, "tEXt", text);
+    AppendPngChunk(png, "IDAT", pixels);
+    AppendPngChunk(png, "IEND", std::string());
+    return png;
+}
+
+std::string MakeSvg(const std::string& label, size_t minSize) {
+    std::string head =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\"?>"
+        "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"320\" height=\"40\" viewBox=\"0 0 320 40\">"
+        "<text x=\"8\" y=\"24\" font-family=\"sans-serif\" font-size=\"14\">" + label + "</text>";
+    const std::string tail = "</svg>";
+    if (head.size() + tail.size() + 7 < minSize) {
+        head += "<!--" + std::string(minSize - head.size() - tail.size() - 7, '.') + "-->";
+    }
+    return head + tail;
+}
+
+void SleepMs(double ms) {
+    if (ms > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(static_cast<int64_t>(ms * 1000)));
+    }
+}
+
+[[noreturn]] void Hang() {
+    for (;;) std::this_thread::sleep_for(std::chrono::hours(1));
+}
+
+unsigned long CurrentProcessId() {
+#ifdef _WIN32
+    return GetCurrentProcessId();
+#else
+    return static_cast<unsigned long>(getpid());
+#endif
+}
+
+// What a diagram asks for with "' sim:" comment lines.
+struct Directives {
+    bool   fail = false;
+    bool   hang = false;
+    bool   crash = false;
+    double sleepMs = -1;
+    double sizeBytes = -1;
+    double memoryMb = -1;
+};
+
+Directives ReadDirectives(const std::vector<std::string>& lines) {
+    Directives directives;
+    for (const std::string& line : lines) {
+        const size_t quote = line.find_first_not_of(" \t");
+        if (quote == std::string::npos || line[quote] != '\'') continue;
+        const size_t tag = line.find_first_not_of(" \t", quote + 1);
+        if (tag == std::string::npos || line.compare(tag, 4, "sim:") != 0) continue;
+        char word[16] = {};
+        double value = 0;
+        const int fields = std::sscanf(line.c_str() + tag + 4, " %15s %lf", word, &value);
+        const std::string what = fields >= 1 ? word : "";
+        if (what == "fail") directives.fail = true;
+        else if (what == "hang") directives.hang = true;
+        else if (what == "crash") directives.crash = true;
+        else if (what == "sleep" && fields == 2) directives.sleepMs = value;
+        else if (what == "size" && fields == 2) directives.sizeBytes = value;
+        else if (what == "memory" && fields == 2) directives.memoryMb = value;
+    }
+    return directives;
+}
+
+class PipeSimulator {
+public:
+    explicit PipeSimulator(const SimulatorOptions& options)
+        : options_(options), random_(static_cast<uint64_t>(options.Number("seed", 1))) {}
+
+    void Render(const std::vector<std::string>& lines) {
+        ++diagrams_;
+        std::string source;
+        size_t pages = 1;
+        for (const std::string& line : lines) {
+            source += line + "\n";
+            if (line.find_first_not_of(" \t") != std::string::npos &&
+                line.compare(line.find_first_not_of(" \t"), 7, "newpage") == 0) {
+                ++pages;
+            }
+        }
+        const Directives directives = ReadDirectives(lines);
+        const uint64_t hash = puml::Hash64(source.data(), source.size());
+
+        const double crashAfter = options_.Number("crash_after");
+        const bool crash = directives.crash || random_.Uniform() < options_.Number("crash_rate") ||
+                           (crashAfter > 0 && diagrams_ > crashAfter);
+        const bool hang = directives.hang || random_.Uniform() < options_.Number("hang_rate");
+        const bool fail = directives.fail || random_.Uniform() < options_.Number("fail_rate") ||
+                          options_.imageIndex >= pages;
+        double latencyMs = directives.sleepMs >= 0 ? directives.sleepMs
+                                                   : SampleLatencyMs(options_.Get("latency", "0"), random_);
+        latencyMs += options_.Number("latency_per_kb_ms") * static_cast<double>(source.size()) / 1024.0;
+
+        // The memory grows over the render in steps, like a JVM's heap, so
+        // a memory limit's monitor sees it before an allocation fails.
+        const double memoryMb = directives.memoryMb >= 0 ? directives.memoryMb : options_.Number("memory_mb");
+        std::vector<std::vector<char>> memory;
+        const int steps = memoryMb > 0 ? 16 : 1;
+        for (int step = 0; step < steps; ++step) {
+            if (memoryMb > 0) {
+                memory.emplace_back(static_cast<size_t>(memoryMb * 1024 * 1024 / steps));
+                for (size_t i = 0; i < memory.back().size(); i += 4096) memory.back()[i] = 1;
+            }
+            SleepMs(latencyMs / steps);
+        }
+        LogDiagram(hash, latencyMs, crash ? "crash" : hang ? "hang" : fail ? "error" : "ok");
+        if (hang) {
+            Hang();
+        }
+
+        const std::string label = std::string(fail ? "Syntax Error? " : "") + "sim diagram " +
+                                  std::to_string(diagrams_) + " page " + std::to_string(options_.imageIndex) +
+                                  " hash " + puml::HashToHex(hash);
+        const size_t size = static_cast<size_t>(directives.sizeBytes >= 0 ? directives.sizeBytes
+                                                                          : options_.Number("output_bytes"));
+        const std::string image = options_.format == "svg" ? MakeSvg(label, size) : MakePng(label, size);
+        if (crash) {
+            // Dies halfway through the image, as a crashing JVM would.
+            std::fwrite(image.data(), 1, image.size() / 2, stdout);
+            std::fflush(stdout);
+            std::_Exit(134);
+        }
+        if (fail) {
+            std::fprintf(stderr, "ERROR\n1\nSyntax Error?\n");
+        }
+        std::fwrite(image.data(), 1, image.size(), stdout);
+        if (!options_.delimiter.empty()) {
+            std::fwrite(options_.delimiter.data(), 1, options_.delimiter.size(), stdout);
+            std::fputc('\n', stdout);
+        }
+        std::fflush(stdout);
+    }
+
+private:
+    void LogDiagram(uint64_t hash, double latencyMs, const char* outcome) {
+        const std::string path = options_.Get("log");
+        if (path.empty()) return;
+        std::ofstream out(std::filesystem::u8path(path), std::ios::app);
+        out << "pid=" << CurrentProcessId() << " diagram=" << diagrams_ << " hash=" << puml::HashToHex(hash)
+            << " latencyMs=" << static_cast<long long>(latencyMs) << " outcome=" << outcome << "\n";
+    }
+
+    const SimulatorOptions& options_;
+    Random                  random_;
+    uint64_t                diagrams_ = 0;
+};
+
+// What "java -XshowSettings:all -version" prints, on stderr like java.
+int PrintVersion(const SimulatorOptions& options, const std::string& self) {
+    std::error_code ec;
+    const std::string home = std::filesystem::absolute(std::filesystem::u8path(self), ec).parent_path().u8string();
+    std::fprintf(stderr,
+                 "VM settings:\n"
+                 "    Max. Heap Size (Estimated): %s\n"
+                 "    Using VM: PlantUML pipe simulator\n"
+                 "\n"
+                 "Property settings:\n"
+                 "    java.home = %s\n"
+                 "    java.specification.version = 21\n"
+                 "    java.vendor = PlantUML pipe simulator\n"
+                 "    java.version = 21.0.0-sim\n"
+                 "\n"
+                 "simulator version \"21.0.0-sim\"\n",
+                 options.maxHeap.empty() ? "1.00G" : options.maxHeap.c_str(), home.c_str());
+    return 0;
+}
+
+int RunSimulator(const std::vector<std::string>& args, const std::string& self) {
+    const SimulatorOptions options = ParseArguments(args);
+    if (options.version) {
+        return PrintVersion(options, self);
+    }
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    SleepMs(options.Number("startup_ms"));
+
+    PipeSimulator simulator(options);
+    std::vector<std::string> diagram;
+    bool inDiagram = false;
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        const size_t start = line.find_first_not_of(" \t");
+        const bool marker = start != std::string::npos && line[start] == '@';
+        if (!inDiagram) {
+            if (marker && line.compare(start, 6, "@start") == 0) {
+                inDiagram = true;
+                diagram.clear();
+            }
+            continue;
+        }
+        if (marker && line.compare(start, 4, "@end") == 0) {
+            inDiagram = false;
+            simulator.Render(diagram);
+            continue;
+        }
+        diagram.push_back(line);
+    }
+
+    if (!options.archivePath.empty()) {
+        std::ofstream(std::filesystem::u8path(options.archivePath), std::ios::binary)
+            << "PlantUML pipe simulator class data archive placeholder\n";
+    }
+    return 0;
+}
+
+} // namespace
+
+#ifdef _WIN32
+int wmain(int argc, wchar_t** argv) {
+    std::vector<std::string> args;
+    for (int i = 0; i < argc; ++i) {
+        const int n = WideCharToMultiByte(CP_UTF8, 0, argv[i], -1, nullptr, 0, nullptr, nullptr);
+        std::string arg(n > 1 ? n - 1 : 0, '\0');
+        if (n > 1) WideCharToMultiByte(CP_UTF8, 0, argv[i], -1, arg.data(), n - 1, nullptr, nullptr);
+        args.push_back(arg);
+    }
+    const std::string self = args.empty() ? std::string() : args.front();
+    return RunSimulator(std::vector<std::string>(args.begin() + (args.empty() ? 0 : 1), args.end()), self);
+}
+#else
+int main(int argc, char** argv) {
+    return RunSimulator(std::vector<std::string>(argv + 1, argv + argc), argv[0]);
+}
+#endif
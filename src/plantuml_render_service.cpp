@@ -0,0 +1,238 @@
+// Shared PlantUML render service.
+//
+// Started by the plugin when [service] enabled=1 and nobody serves its
+// endpoint yet; every Total Commander process of the user session then
+// renders through the resident JVMs of this one process. Exits after a
+// period without clients. Portable: on POSIX it listens on a Unix socket.
+//
+// plantuml_render_service --endpoint NAME --java PATH --jar PATH
+//     [--jvm-option OPTION]... [--instances N] [--daemon-idle-ms MS]
+//     [--idle-exit-ms MS] [--memory-mb MB] [--max-renders N] [--log PATH]
+
+#include "core/core_log.h"
+#include "core/plantuml_daemon.h"
+#include "core/process_pump.h"
+#include "core/render_service.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+struct ServiceOptions {
+    std::string              endpoint;
+    std::string              java;
+    std::string              jar;
+    std::vector<std::string> jvmOptions;
+    size_t                   instances = 2;
+    uint32_t                 daemonIdleMs = 120000;
+    uint32_t                 idleExitMs = 600000;
+    uint64_t                 memoryMb = 0;      // per renderer process, 0 = unlimited
+    size_t                   maxRenders = 0;    // renders working at once, 0 = unlimited
+    std::string              log;
+};
+
+bool ParseArguments(const std::vector<std::string>& args, ServiceOptions& options, std::string* error) {
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& name = args[i];
+        if (i + 1 >= args.size()) {
+            *error = "missing value for " + name;
+            return false;
+        }
+        const std::string& value = args[++i];
+        if (name == "--endpoint") options.endpoint = value;
+        else if (name == "--java") options.java = value;
+        else if (name == "--jar") options.jar = value;
+        else if (name == "--jvm-option") options.jvmOptions.push_back(value);
+        else if (name == "--instances") options.instances = std::strtoul(value.c_str(), nullptr, 10);
+        else if (name == "--daemon-idle-ms") options.daemonIdleMs = std::strtoul(value.c_str(), nullptr, 10);
+        else if (name == "--idle-exit-ms") options.idleExitMs = std::strtoul(value.c_str(), nullptr, 10);
+        else if (name == "--memory-mb") options.memoryMb = std::strtoull(value.c_str(), nullptr, 10);
+        else if (name == "--max-renders") options.maxRenders = std::strtoul(value.c_str(), nullptr, 10);
+        else if (name == "--log") options.log = value;
+        else {
+            *error = "unknown option " + name;
+            return false;
+        }
+    }
+    if (options.endpoint.empty() || options.java.empty() || options.jar.empty()) {
+        *error = "--endpoint, --java and --jar are required";
+        return false;
+    }
+    if (options.instances < 1) options.instances = 1;
+    if (options.instances > 8) options.instances = 8;
+    return true;
+}
+
+unsigned long CurrentProcessId() {
+#ifdef _WIN32
+    return GetCurrentProcessId();
+#else
+    return static_cast<unsigned long>(getpid());
+#endif
+}
+
+// Appends to the plugin's log file, which several processes share already.
+void InstallLogSink(const std::string& path) {
+    if (path.empty()) {
+        return;
+    }
+    static std::mutex mutex;
+    const std::string prefix = "[service " + std::to_string(CurrentProcessId()) + "] ";
+    puml::SetLogSink([path, prefix](const std::string& message) {
+        const std::time_t now = std::time(nullptr);
+        char stamp[32] = {};
+        std::strftime(stamp, sizeof(stamp), "[%Y-%m-%d %H:%M:%S] ", std::localtime(&now));
+        std::lock_guard<std::mutex> lock(mutex);
+        std::ofstream out(std::filesystem::u8path(path), std::ios::app | std::ios::binary);
+#ifdef _WIN32
+        out << stamp << prefix << message << "\r\n";
+#else
+        out << stamp << prefix << message << "\n";
+#endif
+    });
+}
+
+class PlantUmlService {
+public:
+    explicit PlantUmlService(const ServiceOptions& options) : options_(options), limiter_(options.maxRenders) {
+        for (int svg = 0; svg < 2; ++svg) {
+            puml::DaemonOptions daemon;
+            daemon.process = BaseSpec(svg != 0);
+            daemon.idleShutdownMs = options.daemonIdleMs;
+            daemon.limiter = &limiter_;
+            daemon.name = svg ? "service[svg]" : "service[png]";
+            pools_[svg] = std::make_unique<puml::PlantUmlDaemonPool>(daemon, options.instances);
+        }
+    }
+
+    ~PlantUmlService() {
+        pools_[0]->Shutdown();
+        pools_[1]->Shutdown();
+    }
+
+    // cancel fires when the client has gone: its JVM time goes to others.
+    puml::RenderServiceResponse Render(const puml::RenderServiceRequest& request,
+                                       const puml::CancellationToken& cancel) {
+        puml::RenderServiceResponse response;
+        std::string error;
+        const bool ok = request.imageIndex == 0
+            ? pools_[request.svg ? 1 : 0]->Render(request.source, request.timeoutMs, response.image, &error,
+                                                  &cancel, request.background)
+            : RenderOnce(request, response.image, &error, cancel);
+        if (ok && !response.image.empty()) {
+            response.status = puml::RenderServiceStatus::Rendered;
+        } else {
+            response.status = puml::RenderServiceStatus::Failed;
+            response.error = ok ? "renderer produced no output" : error;
+            response.image.clear();
+        }
+        return response;
+    }
+
+private:
+    puml::ProcessSpec BaseSpec(bool svg) const {
+        puml::ProcessSpec spec;
+        spec.executable = options_.java;
+        spec.arguments = options_.jvmOptions;
+        spec.arguments.insert(spec.arguments.end(), {
+            "-Djava.awt.headless=true", "-jar", options_.jar,
+            "-charset", "UTF-8", "-pipe", svg ? "-tsvg" : "-tpng",
+        });
+        spec.limits.memoryBytes = options_.memoryMb * 1024 * 1024;
+        return spec;
+    }
+
+    // Later pages of a diagram: the daemons' pipe only returns the first.
+    bool RenderOnce(const puml::RenderServiceRequest& request, std::vector<unsigned char>& out, std::string* error,
+                    const puml::CancellationToken& cancel) {
+        puml::ProcessSpec spec = BaseSpec(request.svg);
+        spec.arguments.push_back("-pipeimageindex");
+        spec.arguments.push_back(std::to_string(request.imageIndex));
+        spec.workingDirectory = request.workingDirectory;
+        spec.pipeBufferSize = 64 * 1024;
+        spec.limits.lowPriority = request.background;
+
+        std::error_code ec;
+        const std::filesystem::path tempDir = std::filesystem::temp_directory_path(ec);
+        puml::SpillableBuffer output(16ull * 1024 * 1024, ec ? std::string() : tempDir.u8string());
+        puml::PumpOptions pump;
+        pump.timeoutMs = request.timeoutMs;
+        pump.limiter = &limiter_;
+        pump.background = request.background;
+        const puml::PumpResult result = puml::RunProcessPump(spec, request.source, pump, output, error, &cancel);
+        if (result.status != puml::PumpStatus::Completed) {
+            if (error && error->empty()) *error = puml::PumpStatusName(result.status);
+            return false;
+        }
+        return output.ReadAll(out);
+    }
+
+    ServiceOptions options_;
+    puml::ConcurrencyLimiter limiter_;
+    std::unique_ptr<puml::PlantUmlDaemonPool> pools_[2];   // [0] PNG, [1] SVG
+};
+
+int RunService(const std::vector<std::string>& args) {
+    ServiceOptions options;
+    std::string error;
+    if (!ParseArguments(args, options, &error)) {
+        std::fprintf(stderr, "plantuml_render_service: %s\n", error.c_str());
+        return 2;
+    }
+    InstallLogSink(options.log);
+
+    PlantUmlService service(options);
+    puml::RenderServiceServerOptions serverOptions;
+    serverOptions.endpoint = options.endpoint;
+    serverOptions.idleExitMs = options.idleExitMs;
+    puml::RenderServiceServer server(serverOptions,
+        [&service](const puml::RenderServiceRequest& request, const puml::CancellationToken& cancel) {
+            return service.Render(request, cancel);
+        });
+    bool inUse = false;
+    if (!server.Start(&inUse, &error)) {
+        // Two plugin instances may start a service at the same moment.
+        puml::Log(std::string("render service: not started: ") + (inUse ? "already running" : error));
+        return inUse ? 0 : 1;
+    }
+    server.Wait();
+    server.Stop();
+    const puml::RenderServiceStats stats = server.Stats();
+    puml::Log("render service: served " + std::to_string(stats.requests) + " request(s) on " +
+              std::to_string(stats.connections) + " connection(s), " + std::to_string(stats.failures) +
+              " failed, " + std::to_string(stats.abandoned) + " abandoned by their client");
+    return 0;
+}
+
+} // namespace
+
+#ifdef _WIN32
+int wmain(int argc, wchar_t** argv) {
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        const int n = WideCharToMultiByte(CP_UTF8, 0, argv[i], -1, nullptr, 0, nullptr, nullptr);
+        std::string arg(n > 1 ? n - 1 : 0, '\0');
+        if (n > 1) WideCharToMultiByte(CP_UTF8, 0, argv[i], -1, arg.data(), n - 1, nullptr, nullptr);
+        args.push_back(arg);
+    }
+    return RunService(args);
+}
+#else
+int main(int argc, char** argv) {
+    return RunService(std::vector<std::string>(argv + 1, argv + argc));
+}
+#endif
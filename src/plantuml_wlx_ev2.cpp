@@ -11,18 +11,56 @@
 #include <wrl.h>
 #include <wrl/event.h>
 #include <string>
+#include <string_view>
 #include <sstream>
+#include <iomanip>
 #include <vector>
+#include <unordered_map>
+#include <unordered_set>
 #include <memory>
 #include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <thread>
 #include <cwchar>
+#include <charconv>
+#include <cstring>
 
 #include <wincodec.h>
 
 #include "WebView2.h"
 
+#include "core/buffer_pool.h"
+#include "core/concurrency_limiter.h"
+#include "core/content_hash.h"
+#include "core/core_log.h"
+#include "core/diagram_markup.h"
+#include "core/diagram_splitter.h"
+#include "core/disk_cache.h"
+#include "core/file_watcher.h"
+#include "core/hedged_render.h"
+#include "core/html_template.h"
+#include "core/http_client.h"
+#include "core/include_scanner.h"
+#include "core/jar_manifest.h"
+#include "core/jvm_launch.h"
+#include "core/jvm_renderer.h"
+#include "core/lru_cache.h"
+#include "core/plantuml_daemon.h"
+#include "core/process_pump.h"
+#include "core/render_arena.h"
+#include "core/render_artifact.h"
+#include "core/render_cache_key.h"
+#include "core/render_scheduler.h"
+#include "core/render_service.h"
+#include "core/single_flight.h"
+#include "core/source_file.h"
+#include "core/toolchain.h"
+#include "core/worker_pool.h"
+
 #pragma comment(lib, "shlwapi.lib")
 #pragma comment(lib, "Comdlg32.lib")
 #pragma comment(lib, "windowscodecs.lib")
@@ -31,13 +69,49 @@ using namespace Microsoft::WRL;
 
 // ---------------------- Config ----------------------
 static std::wstring g_prefer          = L"svg";           // "svg" or "png"
-static std::wstring g_rendererSetting = L"java";          // "java" or "web"
+static std::wstring g_rendererSetting = L"java";          // "java", "jni" or "web"
+static bool         g_hedgeEnabled    = false;           // renderer=auto: race the jar backend against the server
 static std::string  g_detectA         = R"(EXT="PUML" | EXT="PLANTUML" | EXT="UML" | EXT="WSD" | EXT="WS" | EXT="IUML")";
 
 static std::wstring g_jarPath;                      // If empty: auto-detect moduleDir\plantuml.jar
 static std::wstring g_javaPath;                     // Optional explicit java[w].exe
+static std::wstring g_jvmPath;                      // Optional explicit jvm.dll for renderer=jni
 static std::wstring g_logPath;                      // If empty: moduleDir\plantumlwebview.log
 static DWORD        g_jarTimeoutMs = 8000;
+static bool         g_daemonEnabled = true;         // keep one JVM resident per format
+static DWORD        g_daemonIdleMs = 120000;
+static DWORD        g_renderThreads = 2;            // background render scheduler threads
+static bool         g_splitDiagrams = true;         // render the diagrams of one file in parallel
+static DWORD        g_diagramThreads = 0;           // workers for those diagrams, 0 = one per core
+static DWORD        g_daemonInstances = 2;          // resident JVMs per format
+static bool         g_cdsEnabled = true;            // AppCDS archive of the jar for faster JVM starts
+static std::wstring g_cdsDir;                       // If empty: %LOCALAPPDATA%\PlantUmlWebView\cds
+static DWORD        g_jvmTieredStopAtLevel = 1;     // JIT tiers of java processes, 0 = JVM default
+static DWORD        g_jvmInitialHeapMb = 0;         // -Xms, 0 = JVM default
+static DWORD        g_jvmMaxHeapMb = 0;             // -Xmx, 0 = JVM default
+static std::wstring g_jvmGc = L"serial";            // collector, empty = JVM default
+static std::wstring g_jvmOptions;                   // extra options for java processes
+static bool         g_serviceEnabled = false;       // render through the shared render service
+static std::wstring g_serviceExe;                   // If empty: moduleDir\plantuml_render_service.exe
+static DWORD        g_serviceConnectTimeoutMs = 500;
+static DWORD        g_serviceIdleExitMs = 600000;   // the service exits after this long without clients
+static DWORD        g_renderMemoryMb = 2048;        // per java process tree, 0 = unlimited
+static DWORD        g_maxRenders = 0;               // renders working at once, 0 = one per core
+static bool         g_autoRefresh = true;           // re-render when the shown file is saved
+static DWORD        g_autoRefreshDelayMs = 300;     // quiet time before re-rendering
+static bool         g_otherFormat = true;           // also render the other format in the background
+static bool         g_cacheEnabled = true;          // persistent render cache
+static std::wstring g_cacheDir;                     // If empty: %LOCALAPPDATA%\PlantUmlWebView\cache
+static DWORD        g_cacheMaxMb = 256;
+static DWORD        g_memoryCacheMb = 64;           // 0 disables the in-memory LRU
+static DWORD        g_prefetchDepth = 0;            // neighbors on each side to pre-render, 0 = off
+static DWORD        g_prefetchMaxRunning = 1;       // speculative renders running at once
+static std::wstring g_webServerUrl = L"https://www.plantuml.com/plantuml";
+static DWORD        g_webTimeoutMs = 15000;         // renderer=auto requests to the server
+static DWORD        g_hedgeDelayMs = 1500;          // until the jar backend has a latency history
+static DWORD        g_hedgeMaxDelayMs = 10000;
+static DWORD        g_breakerFailures = 3;          // failures in a row that take a backend out
+static DWORD        g_breakerCooldownMs = 30000;    // before its first health probe
 static bool         g_logEnabled = true;
 
 static bool         g_cfgLoaded = false;
@@ -48,34 +122,53 @@ static bool         g_logSessionStarted = false;
 enum class RenderBackend {
     Java,
     Web,
+    Jni,    // plantuml.jar in a JVM loaded into this process
 };
 
 static const wchar_t* RenderBackendName(RenderBackend backend) {
     switch (backend) {
     case RenderBackend::Java: return L"java";
     case RenderBackend::Web:  return L"web";
+    case RenderBackend::Jni:  return L"jni";
     }
     return L"unknown";
 }
 
+// Backends running the local plantuml.jar; their artifacts are the same.
+static bool IsJarBackend(RenderBackend backend) {
+    return backend == RenderBackend::Java || backend == RenderBackend::Jni;
+}
+
 static RenderBackend ParseRendererSettingValue(const std::wstring& rendererText,
                                               RenderBackend fallback);
+static bool IsAutoRendererSetting(const std::wstring& rendererText);
 static RenderBackend GetConfiguredRenderer();
 static std::wstring GetConfiguredRendererName();
 
 static std::string ToUtf8(const std::wstring& w);
+static puml::RenderScheduler* GetRenderScheduler();
 
-static std::wstring FormatTimestamp() {
+static std::wstring_view FormatTimestamp(wchar_t (&buf)[64]) {
     SYSTEMTIME st{};
     GetLocalTime(&st);
-    wchar_t buf[64];
-    swprintf(buf, 64, L"[%04u-%02u-%02u %02u:%02u:%02u.%03u] ",
-             st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond, st.wMilliseconds);
-    return buf;
+    const int n = swprintf(buf, 64, L"[%04u-%02u-%02u %02u:%02u:%02u.%03u] ",
+                           st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond, st.wMilliseconds);
+    return std::wstring_view(buf, n > 0 ? static_cast<size_t>(n) : 0);
+}
+
+// Writes w as UTF-8 at out, which has room for three bytes per UTF-16 unit,
+// the most one can take. Returns the number of bytes written.
+static size_t NarrowInto(std::wstring_view w, char* out) {
+    if (w.empty()) return 0;
+    const int n = ::WideCharToMultiByte(CP_UTF8, 0, w.data(), (int)w.size(), out, (int)(w.size() * 3), nullptr, nullptr);
+    return n > 0 ? static_cast<size_t>(n) : 0;
+}
+
+static bool LogEnabled() {
+    return g_logEnabled && !g_logPath.empty();
 }
 
-static void AppendLog(const std::wstring& message) {
-    if (!g_logEnabled || g_logPath.empty()) return;
+static void AppendLogParts(std::initializer_list<std::wstring_view> parts) {
     std::lock_guard<std::mutex> lock(g_logMutex);
     HANDLE h = CreateFileW(g_logPath.c_str(), FILE_APPEND_DATA, FILE_SHARE_READ, nullptr,
                            OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
@@ -87,7 +180,9 @@ static void AppendLog(const std::wstring& message) {
             DWORD written = 0;
             WriteFile(h, sep.c_str(), (DWORD)sep.size(), &written, nullptr);
         }
-        std::wstring header = FormatTimestamp() + L"--- PlantUML WebView session start ---\r\n";
+        wchar_t stamp[64];
+        std::wstring header(FormatTimestamp(stamp));
+        header += L"--- PlantUML WebView session start ---\r\n";
         std::string headerUtf8 = ToUtf8(header);
         if (!headerUtf8.empty()) {
             DWORD written = 0;
@@ -95,27 +190,50 @@ static void AppendLog(const std::wstring& message) {
         }
         g_logSessionStarted = true;
     }
-    std::wstring line = FormatTimestamp() + message + L"\r\n";
-    std::string utf8 = ToUtf8(line);
-    if (!utf8.empty()) {
-        DWORD written = 0;
-        WriteFile(h, utf8.data(), (DWORD)utf8.size(), &written, nullptr);
-    }
+    // Narrowed straight into a pooled buffer rather than concatenated first.
+    wchar_t buf[64];
+    const std::wstring_view stamp = FormatTimestamp(buf);
+    size_t length = stamp.size();
+    for (std::wstring_view part : parts) length += part.size();
+    puml::PooledBuffer line = puml::BufferPool::Shared().Acquire(length * 3 + 2);
+    char* utf8 = line.As<char>();
+    size_t size = NarrowInto(stamp, utf8);
+    for (std::wstring_view part : parts) size += NarrowInto(part, utf8 + size);
+    utf8[size++] = '\r';
+    utf8[size++] = '\n';
+    DWORD written = 0;
+    WriteFile(h, utf8, (DWORD)size, &written, nullptr);
     CloseHandle(h);
 }
 
-static bool ClipboardSetUnicodeText(const std::wstring& text) {
-    const size_t bytes = (text.size() + 1) * sizeof(wchar_t);
-    HGLOBAL mem = GlobalAlloc(GMEM_MOVEABLE, bytes);
+// One line from its pieces, e.g. AppendLog(context, L": reading ", path):
+// they are narrowed one after another, never concatenated, and not looked
+// at while logging is off.
+template <typename... Parts>
+static void AppendLog(const Parts&... parts) {
+    if (LogEnabled()) AppendLogParts({std::wstring_view(parts)...});
+}
+
+// CF_UNICODETEXT is UTF-16: the text is widened straight into the clipboard's memory.
+static bool ClipboardSetUtf8Text(std::string_view text) {
+    const int length = text.empty() ? 0
+        : MultiByteToWideChar(CP_UTF8, 0, text.data(), static_cast<int>(text.size()), nullptr, 0);
+    if (!text.empty() && length <= 0) {
+        return false;
+    }
+    HGLOBAL mem = GlobalAlloc(GMEM_MOVEABLE, (static_cast<size_t>(length) + 1) * sizeof(wchar_t));
     if (!mem) {
         return false;
     }
-    void* ptr = GlobalLock(mem);
+    wchar_t* ptr = static_cast<wchar_t*>(GlobalLock(mem));
     if (!ptr) {
         GlobalFree(mem);
         return false;
     }
-    memcpy(ptr, text.c_str(), bytes);
+    if (length > 0) {
+        MultiByteToWideChar(CP_UTF8, 0, text.data(), static_cast<int>(text.size()), ptr, length);
+    }
+    ptr[length] = L'\0';
     GlobalUnlock(mem);
     if (!SetClipboardData(CF_UNICODETEXT, mem)) {
         GlobalFree(mem);
@@ -146,10 +264,10 @@ static bool ClipboardSetBinaryData(UINT format, const void* data, size_t size) {
     return true;
 }
 
-static bool CreateDibFromPng(const std::vector<unsigned char>& png,
+static bool CreateDibFromPng(const unsigned char* png, size_t pngSize,
                              std::vector<unsigned char>& outDib) {
     outDib.clear();
-    if (png.empty()) {
+    if (pngSize == 0) {
         return false;
     }
 
@@ -178,7 +296,7 @@ static bool CreateDibFromPng(const std::vector<unsigned char>& png,
         return false;
     }
 
-    IStream* rawStream = SHCreateMemStream(png.data(), static_cast<UINT>(png.size()));
+    IStream* rawStream = SHCreateMemStream(png, static_cast<UINT>(pngSize));
     if (!rawStream) {
         if (needUninit) CoUninitialize();
         return false;
@@ -270,15 +388,6 @@ static bool FileExistsW(const std::wstring& p) {
     return (a != INVALID_FILE_ATTRIBUTES) && !(a & FILE_ATTRIBUTE_DIRECTORY);
 }
 
-static void ReplaceAll(std::wstring& inout, const std::wstring& from, const std::wstring& to) {
-    if (from.empty()) return;
-    size_t pos = 0;
-    while ((pos = inout.find(from, pos)) != std::wstring::npos) {
-        inout.replace(pos, from.size(), to);
-        pos += to.size();
-    }
-}
-
 static std::wstring ExtractJsonStringField(const std::wstring& json, const std::wstring& field) {
     if (json.empty() || field.empty()) {
         return std::wstring();
@@ -304,11 +413,54 @@ static std::wstring ExtractJsonStringField(const std::wstring& json, const std::
     return json.substr(quote + 1, end - quote - 1);
 }
 
-static std::wstring FromUtf8(const std::string& s) {
+// Quoted JSON string literal for messages posted to the page, from UTF-8.
+static std::string JsonQuote(const std::string& text) {
+    static const char kHex[] = "0123456789abcdef";
+    std::string out;
+    out.reserve(text.size() + text.size() / 16 + 2);
+    out.push_back('"');
+    for (size_t i = 0; i < text.size(); ++i) {
+        const unsigned char c = static_cast<unsigned char>(text[i]);
+        switch (c) {
+        case '"':  out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (c < 0x20) {
+                out += "\\u00";
+                out.push_back(kHex[c >> 4]);
+                out.push_back(kHex[c & 0xF]);
+            } else if (c == 0xE2 && i + 2 < text.size() && text[i + 1] == '\x80' &&
+                       (text[i + 2] == '\xA8' || text[i + 2] == '\xA9')) {
+                // U+2028 and U+2029 end a line in JavaScript
+                out += text[i + 2] == '\xA8' ? "\\u2028" : "\\u2029";
+                i += 2;
+            } else {
+                out.push_back(static_cast<char>(c));
+            }
+        }
+    }
+    out.push_back('"');
+    return out;
+}
+
+static std::wstring FromUtf8(std::string_view s) {
     if (s.empty()) return std::wstring();
-    int n = ::MultiByteToWideChar(CP_UTF8, 0, s.c_str(), (int)s.size(), nullptr, 0);
+    int n = ::MultiByteToWideChar(CP_UTF8, 0, s.data(), (int)s.size(), nullptr, 0);
     std::wstring w(n, L'\0');
-    if (n > 0) ::MultiByteToWideChar(CP_UTF8, 0, s.c_str(), (int)s.size(), w.data(), n);
+    if (n > 0) ::MultiByteToWideChar(CP_UTF8, 0, s.data(), (int)s.size(), w.data(), n);
+    return w;
+}
+// UTF-8 to a NUL-terminated UTF-16 string in a pooled buffer, for the
+// page and the images handed to WebView2 on every render. A UTF-8 byte
+// never gives more than one UTF-16 unit.
+static const wchar_t* WidenToPooled(std::string_view s, puml::PooledBuffer& buffer) {
+    buffer = puml::BufferPool::Shared().Acquire((s.size() + 1) * sizeof(wchar_t));
+    wchar_t* w = buffer.As<wchar_t>();
+    const int n = s.empty() ? 0 : ::MultiByteToWideChar(CP_UTF8, 0, s.data(), (int)s.size(), w, (int)s.size());
+    w[n > 0 ? n : 0] = L'\0';
     return w;
 }
 static std::string ToUtf8(const std::wstring& w) {
@@ -319,35 +471,50 @@ static std::string ToUtf8(const std::wstring& w) {
     return s;
 }
 
-static std::wstring ReadFileUtf16OrAnsi(const wchar_t* path) {
-    HANDLE h = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
-    if (h == INVALID_HANDLE_VALUE) {
-        AppendLog(L"ReadFileUtf16OrAnsi: failed to open file " + std::wstring(path ? path : L"<null>") +
-                  L" (error=" + std::to_wstring(GetLastError()) + L")");
-        return L"";
-    }
-    DWORD size = GetFileSize(h, nullptr);
-    std::string bytes; bytes.resize(size ? size : 0);
-    DWORD read = 0;
-    if (size && (!ReadFile(h, bytes.data(), size, &read, nullptr) || read != size)) {
-        AppendLog(L"ReadFileUtf16OrAnsi: short read for file " + std::wstring(path ? path : L"<null>") +
-                  L" (wanted=" + std::to_wstring(size) + L", got=" + std::to_wstring(read) + L")");
+// A source file as UTF-8, which the whole render pipeline carries. A UTF-8
+// file is not copied: Utf8() is a view of the mapped or read file, minus its
+// BOM. Only UTF-16LE files (BOM) and files in the ANSI code page (no BOM and
+// not valid UTF-8) are converted, after which the file itself is closed.
+struct SourceText {
+    puml::SourceFile     file;
+    std::string          converted;
+    puml::SourceEncoding encoding = puml::SourceEncoding::Utf8;   // of the file as read
+    bool                 mapped = false;
+
+    std::string_view Utf8() const {
+        return encoding == puml::SourceEncoding::Utf8 || encoding == puml::SourceEncoding::Utf8Bom
+                   ? file.Utf8() : std::string_view(converted);
     }
-    CloseHandle(h);
+    // Before a render: the mapping must not outlive the cache checks, or an
+    // editor saving during a long render fails to truncate the file. Views
+    // taken from Utf8() before are invalid afterwards.
+    void ReleaseMapping() { file.ReleaseMapping(); }
+};
 
-    if (bytes.size() >= 2 && (unsigned char)bytes[0]==0xFF && (unsigned char)bytes[1]==0xFE) {
-        std::wstring w((wchar_t*)(bytes.data()+2), (bytes.size()-2)/2); return w;
+static bool ReadSourceText(const std::wstring& path, SourceText& source) {
+    std::string error;
+    if (!source.file.Open(ToUtf8(path), &error)) {
+        AppendLog(L"ReadSourceText: failed to read file " + path + L" (" + FromUtf8(error) + L")");
+        return false;
     }
-    if (bytes.size() >= 3 && (unsigned char)bytes[0]==0xEF && (unsigned char)bytes[1]==0xBB && (unsigned char)bytes[2]==0xBF) {
-        int wlen = MultiByteToWideChar(CP_UTF8, 0, bytes.data()+3, (int)bytes.size()-3, nullptr, 0);
-        std::wstring w(wlen, L'\0');
-        MultiByteToWideChar(CP_UTF8, 0, bytes.data()+3, (int)bytes.size()-3, w.data(), wlen);
-        return w;
+    source.encoding = source.file.Encoding();
+    source.mapped = source.file.Mapped();
+    const std::string_view bytes = source.file.Bytes();
+    if (source.encoding == puml::SourceEncoding::Utf16Le) {
+        const wchar_t* w = reinterpret_cast<const wchar_t*>(bytes.data() + 2);
+        const int wlen = static_cast<int>((bytes.size() - 2) / 2);
+        const int n = wlen > 0 ? WideCharToMultiByte(CP_UTF8, 0, w, wlen, nullptr, 0, nullptr, nullptr) : 0;
+        source.converted.assign(n > 0 ? n : 0, '\0');
+        if (n > 0) WideCharToMultiByte(CP_UTF8, 0, w, wlen, source.converted.data(), n, nullptr, nullptr);
+        source.file.Close();
+    } else if (source.encoding == puml::SourceEncoding::Legacy) {
+        const int wlen = MultiByteToWideChar(CP_ACP, 0, bytes.data(), (int)bytes.size(), nullptr, 0);
+        std::wstring w(wlen > 0 ? wlen : 0, L'\0');
+        if (wlen > 0) MultiByteToWideChar(CP_ACP, 0, bytes.data(), (int)bytes.size(), w.data(), wlen);
+        source.converted = ToUtf8(w);
+        source.file.Close();
     }
-    int wlen = MultiByteToWideChar(CP_ACP, 0, bytes.data(), (int)bytes.size(), nullptr, 0);
-    std::wstring w(wlen, L'\0');
-    MultiByteToWideChar(CP_ACP, 0, bytes.data(), (int)bytes.size(), w.data(), wlen);
-    return w;
+    return true;
 }
 
 static bool WriteBufferToFile(const std::wstring& path, const void* data, size_t size) {
@@ -395,6 +562,132 @@ static bool TryAutoDetectPlantUmlJar(std::wstring& outPath) {
     return false;
 }
 
+// ---------------------- Toolchain ----------------------
+// The java and plantuml.jar renders use, and what that java can do, found
+// once per session on first use. A record in the cache directory lets later
+// sessions skip the PATH search, the jar scan and the probing JVM for as
+// long as the configuration, PATH and the plugin directory are the same and
+// the java and jar it names are unchanged. Delete it to force a new search.
+
+static const DWORD     kJavaProbeTimeoutMs = 15000;
+
+static puml::Toolchain g_toolchain;
+static std::string     g_toolchainSnapshot;
+static bool            g_toolchainFromRecord = false;   // set by LoadConfigIfNeeded
+static bool            g_toolchainUsable = false;
+static std::atomic<bool> g_toolchainReady{false};
+
+static void InvalidateJarIdentity();
+
+static std::wstring ToolchainRecordPath() {
+    return g_cacheEnabled ? g_cacheDir + L"\\toolchain.txt" : std::wstring();
+}
+
+// Everything discovery depends on besides the java and jar themselves.
+static std::string ToolchainSnapshot(const std::wstring& configuredJar, const std::wstring& moduleDir) {
+    std::wstring path;
+    const DWORD n = GetEnvironmentVariableW(L"PATH", nullptr, 0);
+    if (n > 0) {
+        path.resize(n);
+        path.resize(GetEnvironmentVariableW(L"PATH", &path[0], n));
+    }
+    puml::Hasher64 hasher;
+    hasher.Update("java=" + ToUtf8(g_javaPath) + "\njar=" + ToUtf8(configuredJar) + "\npath=" + ToUtf8(path) + "\n");
+    // A plantuml*.jar added to or removed from the plugin directory changes
+    // what auto-detection finds.
+    hasher.Update("dir=" + puml::DescribeFileStamp(ToUtf8(moduleDir)));
+    return puml::HashToHex(hasher.Digest());
+}
+
+static bool SearchJavaExecutable(std::wstring& outPath) {
+    if (!g_javaPath.empty() && FileExistsW(g_javaPath)) { outPath = g_javaPath; return true; }
+    wchar_t found[MAX_PATH]{};
+    if (SearchPathW(nullptr, L"java.exe", nullptr, MAX_PATH, found, nullptr))  { outPath = found; return true; }
+    if (SearchPathW(nullptr, L"javaw.exe", nullptr, MAX_PATH, found, nullptr)) { outPath = found; return true; }
+    return false;
+}
+
+static std::wstring DescribeToolchain(const puml::Toolchain& toolchain) {
+    std::wstringstream os;
+    os << L"java=" << FromUtf8(toolchain.javaExecutable)
+       << L" (Java " << FromUtf8(toolchain.java.version)
+       << L", " << (toolchain.java.vendor.empty() ? L"unknown vendor" : FromUtf8(toolchain.java.vendor))
+       << L", default max heap " << (toolchain.java.defaultMaxHeapBytes / (1024 * 1024)) << L" MB"
+       << L", class data archives " << (toolchain.java.dynamicArchive ? L"supported" : L"unsupported")
+       << L"), plantuml=" << (toolchain.plantUmlVersion.empty() ? L"<unknown version>"
+                                                                : FromUtf8(toolchain.plantUmlVersion));
+    return os.str();
+}
+
+// Searches java, runs it once to probe it and reads the jar's manifest.
+// False if no usable java was found.
+static bool DiscoverToolchain(puml::Toolchain& toolchain) {
+    const auto started = std::chrono::steady_clock::now();
+    toolchain = puml::Toolchain();
+    toolchain.snapshot = g_toolchainSnapshot;
+    toolchain.jarPath = ToUtf8(g_jarPath);
+    toolchain.jarStamp = puml::DescribeFileStamp(toolchain.jarPath);
+
+    std::wstring javaExe;
+    if (!SearchJavaExecutable(javaExe)) {
+        AppendLog(L"Toolchain: Java executable not found (set [plantuml] java or add java.exe to PATH)");
+        return false;
+    }
+    toolchain.javaExecutable = ToUtf8(javaExe);
+    toolchain.javaStamp = puml::DescribeFileStamp(toolchain.javaExecutable);
+    std::string error;
+    if (!puml::ProbeJava(toolchain.javaExecutable, kJavaProbeTimeoutMs, toolchain.java, &error)) {
+        AppendLog(L"Toolchain: " + javaExe + L" is not usable: " + FromUtf8(error));
+        return false;
+    }
+    if (!toolchain.java.desktop) {
+        AppendLog(L"Toolchain: " + javaExe + L" (Java " + FromUtf8(toolchain.java.version) +
+                  L") lacks the java.desktop module PlantUML needs; set [plantuml] java to a full JRE or JDK");
+        return false;
+    }
+    std::string manifest;
+    if (!toolchain.jarStamp.empty()) {
+        if (puml::ReadJarManifest(toolchain.jarPath, manifest, &error)) {
+            toolchain.plantUmlVersion = puml::JarManifestAttribute(manifest, "Implementation-Version");
+        } else {
+            AppendLog(L"Toolchain: cannot read the manifest of " + g_jarPath + L": " + FromUtf8(error));
+        }
+    }
+
+    const auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - started).count();
+    AppendLog(L"Toolchain: discovered in " + std::to_wstring(elapsedMs) + L" ms: " + DescribeToolchain(toolchain));
+    const std::wstring record = ToolchainRecordPath();
+    if (!toolchain.jarStamp.empty() && !record.empty() && !puml::SaveToolchain(ToUtf8(record), toolchain)) {
+        AppendLog(L"Toolchain: cannot write " + record);
+    }
+    return true;
+}
+
+// Blocks while discovery runs. nullptr if no usable java was found, which is
+// not searched for again before the next session.
+static const puml::Toolchain* GetToolchain() {
+    static std::mutex mutex;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!g_toolchainReady.load(std::memory_order_acquire)) {
+        if (g_toolchainFromRecord) {
+            g_toolchainUsable = true;
+            AppendLog(L"Toolchain: reusing " + ToolchainRecordPath() + L": " + DescribeToolchain(g_toolchain));
+        } else {
+            g_toolchainUsable = DiscoverToolchain(g_toolchain);
+        }
+        g_toolchainReady.store(true, std::memory_order_release);
+    }
+    return g_toolchainUsable ? &g_toolchain : nullptr;
+}
+
+// Never waits: nullptr until GetToolchain has finished. For code that may
+// run with locks held, which only ever starts java after a render got the
+// toolchain.
+static const puml::Toolchain* KnownToolchain() {
+    return g_toolchainReady.load(std::memory_order_acquire) && g_toolchainUsable ? &g_toolchain : nullptr;
+}
+
 static void LoadConfigIfNeeded() {
     if (g_cfgLoaded) return;
     g_cfgLoaded = true;
@@ -407,11 +700,29 @@ static void LoadConfigIfNeeded() {
 
     RenderBackend rendererChoice = GetConfiguredRenderer();
     if (GetPrivateProfileStringW(L"render", L"renderer", L"", buf, 2048, ini.c_str()) > 0 && buf[0]) {
+        g_hedgeEnabled = IsAutoRendererSetting(buf);
         rendererChoice = ParseRendererSettingValue(buf, rendererChoice);
     } else if (GetPrivateProfileStringW(L"render", L"pipeline", L"", buf, 2048, ini.c_str()) > 0 && buf[0]) {
+        g_hedgeEnabled = IsAutoRendererSetting(buf);
         rendererChoice = ParseRendererSettingValue(buf, rendererChoice);
     }
+    if (g_hedgeEnabled) {
+        // The jar backend that renders first; the server is the other one.
+        GetPrivateProfileStringW(L"hedge", L"primary", L"java", buf, 2048, ini.c_str());
+        rendererChoice = ParseRendererSettingValue(buf, RenderBackend::Java);
+        if (!IsJarBackend(rendererChoice)) rendererChoice = RenderBackend::Java;
+    }
     g_rendererSetting = RenderBackendName(rendererChoice);
+    DWORD renderThreads = GetPrivateProfileIntW(L"render", L"threads", 0, ini.c_str());
+    if (renderThreads > 0) g_renderThreads = renderThreads > 16 ? 16 : renderThreads;
+    g_splitDiagrams = GetPrivateProfileIntW(L"render", L"split", 1, ini.c_str()) != 0;
+    g_diagramThreads = GetPrivateProfileIntW(L"render", L"diagram_threads", 0, ini.c_str());
+    if (g_diagramThreads == 0) g_diagramThreads = std::thread::hardware_concurrency();
+    if (g_diagramThreads == 0) g_diagramThreads = 2;
+    if (g_diagramThreads > 16) g_diagramThreads = 16;
+    g_autoRefresh = GetPrivateProfileIntW(L"render", L"auto_refresh", 1, ini.c_str()) != 0;
+    g_autoRefreshDelayMs = GetPrivateProfileIntW(L"render", L"auto_refresh_delay_ms", 300, ini.c_str());
+    g_otherFormat = GetPrivateProfileIntW(L"render", L"other_format", 1, ini.c_str()) != 0;
 
     if (GetPrivateProfileStringW(L"detect", L"string", L"", buf, 2048, ini.c_str()) > 0 && buf[0]) {
         int need = WideCharToMultiByte(CP_UTF8, 0, buf, -1, nullptr, 0, nullptr, nullptr);
@@ -432,8 +743,98 @@ static void LoadConfigIfNeeded() {
             g_javaPath = moduleDir + L"\\" + g_javaPath;
         }
     }
+    if (GetPrivateProfileStringW(L"plantuml", L"jvm", L"", buf, 2048, ini.c_str()) > 0 && buf[0]) {
+        g_jvmPath = buf;
+        if (PathIsRelativeW(g_jvmPath.c_str())) {
+            g_jvmPath = moduleDir + L"\\" + g_jvmPath;
+        }
+    }
     DWORD tmo = GetPrivateProfileIntW(L"plantuml", L"timeout_ms", 0, ini.c_str());
     if (tmo > 0) g_jarTimeoutMs = tmo;
+    g_daemonEnabled = GetPrivateProfileIntW(L"plantuml", L"daemon", 1, ini.c_str()) != 0;
+    DWORD idleMs = GetPrivateProfileIntW(L"plantuml", L"daemon_idle_ms", 0, ini.c_str());
+    if (idleMs > 0) g_daemonIdleMs = idleMs;
+    DWORD daemonInstances = GetPrivateProfileIntW(L"plantuml", L"daemon_instances", 0, ini.c_str());
+    if (daemonInstances > 0) g_daemonInstances = daemonInstances > 8 ? 8 : daemonInstances;
+
+    g_cdsEnabled = GetPrivateProfileIntW(L"jvm", L"cds", 1, ini.c_str()) != 0;
+    if (GetPrivateProfileStringW(L"jvm", L"cds_dir", L"", buf, 2048, ini.c_str()) > 0 && buf[0]) {
+        g_cdsDir = buf;
+        if (PathIsRelativeW(g_cdsDir.c_str())) {
+            g_cdsDir = moduleDir + L"\\" + g_cdsDir;
+        }
+    }
+    if (g_cdsDir.empty()) {
+        DWORD n = GetEnvironmentVariableW(L"LOCALAPPDATA", buf, 2048);
+        g_cdsDir = (n > 0 && n < 2048) ? std::wstring(buf) + L"\\PlantUmlWebView\\cds"
+                                       : moduleDir + L"\\cds";
+    }
+    g_jvmTieredStopAtLevel = GetPrivateProfileIntW(L"jvm", L"tiered_stop_at_level", 1, ini.c_str());
+    if (g_jvmTieredStopAtLevel > 4) g_jvmTieredStopAtLevel = 0;
+    g_jvmInitialHeapMb = GetPrivateProfileIntW(L"jvm", L"initial_heap_mb", 0, ini.c_str());
+    g_jvmMaxHeapMb = GetPrivateProfileIntW(L"jvm", L"max_heap_mb", 0, ini.c_str());
+    GetPrivateProfileStringW(L"jvm", L"gc", L"serial", buf, 2048, ini.c_str());
+    g_jvmGc = buf;
+    std::transform(g_jvmGc.begin(), g_jvmGc.end(), g_jvmGc.begin(), [](wchar_t c){ return (wchar_t)towlower(c); });
+    if (!puml::IsKnownGcName(ToUtf8(g_jvmGc))) g_jvmGc.clear();   // logged as <default>
+    if (GetPrivateProfileStringW(L"jvm", L"options", L"", buf, 2048, ini.c_str()) > 0 && buf[0]) {
+        g_jvmOptions = buf;
+    }
+
+    g_serviceEnabled = GetPrivateProfileIntW(L"service", L"enabled", 0, ini.c_str()) != 0;
+    if (GetPrivateProfileStringW(L"service", L"executable", L"", buf, 2048, ini.c_str()) > 0 && buf[0]) {
+        g_serviceExe = buf;
+        if (PathIsRelativeW(g_serviceExe.c_str())) {
+            g_serviceExe = moduleDir + L"\\" + g_serviceExe;
+        }
+    }
+    if (g_serviceExe.empty()) {
+        g_serviceExe = moduleDir + L"\\plantuml_render_service.exe";
+    }
+    DWORD connectMs = GetPrivateProfileIntW(L"service", L"connect_timeout_ms", 0, ini.c_str());
+    if (connectMs > 0) g_serviceConnectTimeoutMs = connectMs;
+    DWORD serviceIdleMs = GetPrivateProfileIntW(L"service", L"idle_exit_ms", 0, ini.c_str());
+    if (serviceIdleMs > 0) g_serviceIdleExitMs = serviceIdleMs;
+
+    g_renderMemoryMb = GetPrivateProfileIntW(L"limits", L"memory_mb", 2048, ini.c_str());
+    g_maxRenders = GetPrivateProfileIntW(L"limits", L"max_renders", 0, ini.c_str());
+    if (g_maxRenders == 0) g_maxRenders = std::thread::hardware_concurrency();
+    if (g_maxRenders == 0) g_maxRenders = 2;
+    if (g_maxRenders > 64) g_maxRenders = 64;
+
+    g_cacheEnabled = GetPrivateProfileIntW(L"cache", L"enabled", 1, ini.c_str()) != 0;
+    if (GetPrivateProfileStringW(L"cache", L"dir", L"", buf, 2048, ini.c_str()) > 0 && buf[0]) {
+        g_cacheDir = buf;
+        if (PathIsRelativeW(g_cacheDir.c_str())) {
+            g_cacheDir = moduleDir + L"\\" + g_cacheDir;
+        }
+    }
+    if (g_cacheDir.empty()) {
+        DWORD n = GetEnvironmentVariableW(L"LOCALAPPDATA", buf, 2048);
+        g_cacheDir = (n > 0 && n < 2048) ? std::wstring(buf) + L"\\PlantUmlWebView\\cache"
+                                         : moduleDir + L"\\cache";
+    }
+    DWORD cacheMb = GetPrivateProfileIntW(L"cache", L"max_mb", 0, ini.c_str());
+    if (cacheMb > 0) g_cacheMaxMb = cacheMb;
+    g_memoryCacheMb = GetPrivateProfileIntW(L"cache", L"memory_mb", 64, ini.c_str());
+
+    g_prefetchDepth = GetPrivateProfileIntW(L"prefetch", L"depth", 0, ini.c_str());
+    if (g_prefetchDepth > 16) g_prefetchDepth = 16;
+    DWORD prefetchRunning = GetPrivateProfileIntW(L"prefetch", L"max_running", 0, ini.c_str());
+    if (prefetchRunning > 0) g_prefetchMaxRunning = prefetchRunning;
+
+    if (GetPrivateProfileStringW(L"web", L"server", L"", buf, 2048, ini.c_str()) > 0 && buf[0]) {
+        g_webServerUrl = buf;
+        while (!g_webServerUrl.empty() && g_webServerUrl.back() == L'/') g_webServerUrl.pop_back();
+    }
+    DWORD webTimeoutMs = GetPrivateProfileIntW(L"web", L"timeout_ms", 0, ini.c_str());
+    if (webTimeoutMs > 0) g_webTimeoutMs = webTimeoutMs;
+    g_hedgeDelayMs = GetPrivateProfileIntW(L"hedge", L"delay_ms", 1500, ini.c_str());
+    g_hedgeMaxDelayMs = GetPrivateProfileIntW(L"hedge", L"max_delay_ms", 10000, ini.c_str());
+    if (g_hedgeMaxDelayMs < g_hedgeDelayMs) g_hedgeMaxDelayMs = g_hedgeDelayMs;
+    g_breakerFailures = GetPrivateProfileIntW(L"hedge", L"breaker_failures", 3, ini.c_str());
+    if (g_breakerFailures == 0) g_breakerFailures = 1;
+    g_breakerCooldownMs = GetPrivateProfileIntW(L"hedge", L"breaker_cooldown_ms", 30000, ini.c_str());
 
     int logEnabled = GetPrivateProfileIntW(L"debug", L"log_enabled", 1, ini.c_str());
     g_logEnabled = (logEnabled != 0);
@@ -452,25 +853,69 @@ static void LoadConfigIfNeeded() {
     } else {
         g_logPath.clear();
     }
-
-    bool needDetectJar = g_jarPath.empty();
-    if (!g_jarPath.empty() && !FileExistsW(g_jarPath)) {
-        AppendLog(L"LoadConfig: configured jar not found at " + g_jarPath + L". Attempting auto-detect.");
-        needDetectJar = true;
-    }
-    if (needDetectJar) {
-        std::wstring detected;
-        if (TryAutoDetectPlantUmlJar(detected)) {
-            g_jarPath.swap(detected);
+    puml::SetLogSink([](const std::string& message) { AppendLog(FromUtf8(message)); });
+
+    g_toolchainSnapshot = ToolchainSnapshot(g_jarPath, moduleDir);
+    InvalidateJarIdentity();   // built from the toolchain and the jar loaded here
+    const std::wstring toolchainRecord = ToolchainRecordPath();
+    g_toolchainFromRecord = !toolchainRecord.empty() &&
+                            puml::LoadToolchain(ToUtf8(toolchainRecord), g_toolchainSnapshot, g_toolchain);
+    if (g_toolchainFromRecord) {
+        // The jar the same configuration found last time, unchanged since.
+        g_jarPath = FromUtf8(g_toolchain.jarPath);
+    } else {
+        bool needDetectJar = g_jarPath.empty();
+        if (!g_jarPath.empty() && !FileExistsW(g_jarPath)) {
+            AppendLog(L"LoadConfig: configured jar not found at " + g_jarPath + L". Attempting auto-detect.");
+            needDetectJar = true;
+        }
+        if (needDetectJar) {
+            std::wstring detected;
+            if (TryAutoDetectPlantUmlJar(detected)) {
+                g_jarPath.swap(detected);
+            }
         }
     }
 
     std::wstringstream cfg;
     cfg << L"Config loaded. prefer=" << g_prefer
         << L", renderer=" << GetConfiguredRendererName()
+        << L", renderThreads=" << g_renderThreads
+        << L", split=" << (g_splitDiagrams ? L"1" : L"0")
+        << L", diagramThreads=" << g_diagramThreads
+        << L", autoRefresh=" << (g_autoRefresh ? L"1" : L"0")
+        << L", autoRefreshDelayMs=" << g_autoRefreshDelayMs
+        << L", otherFormat=" << (g_otherFormat ? L"1" : L"0")
         << L", jar=" << (g_jarPath.empty() ? L"<auto>" : g_jarPath)
         << L", java=" << (g_javaPath.empty() ? L"<auto>" : g_javaPath)
+        << L", jvm=" << (g_jvmPath.empty() ? L"<auto>" : g_jvmPath)
+        << L", toolchain=" << (g_toolchainFromRecord ? L"<record>" : L"<discover>")
         << L", timeoutMs=" << g_jarTimeoutMs
+        << L", daemon=" << (g_daemonEnabled ? L"1" : L"0")
+        << L", daemonIdleMs=" << g_daemonIdleMs
+        << L", daemonInstances=" << g_daemonInstances
+        << L", cds=" << (g_cdsEnabled ? g_cdsDir : L"<disabled>")
+        << L", jvmTieredStopAtLevel=" << g_jvmTieredStopAtLevel
+        << L", jvmInitialHeapMb=" << g_jvmInitialHeapMb
+        << L", jvmMaxHeapMb=" << g_jvmMaxHeapMb
+        << L", jvmGc=" << (g_jvmGc.empty() ? L"<default>" : g_jvmGc)
+        << L", jvmOptions=" << g_jvmOptions
+        << L", service=" << (g_serviceEnabled ? g_serviceExe : L"<disabled>")
+        << L", serviceConnectTimeoutMs=" << g_serviceConnectTimeoutMs
+        << L", serviceIdleExitMs=" << g_serviceIdleExitMs
+        << L", renderMemoryMb=" << (g_renderMemoryMb ? std::to_wstring(g_renderMemoryMb) : L"<unlimited>")
+        << L", maxRenders=" << g_maxRenders
+        << L", cache=" << (g_cacheEnabled ? g_cacheDir : L"<disabled>")
+        << L", cacheMaxMb=" << g_cacheMaxMb
+        << L", memoryCacheMb=" << g_memoryCacheMb
+        << L", prefetchDepth=" << g_prefetchDepth
+        << L", prefetchMaxRunning=" << g_prefetchMaxRunning
+        << L", webServer=" << g_webServerUrl
+        << L", webTimeoutMs=" << g_webTimeoutMs
+        << L", hedgeDelayMs=" << g_hedgeDelayMs
+        << L", hedgeMaxDelayMs=" << g_hedgeMaxDelayMs
+        << L", breakerFailures=" << g_breakerFailures
+        << L", breakerCooldownMs=" << g_breakerCooldownMs
         << L", logEnabled=" << (g_logEnabled ? L"1" : L"0")
         << L", log=" << (g_logPath.empty() ? L"<disabled>" : g_logPath);
     AppendLog(cfg.str());
@@ -502,31 +947,38 @@ static RenderBackend ParseRendererSettingValue(const std::wstring& rendererText,
     if (token == L"java") {
         return RenderBackend::Java;
     }
+    if (token == L"jni") {
+        return RenderBackend::Jni;
+    }
     return fallback;
 }
 
+// renderer=auto: hedged between the jar backend and the server.
+static bool IsAutoRendererSetting(const std::wstring& rendererText) {
+    std::wstring token = ToLowerTrim(rendererText);
+    const size_t comma = token.find(L',');
+    if (comma != std::wstring::npos) {
+        token = ToLowerTrim(token.substr(0, comma));
+    }
+    return token == L"auto";
+}
+
 static RenderBackend GetConfiguredRenderer() {
     return ParseRendererSettingValue(g_rendererSetting, RenderBackend::Java);
 }
 
 static std::wstring GetConfiguredRendererName() {
-    return std::wstring(RenderBackendName(GetConfiguredRenderer()));
+    const std::wstring name = RenderBackendName(GetConfiguredRenderer());
+    return g_hedgeEnabled ? L"auto(" + name + L"+web)" : name;
 }
 
-static std::wstring HtmlEscape(const std::wstring& text) {
-    std::wstring out = text;
-    ReplaceAll(out, L"&", L"&amp;");
-    ReplaceAll(out, L"<", L"&lt;");
-    ReplaceAll(out, L">", L"&gt;");
-    ReplaceAll(out, L"\"", L"&quot;");
-    ReplaceAll(out, L"'", L"&#39;");
+static std::string HtmlEscape(std::string_view text) {
+    std::string out;
+    out.reserve(text.size() + puml::HtmlEscapeGrowth(text));
+    puml::AppendHtmlEscaped(out, text);
     return out;
 }
 
-static std::wstring HtmlAttributeEscape(const std::wstring& text) {
-    return HtmlEscape(text);
-}
-
 static std::wstring ExtractFileStem(const std::wstring& path) {
     if (path.empty()) {
         return std::wstring();
@@ -542,43 +994,6 @@ static std::wstring ExtractFileStem(const std::wstring& path) {
     }
     return stem;
 }
-static bool FindJavaExecutable(std::wstring& outPath) {
-    if (!g_javaPath.empty() && FileExistsW(g_javaPath)) { outPath = g_javaPath; return true; }
-    wchar_t found[MAX_PATH]{};
-    if (SearchPathW(nullptr, L"java.exe", nullptr, MAX_PATH, found, nullptr))  { outPath = found; return true; }
-    if (SearchPathW(nullptr, L"javaw.exe", nullptr, MAX_PATH, found, nullptr)) { outPath = found; return true; }
-    return false;
-}
-
-// Simple base64 encoder (for PNG data URLs)
-static std::string Base64(const std::vector<unsigned char>& in) {
-    static const char* tbl = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-    std::string out;
-    size_t i = 0, n = in.size();
-    out.reserve(((n + 2) / 3) * 4);
-    while (i + 2 < n) {
-        unsigned v = (in[i] << 16) | (in[i+1] << 8) | in[i+2];
-        out.push_back(tbl[(v >> 18) & 63]);
-        out.push_back(tbl[(v >> 12) & 63]);
-        out.push_back(tbl[(v >> 6) & 63]);
-        out.push_back(tbl[v & 63]);
-        i += 3;
-    }
-    if (i + 1 == n) {
-        unsigned v = (in[i] << 16);
-        out.push_back(tbl[(v >> 18) & 63]);
-        out.push_back(tbl[(v >> 12) & 63]);
-        out.push_back('=');
-        out.push_back('=');
-    } else if (i + 2 == n) {
-        unsigned v = (in[i] << 16) | (in[i+1] << 8);
-        out.push_back(tbl[(v >> 18) & 63]);
-        out.push_back(tbl[(v >> 12) & 63]);
-        out.push_back(tbl[(v >> 6) & 63]);
-        out.push_back('=');
-    }
-    return out;
-}
 
 static int Base64DecodeChar(wchar_t c) {
     if (c >= L'A' && c <= L'Z') return int(c - L'A');
@@ -637,140 +1052,521 @@ static std::vector<unsigned char> Base64Decode(const std::wstring& in) {
     return out;
 }
 
-// Run "java -jar plantuml.jar -pipe -t(svg|png)" and capture stdout.
-static bool RunPlantUmlJar(const std::wstring& umlTextW, bool preferSvg,
-                           std::wstring& outSvg, std::vector<unsigned char>& outPng)
-{
-    AppendLog(L"RunPlantUmlJar: start");
+// ---------------------- Shared objects ----------------------
+// What every Lister window shares (the limiter, schedulers, worker pools,
+// daemons, the in-process JVM, caches and watchers) is created on first use
+// and never destroyed. A static destructor would run from DllMain when the
+// plugin unloads, under the loader lock, where joining their threads
+// deadlocks; and a JVM loaded into the process cannot be unloaded anyway.
+// The host process exiting reclaims them, and the -pipe JVMs end by
+// themselves once the plugin's end of their stdin pipe closes with it.
+
+// ---------------------- Resource limits ----------------------
+// Every render running PlantUML takes a slot of one shared limiter, and every
+// java process runs under [limits] memory_mb (a job object per process, so
+// closing it also ends whatever the JVM started). Speculative renders wait
+// behind the others and run at lowered CPU priority.
+
+static puml::ConcurrencyLimiter* GetRenderLimiter() {
+    static auto* limiter = new puml::ConcurrencyLimiter(g_maxRenders);
+    return limiter;
+}
 
-    if (g_jarPath.empty()) {
-        AppendLog(L"RunPlantUmlJar: jar path is empty");
+static bool IsBackgroundRender() {
+    return puml::CurrentRenderPriority() == puml::RenderPriority::Speculative;
+}
+
+static uint64_t RenderMemoryLimitBytes() {
+    return static_cast<uint64_t>(g_renderMemoryMb) * 1024 * 1024;
+}
+
+// ---------------------- JVM start-up ----------------------
+// Every java process running plantuml.jar starts with the [jvm] launch
+// profile and, once it exists, the jar's class data archive. The archive is
+// created by a training run in the background the first time a JVM is needed.
+
+static puml::JvmLaunchProfile GetJvmLaunchProfile() {
+    puml::JvmLaunchProfile profile;
+    profile.tieredStopAtLevel = static_cast<int>(g_jvmTieredStopAtLevel);
+    profile.initialHeapMb = g_jvmInitialHeapMb;
+    profile.maxHeapMb = g_jvmMaxHeapMb;
+    profile.gc = ToUtf8(g_jvmGc);
+    profile.extraOptions = puml::SplitJvmOptions(ToUtf8(g_jvmOptions));
+    // Left alone, -Xmx defaults to a quarter of the physical memory, which
+    // may exceed [limits] memory_mb: a large diagram would then get the JVM
+    // killed instead of failing with an OutOfMemoryError PlantUML reports.
+    const puml::Toolchain* toolchain = KnownToolchain();
+    const DWORD heapBudgetMb = g_renderMemoryMb / 4 * 3;
+    if (profile.maxHeapMb == 0 && heapBudgetMb > 0 && toolchain &&
+        toolchain->java.defaultMaxHeapBytes > static_cast<uint64_t>(heapBudgetMb) * 1024 * 1024) {
+        profile.maxHeapMb = heapBudgetMb;
+    }
+    return profile;
+}
+
+// One archive per java executable; nullptr with [jvm] cds=0 or a java older
+// than JDK 13.
+static puml::ClassDataArchive* GetClassDataArchive(const std::wstring& javaExe) {
+    const puml::Toolchain* toolchain = KnownToolchain();
+    if (!g_cdsEnabled || (toolchain && !toolchain->java.dynamicArchive)) {
+        return nullptr;
+    }
+    static std::mutex mutex;
+    static std::unordered_map<std::wstring, puml::ClassDataArchive*> archives;
+    std::lock_guard<std::mutex> lock(mutex);
+    puml::ClassDataArchive*& slot = archives[javaExe];
+    if (!slot) {
+        puml::ClassDataArchiveOptions options;
+        options.directory = ToUtf8(g_cdsDir);
+        options.javaExecutable = ToUtf8(javaExe);
+        options.jarPath = ToUtf8(g_jarPath);
+        options.jvmOptions = puml::JvmProfileArguments(GetJvmLaunchProfile());
+        options.trainingLimits.memoryBytes = RenderMemoryLimitBytes();
+        options.trainingLimits.lowPriority = true;
+        options.limiter = GetRenderLimiter();
+        options.name = "ClassDataArchive";
+        slot = new puml::ClassDataArchive(options);
+    }
+    return slot;
+}
+
+// JVM options for a java process about to start. Called for every start,
+// also by a daemon with its lock held: it checks the archive's files and
+// logs, no more than starting the process costs, but never waits for the
+// toolchain probe or the training run.
+static std::vector<std::string> JavaLaunchOptions(const std::wstring& javaExe, const char* logName) {
+    std::vector<std::string> options = puml::JvmProfileArguments(GetJvmLaunchProfile());
+    puml::ClassDataArchive* archive = GetClassDataArchive(javaExe);
+    const std::vector<std::string> archiveOptions =
+        archive ? archive->LaunchArguments() : std::vector<std::string>();
+    options.insert(options.end(), archiveOptions.begin(), archiveOptions.end());
+
+    std::string joined;
+    for (const std::string& option : options) {
+        joined += " " + option;
+    }
+    AppendLog(FromUtf8(logName) + L": starting java, class data archive " +
+              (!archive ? L"disabled" : archiveOptions.empty() ? L"not ready" : L"in use") +
+              L", options:" + FromUtf8(joined));
+    return options;
+}
+
+// The training run takes a minute or so, so it gets a thread of its own
+// rather than the scheduler's speculative slot, which would hold prefetch
+// and other-format renders back until it ended. Its java still waits for a
+// render slot and runs at low priority like any background render.
+static puml::WorkerPool* GetClassDataArchiveTrainer() {
+    static auto* pool = new puml::WorkerPool(1, "ClassDataArchive");
+    return pool;
+}
+
+// Starts the training run creating the class data archive, once per session.
+static void ScheduleClassDataArchive(const std::wstring& javaExe) {
+    static std::mutex mutex;
+    puml::ClassDataArchive* archive = GetClassDataArchive(javaExe);
+    if (!archive) {
+        const puml::Toolchain* toolchain = KnownToolchain();
+        static bool reported = false;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (g_cdsEnabled && toolchain && !reported) {
+            reported = true;
+            AppendLog(L"ClassDataArchive: not used: Java " + FromUtf8(toolchain->java.version) +
+                      L" cannot create one (JDK 13 or later is needed)");
+        }
+        return;
+    }
+    static std::unordered_set<puml::ClassDataArchive*> scheduled;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!scheduled.insert(archive).second) {
+            return;
+        }
+    }
+    if (archive->State() != puml::ClassDataArchiveState::Missing) {
+        AppendLog(L"ClassDataArchive: " + FromUtf8(archive->Path()) + L" is " +
+                  FromUtf8(puml::ClassDataArchiveStateName(archive->State())));
+        return;
+    }
+    AppendLog(L"ClassDataArchive: creating " + FromUtf8(archive->Path()) + L" in the background");
+    GetClassDataArchiveTrainer()->Submit([archive]() {
+        SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+        std::string error;
+        if (!archive->Generate(&error)) {
+            AppendLog(L"ClassDataArchive: not created: " + FromUtf8(error));
+        }
+    });
+}
+
+// Run "java -jar plantuml.jar -pipe -t(svg|png)" once and capture stdout.
+// stdin and stdout are pumped concurrently under g_jarTimeoutMs; output that
+// outgrows kOnceMemoryLimit is buffered in %TEMP% instead of in memory.
+// A non-zero imageIndex selects a later "newpage" page of the diagram. The
+// JVM runs in workingDirectory (the source's folder) so includes resolve.
+static bool RunPlantUmlJarOnce(const std::wstring& javaExe,
+                               std::string_view requestUtf8,
+                               const std::string& workingDirectory,
+                               bool preferSvg,
+                               size_t imageIndex,
+                               bool background,
+                               std::vector<unsigned char>& buffer,
+                               const puml::CancellationToken* cancel)
+{
+    static const uint64_t kOnceMemoryLimit = 16ull * 1024 * 1024;
+
+    puml::ProcessSpec spec;
+    spec.executable = ToUtf8(javaExe);
+    spec.arguments = JavaLaunchOptions(javaExe, "RunPlantUmlJar");
+    spec.arguments.insert(spec.arguments.end(), {
+        "-Djava.awt.headless=true", "-jar", ToUtf8(g_jarPath),
+        "-charset", "UTF-8", "-pipe", preferSvg ? "-tsvg" : "-tpng",
+    });
+    if (imageIndex > 0) {
+        spec.arguments.push_back("-pipeimageindex");
+        spec.arguments.push_back(std::to_string(imageIndex));
+    }
+    spec.workingDirectory = workingDirectory;
+    spec.pipeBufferSize = 64 * 1024;
+    spec.limits.memoryBytes = RenderMemoryLimitBytes();
+    spec.limits.lowPriority = background;
+
+    wchar_t tempDir[MAX_PATH + 1]{};
+    const DWORD tempLen = GetTempPathW(MAX_PATH + 1, tempDir);
+    puml::SpillableBuffer output(kOnceMemoryLimit,
+                                 tempLen > 0 && tempLen <= MAX_PATH ? ToUtf8(tempDir) : std::string());
+
+    puml::PumpOptions options;
+    options.timeoutMs = g_jarTimeoutMs;
+    options.limiter = GetRenderLimiter();
+    options.background = background;
+    std::string error;
+    const puml::PumpResult result = puml::RunProcessPump(spec, requestUtf8, options, output, &error, cancel);
+
+    std::wstringstream os;
+    os << L"RunPlantUmlJar: process " << FromUtf8(puml::PumpStatusName(result.status))
+       << L". exitCode=" << result.exitCode
+       << L", outputBytes=" << result.outputBytes
+       << L", elapsedMs=" << result.elapsedMs
+       << L", slotWaitMs=" << result.waitMs
+       << (result.stdinComplete ? L"" : L", stdin not fully consumed");
+    AppendLog(os.str());
+
+    if (result.status == puml::PumpStatus::StartFailed) {
+        AppendLog(L"RunPlantUmlJar: failed to start java: " + FromUtf8(error));
         return false;
     }
-    if (!FileExistsW(g_jarPath)) {
-        AppendLog(L"RunPlantUmlJar: jar not found at " + g_jarPath);
+    if (result.status == puml::PumpStatus::MemoryLimit) {
+        AppendLog(L"RunPlantUmlJar: java killed: memory limit of " + std::to_wstring(g_renderMemoryMb) +
+                  L" MB exceeded ([limits] memory_mb)");
+        return false;
+    }
+    if (result.status != puml::PumpStatus::Completed) {
+        return false;
+    }
+    if (result.outputBytes == 0) {
+        AppendLog(L"RunPlantUmlJar: process produced no output");
+        return false;
+    }
+    if (!output.ReadAll(buffer)) {
+        AppendLog(L"RunPlantUmlJar: failed to collect process output");
         return false;
     }
+    return true;
+}
 
-    std::wstring javaExe;
-    if (!FindJavaExecutable(javaExe)) {
-        AppendLog(L"RunPlantUmlJar: Java executable not found");
+// Resident renderers per output format, shared by every Lister window.
+static puml::PlantUmlDaemonPool* GetPlantUmlDaemons(const std::wstring& javaExe, bool preferSvg) {
+    static std::mutex mutex;
+    static puml::PlantUmlDaemonPool* pools[2] = {};
+    std::lock_guard<std::mutex> lock(mutex);
+    puml::PlantUmlDaemonPool*& slot = pools[preferSvg ? 0 : 1];
+    if (!slot) {
+        puml::DaemonOptions options;
+        options.process.executable = ToUtf8(javaExe);
+        options.process.arguments = {
+            "-Djava.awt.headless=true", "-jar", ToUtf8(g_jarPath),
+            "-charset", "UTF-8", "-pipe", preferSvg ? "-tsvg" : "-tpng",
+        };
+        options.launchOptions = [javaExe, preferSvg]() {
+            return JavaLaunchOptions(javaExe, preferSvg ? "RunPlantUmlJar[svg]" : "RunPlantUmlJar[png]");
+        };
+        options.process.limits.memoryBytes = RenderMemoryLimitBytes();
+        options.idleShutdownMs = g_daemonIdleMs;
+        options.name = preferSvg ? "RunPlantUmlJar[svg]" : "RunPlantUmlJar[png]";
+        options.limiter = GetRenderLimiter();
+        slot = new puml::PlantUmlDaemonPool(options, g_daemonInstances);
+    }
+    return slot;
+}
+
+// ---------------------- Render service ----------------------
+// With [service] enabled=1 the JVMs live in one plantuml_render_service
+// process per user session, shared by every Total Commander running the
+// plugin. The first plugin that finds no service starts it; the service
+// exits by itself once no plugin has connected for a while.
+
+// Plugins configured with another java, jar, launch profile or memory limit
+// get their own service.
+static std::string RenderServiceEndpoint(const std::wstring& javaExe) {
+    puml::Hasher64 hasher;
+    hasher.Update(ToUtf8(javaExe) + '\n' + ToUtf8(g_jarPath) + '\n');
+    for (const std::string& option : puml::JvmProfileArguments(GetJvmLaunchProfile())) {
+        hasher.Update(option + '\n');
+    }
+    hasher.Update("memory_mb=" + std::to_string(g_renderMemoryMb));
+    return "PlantUmlWebView-" + puml::HashToHex(hasher.Digest());
+}
+
+// Starts the service detached from this process. Attempts are spaced out so
+// a service that cannot start does not cost every render a process launch.
+static bool StartRenderService(const std::wstring& javaExe, const std::string& endpoint) {
+    static const auto kRetryAfter = std::chrono::seconds(30);
+    static std::mutex mutex;
+    static std::chrono::steady_clock::time_point lastAttempt;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto now = std::chrono::steady_clock::now();
+        if (lastAttempt != std::chrono::steady_clock::time_point() && now - lastAttempt < kRetryAfter) {
+            return false;
+        }
+        lastAttempt = now;
+    }
+    if (!FileExistsW(g_serviceExe)) {
+        AppendLog(L"RenderService: executable not found at " + g_serviceExe);
         return false;
     }
 
-    AppendLog(L"RunPlantUmlJar: using java executable " + javaExe);
+    puml::ProcessSpec spec;
+    spec.executable = ToUtf8(g_serviceExe);
+    spec.arguments = {
+        "--endpoint", endpoint, "--java", ToUtf8(javaExe), "--jar", ToUtf8(g_jarPath),
+        "--instances", std::to_string(g_daemonInstances),
+        "--daemon-idle-ms", std::to_string(g_daemonIdleMs),
+        "--idle-exit-ms", std::to_string(g_serviceIdleExitMs),
+        "--memory-mb", std::to_string(g_renderMemoryMb),
+        "--max-renders", std::to_string(g_maxRenders),
+    };
+    for (const std::string& option : JavaLaunchOptions(javaExe, "RenderService")) {
+        spec.arguments.push_back("--jvm-option");
+        spec.arguments.push_back(option);
+    }
+    if (!g_logPath.empty()) {
+        spec.arguments.push_back("--log");
+        spec.arguments.push_back(ToUtf8(g_logPath));
+    }
+    std::string error;
+    if (!puml::StartDetachedProcess(spec, &error)) {
+        AppendLog(L"RenderService: failed to start " + g_serviceExe + L": " + FromUtf8(error));
+        return false;
+    }
+    AppendLog(L"RenderService: started " + g_serviceExe + L" for endpoint " + FromUtf8(endpoint));
+    return true;
+}
+
+// Unavailable means the caller renders locally.
+static puml::RenderServiceOutcome RenderThroughService(const std::wstring& javaExe,
+                                                       std::string_view requestUtf8,
+                                                       const std::string& workingDirectory,
+                                                       bool preferSvg,
+                                                       size_t imageIndex,
+                                                       bool background,
+                                                       std::vector<unsigned char>& buffer,
+                                                       const puml::CancellationToken* cancel)
+{
+    static const auto kStartWait = std::chrono::milliseconds(5000);
+
+    puml::RenderServiceRequest request;
+    request.source.assign(requestUtf8.data(), requestUtf8.size());
+    request.workingDirectory = workingDirectory;
+    request.svg = preferSvg;
+    request.imageIndex = static_cast<uint32_t>(imageIndex);
+    request.timeoutMs = g_jarTimeoutMs;
+    request.background = background;
+
+    const std::string endpoint = RenderServiceEndpoint(javaExe);
+    std::string error;
+    puml::RenderServiceOutcome outcome =
+        puml::RequestRender(endpoint, request, g_serviceConnectTimeoutMs, buffer, &error, cancel);
+    if (outcome == puml::RenderServiceOutcome::Unavailable && StartRenderService(javaExe, endpoint)) {
+        // The new service listens once it has parsed its arguments.
+        const auto deadline = std::chrono::steady_clock::now() + kStartWait;
+        while (outcome == puml::RenderServiceOutcome::Unavailable && std::chrono::steady_clock::now() < deadline &&
+               !puml::IsCancelled(cancel)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            outcome = puml::RequestRender(endpoint, request, g_serviceConnectTimeoutMs, buffer, &error, cancel);
+        }
+    }
+    if (outcome != puml::RenderServiceOutcome::Rendered) {
+        AppendLog(L"RunPlantUmlJar: render service " + FromUtf8(puml::RenderServiceOutcomeName(outcome)) +
+                  (error.empty() ? L"" : L": " + FromUtf8(error)));
+    }
+    return outcome;
+}
 
+// The JVM loaded into this process for renderer=jni, created on first use.
+// Returns nullptr when no jvm.dll is found; the -pipe renderers are used then.
+static puml::JvmRenderer* GetInProcessJvm(const std::wstring& javaExe) {
+    static std::mutex mutex;
+    static puml::JvmRenderer* jvm = nullptr;
+    static bool searched = false;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (searched) {
+        return jvm;
+    }
+    searched = true;
+
+    std::string library = ToUtf8(g_jvmPath);
+    if (library.empty()) {
+        library = puml::FindJvmLibrary(ToUtf8(javaExe));
+    }
+    if (library.empty()) {
+        // java.exe on PATH is often a launcher stub outside the JDK; the
+        // probe saw which runtime it actually starts.
+        const puml::Toolchain* toolchain = KnownToolchain();
+        if (toolchain && !toolchain->java.home.empty()) library = puml::FindJvmLibrary(toolchain->java.home);
+    }
+    if (library.empty()) {
+        wchar_t javaHome[MAX_PATH]{};
+        const DWORD n = GetEnvironmentVariableW(L"JAVA_HOME", javaHome, MAX_PATH);
+        if (n > 0 && n < MAX_PATH) library = puml::FindJvmLibrary(ToUtf8(javaHome));
+    }
+    if (library.empty()) {
+        AppendLog(L"RunPlantUmlJar: no jvm.dll found for renderer=jni (set [plantuml] jvm); using java -pipe");
+        return nullptr;
+    }
 
-    std::wstring fmt = preferSvg ? L"-tsvg" : L"-tpng";
+    // JVM options are not UTF-8 on Windows; the 8.3 name keeps the path ASCII.
+    std::wstring jarPath = g_jarPath;
+    wchar_t shortPath[MAX_PATH]{};
+    const DWORD shortLength = GetShortPathNameW(g_jarPath.c_str(), shortPath, MAX_PATH);
+    if (shortLength > 0 && shortLength < MAX_PATH) jarPath = shortPath;
+
+    puml::JvmRendererOptions options;
+    options.jvmLibrary = library;
+    options.jarPath = ToUtf8(jarPath);
+    options.name = "RunPlantUmlJar[jni]";
+    jvm = new puml::JvmRenderer(options);
+    AppendLog(L"RunPlantUmlJar: in-process JVM will load " + FromUtf8(library));
+    return jvm;
+}
 
-    SECURITY_ATTRIBUTES sa{ sizeof(SECURITY_ATTRIBUTES), nullptr, TRUE };
-    HANDLE hInR=nullptr,  hInW=nullptr;
-    HANDLE hOutR=nullptr, hOutW=nullptr;
+// Render via the resident daemon (default) or a one-shot JVM and decode stdout.
+// Later pages of a diagram (imageIndex > 0) always take a one-shot JVM: the
+// daemon's pipe only ever returns the first page. The shared daemons run in
+// no particular directory, so relative includes are sent as absolute paths.
+// RenderBackend::Jni renders in the in-process JVM instead, every page
+// included, and falls back to the pipe when that JVM cannot be started.
+// Otherwise [service] enabled=1 hands the render to the shared render
+// service first and only renders here when no service can be reached.
+static bool RunPlantUmlJar(RenderBackend backend,
+                           std::string_view umlUtf8, const std::wstring& sourcePath, bool preferSvg,
+                           std::string& outSvg, std::vector<unsigned char>& outPng,
+                           size_t imageIndex,
+                           const puml::CancellationToken* cancel)
+{
+    AppendLog(L"RunPlantUmlJar: start");
 
-    if (!CreatePipe(&hInR, &hInW, &sa, 0)) {
-        AppendLog(L"RunPlantUmlJar: failed to create stdin pipe");
+    if (g_jarPath.empty()) {
+        AppendLog(L"RunPlantUmlJar: jar path is empty");
         return false;
     }
-    if (!CreatePipe(&hOutR, &hOutW, &sa, 0)) {
-        AppendLog(L"RunPlantUmlJar: failed to create stdout pipe");
-        CloseHandle(hInR); CloseHandle(hInW);
+    const puml::Toolchain* toolchain = GetToolchain();
+    if (!toolchain) {
+        AppendLog(L"RunPlantUmlJar: no usable Java executable");
         return false;
     }
-
-    // Make only the child side inheritable
-    SetHandleInformation(hInR,  HANDLE_FLAG_INHERIT, HANDLE_FLAG_INHERIT);
-    SetHandleInformation(hOutW, HANDLE_FLAG_INHERIT, HANDLE_FLAG_INHERIT);
-    SetHandleInformation(hInW,  HANDLE_FLAG_INHERIT, 0);
-    SetHandleInformation(hOutR, HANDLE_FLAG_INHERIT, 0);
-
-    std::wstringstream cmd;
-    cmd << L"\"" << javaExe << L"\" -Djava.awt.headless=true -jar \"" << g_jarPath
-        << L"\" -pipe " << fmt;
-
-    STARTUPINFOW si{}; si.cb = sizeof(si);
-    si.dwFlags |= STARTF_USESTDHANDLES | STARTF_USESHOWWINDOW;
-    si.wShowWindow = SW_HIDE;
-    si.hStdInput  = hInR;
-    si.hStdOutput = hOutW;
-    si.hStdError  = hOutW;
-
-    PROCESS_INFORMATION pi{};
-    std::wstring cmdline = cmd.str();
-    BOOL ok = CreateProcessW(nullptr, cmdline.data(), nullptr, nullptr, TRUE,
-                             CREATE_NO_WINDOW, nullptr, nullptr, &si, &pi);
-    CloseHandle(hOutW);
-    CloseHandle(hInR);
-
-    if (!ok) {
-        AppendLog(L"RunPlantUmlJar: CreateProcessW failed with error " + std::to_wstring(GetLastError()));
-        CloseHandle(hInW); CloseHandle(hOutR);
+    if (toolchain->jarStamp.empty()) {
+        AppendLog(L"RunPlantUmlJar: jar not found at " + g_jarPath);
         return false;
     }
 
-    // Write UML as UTF-8 to child stdin
-    std::string umlUtf8 = ToUtf8(umlTextW);
-    DWORD written = 0;
-    if (!umlUtf8.empty()) {
-        if (!WriteFile(hInW, umlUtf8.data(), (DWORD)umlUtf8.size(), &written, nullptr)) {
-            AppendLog(L"RunPlantUmlJar: failed to write UML to stdin (error=" + std::to_wstring(GetLastError()) + L")");
-        }
-    }
-    CloseHandle(hInW); // signal EOF
+    const std::wstring javaExe = FromUtf8(toolchain->javaExecutable);
+    AppendLog(L"RunPlantUmlJar: using java executable " + javaExe);
 
-    // Read child's stdout (up to 50MB)
+    const std::string sourceDirectory = puml::ParentDirectory(ToUtf8(sourcePath));
+    // Copied only when a relative include has to be rewritten.
+    std::string absolutized;
+    const std::string_view request =
+        puml::AbsolutizeReferences(umlUtf8, sourceDirectory, absolutized) ? std::string_view(absolutized) : umlUtf8;
     std::vector<unsigned char> buffer;
-    buffer.reserve(64 * 1024);
-    unsigned char tmp[16 * 1024];
-    DWORD got = 0;
-    for (;;) {
-        if (!ReadFile(hOutR, tmp, sizeof(tmp), &got, nullptr) || got == 0) break;
-        buffer.insert(buffer.end(), tmp, tmp + got);
-        if (buffer.size() > (50 * 1024 * 1024)) break;
-        DWORD wr = WaitForSingleObject(pi.hProcess, 0);
-        if (wr == WAIT_OBJECT_0) {
-            while (ReadFile(hOutR, tmp, sizeof(tmp), &got, nullptr) && got) {
-                buffer.insert(buffer.end(), tmp, tmp + got);
+    const auto started = std::chrono::steady_clock::now();
+    const wchar_t* via = g_daemonEnabled && imageIndex == 0 ? L"java -pipe" : L"one-shot java";
+    const bool background = IsBackgroundRender();
+    bool renderedInProcess = false;
+    puml::JvmRenderer* jvm = backend == RenderBackend::Jni ? GetInProcessJvm(javaExe) : nullptr;
+    if (jvm && jvm->Usable()) {
+        // Shares the render slots; the JVM's memory is Total Commander's and
+        // only bounded by [jvm] max_heap_mb.
+        puml::ConcurrencySlot slot(GetRenderLimiter(), background, cancel);
+        if (!slot.Acquired()) {
+            return false;
+        }
+        std::string error;
+        renderedInProcess = jvm->Render(request, preferSvg, imageIndex, g_jarTimeoutMs, buffer, &error, cancel);
+        if (renderedInProcess) {
+            via = L"in-process JVM";
+        } else {
+            AppendLog(L"RunPlantUmlJar: in-process render failed: " + FromUtf8(error));
+            if (jvm->Usable() || puml::IsCancelled(cancel)) {
+                return false;
             }
-            break;
+            AppendLog(L"RunPlantUmlJar: falling back to java -pipe");
         }
     }
-    CloseHandle(hOutR);
-
-    DWORD wr = WaitForSingleObject(pi.hProcess, g_jarTimeoutMs);
-    if (wr == WAIT_FAILED) {
-        AppendLog(L"RunPlantUmlJar: WaitForSingleObject failed with error " + std::to_wstring(GetLastError()));
-    } else if (wr == WAIT_TIMEOUT) {
-        AppendLog(L"RunPlantUmlJar: timeout after " + std::to_wstring(g_jarTimeoutMs) + L" ms");
-        TerminateProcess(pi.hProcess, 1);
+    if (!renderedInProcess) {
+        ScheduleClassDataArchive(javaExe);
     }
-    CloseHandle(pi.hThread);
-    DWORD exitCode = 1;
-    GetExitCodeProcess(pi.hProcess, &exitCode);
-    CloseHandle(pi.hProcess);
-
-    if (buffer.empty()) {
-        AppendLog(L"RunPlantUmlJar: process produced no output. exitCode=" + std::to_wstring(exitCode));
+    bool renderedByService = false;
+    if (!renderedInProcess && g_serviceEnabled) {
+        switch (RenderThroughService(javaExe, request, sourceDirectory, preferSvg, imageIndex, background, buffer,
+                                     cancel)) {
+        case puml::RenderServiceOutcome::Rendered:
+            renderedByService = true;
+            via = L"render service";
+            break;
+        case puml::RenderServiceOutcome::Unavailable:
+            buffer.clear();
+            AppendLog(L"RunPlantUmlJar: rendering locally");
+            break;
+        default:
+            return false;
+        }
+    }
+    if (renderedInProcess || renderedByService) {
+        if (buffer.empty()) {
+            AppendLog(L"RunPlantUmlJar: " + std::wstring(via) + L" produced no output");
+            return false;
+        }
+    } else if (g_daemonEnabled && imageIndex == 0) {
+        std::string error;
+        if (!GetPlantUmlDaemons(javaExe, preferSvg)->Render(request, g_jarTimeoutMs, buffer, &error, cancel,
+                                                            background)) {
+            AppendLog(L"RunPlantUmlJar: daemon render failed: " + FromUtf8(error));
+            return false;
+        }
+        if (buffer.empty()) {
+            AppendLog(L"RunPlantUmlJar: daemon produced no output");
+            return false;
+        }
+    } else if (!RunPlantUmlJarOnce(javaExe, request, sourceDirectory, preferSvg, imageIndex, background, buffer,
+                                   cancel)) {
         return false;
     }
 
     if (preferSvg) {
-        // interpret bytes as UTF-8 SVG
-        int wlen = MultiByteToWideChar(CP_UTF8, 0,
-                                       (const char*)buffer.data(), (int)buffer.size(),
-                                       nullptr, 0);
-        if (wlen <= 0) {
-            AppendLog(L"RunPlantUmlJar: failed to decode SVG output");
+        // The jar writes UTF-8, which is what the pipeline carries.
+        if (buffer.empty()) {
+            AppendLog(L"RunPlantUmlJar: empty SVG output");
             return false;
         }
-        std::wstring svg(wlen, L'\0');
-        MultiByteToWideChar(CP_UTF8, 0, (const char*)buffer.data(), (int)buffer.size(),
-                            svg.data(), wlen);
-        outSvg.swap(svg);
+        outSvg.assign(reinterpret_cast<const char*>(buffer.data()), buffer.size());
     } else {
         outPng.swap(buffer);
     }
-    AppendLog(L"RunPlantUmlJar: success. exitCode=" + std::to_wstring(exitCode) +
-              L", outputLength=" + std::to_wstring((unsigned long long)(preferSvg ? outSvg.size() : outPng.size())));
+    const auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - started).count();
+    AppendLog(L"RunPlantUmlJar: success. outputLength=" +
+              std::to_wstring((unsigned long long)(preferSvg ? outSvg.size() : outPng.size())) +
+              L" via " + via + L" in " + std::to_wstring(elapsedMs) + L" ms");
     return true;
 }
 
@@ -792,8 +1588,8 @@ static const char kPlantumlEncoderScriptPart13[] = R"ENC13(2?++l:0)]=1,t.depth[r
 static const char kPlantumlEncoderScriptPart14[] = R"ENC14(r(n=a=0;n<s-1;n++)for(E[n]=a,t=0;t<1<<y[n];t++)S[a++]=n;for(S[a-1]=n,n=r=0;n<16;n++)for(I[n]=r,t=0;t<1<<k[n];t++)C[r++]=n;for(r>>=7;n<d;n++)for(I[n]=r<<7,t=0;t<1<<k[n]-7;t++)C[256+r++]=n;for(e=0;e<=m;e++)i[e]=0;for(t=0;t<=143;)A[2*t+1]=8,t++,i[8]++;for(;t<=255;)A[2*t+1]=9,t++,i[9]++;for(;t<=279;)A[2*t+1]=7,t++,i[7]++;for(;t<=287;)A[2*t+1]=8,t++,i[8]++;for(F(A,_+1,i),t=0;t<d;t++)B[2*t+1]=5,B[2*t]=H(t,5);j=new O(A,y,l+1,_,m),U=new O(B,k,0,d,m),D=new O(new Array(0),z,0,u,c)}(),X=!0),t.l_desc=new q(t.dyn_ltree,j),t.d_desc=new q(t.dyn_dtree,U),t.bl_desc=new q(t.bl_tree,D),t.bi_buf=0,t.bi_valid=0,K(t)},a._tr_stored_block=Y,a._tr_flush_block=function(t,e,a,n){var r,i,s=0;0<t.level?(2===t.strm.data_type&&(t.strm.data_type=function(t){var e,a=4093624447;for(e=0;e<=31;e++,a>>>=1)if(1&a&&0!==t.dyn_ltree[2*e])return h;if(0!==t.dyn_ltree[18]||0!==t.dyn_ltree[20]||0!==t.dyn_ltree[26])return o;for(e=32;e<l;e++)if(0!==t.dyn_ltree[2*e])return o;return h}(t)),Q(t,t.l_desc),Q(t,t.d_desc),s=function(t){var e;for(V(t,t.dyn_ltree,t.l_desc.max_code),V(t,t.dyn_dtree,t.d_desc.max_code),Q(t,t.bl_desc),e=u-1;3<=e&&0===t.bl_tree[2*x[e]+1];e--);return t.opt_len+=3*(e+1)+5+5+4,e}(t),r=t.opt_len+3+7>>>3,(i=t.static_len+3+7>>>3)<=r&&(r=i)):r=i=a+5,a+4<=r&&-1!==e?Y(t,e,a,n):4===t.strategy||i===r?(L(t,2+(n?1:0),3),J(t,A,B)):(L(t,4+(n?1:0),3),function(t,e,a,n){var r;for(L(t,e-257,5),L(t,a-1,5),L(t,n-4,4),r=0;r<n;r++)L(t,t.bl_tree[2*x[r]+1],3);W(t,t.dyn_ltree,e-1),W(t,t.dyn_dtree,a-1)}(t,t.l_desc.max_code+1,t.d_desc.max_code+1,s+1),J(t,t.dyn_ltree,t.dyn_dtree)),K(t),n&&M(t)},a._tr_tally=function(t,e,a){return t.pending_buf[t.d_buf+2*t.last_lit]=e>>>8&255,t.pending_buf[t.d_buf+2*t.last_lit+1]=255&e,t.pending_buf[t.l_buf+t.last_lit]=255&a,t.last_lit++,0===e?t.dyn_ltree[2*a]++:(t.matches++,e--,t.dyn_ltree[2*(S[a]+l+1)]++,t.dyn_dtree[2*R(e)]++),t.last_lit===t.lit_bufsize-1},a._tr_align=function(t){L(t,2,3),N(t,p,A),function(t){16===t.bi_valid?(T(t,t.bi_buf),t.bi_buf=0,t.bi_valid=0):8<=t.bi_valid&&(t.pendi)ENC14";
 static const char kPlantumlEncoderScriptPart15[] = R"ENC15(ng_buf[t.pending++]=255&t.bi_buf,t.bi_buf>>=8,t.bi_valid-=8)}(t)}},{"../utils/common":5}],12:[function(t,e,a){"use strict";e.exports=function(){this.input=null,this.next_in=0,this.avail_in=0,this.total_in=0,this.output=null,this.next_out=0,this.avail_out=0,this.total_out=0,this.msg="",this.state=null,this.data_type=2,this.adler=0}},{}]},{},[3])(3)});)ENC15";
 
-static const std::wstring& PlantumlEncoderScript() {
-    static const std::wstring script = []() {
+static const std::string& PlantumlEncoderScript() {
+    static const std::string script = []() {
         std::string combined;
         combined.reserve(30000);
         combined.append(kPlantumlEncoderScriptPart1);
@@ -811,54 +1607,73 @@ static const std::wstring& PlantumlEncoderScript() {
         combined.append(kPlantumlEncoderScriptPart13);
         combined.append(kPlantumlEncoderScriptPart14);
         combined.append(kPlantumlEncoderScriptPart15);
-        return FromUtf8(combined);
+        return combined;
     }();
     return script;
 }
 
-static std::wstring BuildShellHtmlWithBody(const std::wstring& body, bool preferSvg);
+static std::string BuildShellHtmlWithBody(std::string_view body, bool preferSvg);
+
+// Page markup for the SVG document(s) or PNG image(s) produced by the jar.
+static std::string BuildJavaArtifactMarkup(bool preferSvg,
+                                           const puml::ArtifactPtr& svg,
+                                           const puml::ArtifactPtr& png) {
+    if (preferSvg) {
+        return std::string(puml::ArtifactView(svg));
+    }
+    std::string body;
+    if (png) {
+        puml::AppendPngImagesMarkup(body, png->Data(), png->Size());
+    }
+    return body;
+}
+
+// Wrap an SVG document or PNG image produced by the jar in the viewer shell.
+static puml::ArtifactPtr BuildHtmlFromJavaArtifact(bool preferSvg,
+                                                   const puml::ArtifactPtr& svg,
+                                                   const puml::ArtifactPtr& png) {
+    return puml::MakeArtifact(puml::ArtifactFormat::Html,
+                              BuildShellHtmlWithBody(BuildJavaArtifactMarkup(preferSvg, svg, png), preferSvg));
+}
 
-static bool BuildHtmlFromJavaRender(const std::wstring& umlText,
+static bool BuildHtmlFromJavaRender(RenderBackend backend,
+                                    std::string_view umlText,
+                                    const std::wstring& sourcePath,
                                     bool preferSvg,
-                                    std::wstring& outHtml,
-                                    std::wstring* outSvg,
-                                    std::vector<unsigned char>* outPng,
-                                    std::wstring* outErrorMessage) {
+                                    puml::ArtifactPtr& outHtml,
+                                    puml::ArtifactPtr* outSvg,
+                                    puml::ArtifactPtr* outPng,
+                                    std::wstring* outErrorMessage,
+                                    const puml::CancellationToken* cancel) {
     auto setError = [&](const std::wstring& message) {
         if (outErrorMessage) {
             *outErrorMessage = message;
         }
     };
 
-    std::wstring svgOut;
+    std::string svgOut;
     std::vector<unsigned char> pngOut;
-    if (!RunPlantUmlJar(umlText, preferSvg, svgOut, pngOut)) {
+    if (!RunPlantUmlJar(backend, umlText, sourcePath, preferSvg, svgOut, pngOut, 0, cancel)) {
         setError(L"Local Java/JAR rendering failed. Check Java installation and plantuml.jar path in the INI file.");
         return false;
     }
 
-    if (preferSvg) {
-        outHtml = BuildShellHtmlWithBody(svgOut, true);
-    } else {
-        const std::string b64 = Base64(pngOut);
-        std::wstring body = L"<img alt=\"diagram\" src=\"data:image/png;base64,";
-        body += FromUtf8(b64);
-        body += L"\"/>";
-        outHtml = BuildShellHtmlWithBody(body, false);
-    }
+    puml::ArtifactPtr svg = puml::MakeArtifact(puml::ArtifactFormat::Svg, std::move(svgOut));
+    puml::ArtifactPtr png = puml::MakeArtifact(puml::ArtifactFormat::Png, std::move(pngOut));
+    outHtml = BuildHtmlFromJavaArtifact(preferSvg, svg, png);
     if (outSvg) {
-        *outSvg = std::move(svgOut);
+        *outSvg = std::move(svg);
     }
     if (outPng) {
-        *outPng = std::move(pngOut);
+        *outPng = std::move(png);
     }
     setError(std::wstring());
     return true;
 }
 
-// Build minimal HTML wrapper with injected BODY (svg markup or <img src="data:...">)
-static std::wstring BuildShellHtmlWithBody(const std::wstring& body, bool preferSvg) {
-    std::wstring html = LR"HTML(<!doctype html>
+// Viewer shell around the diagrams of a jar render; {{BODY}} takes the SVG
+// markup or <img src="data:..."> elements.
+static constexpr char kShellHtml[] = R"HTML(<!doctype html>
 <html>
 <head>
   <meta charset="utf-8">
@@ -876,6 +1691,10 @@ static std::wstring BuildShellHtmlWithBody(const std::wstring& body, bool prefer
     #root { padding: 56px 8px 8px 8px; display: grid; place-items: start center; }
     img, svg { max-width: 100%; height: auto; }
     .err { padding: 12px 14px; border-radius: 10px; background: color-mix(in oklab, Canvas 85%, red 15%); }
+    .diagram { margin-bottom: 16px; }
+    .pending { padding: 12px 14px; opacity: 0.6; }
+    .source { margin: 0; padding: 12px 14px; opacity: 0.7; white-space: pre-wrap; font: 12px ui-monospace, Consolas, monospace; }
+    #stale-badge { align-self: center; padding: 4px 8px; border-radius: 6px; background: color-mix(in oklab, Canvas 80%, orange 20%); }
   </style>
 </head>
 <body data-format="{{FORMAT}}">
@@ -887,6 +1706,7 @@ static std::wstring BuildShellHtmlWithBody(const std::wstring& body, bool prefer
       <option value="png">PNG</option>
     </select>
     <button id="btn-copy" type="button">Copy to clipboard</button>
+    <span id="stale-badge" hidden title="Showing the previous rendering until the new one is ready">Updating...</span>
   </div>
   <div id="root">
     {{BODY}}
@@ -915,6 +1735,23 @@ static std::wstring BuildShellHtmlWithBody(const std::wstring& body, bool prefer
     };
     hookButton(document.getElementById('btn-refresh'), 'refresh');
     hookButton(document.getElementById('btn-save'), 'saveAs');
+    // Files with several diagrams: each one is streamed into its slot when ready
+    if (window.chrome && window.chrome.webview) {
+      window.chrome.webview.addEventListener('message', ev => {
+        const msg = ev.data || {};
+        if (msg.type === 'diagram') {
+          const slot = document.querySelector('.diagram[data-index="' + msg.index + '"]');
+          if (slot) {
+            slot.innerHTML = msg.html;
+          }
+        } else if (msg.type === 'stale') {
+          const badge = document.getElementById('stale-badge');
+          if (badge) {
+            badge.hidden = !msg.stale;
+          }
+        }
+      });
+    }
     const select = document.getElementById('format-select');
     if (select) {
       const setDisabled = (disabled) => {
@@ -999,7 +1836,7 @@ static std::wstring BuildShellHtmlWithBody(const std::wstring& body, bool prefer
           copyButton.removeAttribute('title');
         } else if (webApiAvailable) {
           copyButton.disabled = false;
-          copyButton.title = 'Host unavailable – using browser clipboard';
+          copyButton.title = 'Host unavailable \u2013 using browser clipboard';
           window.setTimeout(updateCopyState, 1000);
         } else {
           copyButton.disabled = true;
@@ -1022,32 +1859,39 @@ static std::wstring BuildShellHtmlWithBody(const std::wstring& body, bool prefer
   </script>
 </body>
 </html>)HTML";
-    ReplaceAll(html, L"{{BODY}}", body);
-    ReplaceAll(html, L"{{FORMAT}}", preferSvg ? L"svg" : L"png");
-    ReplaceAll(html, L"{{PLANTUML_ENCODER}}", PlantumlEncoderScript());
-    return html;
-}
 
-static std::wstring BuildErrorHtml(const std::wstring& message, bool preferSvg) {
-    std::wstring safe = message;
-    ReplaceAll(safe, L"<", L"&lt;");
-    ReplaceAll(safe, L">", L"&gt;");
-    return BuildShellHtmlWithBody(L"<div class='err'>"+safe+L"</div>", preferSvg);
+enum ShellSlot : size_t { kShellFormat, kShellBody, kShellSlotCount };
+
+static constexpr puml::HtmlTemplate<kShellSlotCount> kShellTemplate({kShellHtml}, {{"FORMAT", "BODY"}});
+static_assert(kShellTemplate.Valid(), "kShellHtml has a placeholder the shell does not fill");
+
+// Build minimal HTML wrapper with injected BODY (svg markup or <img src="data:...">)
+static std::string BuildShellHtmlWithBody(std::string_view body, bool preferSvg) {
+    puml::HtmlTemplate<kShellSlotCount>::SlotValues slots;
+    slots[kShellFormat] = {preferSvg ? "svg" : "png"};
+    slots[kShellBody] = {body};
+    return kShellTemplate.Render(slots);
 }
 
-static bool BuildHtmlFromWebRender(const std::wstring& umlText,
-                                   const std::wstring& sourcePath,
-                                   bool preferSvg,
-                                   std::wstring& outHtml,
-                                   std::wstring* outErrorMessage) {
-    const std::wstring escaped = HtmlEscape(umlText);
-    std::wstring sourceName = ExtractFileStem(sourcePath);
-    if (sourceName.empty()) {
-        sourceName = L"plantuml-diagram";
+// Shows the shell's "Updating..." badge: the page is outdated and a fresh
+// render is on its way. The badge comes before the body, so the search
+// stops long before the diagrams.
+static std::string MarkShellHtmlStale(std::string html) {
+    static const std::string kHiddenBadge = "<span id=\"stale-badge\" hidden ";
+    const size_t pos = html.find(kHiddenBadge);
+    if (pos != std::string::npos) {
+        html.erase(pos + kHiddenBadge.size() - 7, 7);
     }
-    const std::wstring safeSourceName = HtmlAttributeEscape(sourceName);
+    return html;
+}
 
-    static const wchar_t kWebShellPart1[] = LR"HTML1(<!doctype html>
+static std::string BuildErrorHtml(const std::wstring& message, bool preferSvg) {
+    return BuildShellHtmlWithBody("<div class='err'>" + HtmlEscape(ToUtf8(message)) + "</div>", preferSvg);
+}
+
+// Viewer shell for the PlantUML server: the page renders the diagram
+// itself from the source it carries.
+static constexpr char kWebShellPart1[] = R"HTML1(<!doctype html>
 <html>
 <head>
   <meta charset="utf-8">
@@ -1071,7 +1915,7 @@ static bool BuildHtmlFromWebRender(const std::wstring& umlText,
   </style>
   <script>{{PLANTUML_ENCODER}}</script>
 </head>
-<body data-format="{{FORMAT}}" data-source-name="{{SOURCE_NAME}}">
+<body data-format="{{FORMAT}}" data-source-name="{{SOURCE_NAME}}" data-server="{{PLANTUML_SERVER_URL}}">
   <div id="toolbar">
     <button id="btn-refresh" type="button">Refresh</button>
     <button id="btn-save" type="button">Save as...</button>
@@ -1091,9 +1935,8 @@ static bool BuildHtmlFromWebRender(const std::wstring& umlText,
   <pre id="plantuml-source" class="hidden-source">{{PLANTUML_SOURCE}}</pre>
   <script>
     (function() {
-      const PLANTUML_SERVER_URL = 'https://www.plantuml.com/plantuml';
-
       const bodyEl = document.body;
+      const PLANTUML_SERVER_URL = bodyEl.dataset.server || 'https://www.plantuml.com/plantuml';
       const sourceEl = document.getElementById('plantuml-source');
       const svgContainer = document.getElementById('svg-container');
       const pngImage = document.getElementById('png-image');
@@ -1206,7 +2049,7 @@ static bool BuildHtmlFromWebRender(const std::wstring& umlText,
       };
 )HTML1";
 
-    static const wchar_t kWebShellPart2[] = LR"HTML2(
+static constexpr char kWebShellPart2[] = R"HTML2(
       const updateSaveState = () => {
         if (!saveButton) {
           return;
@@ -1235,7 +2078,7 @@ static bool BuildHtmlFromWebRender(const std::wstring& umlText,
           copyButton.removeAttribute('title');
         } else if (webApiAvailable && hasRenderable()) {
           copyButton.disabled = false;
-          copyButton.title = 'Host unavailable – using browser clipboard';
+          copyButton.title = 'Host unavailable \u2013 using browser clipboard';
         } else if (!webApiAvailable) {
           copyButton.disabled = true;
           copyButton.title = getFormat() === 'png' && !clipboardItemAvailable
@@ -1333,7 +2176,7 @@ static bool BuildHtmlFromWebRender(const std::wstring& umlText,
       };
 )HTML2";
 
-    static const wchar_t kWebShellPart3[] = LR"HTML3(
+static constexpr char kWebShellPart3[] = R"HTML3(
       const renderDiagram = async () => {
         const format = getFormat();
         const source = getSource();
@@ -1430,7 +2273,7 @@ static bool BuildHtmlFromWebRender(const std::wstring& umlText,
       };
 )HTML3";
 
-    static const wchar_t kWebShellPart4[] = LR"HTML4(
+static constexpr char kWebShellPart4[] = R"HTML4(
       if (formatSelect) {
         const stored = (() => {
           try {
@@ -1519,49 +2362,276 @@ static bool BuildHtmlFromWebRender(const std::wstring& umlText,
 </html>
 )HTML4";
 
-    std::wstring html(kWebShellPart1);
-    html.append(kWebShellPart2);
-    html.append(kWebShellPart3);
-    html.append(kWebShellPart4);
+enum WebShellSlot : size_t {
+    kWebShellFormat,
+    kWebShellSourceName,
+    kWebShellServerUrl,
+    kWebShellEncoder,
+    kWebShellSource,
+    kWebShellSlotCount,
+};
 
-    ReplaceAll(html, L"{{FORMAT}}", preferSvg ? L"svg" : L"png");
-    ReplaceAll(html, L"{{SOURCE_NAME}}", safeSourceName);
-    ReplaceAll(html, L"{{PLANTUML_ENCODER}}", PlantumlEncoderScript());
-    ReplaceAll(html, L"{{PLANTUML_SOURCE}}", escaped);
+static constexpr puml::HtmlTemplate<kWebShellSlotCount> kWebShellTemplate(
+    {kWebShellPart1, kWebShellPart2, kWebShellPart3, kWebShellPart4},
+    {{"FORMAT", "SOURCE_NAME", "PLANTUML_SERVER_URL", "PLANTUML_ENCODER", "PLANTUML_SOURCE"}});
+static_assert(kWebShellTemplate.Valid(), "kWebShellPart1..4 have a placeholder the web shell does not fill");
 
-    outHtml.swap(html);
+static bool BuildHtmlFromWebRender(std::string_view umlText,
+                                   const std::wstring& sourcePath,
+                                   bool preferSvg,
+                                   std::string& outHtml,
+                                   std::wstring* outErrorMessage) {
+    std::wstring sourceName = ExtractFileStem(sourcePath);
+    if (sourceName.empty()) {
+        sourceName = L"plantuml-diagram";
+    }
+    const std::string sourceNameUtf8 = ToUtf8(sourceName);
+    const std::string serverUrl = ToUtf8(g_webServerUrl);
+
+    // The source is escaped as it is copied into the page.
+    puml::HtmlTemplate<kWebShellSlotCount>::SlotValues slots;
+    slots[kWebShellFormat] = {preferSvg ? "svg" : "png"};
+    slots[kWebShellSourceName] = {sourceNameUtf8, puml::SlotEscape::Html};
+    slots[kWebShellServerUrl] = {serverUrl, puml::SlotEscape::Html};
+    slots[kWebShellEncoder] = {PlantumlEncoderScript()};
+    slots[kWebShellSource] = {umlText, puml::SlotEscape::Html};
+    kWebShellTemplate.Render(slots, outHtml);
     if (outErrorMessage) {
         *outErrorMessage = std::wstring();
     }
     return true;
 }
 
+// Copying a result copies artifact pointers, never their bytes.
 struct RenderPipelineResult {
     bool success = false;
     RenderBackend backend = RenderBackend::Java;
-    std::wstring html;
-    std::wstring svg;
-    std::vector<unsigned char> png;
+    puml::ArtifactPtr html;   // UTF-8, like everything the pipeline carries
+    puml::ArtifactPtr svg;
+    puml::ArtifactPtr png;
     std::wstring errorMessage;
+    bool partial = false;   // some diagrams of a multi-diagram file failed; never cached
+    bool servedByServer = false;   // renderer=auto: the server answered first; never cached
+};
+
+// Images of a multi-diagram render by DiagramImageId.
+using DiagramImageSet = std::unordered_map<std::string, std::shared_ptr<const RenderPipelineResult>>;
+
+// Progressive display of files with several diagrams. Called on render
+// threads: started once with the page of empty slots, then imageReady for
+// every diagram image as soon as it is rendered, in completion order.
+// Images found in previousImages (the window's last render) are reused
+// instead of rendered; every successful image is added to renderedImages.
+struct RenderProgress {
+    std::function<void(size_t imageCount, std::string pageHtml)> started;
+    std::function<void(size_t index, const std::string& imageId, std::string markup)> imageReady;
+    std::shared_ptr<const DiagramImageSet> previousImages;
+    std::shared_ptr<DiagramImageSet> renderedImages;
+};
+
+static RenderPipelineResult RenderDiagramImages(RenderBackend backend,
+                                                std::string_view text,
+                                                const std::pmr::vector<puml::DiagramBlock>& blocks,
+                                                const std::wstring& sourcePath,
+                                                bool preferSvg,
+                                                const RenderProgress* progress,
+                                                const puml::CancellationToken* cancel);
+
+// ---------------------- Hedged rendering ----------------------
+// renderer=auto: the jar backend renders first. When it takes longer than
+// usual (the hedge delay follows its latency histogram) or fails, the
+// diagram is posted to the [web] server as well and whichever answers first
+// is shown; the other is cancelled. A backend that keeps failing or timing
+// out is skipped by its circuit breaker until a health probe succeeds.
+// Only single-image diagrams on screen without local includes are hedged:
+// the server renders just the first diagram, cannot read local files, and
+// prefetch must not load it.
+
+static const char kHealthProbeDiagram[] = "@startuml\nprobe -> probe\n@enduml\n";
+
+static puml::BreakerSettings BreakerSettingsFromConfig() {
+    puml::BreakerSettings settings;
+    settings.failureThreshold = g_breakerFailures;
+    settings.cooldownMs = g_breakerCooldownMs;
+    if (settings.maxCooldownMs < settings.cooldownMs) settings.maxCooldownMs = settings.cooldownMs;
+    return settings;
+}
+
+struct BackendHealth {
+    explicit BackendHealth(const char* name) : breaker(name, BreakerSettingsFromConfig()) {}
+
+    puml::CircuitBreaker   breaker;
+    puml::LatencyHistogram latency;
 };
 
+static BackendHealth& JarHealth() {
+    static auto* health = new BackendHealth("jar");
+    return *health;
+}
+
+static BackendHealth& WebHealth() {
+    static auto* health = new BackendHealth("web");
+    return *health;
+}
+
+static puml::WorkerPool* GetHealthProbeWorkers() {
+    static auto* pool = new puml::WorkerPool(1, "HealthProbes");
+    return pool;
+}
+
+// Posts the source to <server>/svg or /png. Like the jar, the server answers
+// a diagram with syntax errors with an image of the error (status 400).
+static bool RenderOnWebServer(std::string_view umlUtf8,
+                              bool preferSvg,
+                              std::string& outSvg,
+                              std::vector<unsigned char>& outPng,
+                              std::string& error,
+                              const puml::CancellationToken* cancel) {
+    static const size_t kMaxImageBytes = 64 * 1024 * 1024;
+    const std::string url = ToUtf8(g_webServerUrl) + (preferSvg ? "/svg" : "/png");
+    puml::HttpResponse response;
+    if (!puml::HttpPost(url, "text/plain; charset=utf-8", umlUtf8, g_webTimeoutMs, kMaxImageBytes,
+                        response, &error, cancel)) {
+        return false;
+    }
+    const bool image = response.contentType.compare(0, 6, "image/") == 0;
+    if ((response.status != 200 && !(response.status == 400 && image)) || response.body.empty()) {
+        error = "HTTP " + std::to_string(response.status) + " from " + url;
+        return false;
+    }
+    if (preferSvg) {
+        outSvg.assign(response.body.begin(), response.body.end());
+    } else {
+        outPng = std::move(response.body);
+    }
+    return true;
+}
+
+// Open breakers get their probe off the render path; until it succeeds the
+// other backend renders alone.
+static void ScheduleHealthProbes(RenderBackend backend) {
+    if (JarHealth().breaker.BeginProbe()) {
+        GetHealthProbeWorkers()->Submit([backend]() {
+            puml::RenderPriorityScope priority(puml::RenderPriority::Speculative);
+            std::string svg;
+            std::vector<unsigned char> png;
+            JarHealth().breaker.FinishProbe(
+                RunPlantUmlJar(backend, kHealthProbeDiagram, std::wstring(), true, svg, png, 0, nullptr));
+        });
+    }
+    if (WebHealth().breaker.BeginProbe()) {
+        GetHealthProbeWorkers()->Submit([]() {
+            std::string svg;
+            std::vector<unsigned char> png;
+            std::string error;
+            const bool healthy = RenderOnWebServer(kHealthProbeDiagram, true, svg, png, error, nullptr);
+            if (!healthy) {
+                AppendLog(L"RenderHedged: server health probe failed: " + FromUtf8(error));
+            }
+            WebHealth().breaker.FinishProbe(healthy);
+        });
+    }
+}
+
+static RenderPipelineResult RenderHedged(RenderBackend backend,
+                                         std::string_view text,
+                                         const std::wstring& sourcePath,
+                                         bool preferSvg,
+                                         const puml::CancellationToken* cancel) {
+    ScheduleHealthProbes(backend);
+
+    const std::wstring jarName = RenderBackendName(backend);
+    std::string jarSvg;
+    std::string webSvg;
+    std::vector<unsigned char> jarPng;
+    std::vector<unsigned char> webPng;
+
+    puml::HedgeBackend jar;
+    jar.name = ToUtf8(jarName);
+    jar.breaker = &JarHealth().breaker;
+    jar.latency = &JarHealth().latency;
+    jar.render = [&](const puml::CancellationToken& attemptCancel, std::string& error) {
+        if (RunPlantUmlJar(backend, text, sourcePath, preferSvg, jarSvg, jarPng, 0, &attemptCancel)) {
+            return true;
+        }
+        error = "local render failed";
+        return false;
+    };
+    puml::HedgeBackend web;
+    web.name = "web";
+    web.breaker = &WebHealth().breaker;
+    web.latency = &WebHealth().latency;
+    web.render = [&](const puml::CancellationToken& attemptCancel, std::string& error) {
+        return RenderOnWebServer(text, preferSvg, webSvg, webPng, error, &attemptCancel);
+    };
+
+    puml::HedgePolicy policy;
+    policy.initialDelayMs = g_hedgeDelayMs;
+    policy.maxDelayMs = g_hedgeMaxDelayMs;
+    policy.slowMs = g_hedgeMaxDelayMs;
+    const puml::HedgeOutcome outcome = puml::RunHedged(jar, web, policy, cancel);
+
+    const bool byServer = outcome.winner == puml::HedgeWinner::Secondary;
+    std::wstringstream os;
+    os << L"RenderHedged: "
+       << (outcome.winner == puml::HedgeWinner::None ? L"no backend" : byServer ? L"web" : jarName.c_str())
+       << L" answered in " << outcome.elapsedMs << L" ms";
+    if (outcome.failover) {
+        os << L" (" << jarName << L" circuit open)";
+    } else if (outcome.hedged) {
+        os << L" (hedged after " << outcome.delayMs << L" ms)";
+    }
+    os << L"; " << jarName << L" " << FromUtf8(JarHealth().latency.Describe())
+       << L", web " << FromUtf8(WebHealth().latency.Describe());
+    if (!outcome.secondaryError.empty() && !puml::IsCancelled(cancel)) {
+        os << L"; web: " << FromUtf8(outcome.secondaryError);
+    }
+    AppendLog(os.str());
+
+    RenderPipelineResult result;
+    result.backend = backend;
+    if (outcome.winner == puml::HedgeWinner::None) {
+        result.errorMessage = L"Neither local Java nor the PlantUML server could render the diagram. Check the log for details.";
+        return result;
+    }
+    result.success = true;
+    result.servedByServer = byServer;
+    result.svg = puml::MakeArtifact(puml::ArtifactFormat::Svg, std::move(byServer ? webSvg : jarSvg));
+    result.png = puml::MakeArtifact(puml::ArtifactFormat::Png, std::move(byServer ? webPng : jarPng));
+    result.html = BuildHtmlFromJavaArtifact(preferSvg, result.svg, result.png);
+    return result;
+}
+
 static RenderPipelineResult ExecuteRenderBackend(RenderBackend backend,
-                                                 const std::wstring& text,
+                                                 std::string_view text,
                                                  const std::wstring& sourcePath,
-                                                 bool preferSvg) {
+                                                 bool preferSvg,
+                                                 const RenderProgress* progress,
+                                                 const puml::CancellationToken* cancel) {
     RenderPipelineResult result;
     result.backend = backend;
 
-    if (backend == RenderBackend::Java) {
-        std::wstring html;
-        std::wstring svg;
-        std::vector<unsigned char> png;
+    size_t images = 0;
+    if (IsJarBackend(backend) && (g_splitDiagrams || g_hedgeEnabled)) {
+        const std::pmr::vector<puml::DiagramBlock> blocks = puml::SplitDiagramBlocks(text);
+        for (const puml::DiagramBlock& block : blocks) {
+            images += block.pages;
+        }
+        if (g_splitDiagrams && images > 1) {
+            return RenderDiagramImages(backend, text, blocks, sourcePath, preferSvg, progress, cancel);
+        }
+    }
+
+    if (IsJarBackend(backend) && g_hedgeEnabled && images == 1 && !IsBackgroundRender() &&
+        puml::ScanSourceReferences(text).empty()) {
+        return RenderHedged(backend, text, sourcePath, preferSvg, cancel);
+    }
+
+    if (IsJarBackend(backend)) {
         std::wstring error;
-        if (BuildHtmlFromJavaRender(text, preferSvg, html, &svg, &png, &error)) {
+        if (BuildHtmlFromJavaRender(backend, text, sourcePath, preferSvg, result.html, &result.svg, &result.png,
+                                    &error, cancel)) {
             result.success = true;
-            result.html = std::move(html);
-            result.svg = std::move(svg);
-            result.png = std::move(png);
             return result;
         }
         result.errorMessage = !error.empty() ? error : std::wstring(L"Local Java rendering failed.");
@@ -1569,11 +2639,11 @@ static RenderPipelineResult ExecuteRenderBackend(RenderBackend backend,
     }
 
     if (backend == RenderBackend::Web) {
-        std::wstring html;
+        std::string html;
         std::wstring error;
         if (BuildHtmlFromWebRender(text, sourcePath, preferSvg, html, &error)) {
             result.success = true;
-            result.html = std::move(html);
+            result.html = puml::MakeArtifact(puml::ArtifactFormat::Html, std::move(html));
             if (!error.empty()) {
                 result.errorMessage = error;
             }
@@ -1587,8 +2657,336 @@ static RenderPipelineResult ExecuteRenderBackend(RenderBackend backend,
     return result;
 }
 
+// ---------------------- Render cache ----------------------
+// Artifacts of the Java renderer, keyed by source content, output format, jar
+// identity and the settings that influence the output. Recent results stay in
+// memory; every result is also persisted on disk. Both caches are shared by
+// every Lister window.
+using MemoryRenderCache = puml::ByteBudgetLruCache<std::shared_ptr<const RenderPipelineResult>>;
+
+enum class RenderCacheHit {
+    None,
+    Memory,
+    Disk,
+};
+
+static MemoryRenderCache* GetMemoryRenderCache() {
+    static MemoryRenderCache* cache = new MemoryRenderCache(static_cast<uint64_t>(g_memoryCacheMb) * 1024 * 1024);
+    return cache;
+}
+
+static puml::DiskRenderCache* GetDiskRenderCache() {
+    static puml::DiskRenderCache* cache = new puml::DiskRenderCache(
+        ToUtf8(g_cacheDir), static_cast<uint64_t>(g_cacheMaxMb) * 1024 * 1024);
+    return cache;
+}
+
+// Included files are hashed and scanned once per modification.
+static puml::DependencyScanner* GetDependencyScanner() {
+    static auto* scanner = new puml::DependencyScanner();
+    return scanner;
+}
+
+// Local files the source pulls in, resolved relative to its folder.
+static puml::DependencyGraph ScanSourceDependencies(std::string_view sourceUtf8, const std::wstring& sourcePath) {
+    return GetDependencyScanner()->Scan(sourceUtf8, puml::ParentDirectory(ToUtf8(sourcePath)));
+}
+
+static uint64_t EstimateRenderResultBytes(const RenderPipelineResult& result) {
+    return sizeof(RenderPipelineResult)
+         + puml::ArtifactSize(result.html) + puml::ArtifactSize(result.svg) + puml::ArtifactSize(result.png)
+         + result.errorMessage.size() * sizeof(wchar_t);
+}
+
+// Path, size and modification time: a replaced or updated jar invalidates
+// everything it rendered. So does another Java, whose fonts and text
+// metrics PlantUML lays out with. Built once and kept, as every cache key
+// needs it; a watcher on the jar's directory drops it when the jar changes,
+// and a configuration naming another jar rebuilds it. Shared rather than
+// copied out, since every render asks for it.
+static std::mutex   g_jarIdentityMutex;
+static std::wstring g_jarIdentityPath;     // the g_jarPath it was built for
+static std::shared_ptr<const std::string> g_jarIdentity;
+static bool         g_jarIdentityValid = false;
+
+static void InvalidateJarIdentity() {
+    std::lock_guard<std::mutex> lock(g_jarIdentityMutex);
+    g_jarIdentityValid = false;
+}
+
+// Started for the first jar only; the configuration is read once per
+// process.
+static void WatchPlantUmlJar(const std::string& jarUtf8) {
+    static puml::FileWatcher* watcher = [&jarUtf8]() {
+        std::string error;
+        std::unique_ptr<puml::FileWatcher> started = puml::StartFileWatcher(
+            {jarUtf8}, 1000, []() {
+                AppendLog(L"Jar identity: plantuml.jar changed, rebuilding the cache identity");
+                InvalidateJarIdentity();
+            },
+            &error);
+        if (!started) {
+            AppendLog(L"Jar identity: cannot watch " + FromUtf8(jarUtf8) + L": " + FromUtf8(error));
+        }
+        return started.release();
+    }();
+    (void)watcher;
+}
+
+// Never null; empty when there is no jar.
+static std::shared_ptr<const std::string> DescribePlantUmlJarIdentity() {
+    std::lock_guard<std::mutex> lock(g_jarIdentityMutex);
+    if (g_jarIdentityValid && g_jarIdentityPath == g_jarPath) {
+        return g_jarIdentity;
+    }
+    const std::string jar = ToUtf8(g_jarPath);
+    std::string identity = puml::DescribeFileStamp(jar);
+    if (!identity.empty()) {
+        WatchPlantUmlJar(jar);
+        const puml::Toolchain* toolchain = GetToolchain();
+        if (toolchain) {
+            // The version the toolchain read is stale once the jar changed.
+            std::string version = toolchain->plantUmlVersion;
+            std::string manifest;
+            if (identity != toolchain->jarStamp && puml::ReadJarManifest(jar, manifest, nullptr)) {
+                version = puml::JarManifestAttribute(manifest, "Implementation-Version");
+            }
+            identity += "|plantuml=" + version + "|java=" + toolchain->java.version;
+        }
+    }
+    // A missing jar is not remembered, so one that appears later is used.
+    g_jarIdentityValid = !identity.empty();
+    g_jarIdentity = std::make_shared<const std::string>(std::move(identity));
+    g_jarIdentityPath = g_jarPath;
+    return g_jarIdentity;
+}
+
+// Returns an empty key when no cache applies to this render. dependencyHash
+// covers the files the source includes (DependencyGraph::combinedHash).
+// imageIndex addresses one image of a single diagram block instead of a
+// whole file.
+static const size_t kWholeSource = static_cast<size_t>(-1);
+
+static std::string BuildRenderCacheKey(RenderBackend backend,
+                                       std::string_view sourceUtf8,
+                                       bool preferSvg,
+                                       uint64_t dependencyHash,
+                                       size_t imageIndex = kWholeSource) {
+    if (!IsJarBackend(backend) || (!g_cacheEnabled && g_memoryCacheMb == 0)) {
+        return std::string();
+    }
+    const std::shared_ptr<const std::string> jarIdentity = DescribePlantUmlJarIdentity();
+    if (jarIdentity->empty()) {
+        return std::string();
+    }
+    // Assembled on the stack: a key is built for every render.
+    char settings[96] = "renderer=java;charset=UTF-8;mode=";
+    char* end = settings + std::strlen(settings);
+    const auto append = [&end](std::string_view text) {
+        end = std::copy(text.begin(), text.end(), end);
+    };
+    append(backend == RenderBackend::Jni ? "jni" : g_daemonEnabled ? "pipe" : "once");
+    if (imageIndex != kWholeSource) {
+        append(";image=");
+        end = std::to_chars(end, settings + sizeof(settings), imageIndex).ptr;
+    } else if (g_splitDiagrams) {
+        append(";split=1");
+    }
+    puml::RenderCacheKeyInput input;
+    input.source = sourceUtf8.data();
+    input.sourceSize = sourceUtf8.size();
+    input.format = preferSvg ? "svg" : "png";
+    input.rendererIdentity = *jarIdentity;
+    input.dependencyHash = dependencyHash;
+    input.settings = std::string_view(settings, static_cast<size_t>(end - settings));
+    return puml::DeriveRenderCacheKey(input);
+}
+
+// A peek (a preview, not a render) neither counts in the hit ratios nor
+// refreshes recency, and a disk entry it reads is not promoted to memory.
+static RenderCacheHit TryLoadCachedRender(const std::string& key, bool preferSvg, RenderPipelineResult& result,
+                                          bool peek = false) {
+    if (key.empty()) {
+        return RenderCacheHit::None;
+    }
+    std::shared_ptr<const RenderPipelineResult> recent;
+    if (g_memoryCacheMb > 0 &&
+        (peek ? GetMemoryRenderCache()->Peek(key, recent) : GetMemoryRenderCache()->Get(key, recent))) {
+        result = *recent;
+        return RenderCacheHit::Memory;
+    }
+
+    std::vector<unsigned char> bytes;
+    const char* extension = preferSvg ? "svg" : "png";
+    if (!g_cacheEnabled ||
+        !(peek ? GetDiskRenderCache()->Peek(key, extension, bytes) : GetDiskRenderCache()->Get(key, extension, bytes)) ||
+        bytes.empty()) {
+        return RenderCacheHit::None;
+    }
+    RenderPipelineResult loaded;
+    loaded.backend = RenderBackend::Java;
+    if (preferSvg) {
+        loaded.svg = puml::MakeArtifact(puml::ArtifactFormat::Svg, std::move(bytes));
+    } else {
+        loaded.png = puml::MakeArtifact(puml::ArtifactFormat::Png, std::move(bytes));
+    }
+    loaded.html = BuildHtmlFromJavaArtifact(preferSvg, loaded.svg, loaded.png);
+    loaded.success = true;
+    if (g_memoryCacheMb > 0 && !peek) {
+        GetMemoryRenderCache()->Put(key, std::make_shared<const RenderPipelineResult>(loaded),
+                                    EstimateRenderResultBytes(loaded));
+    }
+    result = std::move(loaded);
+    return RenderCacheHit::Disk;
+}
+
+static void StoreCachedRender(const std::string& key, bool preferSvg, const RenderPipelineResult& result) {
+    if (key.empty() || !result.success || result.partial || result.servedByServer || !IsJarBackend(result.backend)) {
+        return;
+    }
+    if (g_memoryCacheMb > 0) {
+        GetMemoryRenderCache()->Put(key, std::make_shared<const RenderPipelineResult>(result),
+                                    EstimateRenderResultBytes(result));
+    }
+    if (!g_cacheEnabled) {
+        return;
+    }
+    const puml::ArtifactPtr& image = preferSvg ? result.svg : result.png;
+    if (image) {
+        GetDiskRenderCache()->Put(key, puml::ArtifactFormatName(image->Format()), image->Data(), image->Size());
+    }
+}
+
+// Membership test that neither counts as a lookup nor refreshes recency.
+static bool IsRenderCached(const std::string& key, bool preferSvg) {
+    return !key.empty() &&
+           ((g_memoryCacheMb > 0 && GetMemoryRenderCache()->Contains(key)) ||
+            (g_cacheEnabled && GetDiskRenderCache()->Contains(key, preferSvg ? "svg" : "png")));
+}
+
+// The caches are content addressed, so an edited file misses them. To paint
+// something at once, the render cache key of the last render of every file
+// is remembered per path and format: in memory, and as a small ".ref" entry
+// in the disk cache for other windows and later sessions.
+static const size_t kMaxLastRenderKeys = 4096;
+static std::mutex   g_lastRenderMutex;
+static std::unordered_map<std::string, std::string> g_lastRenderKeys;   // path key -> render cache key
+
+static std::string BuildLastRenderKey(const std::wstring& sourcePath, bool preferSvg) {
+    const std::string path = ToUtf8(ToLowerTrim(sourcePath));
+    puml::RenderCacheKeyInput input;
+    input.source = path.data();
+    input.sourceSize = path.size();
+    input.format = preferSvg ? "svg" : "png";
+    input.settings = "last-render";
+    return puml::DeriveRenderCacheKey(input);
+}
+
+static void RememberLastRender(const std::wstring& sourcePath, bool preferSvg, const std::string& cacheKey) {
+    if (cacheKey.empty()) {
+        return;
+    }
+    const std::string key = BuildLastRenderKey(sourcePath, preferSvg);
+    {
+        std::lock_guard<std::mutex> lock(g_lastRenderMutex);
+        if (g_lastRenderKeys.size() >= kMaxLastRenderKeys) {
+            g_lastRenderKeys.clear();
+        }
+        std::string& last = g_lastRenderKeys[key];
+        if (last == cacheKey) {
+            return;
+        }
+        last = cacheKey;
+    }
+    if (g_cacheEnabled) {
+        // Keyed by path, not content: a newer render replaces the entry.
+        GetDiskRenderCache()->Replace(key, "ref", cacheKey.data(), cacheKey.size());
+    }
+}
+
+// The last render of the file in this format, whatever its content was then.
+// A preview: the caches' lookup statistics are left alone.
+static bool TryLoadLastRender(const std::wstring& sourcePath, bool preferSvg, RenderPipelineResult& result) {
+    if (!g_cacheEnabled && g_memoryCacheMb == 0) {
+        return false;
+    }
+    const std::string key = BuildLastRenderKey(sourcePath, preferSvg);
+    std::string cacheKey;
+    {
+        std::lock_guard<std::mutex> lock(g_lastRenderMutex);
+        auto it = g_lastRenderKeys.find(key);
+        if (it != g_lastRenderKeys.end()) {
+            cacheKey = it->second;
+        }
+    }
+    std::vector<unsigned char> bytes;
+    if (cacheKey.empty() && g_cacheEnabled && GetDiskRenderCache()->Peek(key, "ref", bytes)) {
+        cacheKey.assign(bytes.begin(), bytes.end());
+    }
+    return !cacheKey.empty() && TryLoadCachedRender(cacheKey, preferSvg, result, true) != RenderCacheHit::None;
+}
+
+static void LogRenderCacheStats(const std::wstring& logContext, RenderCacheHit hit) {
+    if (!LogEnabled()) return;
+    std::wstringstream os;
+    os << logContext << L": render cache "
+       << (hit == RenderCacheHit::Memory ? L"memory hit" : hit == RenderCacheHit::Disk ? L"disk hit" : L"miss");
+    if (g_memoryCacheMb > 0) {
+        const puml::LruCacheStats memory = GetMemoryRenderCache()->Stats();
+        os << L"; memory hits=" << memory.hits << L", misses=" << memory.misses
+           << L", hitRatio=" << std::fixed << std::setprecision(2) << memory.HitRatio()
+           << L", evictions=" << memory.evictions
+           << L", entries=" << memory.entries << L", bytes=" << memory.bytes;
+    }
+    if (g_cacheEnabled) {
+        const puml::DiskCacheStats disk = GetDiskRenderCache()->Stats();
+        os << L"; disk hits=" << disk.hits << L", misses=" << disk.misses
+           << L", writes=" << disk.writes << L", evictions=" << disk.evictions
+           << L", entries=" << disk.entries << L", bytes=" << disk.bytes;
+    }
+    AppendLog(os.str());
+}
+
 // ---------------------- WebView host ----------------------
 static const wchar_t* kWndClass = L"PumlWebViewHost";
+static const UINT     kMsgRenderCompleted = WM_APP + 1;   // drains Host::completedRenders
+static const UINT     kMsgRenderProgress  = WM_APP + 2;   // drains Host::pendingProgress
+static const UINT     kMsgSourceChanged   = WM_APP + 3;   // the watched source file was saved
+
+// One render of a Host's source file, executed on a render worker. The result
+// is handed back to the window thread, which owns all WebView2 objects.
+struct RenderJob {
+    uint64_t generation = 0;
+    std::wstring sourcePath;
+    RenderBackend renderer = RenderBackend::Java;
+    bool preferSvg = true;
+    std::wstring logContext;
+    std::wstring failureDialogMessage;
+    bool showDialogOnFailure = false;
+    bool onlyIfChanged = false;       // auto-refresh: skip when the source is what is shown
+    uint64_t sourceHash = 0;          // the file and every file it includes
+    std::vector<std::string> watchPaths;   // auto-refresh: the file and its dependencies
+    RenderPipelineResult result;
+    std::shared_ptr<const DiagramImageSet> images;   // per-image results of a split render
+};
+
+// A step of a render, posted to the window thread. Multi-diagram renders post
+// the page of empty slots first, then the markup of each finished image.
+struct RenderProgressUpdate {
+    enum class Kind {
+        Image,
+        Page,
+        Stale,     // the page shown is outdated until this render finishes
+        Preview,   // the last render or the source, shown outdated until this render finishes
+    };
+    Kind kind = Kind::Image;
+    uint64_t generation = 0;
+    size_t index = 0;          // image slot, or the number of slots for the page
+    bool stale = false;        // Kind::Stale
+    bool preferSvg = true;     // Kind::Preview
+    std::string imageId;
+    std::string html;
+};
 
 struct Host {
     std::atomic<long> refs{1};
@@ -1608,27 +3006,109 @@ struct Host {
     bool                             navCompletedRegistered = false;
     bool                             webMessageRegistered   = false;
 
-    std::wstring initialHtml; // what we will NavigateToString()
+    // The page shown and the render it shows, shared with the render caches;
+    // readers copy the pointers under stateMutex and use the bytes after.
+    puml::ArtifactPtr initialHtml;  // what we will NavigateToString(), UTF-8 until then
     std::wstring sourceFilePath;
-    std::wstring lastSvg;
-    std::vector<unsigned char> lastPng;
+    puml::ArtifactPtr lastSvg;
+    puml::ArtifactPtr lastPng;
     bool lastPreferSvg = true;
     bool hasRender = false;
     RenderBackend configuredRenderer = RenderBackend::Java;
     RenderBackend activeRenderer = RenderBackend::Java;
     std::wstring firstErrorMessage;
+
+    uint64_t renderGeneration = 0;   // bumped per request; older results are dropped
+    std::vector<std::shared_ptr<RenderJob>> completedRenders;
+    std::vector<RenderProgressUpdate> pendingProgress;
+
+    // What the last successful render was made from, for auto-refresh.
+    bool hasRenderedSource = false;
+    uint64_t renderedSourceHash = 0;
+    bool renderedPreferSvg = true;
+    std::shared_ptr<const DiagramImageSet> lastImages;
+    uint64_t shownGeneration = 0;                // render whose result is shown
+    std::unique_ptr<puml::FileWatcher> watcher;
+    std::vector<std::string> watchedPaths;       // window thread only
+
+    // Multi-diagram pages (window thread only).
+    uint64_t progressGeneration = 0;             // render whose images are arriving, 0 = none
+    std::vector<std::string> progressImages;     // markup per slot, empty until rendered
+    std::vector<std::string> progressImageIds;
+    std::vector<std::string> pageImageIds;       // images on the page shown, per slot
+    std::vector<std::string> navigatedImageIds;  // images built into the page last navigated to
+    bool pageLoaded = false;                     // the last navigation has completed
+    bool pageStale = false;                      // the page shown is outdated, a render is running
+    std::string pendingSlotPage;                 // slot page held back while a stale page is shown
+
+    // The render shown, in the other format: made in the background so that
+    // switching format, Save As and Copy do not wait for Java.
+    bool hasOtherFormat = false;
+    bool otherFormatPreferSvg = false;
+    uint64_t otherFormatSourceHash = 0;
+    RenderPipelineResult otherFormat;
 };
 
+// Window thread. imageIds lists the images the page's slots start out with.
+// The page is widened to UTF-16 here, the only place WebView2 needs it.
+static void HostNavigate(Host* host, std::string_view html, const std::vector<std::string>& imageIds) {
+    host->pageLoaded = false;
+    host->navigatedImageIds = imageIds;
+    host->pageImageIds = imageIds;
+    puml::PooledBuffer wide;
+    host->web->NavigateToString(WidenToPooled(html, wide));
+}
+
+// Window thread: show or clear the "Updating..." badge of the page shown.
+// A page still loading gets it from HostReplayProgressImages.
+static void HostSetPageStale(Host* host, bool stale) {
+    host->pageStale = stale;
+    if (!host->web || !host->pageLoaded) {
+        return;
+    }
+    HRESULT hr = host->web->PostWebMessageAsJson(stale ? L"{\"type\":\"stale\",\"stale\":true}"
+                                                       : L"{\"type\":\"stale\",\"stale\":false}");
+    if (FAILED(hr)) {
+        AppendLog(L"HostSetPageStale: PostWebMessageAsJson failed with HRESULT=" + std::to_wstring(hr));
+    }
+}
+
 static void HostNavigateToInitialHtml(Host* host) {
     if (!host || !host->web) return;
-    std::wstring html;
+    puml::ArtifactPtr html;
     {
         std::lock_guard<std::mutex> lock(host->stateMutex);
         html = host->initialHtml;
     }
-    if (!html.empty()) {
-        AppendLog(L"HostNavigateToInitialHtml: navigating with HTML length=" + std::to_wstring(html.size()));
-        host->web->NavigateToString(html.c_str());
+    if (html) {
+        AppendLog(L"HostNavigateToInitialHtml: navigating with HTML bytes=" + std::to_wstring(html->Size()));
+        // pageImageIds was set together with initialHtml.
+        HostNavigate(host, html->View(), std::vector<std::string>(host->pageImageIds));
+    }
+}
+
+// Window thread: watch the source file and the files it includes. Never
+// called with stateMutex held; the watcher's callback takes it.
+static void HostWatchFiles(Host* host, const std::vector<std::string>& paths, const std::wstring& logContext) {
+    if (paths.empty() || paths == host->watchedPaths) {
+        return;
+    }
+    host->watcher.reset();
+    host->watchedPaths = paths;
+    std::string error;
+    host->watcher = puml::StartFileWatcher(paths, g_autoRefreshDelayMs,
+        [host]() {
+            // Watcher thread; the watcher is stopped before the host goes away.
+            std::lock_guard<std::mutex> lock(host->stateMutex);
+            if (!host->closing.load(std::memory_order_acquire) && host->hwnd) {
+                PostMessageW(host->hwnd, kMsgSourceChanged, 0, 0);
+            }
+        },
+        &error);
+    if (!host->watcher) {
+        AppendLog(logContext, L": auto-refresh disabled, cannot watch the file: ", FromUtf8(error));
+    } else if (paths.size() > 1) {
+        AppendLog(logContext, L": watching the file and ", std::to_wstring(paths.size() - 1), L" included file(s)");
     }
 }
 
@@ -1643,118 +3123,1095 @@ static void HostRelease(Host* host) {
     }
 }
 
-static bool HostRenderAndReload(Host* host,
-                                bool preferSvg,
-                                const std::wstring& logContext,
-                                const std::wstring& failureDialogMessage,
-                                bool showDialogOnFailure) {
-    if (!host) {
-        return false;
-    }
+// Render scheduler shared by every Lister window.
+static puml::RenderScheduler* GetRenderScheduler() {
+    static puml::RenderScheduler* scheduler = []() {
+        auto* created = new puml::RenderScheduler(g_renderThreads, "RenderScheduler");
+        // Prefetch is the CPU budget knob: it never takes more than this many threads.
+        created->SetConcurrencyLimit(puml::RenderPriority::Speculative, g_prefetchMaxRunning);
+        return created;
+    }();
+    return scheduler;
+}
 
-    std::wstring sourcePath;
-    RenderBackend renderer = RenderBackend::Java;
-    {
-        std::lock_guard<std::mutex> lock(host->stateMutex);
-        sourcePath = host->sourceFilePath;
-        renderer = host->configuredRenderer;
+// Identical renders requested at the same time (two windows, or a window and
+// a prefetch) share one backend run, keyed like the caches.
+static puml::SingleFlight<RenderPipelineResult>* GetRenderFlights() {
+    static auto* flights = new puml::SingleFlight<RenderPipelineResult>();
+    return flights;
+}
+
+// Coalescing key: a window only ever needs its newest render.
+static std::string HostRenderKey(const Host* host) {
+    std::ostringstream os;
+    os << "host:" << static_cast<const void*>(host);
+    return os.str();
+}
+
+// Coalescing key of the window's background render in the other format.
+static std::string HostOtherFormatKey(const Host* host) {
+    return HostRenderKey(host) + ":other-format";
+}
+
+// The other format of the render shown, if it is ready. Caller holds stateMutex.
+static bool HostHasOtherFormatLocked(const Host* host) {
+    return host->hasOtherFormat && host->hasRenderedSource && IsJarBackend(host->activeRenderer) &&
+           host->otherFormatSourceHash == host->renderedSourceHash &&
+           host->otherFormatPreferSvg != host->renderedPreferSvg;
+}
+
+static void LogRenderSchedulerStats(const std::wstring& logContext) {
+    if (!LogEnabled()) return;
+    const puml::RenderSchedulerStats stats = GetRenderScheduler()->Stats();
+    std::wstringstream os;
+    os << logContext << L": scheduler submitted=" << stats.submitted
+       << L", completed=" << stats.completed
+       << L", coalesced=" << stats.coalesced
+       << L", cancelled=" << stats.cancelled
+       << L", queueDepth=" << stats.queueDepth
+       << L", maxQueueDepth=" << stats.maxQueueDepth;
+    for (size_t i = 0; i < puml::kRenderPriorityCount; ++i) {
+        if (!stats.startedByPriority[i]) continue;
+        os << L"; " << FromUtf8(puml::RenderPriorityName(static_cast<puml::RenderPriority>(i)))
+           << L" waitAvgMs=" << stats.waitMsTotal[i] / stats.startedByPriority[i]
+           << L", waitMaxMs=" << stats.waitMsMax[i];
     }
+    const puml::ConcurrencyLimiterStats slots = GetRenderLimiter()->Stats();
+    os << L"; render slots limit=" << GetRenderLimiter()->Limit()
+       << L", running=" << slots.running
+       << L", maxRunning=" << slots.maxRunning
+       << L", waited=" << slots.waited << L"/" << slots.admitted
+       << L", waitMaxMs=" << slots.waitMsMax;
+    const puml::BufferPoolStats buffers = puml::BufferPool::Shared().Stats();
+    os << L"; buffer pool reused=" << buffers.reused << L"/" << buffers.acquired
+       << L", discarded=" << buffers.discarded
+       << L", pooledBytes=" << buffers.pooledBytes
+       << L", maxPooledBytes=" << buffers.maxPooledBytes;
+    AppendLog(os.str());
+}
 
-    if (sourcePath.empty()) {
-        AppendLog(logContext + L": no source path recorded");
-        {
-            std::lock_guard<std::mutex> lock(host->stateMutex);
-            host->lastPreferSvg = preferSvg;
-        }
-        if (showDialogOnFailure && host->hwnd) {
-            MessageBoxW(host->hwnd,
-                        L"Unable to render because the original file path is unknown.",
-                        L"PlantUML Viewer",
-                        MB_OK | MB_ICONERROR);
+// Cache lookup first, then the backend; fresh results are stored in the caches.
+static RenderPipelineResult RenderThroughCaches(RenderBackend renderer,
+                                                std::string_view text,
+                                                const std::wstring& sourcePath,
+                                                bool preferSvg,
+                                                const std::string& cacheKey,
+                                                const RenderProgress* progress,
+                                                const puml::CancellationToken& cancel,
+                                                RenderCacheHit* outHit) {
+    RenderPipelineResult result;
+    const RenderCacheHit hit = TryLoadCachedRender(cacheKey, preferSvg, result);
+    if (outHit) *outHit = hit;
+    if (hit == RenderCacheHit::None) {
+        // Scratch for the render's temporaries, all given back when it is done.
+        puml::RenderArena arena;
+        puml::RenderArenaScope arenaScope(&arena);
+        result = ExecuteRenderBackend(renderer, text, sourcePath, preferSvg, progress, &cancel);
+        if (!cancel.IsCancelled()) {
+            StoreCachedRender(cacheKey, preferSvg, result);
         }
-        return false;
     }
+    return result;
+}
 
-    AppendLog(logContext + L": reloading file " + sourcePath);
-    const std::wstring text = ReadFileUtf16OrAnsi(sourcePath.c_str());
-    AppendLog(logContext + L": file characters=" + std::to_wstring(text.size()));
+// ---------------------- Multi-diagram files ----------------------
+// Every @start ... @end block of a file, and every "newpage" page of a block,
+// is rendered on its own: in parallel on the diagram workers and the daemon
+// pool, each image cached under its own key, so that editing one diagram of
+// a file only re-renders that diagram.
 
-    RenderPipelineResult renderResult = ExecuteRenderBackend(renderer,
-                                                             text,
-                                                             sourcePath,
-                                                             preferSvg);
+static puml::WorkerPool* GetDiagramWorkers() {
+    static auto* pool = new puml::WorkerPool(g_diagramThreads, "DiagramWorkers");
+    return pool;
+}
 
-    std::wstring htmlToNavigate;
+// Identifies one image by the content of its block and of the files the
+// block includes, its page and the format.
+static std::string DiagramImageId(const std::string& blockSource, uint64_t dependencyHash,
+                                  size_t imageIndex, bool preferSvg) {
+    return puml::HashToHex(puml::Hash64(blockSource.data(), blockSource.size(), dependencyHash)) +
+           (preferSvg ? ":svg:" : ":png:") + std::to_string(imageIndex);
+}
 
-    if (renderResult.success) {
-        std::wstringstream os;
-        os << logContext << L": render succeeded via " << RenderBackendName(renderResult.backend);
-        AppendLog(os.str());
-        {
-            std::lock_guard<std::mutex> lock(host->stateMutex);
-            host->configuredRenderer = renderer;
-            host->initialHtml = renderResult.html;
-            host->lastPreferSvg = preferSvg;
-            host->activeRenderer = renderResult.backend;
-            host->firstErrorMessage.clear();
-            if (renderResult.backend == RenderBackend::Java) {
-                host->lastSvg = renderResult.svg;
-                host->lastPng = renderResult.png;
-                host->hasRender = preferSvg ? !host->lastSvg.empty() : !host->lastPng.empty();
-            } else {
-                host->lastSvg.clear();
-                host->lastPng.clear();
-                host->hasRender = false;
-            }
-            htmlToNavigate = host->initialHtml;
+static RenderPipelineResult RenderDiagramImage(RenderBackend backend,
+                                               const std::string& blockSource,
+                                               const std::wstring& sourcePath,
+                                               size_t imageIndex,
+                                               bool preferSvg,
+                                               uint64_t dependencyHash,
+                                               const puml::CancellationToken* cancel) {
+    RenderPipelineResult result;
+    result.backend = backend;
+    const std::string cacheKey = BuildRenderCacheKey(backend, blockSource, preferSvg, dependencyHash, imageIndex);
+    if (TryLoadCachedRender(cacheKey, preferSvg, result) != RenderCacheHit::None) {
+        return result;
+    }
+    if (puml::IsCancelled(cancel)) {
+        result.errorMessage = L"Rendering was cancelled.";
+        return result;
+    }
+    std::string svg;
+    std::vector<unsigned char> png;
+    if (!RunPlantUmlJar(backend, blockSource, sourcePath, preferSvg, svg, png, imageIndex, cancel)) {
+        result.errorMessage = L"Local Java/JAR rendering failed. Check Java installation and plantuml.jar path in the INI file.";
+        return result;
+    }
+    result.svg = puml::MakeArtifact(puml::ArtifactFormat::Svg, std::move(svg));
+    result.png = puml::MakeArtifact(puml::ArtifactFormat::Png, std::move(png));
+    result.success = true;
+    if (!puml::IsCancelled(cancel)) {
+        StoreCachedRender(cacheKey, preferSvg, result);
+    }
+    return result;
+}
+
+static RenderPipelineResult RenderDiagramImages(RenderBackend backend,
+                                                std::string_view text,
+                                                const std::pmr::vector<puml::DiagramBlock>& blocks,
+                                                const std::wstring& sourcePath,
+                                                bool preferSvg,
+                                                const RenderProgress* progress,
+                                                const puml::CancellationToken* cancel) {
+    struct Image {
+        const puml::DiagramBlock* block;
+        const std::string* source;   // the block on its own, as rendered and hashed
+        size_t index;
+        uint64_t dependencyHash;
+        std::string id;
+    };
+    std::pmr::memory_resource* arena = puml::CurrentRenderArena();
+    std::pmr::vector<std::string> blockSources(blocks.size(), arena);
+    std::pmr::vector<Image> images(arena);
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        const puml::DiagramBlock& block = blocks[b];
+        std::string& blockSource = blockSources[b];
+        puml::AppendBlockText(blockSource, text, block);
+        // A block only depends on what it includes itself, so editing a
+        // shared file re-renders just the diagrams that use it.
+        const uint64_t dependencyHash = ScanSourceDependencies(blockSource, sourcePath).combinedHash;
+        for (size_t page = 0; page < block.pages; ++page) {
+            images.push_back({&block, &blockSource, page, dependencyHash,
+                              DiagramImageId(blockSource, dependencyHash, page, preferSvg)});
         }
-    } else {
-        std::wstring dialogMessage = failureDialogMessage.empty()
-            ? std::wstring(L"Unable to render the diagram. Check the log for details.")
-            : failureDialogMessage;
-        if (!renderResult.errorMessage.empty()) {
-            dialogMessage = renderResult.errorMessage;
+    }
+
+    const auto started = std::chrono::steady_clock::now();
+    std::wstringstream os;
+    os << L"RenderDiagramImages: " << blocks.size() << L" diagram(s), " << images.size()
+       << L" image(s) on " << GetDiagramWorkers()->ThreadCount() << L" worker(s)";
+    AppendLog(os.str());
+
+    if (progress && progress->started) {
+        std::string slots;
+        for (size_t i = 0; i < images.size(); ++i) {
+            puml::AppendDiagramSlotMarkup(slots, i, "<div class=\"pending\">Rendering diagram " + std::to_string(i + 1) +
+                                              " of " + std::to_string(images.size()) + "...</div>");
         }
-        AppendLog(logContext + L": render failed -> " + dialogMessage);
-        {
-            std::lock_guard<std::mutex> lock(host->stateMutex);
-            host->initialHtml = BuildErrorHtml(dialogMessage, preferSvg);
-            host->lastSvg.clear();
-            host->lastPng.clear();
-            host->lastPreferSvg = preferSvg;
-            host->hasRender = false;
-            host->activeRenderer = renderer;
-            host->configuredRenderer = renderer;
-            host->firstErrorMessage = dialogMessage;
-            htmlToNavigate = host->initialHtml;
+        progress->started(images.size(), BuildShellHtmlWithBody(slots, preferSvg));
+    }
+
+    // Submitted in source order, so the first diagram is also the first to start.
+    std::pmr::vector<std::shared_ptr<const RenderPipelineResult>> results(images.size(), arena);
+    std::pmr::vector<std::string> markup(images.size(), arena);
+    std::mutex mutex;
+    std::condition_variable allDone;
+    size_t remaining = images.size();
+    size_t reused = 0;
+    long long firstImageMs = -1;
+    for (size_t i = 0; i < images.size(); ++i) {
+        auto renderOne = [&, i](std::shared_ptr<const RenderPipelineResult> previous) {
+            const Image& image = images[i];
+            results[i] = previous ? std::move(previous)
+                                  : std::make_shared<const RenderPipelineResult>(RenderDiagramImage(
+                                        backend, *image.source, sourcePath, image.index, preferSvg,
+                                        image.dependencyHash, cancel));
+            const RenderPipelineResult& result = *results[i];
+            markup[i] = result.success
+                ? BuildJavaArtifactMarkup(preferSvg, result.svg, result.png)
+                : "<div class=\"err\">" + HtmlEscape(ToUtf8(result.errorMessage)) + " (diagram at line " +
+                      std::to_string(image.block->firstLine) + ")</div>";
+            if (progress && progress->imageReady && !puml::IsCancelled(cancel)) {
+                progress->imageReady(i, image.id, markup[i]);
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            if (result.success && progress && progress->renderedImages) {
+                (*progress->renderedImages)[image.id] = results[i];
+            }
+            if (firstImageMs < 0) {
+                firstImageMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - started).count();
+            }
+            if (--remaining == 0) {
+                allDone.notify_all();
+            }
+        };
+        if (progress && progress->previousImages) {
+            const auto found = progress->previousImages->find(images[i].id);
+            if (found != progress->previousImages->end()) {
+                ++reused;
+                renderOne(found->second);
+                continue;
+            }
         }
-        if (showDialogOnFailure && host->hwnd) {
-            MessageBoxW(host->hwnd, dialogMessage.c_str(), L"PlantUML Viewer", MB_OK | MB_ICONERROR);
+        const puml::RenderPriority priority = puml::CurrentRenderPriority();
+        if (!GetDiagramWorkers()->Submit([renderOne, priority, arena]() {
+                puml::RenderPriorityScope scope(priority);
+                puml::RenderArenaScope arenaScope(arena);
+                renderOne(nullptr);
+            })) {
+            renderOne(nullptr);
         }
     }
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        allDone.wait(lock, [&]() { return remaining == 0; });
+    }
 
-    if (host->web && !htmlToNavigate.empty()) {
-        host->web->NavigateToString(htmlToNavigate.c_str());
+    RenderPipelineResult combined;
+    combined.backend = backend;
+    std::string body;
+    std::string svg;
+    std::vector<unsigned char> png;
+    size_t failed = 0;
+    size_t bodySize = 0;
+    for (const std::string& content : markup) {
+        bodySize += content.size() + 64;
+    }
+    body.reserve(bodySize);
+    for (size_t i = 0; i < images.size(); ++i) {
+        puml::AppendDiagramSlotMarkup(body, i, markup[i]);
+        const RenderPipelineResult& result = *results[i];
+        if (!result.success) {
+            if (combined.errorMessage.empty()) combined.errorMessage = result.errorMessage;
+            ++failed;
+            continue;
+        }
+        svg += puml::ArtifactView(result.svg);
+        if (result.png) {
+            png.insert(png.end(), result.png->Data(), result.png->Data() + result.png->Size());
+        }
+    }
+    combined.success = failed < images.size();
+    combined.partial = combined.success && failed > 0;
+    if (combined.success) {
+        combined.html = puml::MakeArtifact(puml::ArtifactFormat::Html, BuildShellHtmlWithBody(body, preferSvg));
+        combined.svg = puml::MakeArtifact(puml::ArtifactFormat::Svg, std::move(svg));
+        combined.png = puml::MakeArtifact(puml::ArtifactFormat::Png, std::move(png));
     }
 
-    return renderResult.success;
+    std::wstringstream done;
+    done << L"RenderDiagramImages: " << (images.size() - failed) << L"/" << images.size()
+         << L" image(s) ready (" << reused << L" reused) in "
+         << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count()
+         << L" ms, first after " << firstImageMs << L" ms";
+    AppendLog(done.str());
+    return combined;
 }
 
-static void HostHandleSaveAs(Host* host) {
-    if (!host) return;
+// ---------------------- Prefetch ----------------------
+// While a diagram is viewed, its neighbors in the folder (by name, limited to
+// the detect-string extensions) are rendered at speculative priority so the
+// next cursor move in quick view is a cache hit.
+struct PrefetchStats {
+    uint64_t planned = 0;         // neighbor renders queued
+    uint64_t rendered = 0;        // rendered into the caches
+    uint64_t alreadyCached = 0;
+    uint64_t cancelled = 0;       // dropped because the user left the folder
+    uint64_t used = 0;            // later served a Lister window
+};
+
+static std::mutex                             g_prefetchMutex;
+static std::wstring                           g_prefetchFolder;   // lower-case, with trailing separator
+static std::vector<puml::CancellationTokenPtr> g_prefetchTokens;  // work queued for g_prefetchFolder
+static std::unordered_set<std::wstring>       g_prefetchQueued;   // lower-case paths queued for g_prefetchFolder
+static std::unordered_set<std::string>        g_prefetchedKeys;   // started by prefetch, not yet viewed
+static PrefetchStats                          g_prefetchStats;
+
+static void LogPrefetchStats(const std::wstring& logContext) {
+    if (!LogEnabled()) return;
+    PrefetchStats stats;
+    {
+        std::lock_guard<std::mutex> lock(g_prefetchMutex);
+        stats = g_prefetchStats;
+    }
+    std::wstringstream os;
+    os << logContext << L": prefetch planned=" << stats.planned
+       << L", rendered=" << stats.rendered
+       << L", alreadyCached=" << stats.alreadyCached
+       << L", cancelled=" << stats.cancelled
+       << L", used=" << stats.used;
+    AppendLog(os.str());
+}
+
+static void NotePrefetchUse(const std::string& cacheKey, const std::wstring& logContext) {
+    {
+        std::lock_guard<std::mutex> lock(g_prefetchMutex);
+        if (g_prefetchedKeys.erase(cacheKey) == 0) {
+            return;
+        }
+        ++g_prefetchStats.used;
+    }
+    LogPrefetchStats(logContext + L": served by prefetch");
+}
+
+static std::wstring DirectoryOfPath(const std::wstring& path) {
+    const size_t slash = path.find_last_of(L"\\/");
+    return slash == std::wstring::npos ? std::wstring() : path.substr(0, slash + 1);
+}
+
+// Extensions listed as EXT="..." in the detect string, lower-case with a dot.
+static std::vector<std::wstring> GetDetectStringExtensions() {
+    std::vector<std::wstring> extensions;
+    const std::wstring detect = ToLowerTrim(FromUtf8(g_detectA));
+    size_t pos = 0;
+    while ((pos = detect.find(L"ext=\"", pos)) != std::wstring::npos) {
+        pos += 5;
+        const size_t end = detect.find(L'"', pos);
+        if (end == std::wstring::npos) break;
+        extensions.push_back(L"." + detect.substr(pos, end - pos));
+        pos = end + 1;
+    }
+    return extensions;
+}
+
+// The files after and before sourcePath in name order, nearest first.
+static std::vector<std::wstring> FindPrefetchNeighbors(const std::wstring& sourcePath, size_t depth) {
+    std::vector<std::wstring> neighbors;
+    const std::wstring dir = DirectoryOfPath(sourcePath);
+    if (dir.empty() || depth == 0) {
+        return neighbors;
+    }
+    const std::vector<std::wstring> extensions = GetDetectStringExtensions();
+    const std::wstring self = ToLowerTrim(sourcePath.substr(dir.size()));
+
+    std::vector<std::wstring> names;
+    WIN32_FIND_DATAW fd{};
+    HANDLE hFind = FindFirstFileExW((dir + L"*").c_str(), FindExInfoBasic, &fd,
+                                   FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+    if (hFind == INVALID_HANDLE_VALUE) {
+        return neighbors;
+    }
+    do {
+        if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+        const std::wstring ext = ToLowerTrim(PathFindExtensionW(fd.cFileName));
+        if (std::find(extensions.begin(), extensions.end(), ext) != extensions.end()) {
+            names.push_back(fd.cFileName);
+        }
+    } while (FindNextFileW(hFind, &fd));
+    FindClose(hFind);
+
+    std::sort(names.begin(), names.end(), [](const std::wstring& a, const std::wstring& b) {
+        return lstrcmpiW(a.c_str(), b.c_str()) < 0;
+    });
+    auto selfIt = std::find_if(names.begin(), names.end(),
+                               [&](const std::wstring& name) { return ToLowerTrim(name) == self; });
+    if (selfIt == names.end()) {
+        return neighbors;
+    }
+    const size_t index = static_cast<size_t>(selfIt - names.begin());
+    for (size_t step = 1; step <= depth; ++step) {
+        if (index + step < names.size()) neighbors.push_back(dir + names[index + step]);
+        if (index >= step) neighbors.push_back(dir + names[index - step]);
+    }
+    return neighbors;
+}
+
+static void RunPrefetchRender(RenderBackend renderer,
+                              const std::wstring& path,
+                              bool preferSvg,
+                              const puml::CancellationToken& cancel) {
+    if (cancel.IsCancelled()) {
+        std::lock_guard<std::mutex> lock(g_prefetchMutex);
+        ++g_prefetchStats.cancelled;
+        return;
+    }
+
+    SourceText source;
+    if (!ReadSourceText(path, source)) {
+        return;
+    }
+    std::string_view sourceUtf8 = source.Utf8();
+    const std::string cacheKey = BuildRenderCacheKey(renderer, sourceUtf8, preferSvg,
+                                                     ScanSourceDependencies(sourceUtf8, path).combinedHash);
+    if (cacheKey.empty()) {
+        return;
+    }
+    if (IsRenderCached(cacheKey, preferSvg)) {
+        std::lock_guard<std::mutex> lock(g_prefetchMutex);
+        ++g_prefetchStats.alreadyCached;
+        return;
+    }
+    source.ReleaseMapping();
+    sourceUtf8 = source.Utf8();
+
+    AppendLog(L"Prefetch: rendering " + path);
+    {
+        // Recorded up front so a window joining this render counts as a use.
+        std::lock_guard<std::mutex> lock(g_prefetchMutex);
+        g_prefetchedKeys.insert(cacheKey);
+    }
+    RenderPipelineResult result;
+    const bool finished = GetRenderFlights()->Do(cacheKey, &cancel,
+        [&](const puml::CancellationToken& renderCancel) {
+            return RenderThroughCaches(renderer, sourceUtf8, path, preferSvg, cacheKey, nullptr, renderCancel, nullptr);
+        },
+        result);
+
+    std::lock_guard<std::mutex> lock(g_prefetchMutex);
+    if (!finished || cancel.IsCancelled()) {
+        g_prefetchedKeys.erase(cacheKey);
+        ++g_prefetchStats.cancelled;
+    } else if (!result.success) {
+        g_prefetchedKeys.erase(cacheKey);
+    } else {
+        ++g_prefetchStats.rendered;
+    }
+}
+
+static void PlanPrefetch(RenderBackend renderer,
+                         const std::wstring& sourcePath,
+                         const std::wstring& folder,
+                         bool preferSvg,
+                         const puml::CancellationToken& cancel) {
+    if (cancel.IsCancelled()) {
+        return;
+    }
+    for (const std::wstring& path : FindPrefetchNeighbors(sourcePath, g_prefetchDepth)) {
+        {
+            std::lock_guard<std::mutex> lock(g_prefetchMutex);
+            if (cancel.IsCancelled() || folder != g_prefetchFolder) return;
+            if (!g_prefetchQueued.insert(ToLowerTrim(path)).second) continue;
+            ++g_prefetchStats.planned;
+        }
+        puml::CancellationTokenPtr token = GetRenderScheduler()->Submit(
+            puml::RenderPriority::Speculative, std::string(),
+            [renderer, path, preferSvg](const puml::CancellationToken& renderCancel) {
+                RunPrefetchRender(renderer, path, preferSvg, renderCancel);
+            });
+        std::lock_guard<std::mutex> lock(g_prefetchMutex);
+        if (folder == g_prefetchFolder) {
+            g_prefetchTokens.push_back(token);
+        } else {
+            token->Cancel();
+        }
+    }
+}
+
+// Called for every file Lister opens. Leaving the folder cancels everything
+// queued for the previous one; the directory is listed on a scheduler thread.
+static void SchedulePrefetch(const std::wstring& sourcePath, RenderBackend renderer, bool preferSvg) {
+    if (g_prefetchDepth == 0 || !IsJarBackend(renderer) || (!g_cacheEnabled && g_memoryCacheMb == 0)) {
+        return;
+    }
+    const std::wstring folder = ToLowerTrim(DirectoryOfPath(sourcePath));
+    if (folder.empty()) {
+        return;
+    }
+    std::vector<puml::CancellationTokenPtr> abandoned;
+    {
+        std::lock_guard<std::mutex> lock(g_prefetchMutex);
+        if (folder != g_prefetchFolder) {
+            abandoned.swap(g_prefetchTokens);
+            g_prefetchQueued.clear();
+            g_prefetchFolder = folder;
+        }
+    }
+    for (const puml::CancellationTokenPtr& token : abandoned) {
+        token->Cancel();
+    }
+    if (!abandoned.empty()) {
+        AppendLog(L"Prefetch: folder changed, cancelled " + std::to_wstring(abandoned.size()) + L" queued prefetch task(s)");
+    }
+
+    puml::CancellationTokenPtr token = GetRenderScheduler()->Submit(
+        puml::RenderPriority::Speculative, std::string(),
+        [renderer, sourcePath, folder, preferSvg](const puml::CancellationToken& cancel) {
+            PlanPrefetch(renderer, sourcePath, folder, preferSvg, cancel);
+        });
+    std::lock_guard<std::mutex> lock(g_prefetchMutex);
+    g_prefetchTokens.push_back(token);
+}
+
+// Render thread: hand a progress step of a multi-diagram render to the window.
+static void HostPostRenderProgress(Host* host, RenderProgressUpdate update) {
+    HWND hwnd = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(host->stateMutex);
+        if (host->closing.load(std::memory_order_acquire) || !host->hwnd) {
+            return;
+        }
+        host->pendingProgress.push_back(std::move(update));
+        hwnd = host->hwnd;
+    }
+    PostMessageW(hwnd, kMsgRenderProgress, 0, 0);
+}
+
+// The source placeholder shows at most this much of the file.
+static const size_t kSourcePreviewBytes = 64 * 1024;
+
+// Scheduler thread, before a render that has to run (stale-while-revalidate):
+// the page stays up, marked as outdated, until the render lands. Unless the
+// window shows the file in this format already, the last render of it is
+// posted to be shown instead, or the start of its source text if it was
+// never rendered. Done here, not on the window thread: the cache lookups
+// read files.
+static void PostStalePreview(Host* host, const RenderJob& job, std::string_view sourceUtf8) {
+    RenderProgressUpdate update;
+    update.kind = RenderProgressUpdate::Kind::Stale;
+    update.generation = job.generation;
+    update.stale = true;
+    update.preferSvg = job.preferSvg;
+    bool showingRender = false;
+    bool showingFormat = false;
+    {
+        std::lock_guard<std::mutex> lock(host->stateMutex);
+        showingRender = host->hasRenderedSource;
+        showingFormat = showingRender && host->renderedPreferSvg == job.preferSvg;
+    }
+    RenderPipelineResult last;
+    if (!showingFormat && TryLoadLastRender(job.sourcePath, job.preferSvg, last)) {
+        AppendLog(job.logContext, L": showing the last render until the new one is ready");
+        update.kind = RenderProgressUpdate::Kind::Preview;
+        update.html = MarkShellHtmlStale(std::string(puml::ArtifactView(last.html)));
+    } else if (!showingRender && !sourceUtf8.empty()) {
+        // Not over the diagram in the other format, which beats its source text.
+        AppendLog(job.logContext, L": showing the source until the diagram is rendered");
+        std::string_view shown = sourceUtf8.substr(0, kSourcePreviewBytes);
+        while (shown.size() < sourceUtf8.size() && !shown.empty() &&
+               (static_cast<unsigned char>(sourceUtf8[shown.size()]) & 0xC0) == 0x80) {
+            shown.remove_suffix(1);   // not inside a UTF-8 sequence
+        }
+        std::string body = "<pre class=\"source\">" + HtmlEscape(shown);
+        if (shown.size() < sourceUtf8.size()) {
+            body += "\n\xE2\x80\xA6";
+        }
+        body += "</pre>";
+        update.kind = RenderProgressUpdate::Kind::Preview;
+        update.html = MarkShellHtmlStale(BuildShellHtmlWithBody(body, job.preferSvg));
+    }
+    HostPostRenderProgress(host, std::move(update));
+}
+
+// Scheduler thread, at speculative priority: render what the window shows in
+// the other format and keep it with the window. Dropped once a newer render
+// of the window has been requested.
+static void RunOtherFormatRender(Host* host,
+                                 RenderBackend renderer,
+                                 std::string_view text,
+                                 const std::wstring& sourcePath,
+                                 bool preferSvg,
+                                 uint64_t sourceHash,
+                                 uint64_t dependencyHash,
+                                 uint64_t generation,
+                                 const std::wstring& logContext,
+                                 const puml::CancellationToken& cancel) {
+    {
+        std::lock_guard<std::mutex> lock(host->stateMutex);
+        if (cancel.IsCancelled() || host->renderGeneration != generation) {
+            return;
+        }
+        if (host->hasOtherFormat && host->otherFormatSourceHash == sourceHash &&
+            host->otherFormatPreferSvg == preferSvg) {
+            return;
+        }
+    }
+
+    const std::string cacheKey = BuildRenderCacheKey(renderer, text, preferSvg, dependencyHash);
+    auto render = [&](const puml::CancellationToken& renderCancel) {
+        return RenderThroughCaches(renderer, text, sourcePath, preferSvg, cacheKey, nullptr, renderCancel, nullptr);
+    };
+    RenderPipelineResult result;
+    if (cacheKey.empty()) {
+        result = render(cancel);
+    } else if (!GetRenderFlights()->Do(cacheKey, &cancel, render, result)) {
+        return;
+    }
+    if (cancel.IsCancelled() || !result.success || result.partial) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(host->stateMutex);
+    if (host->closing.load(std::memory_order_acquire) || host->renderGeneration != generation) {
+        return;
+    }
+    host->otherFormat = std::move(result);
+    host->otherFormatPreferSvg = preferSvg;
+    host->otherFormatSourceHash = sourceHash;
+    host->hasOtherFormat = true;
+    AppendLog(logContext, L": ", preferSvg ? L"SVG" : L"PNG", L" ready for a format switch");
+}
+
+static void ScheduleOtherFormatRender(Host* host, const RenderJob& job, std::string_view sourceUtf8,
+                                      uint64_t dependencyHash) {
+    if (!g_otherFormat || !IsJarBackend(job.renderer)) {
+        return;
+    }
+    // Runs after the job, whose source text is gone by then.
+    const std::string text(sourceUtf8);
+    HostAddRef(host);
+    std::shared_ptr<Host> hostRef(host, &HostRelease);
+    const bool preferSvg = !job.preferSvg;
+    const std::wstring sourcePath = job.sourcePath;
+    const std::wstring logContext = job.logContext;
+    const uint64_t sourceHash = job.sourceHash;
+    const uint64_t generation = job.generation;
+    const RenderBackend renderer = job.renderer;
+    GetRenderScheduler()->Submit(puml::RenderPriority::Speculative, HostOtherFormatKey(host),
+        [=](const puml::CancellationToken& cancel) {
+            RunOtherFormatRender(hostRef.get(), renderer, text, sourcePath, preferSvg, sourceHash, dependencyHash,
+                                 generation, logContext, cancel);
+        });
+}
+
+// Scheduler thread: read, render (or load from cache) and post the result back.
+static void RunRenderJob(Host* host, const std::shared_ptr<RenderJob>& job, const puml::CancellationToken& cancel) {
+    if (cancel.IsCancelled()) {
+        return;
+    }
+    AppendLog(job->logContext, L": reloading file ", job->sourcePath);
+    SourceText source;
+    ReadSourceText(job->sourcePath, source);
+    std::string_view sourceUtf8 = source.Utf8();
+    if (LogEnabled()) {
+        AppendLog(job->logContext, L": file bytes=", std::to_wstring(sourceUtf8.size()), L", ",
+                  FromUtf8(puml::SourceEncodingName(source.encoding)), source.mapped ? L", mapped" : L"");
+    }
+
+    const puml::DependencyGraph dependencies = ScanSourceDependencies(sourceUtf8, job->sourcePath);
+    if (!dependencies.files.empty()) {
+        AppendLog(job->logContext, L": ", std::to_wstring(dependencies.files.size()), L" included file(s)",
+                  dependencies.truncated ? L", more not scanned" : L"");
+    }
+    job->sourceHash = puml::Hash64(sourceUtf8.data(), sourceUtf8.size(), dependencies.combinedHash);
+    if (g_autoRefresh) {
+        job->watchPaths.push_back(ToUtf8(job->sourcePath));
+        for (const puml::DependencyFile& file : dependencies.files) {
+            job->watchPaths.push_back(file.path);
+        }
+    }
+    RenderProgress progress;
+    bool unchanged = false;
+    {
+        std::lock_guard<std::mutex> lock(host->stateMutex);
+        unchanged = job->onlyIfChanged && host->hasRenderedSource && host->renderedSourceHash == job->sourceHash &&
+                    host->renderedPreferSvg == job->preferSvg;
+        progress.previousImages = host->lastImages;
+    }
+    if (unchanged) {
+        AppendLog(job->logContext, L": source unchanged, nothing to render");
+        // Clears the badge a superseded render may have set.
+        RenderProgressUpdate update;
+        update.kind = RenderProgressUpdate::Kind::Stale;
+        update.generation = job->generation;
+        HostPostRenderProgress(host, std::move(update));
+        ScheduleOtherFormatRender(host, *job, sourceUtf8, dependencies.combinedHash);
+        return;
+    }
+    progress.renderedImages = std::make_shared<DiagramImageSet>();
+
+    const std::string cacheKey =
+        BuildRenderCacheKey(job->renderer, sourceUtf8, job->preferSvg, dependencies.combinedHash);
+    const bool cached = IsRenderCached(cacheKey, job->preferSvg);
+    if (!cached) {
+        source.ReleaseMapping();
+        sourceUtf8 = source.Utf8();
+    }
+    if (IsJarBackend(job->renderer) && !cached) {
+        PostStalePreview(host, *job, sourceUtf8);
+    }
+    RenderCacheHit cacheHit = RenderCacheHit::None;
+    progress.started = [&](size_t imageCount, std::string pageHtml) {
+        RenderProgressUpdate update;
+        update.generation = job->generation;
+        update.kind = RenderProgressUpdate::Kind::Page;
+        update.index = imageCount;
+        update.html = std::move(pageHtml);
+        HostPostRenderProgress(host, std::move(update));
+    };
+    progress.imageReady = [&](size_t index, const std::string& imageId, std::string markup) {
+        RenderProgressUpdate update;
+        update.generation = job->generation;
+        update.index = index;
+        update.imageId = imageId;
+        update.html = std::move(markup);
+        HostPostRenderProgress(host, std::move(update));
+    };
+    auto render = [&](const puml::CancellationToken& renderCancel) {
+        return RenderThroughCaches(job->renderer, sourceUtf8, job->sourcePath, job->preferSvg,
+                                   cacheKey, &progress, renderCancel, &cacheHit);
+    };
+
+    bool joined = false;
+    if (cacheKey.empty()) {
+        job->result = render(cancel);
+    } else if (GetRenderFlights()->Do(cacheKey, &cancel, render, job->result, &joined) && joined) {
+        const puml::SingleFlightStats flights = GetRenderFlights()->Stats();
+        AppendLog(job->logContext, L": joined an identical render already in flight (executed=",
+                  std::to_wstring(flights.executed), L", joined=", std::to_wstring(flights.joined),
+                  L", abandoned=", std::to_wstring(flights.abandoned), L")");
+    } else if (!cancel.IsCancelled()) {
+        LogRenderCacheStats(job->logContext, cacheHit);
+    }
+    if (joined || cacheHit != RenderCacheHit::None) {
+        NotePrefetchUse(cacheKey, job->logContext);
+    }
+    LogRenderSchedulerStats(job->logContext);
+    if (cancel.IsCancelled()) {
+        AppendLog(job->logContext, L": render cancelled (generation ", std::to_wstring(job->generation), L")");
+        return;
+    }
+    if (!progress.renderedImages->empty()) {
+        job->images = progress.renderedImages;
+    }
+    if (job->result.success && !job->result.partial) {
+        RememberLastRender(job->sourcePath, job->preferSvg, cacheKey);
+        ScheduleOtherFormatRender(host, *job, sourceUtf8, dependencies.combinedHash);
+    }
+
+    HWND hwnd = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(host->stateMutex);
+        if (host->closing.load(std::memory_order_acquire) || !host->hwnd) {
+            AppendLog(job->logContext, L": window closed before render completed");
+            return;
+        }
+        host->completedRenders.push_back(job);
+        hwnd = host->hwnd;
+    }
+    PostMessageW(hwnd, kMsgRenderCompleted, 0, 0);
+}
+
+// Window thread: publish a finished render to the host and the WebView.
+static void HostApplyRenderResult(Host* host, RenderJob& job) {
+    const RenderPipelineResult& renderResult = job.result;
+    puml::ArtifactPtr htmlToNavigate;
+
+    // The includes may have changed with the source; a failed render is
+    // watched too, the fix may be in an included file.
+    HostWatchFiles(host, job.watchPaths, job.logContext);
+
+    // The page on screen already shows every image of this render, posted
+    // one by one; navigating again would only flicker and lose the scroll
+    // position.
+    const bool progressShown = host->progressGeneration == job.generation && host->pendingSlotPage.empty();
+    const bool pageComplete = progressShown && host->pageLoaded && renderResult.success;
+    host->progressGeneration = 0;
+    host->pendingSlotPage.clear();
+
+    if (renderResult.success) {
+        AppendLog(job.logContext, L": render succeeded via ",
+                  renderResult.servedByServer ? L"web" : RenderBackendName(renderResult.backend));
+        {
+            std::lock_guard<std::mutex> lock(host->stateMutex);
+            host->configuredRenderer = job.renderer;
+            host->initialHtml = renderResult.html;
+            host->lastPreferSvg = job.preferSvg;
+            host->activeRenderer = renderResult.backend;
+            host->firstErrorMessage.clear();
+            if (IsJarBackend(renderResult.backend)) {
+                host->lastSvg = renderResult.svg;
+                host->lastPng = renderResult.png;
+                host->hasRender = job.preferSvg ? host->lastSvg != nullptr : host->lastPng != nullptr;
+            } else {
+                host->lastSvg.reset();
+                host->lastPng.reset();
+                host->hasRender = false;
+            }
+            host->hasRenderedSource = true;
+            host->renderedSourceHash = job.sourceHash;
+            host->renderedPreferSvg = job.preferSvg;
+            host->shownGeneration = job.generation;
+            if (job.images) {
+                host->lastImages = job.images;
+            }
+            if (host->otherFormatSourceHash != job.sourceHash) {
+                host->hasOtherFormat = false;
+                host->otherFormat = RenderPipelineResult();
+            }
+            htmlToNavigate = host->initialHtml;
+        }
+    } else {
+        std::wstring dialogMessage = job.failureDialogMessage.empty()
+            ? std::wstring(L"Unable to render the diagram. Check the log for details.")
+            : job.failureDialogMessage;
+        if (!renderResult.errorMessage.empty()) {
+            dialogMessage = renderResult.errorMessage;
+        }
+        AppendLog(job.logContext, L": render failed -> ", dialogMessage);
+        puml::ArtifactPtr errorHtml =
+            puml::MakeArtifact(puml::ArtifactFormat::Html, BuildErrorHtml(dialogMessage, job.preferSvg));
+        {
+            std::lock_guard<std::mutex> lock(host->stateMutex);
+            host->initialHtml = std::move(errorHtml);
+            host->lastSvg.reset();
+            host->lastPng.reset();
+            host->lastPreferSvg = job.preferSvg;
+            host->hasRender = false;
+            host->activeRenderer = job.renderer;
+            host->configuredRenderer = job.renderer;
+            host->firstErrorMessage = dialogMessage;
+            host->hasRenderedSource = false;
+            host->shownGeneration = job.generation;
+            host->hasOtherFormat = false;
+            host->otherFormat = RenderPipelineResult();
+            htmlToNavigate = host->initialHtml;
+        }
+        if (job.showDialogOnFailure && host->hwnd) {
+            MessageBoxW(host->hwnd, dialogMessage.c_str(), L"PlantUML Viewer", MB_OK | MB_ICONERROR);
+        }
+    }
 
-    std::wstring svgCopy;
-    std::vector<unsigned char> pngCopy;
+    if (pageComplete) {
+        host->progressImages.clear();
+        host->progressImageIds.clear();
+        HostSetPageStale(host, false);
+        return;
+    }
+    host->pageStale = false;
+    // The final page of a split render has the same slots, already filled.
+    std::vector<std::string> imageIds;
+    if (renderResult.success && progressShown) {
+        imageIds.swap(host->progressImageIds);
+    }
+    host->progressImages.clear();
+    host->progressImageIds.clear();
+    host->pageImageIds = imageIds;
+    // Until the WebView exists, InitWebView navigates to initialHtml once ready.
+    if (host->web && htmlToNavigate) {
+        HostNavigate(host, htmlToNavigate->View(), imageIds);
+    }
+}
+
+static void HostDrainCompletedRenders(Host* host) {
+    std::vector<std::shared_ptr<RenderJob>> completed;
+    uint64_t latestGeneration = 0;
+    {
+        std::lock_guard<std::mutex> lock(host->stateMutex);
+        completed.swap(host->completedRenders);
+        latestGeneration = host->renderGeneration;
+    }
+    for (const std::shared_ptr<RenderJob>& job : completed) {
+        if (job->generation != latestGeneration) {
+            AppendLog(job->logContext, L": discarding result superseded by a newer request");
+            continue;
+        }
+        HostApplyRenderResult(host, *job);
+    }
+}
+
+// Sends one image into its slot, unless the page already shows that image.
+static void HostPostProgressImage(Host* host, size_t index) {
+    if (!host->web || !host->pageLoaded || index >= host->progressImages.size() ||
+        host->progressImages[index].empty()) {
+        return;
+    }
+    if (index < host->pageImageIds.size() && host->pageImageIds[index] == host->progressImageIds[index]) {
+        return;
+    }
+    const std::string json = "{\"type\":\"diagram\",\"index\":" + std::to_string(index) +
+                             ",\"html\":" + JsonQuote(host->progressImages[index]) + "}";
+    puml::PooledBuffer wide;
+    HRESULT hr = host->web->PostWebMessageAsJson(WidenToPooled(json, wide));
+    if (FAILED(hr)) {
+        AppendLog(L"HostPostProgressImage: PostWebMessageAsJson failed with HRESULT=" + std::to_wstring(hr));
+        return;
+    }
+    if (index < host->pageImageIds.size()) {
+        host->pageImageIds[index] = host->progressImageIds[index];
+    }
+}
+
+// Window thread: navigate to the empty slots of a multi-diagram render.
+static void HostShowSlotPage(Host* host, std::string html, size_t slots) {
+    AppendLog(L"HostDrainRenderProgress: showing " + std::to_wstring(slots) +
+              L" diagram slot(s) (generation " + std::to_wstring(host->progressGeneration) + L")");
+    host->pageStale = false;
+    host->pageImageIds.assign(slots, std::string());
+    puml::ArtifactPtr page = puml::MakeArtifact(puml::ArtifactFormat::Html, std::move(html));
+    {
+        std::lock_guard<std::mutex> lock(host->stateMutex);
+        host->initialHtml = page;
+    }
+    if (host->web) {
+        HostNavigate(host, puml::ArtifactView(page), host->pageImageIds);
+    }
+}
+
+// Window thread: show a preview posted by PostStalePreview, unless the page
+// already shows a render in that format, which is then only marked outdated.
+static void HostShowStalePreview(Host* host, std::string html, bool preferSvg) {
+    puml::ArtifactPtr page;
+    {
+        std::lock_guard<std::mutex> lock(host->stateMutex);
+        if (!host->hasRenderedSource || host->renderedPreferSvg != preferSvg) {
+            page = puml::MakeArtifact(puml::ArtifactFormat::Html, std::move(html));
+            host->initialHtml = page;
+        }
+    }
+    if (!page) {
+        HostSetPageStale(host, true);
+        return;
+    }
+    host->progressImages.clear();
+    host->progressImageIds.clear();
+    host->pendingSlotPage.clear();
+    host->pageImageIds.clear();
+    host->pageStale = true;
+    // Until the WebView exists, InitWebView navigates to initialHtml once ready.
+    if (host->web) {
+        HostNavigate(host, puml::ArtifactView(page), host->pageImageIds);
+    }
+}
+
+// Window thread: show the slot page of a multi-diagram render, then fill in
+// each image as it arrives. When the page on screen already has the same
+// slots (auto-refresh after an edit) it is kept, and only images that
+// changed are sent; an outdated page is kept until the first image is
+// ready. Images that arrive before a page has loaded are sent once it has
+// (HostReplayProgressImages).
+static void HostDrainRenderProgress(Host* host) {
+    std::vector<RenderProgressUpdate> updates;
+    uint64_t latestGeneration = 0;
+    {
+        std::lock_guard<std::mutex> lock(host->stateMutex);
+        updates.swap(host->pendingProgress);
+        latestGeneration = host->renderGeneration;
+    }
+    for (RenderProgressUpdate& update : updates) {
+        if (update.generation != latestGeneration) {
+            continue;
+        }
+        if (update.kind == RenderProgressUpdate::Kind::Stale) {
+            HostSetPageStale(host, update.stale);
+        } else if (update.kind == RenderProgressUpdate::Kind::Preview) {
+            HostShowStalePreview(host, std::move(update.html), update.preferSvg);
+        } else if (update.kind == RenderProgressUpdate::Kind::Page) {
+            host->progressGeneration = update.generation;
+            host->progressImages.assign(update.index, std::string());
+            host->progressImageIds.assign(update.index, std::string());
+            if (host->pageLoaded && host->pageImageIds.size() == update.index) {
+                AppendLog(L"HostDrainRenderProgress: updating " + std::to_wstring(update.index) +
+                          L" diagram slot(s) in place (generation " + std::to_wstring(update.generation) + L")");
+                continue;
+            }
+            if (host->pageStale) {
+                // Better the outdated diagrams than empty slots.
+                AppendLog(L"HostDrainRenderProgress: keeping the outdated page until the first of " +
+                          std::to_wstring(update.index) + L" diagram(s) is ready");
+                host->pendingSlotPage = std::move(update.html);
+                continue;
+            }
+            HostShowSlotPage(host, std::move(update.html), update.index);
+        } else if (update.generation == host->progressGeneration && update.index < host->progressImages.size()) {
+            if (!host->pendingSlotPage.empty()) {
+                std::string page = std::move(host->pendingSlotPage);
+                host->pendingSlotPage.clear();
+                HostShowSlotPage(host, std::move(page), host->progressImages.size());
+            }
+            host->progressImages[update.index] = std::move(update.html);
+            host->progressImageIds[update.index] = std::move(update.imageId);
+            HostPostProgressImage(host, update.index);
+        }
+    }
+}
+
+// Window thread, after a navigation succeeded: send the page its badge if it
+// is outdated, and every image rendered so far that it does not contain.
+// Posts to a page without slots are ignored by it.
+static void HostReplayProgressImages(Host* host) {
+    host->pageLoaded = true;
+    host->pageImageIds = host->navigatedImageIds;
+    if (host->pageStale) {
+        HostSetPageStale(host, true);
+    }
+    for (size_t i = 0; i < host->progressImages.size(); ++i) {
+        HostPostProgressImage(host, i);
+    }
+}
+
+// Queue a render of the host's source file, replacing any render of the same
+// host still queued or running. Returns immediately; the result is applied on
+// the window thread when the kMsgRenderCompleted message arrives. With
+// onlyIfChanged the render is skipped when the file content is the one shown.
+static void HostRenderAndReload(Host* host,
+                                puml::RenderPriority priority,
+                                bool preferSvg,
+                                const std::wstring& logContext,
+                                const std::wstring& failureDialogMessage,
+                                bool showDialogOnFailure,
+                                bool onlyIfChanged) {
+    if (!host) {
+        return;
+    }
+
+    auto job = std::make_shared<RenderJob>();
+    job->preferSvg = preferSvg;
+    job->logContext = logContext;
+    job->failureDialogMessage = failureDialogMessage;
+    job->showDialogOnFailure = showDialogOnFailure;
+    job->onlyIfChanged = onlyIfChanged;
+    {
+        std::lock_guard<std::mutex> lock(host->stateMutex);
+        job->sourcePath = host->sourceFilePath;
+        job->renderer = host->configuredRenderer;
+        if (!job->sourcePath.empty()) {
+            job->generation = ++host->renderGeneration;
+        } else {
+            host->lastPreferSvg = preferSvg;
+        }
+    }
+
+    if (job->sourcePath.empty()) {
+        AppendLog(logContext, L": no source path recorded");
+        if (showDialogOnFailure && host->hwnd) {
+            MessageBoxW(host->hwnd,
+                        L"Unable to render because the original file path is unknown.",
+                        L"PlantUML Viewer",
+                        MB_OK | MB_ICONERROR);
+        }
+        return;
+    }
+
+    // Made for the page being replaced; the new render schedules its own.
+    GetRenderScheduler()->CancelKey(HostOtherFormatKey(host));
+
+    // The reference is released when the task finishes or is dropped unrun.
+    HostAddRef(host);
+    std::shared_ptr<Host> hostRef(host, &HostRelease);
+    GetRenderScheduler()->Submit(priority, HostRenderKey(host),
+        [hostRef, job](const puml::CancellationToken& cancel) {
+            RunRenderJob(hostRef.get(), job, cancel);
+        });
+    if (LogEnabled()) {
+        AppendLog(logContext, L": render queued (generation ", std::to_wstring(job->generation),
+                  L", priority ", FromUtf8(puml::RenderPriorityName(priority)), L")");
+    }
+}
+
+static void HostHandleSaveAs(Host* host) {
+    if (!host) return;
+
+    puml::ArtifactPtr svg;
+    puml::ArtifactPtr png;
     std::wstring sourcePath;
     bool preferSvg = true;
     bool hasRender = false;
+    bool hasOther = false;
     {
         std::lock_guard<std::mutex> lock(host->stateMutex);
         hasRender = host->hasRender;
         preferSvg = host->lastPreferSvg;
-        svgCopy = host->lastSvg;
-        pngCopy = host->lastPng;
+        svg = host->lastSvg;
+        png = host->lastPng;
         sourcePath = host->sourceFilePath;
+        hasOther = hasRender && HostHasOtherFormatLocked(host) && host->otherFormatPreferSvg != preferSvg;
+        if (hasOther) {
+            if (preferSvg) {
+                png = host->otherFormat.png;
+            } else {
+                svg = host->otherFormat.svg;
+            }
+        }
     }
 
     if (!hasRender) {
@@ -1780,15 +4237,21 @@ static void HostHandleSaveAs(Host* host) {
     std::wstring fileBuf(MAX_PATH, L'\0');
     lstrcpynW(fileBuf.data(), suggestedName.c_str(), static_cast<int>(fileBuf.size()));
 
-    std::wstring filterSvg = L"Scalable Vector Graphics (*.svg)\0*.svg\0All Files (*.*)\0*.*\0\0";
-    std::wstring filterPng = L"Portable Network Graphics (*.png)\0*.png\0All Files (*.*)\0*.*\0\0";
+    // Literals, not std::wstring: the filters are lists of NUL-separated
+    // strings. With the other format at hand both are offered, the shown one first.
+    const wchar_t* filterSvg = hasOther
+        ? L"Scalable Vector Graphics (*.svg)\0*.svg\0Portable Network Graphics (*.png)\0*.png\0All Files (*.*)\0*.*\0\0"
+        : L"Scalable Vector Graphics (*.svg)\0*.svg\0All Files (*.*)\0*.*\0\0";
+    const wchar_t* filterPng = hasOther
+        ? L"Portable Network Graphics (*.png)\0*.png\0Scalable Vector Graphics (*.svg)\0*.svg\0All Files (*.*)\0*.*\0\0"
+        : L"Portable Network Graphics (*.png)\0*.png\0All Files (*.*)\0*.*\0\0";
 
     OPENFILENAMEW ofn{};
     ofn.lStructSize = sizeof(ofn);
     ofn.hwndOwner = host->hwnd;
     ofn.lpstrFile = fileBuf.data();
     ofn.nMaxFile = static_cast<DWORD>(fileBuf.size());
-    ofn.lpstrFilter = preferSvg ? filterSvg.c_str() : filterPng.c_str();
+    ofn.lpstrFilter = preferSvg ? filterSvg : filterPng;
     ofn.nFilterIndex = 1;
     ofn.Flags = OFN_OVERWRITEPROMPT | OFN_PATHMUSTEXIST;
     ofn.lpstrDefExt = defaultExt.c_str();
@@ -1806,18 +4269,17 @@ static void HostHandleSaveAs(Host* host) {
     }
 
     std::wstring savePath(ofn.lpstrFile);
-    bool success = false;
-    if (preferSvg) {
-        std::string utf8 = ToUtf8(svgCopy);
-        if (!svgCopy.empty() && utf8.empty()) {
-            AppendLog(L"HostHandleSaveAs: failed to encode SVG as UTF-8");
-            success = false;
-        } else {
-            success = WriteBufferToFile(savePath, utf8.data(), utf8.size());
+    bool saveSvg = preferSvg;
+    if (hasOther) {
+        const std::wstring ext = ToLowerTrim(PathFindExtensionW(savePath.c_str()));
+        if (ext == L".svg" || ext == L".png") {
+            saveSvg = ext == L".svg";
+        } else if (ofn.nFilterIndex == 2) {
+            saveSvg = !preferSvg;
         }
-    } else {
-        success = WriteBufferToFile(savePath, pngCopy.data(), pngCopy.size());
     }
+    const puml::ArtifactPtr& image = saveSvg ? svg : png;
+    const bool success = image && WriteBufferToFile(savePath, image->Data(), image->Size());
 
     if (!success) {
         MessageBoxW(host->hwnd, L"Failed to save the file.", L"PlantUML Viewer", MB_OK | MB_ICONERROR);
@@ -1837,9 +4299,31 @@ static void HostHandleRefresh(Host* host) {
     }
 
     HostRenderAndReload(host,
+                        puml::RenderPriority::Foreground,
                         preferSvg,
                         L"HostHandleRefresh",
                         L"Unable to refresh the diagram. Check the log for details.",
+                        true,
+                        false);
+}
+
+// Window thread, after the watched file was saved. Unchanged blocks reuse
+// the images already shown, so only edited diagrams are rendered again.
+static void HostHandleSourceChanged(Host* host) {
+    if (!host) return;
+
+    bool preferSvg = true;
+    {
+        std::lock_guard<std::mutex> lock(host->stateMutex);
+        preferSvg = host->lastPreferSvg;
+    }
+
+    HostRenderAndReload(host,
+                        puml::RenderPriority::Foreground,
+                        preferSvg,
+                        L"HostHandleSourceChanged",
+                        L"Unable to refresh the diagram. Check the log for details.",
+                        false,
                         true);
 }
 
@@ -1847,31 +4331,61 @@ static void HostHandleFormatChange(Host* host, bool preferSvg) {
     if (!host) return;
 
     RenderBackend backend = RenderBackend::Java;
+    puml::ArtifactPtr swappedHtml;
     {
         std::lock_guard<std::mutex> lock(host->stateMutex);
         backend = host->activeRenderer;
         host->lastPreferSvg = preferSvg;
         if (backend == RenderBackend::Web) {
             host->hasRender = false;
+        } else if (HostHasOtherFormatLocked(host) && host->otherFormatPreferSvg == preferSvg &&
+                   host->shownGeneration == host->renderGeneration) {
+            // Nothing newer is on its way: swap in the other format, and keep
+            // the one shown for switching back.
+            RenderPipelineResult& other = host->otherFormat;
+            other.html.swap(host->initialHtml);
+            other.svg.swap(host->lastSvg);
+            other.png.swap(host->lastPng);
+            host->otherFormatPreferSvg = host->renderedPreferSvg;
+            host->renderedPreferSvg = preferSvg;
+            host->hasRender = preferSvg ? host->lastSvg != nullptr : host->lastPng != nullptr;
+            swappedHtml = host->initialHtml;
         }
     }
 
+    const std::wstring formatLabel = preferSvg ? L"svg" : L"png";
+    const std::wstring logContext = std::wstring(L"HostHandleFormatChange(") + formatLabel + L")";
+
     if (backend == RenderBackend::Web) {
         AppendLog(L"HostHandleFormatChange: updated preferred format to " + std::wstring(preferSvg ? L"SVG" : L"PNG") + L" (web renderer)");
         return;
     }
 
-    const std::wstring formatLabel = preferSvg ? L"svg" : L"png";
-    const std::wstring logContext = std::wstring(L"HostHandleFormatChange(") + formatLabel + L")";
+    if (swappedHtml) {
+        AppendLog(logContext, L": showing the ", preferSvg ? L"SVG" : L"PNG", L" rendered in the background");
+        host->progressGeneration = 0;
+        host->progressImages.clear();
+        host->progressImageIds.clear();
+        host->pendingSlotPage.clear();
+        host->pageImageIds.clear();
+        host->pageStale = false;
+        if (host->web) {
+            HostNavigate(host, swappedHtml->View(), host->pageImageIds);
+        }
+        return;
+    }
+
     const std::wstring errorMessage = preferSvg
         ? std::wstring(L"Unable to render the diagram as SVG. Check the log for details.")
         : std::wstring(L"Unable to render the diagram as PNG. Check the log for details.");
 
     HostRenderAndReload(host,
+                        puml::RenderPriority::FormatSwitch,
                         preferSvg,
                         logContext,
                         errorMessage,
-                        true);
+                        true,
+                        false);
 }
 
 static void HostHandleRenderUpdate(Host* host,
@@ -1882,25 +4396,20 @@ static void HostHandleRenderUpdate(Host* host,
         return;
     }
 
-    std::vector<unsigned char> svgBytes = Base64Decode(svgBase64);
-    const size_t svgByteCount = svgBytes.size();
-    std::wstring svgText;
-    if (!svgBytes.empty()) {
-        std::string utf8(svgBytes.begin(), svgBytes.end());
-        svgText = FromUtf8(utf8);
-    }
+    puml::ArtifactPtr svg = puml::MakeArtifact(puml::ArtifactFormat::Svg, Base64Decode(svgBase64));
+    const size_t svgByteCount = puml::ArtifactSize(svg);
 
-    std::vector<unsigned char> pngBytes = Base64Decode(pngBase64);
-    const size_t pngByteCount = pngBytes.size();
+    puml::ArtifactPtr png = puml::MakeArtifact(puml::ArtifactFormat::Png, Base64Decode(pngBase64));
+    const size_t pngByteCount = puml::ArtifactSize(png);
 
     const std::wstring loweredFormat = ToLowerTrim(format);
     const bool preferSvg = loweredFormat.empty() ? true : (loweredFormat != L"png");
-    const bool hasRenderable = !svgText.empty() || !pngBytes.empty();
+    const bool hasRenderable = svg || png;
 
     {
         std::lock_guard<std::mutex> lock(host->stateMutex);
-        host->lastSvg = std::move(svgText);
-        host->lastPng = std::move(pngBytes);
+        host->lastSvg = std::move(svg);
+        host->lastPng = std::move(png);
         host->lastPreferSvg = preferSvg;
         host->hasRender = hasRenderable;
         if (hasRenderable) {
@@ -1939,19 +4448,69 @@ static void HostHandleRenderFailure(Host* host, const std::wstring& message) {
         finalMessage = L"Unable to render the diagram. Check the log for details.";
     }
 
+    puml::ArtifactPtr errorHtml =
+        puml::MakeArtifact(puml::ArtifactFormat::Html, BuildErrorHtml(finalMessage, preferSvg));
     {
         std::lock_guard<std::mutex> lock(host->stateMutex);
-        host->initialHtml = BuildErrorHtml(finalMessage, host->lastPreferSvg);
-        host->lastSvg.clear();
-        host->lastPng.clear();
+        host->initialHtml = errorHtml;
+        host->lastSvg.reset();
+        host->lastPng.reset();
         host->hasRender = false;
         host->firstErrorMessage = finalMessage;
         host->activeRenderer = host->configuredRenderer;
     }
 
-    if (host->web && !host->initialHtml.empty()) {
-        host->web->NavigateToString(host->initialHtml.c_str());
+    host->progressGeneration = 0;
+    host->progressImages.clear();
+    host->progressImageIds.clear();
+    host->pageImageIds.clear();
+    host->pendingSlotPage.clear();
+    host->pageStale = false;
+    if (host->web && errorHtml) {
+        HostNavigate(host, errorHtml->View(), host->pageImageIds);
+    }
+}
+
+// Clipboard must be open. SVG goes on as text.
+static bool ClipboardPutSvg(const puml::ArtifactPtr& svg) {
+    if (!svg) {
+        AppendLog(L"HostHandleCopy: SVG buffer is empty");
+        return false;
+    }
+    if (!ClipboardSetUtf8Text(svg->View())) {
+        AppendLog(L"HostHandleCopy: failed to place SVG text on the clipboard");
+        return false;
     }
+    return true;
+}
+
+// Clipboard must be open. PNG goes on as a DIB and as "PNG" data.
+static bool ClipboardPutPng(const puml::ArtifactPtr& png) {
+    if (!png) {
+        AppendLog(L"HostHandleCopy: PNG buffer is empty");
+        return false;
+    }
+    std::vector<unsigned char> dib;
+    bool dibOk = false;
+    if (CreateDibFromPng(png->Data(), png->Size(), dib)) {
+        dibOk = ClipboardSetBinaryData(CF_DIB, dib.data(), dib.size());
+        if (!dibOk) {
+            AppendLog(L"HostHandleCopy: failed to place CF_DIB bitmap on the clipboard");
+        }
+    } else {
+        AppendLog(L"HostHandleCopy: failed to convert PNG to DIB");
+    }
+    UINT pngFormat = RegisterClipboardFormatW(L"PNG");
+    bool pngOk = false;
+    if (pngFormat != 0) {
+        pngOk = ClipboardSetBinaryData(pngFormat, png->Data(), png->Size());
+        if (!pngOk) {
+            AppendLog(L"HostHandleCopy: failed to place PNG data on the clipboard");
+        }
+    } else {
+        AppendLog(L"HostHandleCopy: RegisterClipboardFormatW(PNG) failed");
+    }
+    return dibOk || pngOk;
 }
 
 static void HostHandleCopy(Host* host) {
@@ -1959,16 +4518,25 @@ static void HostHandleCopy(Host* host) {
         return;
     }
 
-    std::wstring svgCopy;
-    std::vector<unsigned char> pngCopy;
+    puml::ArtifactPtr svg;
+    puml::ArtifactPtr png;
     bool preferSvg = true;
     bool hasRender = false;
+    bool hasOther = false;
     {
         std::lock_guard<std::mutex> lock(host->stateMutex);
         hasRender = host->hasRender;
         preferSvg = host->lastPreferSvg;
-        svgCopy = host->lastSvg;
-        pngCopy = host->lastPng;
+        svg = host->lastSvg;
+        png = host->lastPng;
+        hasOther = hasRender && HostHasOtherFormatLocked(host) && host->otherFormatPreferSvg != preferSvg;
+        if (hasOther) {
+            if (preferSvg) {
+                png = host->otherFormat.png;
+            } else {
+                svg = host->otherFormat.svg;
+            }
+        }
     }
 
     if (!hasRender) {
@@ -2000,43 +4568,11 @@ static void HostHandleCopy(Host* host) {
         return;
     }
 
-    bool success = false;
-
-    if (preferSvg) {
-        if (!svgCopy.empty()) {
-            success = ClipboardSetUnicodeText(svgCopy);
-            if (!success) {
-                AppendLog(L"HostHandleCopy: failed to place SVG text on the clipboard");
-            }
-        } else {
-            AppendLog(L"HostHandleCopy: SVG buffer is empty");
-        }
-    } else {
-        if (!pngCopy.empty()) {
-            std::vector<unsigned char> dib;
-            bool dibOk = false;
-            if (CreateDibFromPng(pngCopy, dib)) {
-                dibOk = ClipboardSetBinaryData(CF_DIB, dib.data(), dib.size());
-                if (!dibOk) {
-                    AppendLog(L"HostHandleCopy: failed to place CF_DIB bitmap on the clipboard");
-                }
-            } else {
-                AppendLog(L"HostHandleCopy: failed to convert PNG to DIB");
-            }
-            UINT pngFormat = RegisterClipboardFormatW(L"PNG");
-            bool pngOk = false;
-            if (pngFormat != 0) {
-                pngOk = ClipboardSetBinaryData(pngFormat, pngCopy.data(), pngCopy.size());
-                if (!pngOk) {
-                    AppendLog(L"HostHandleCopy: failed to place PNG data on the clipboard");
-                }
-            } else {
-                AppendLog(L"HostHandleCopy: RegisterClipboardFormatW(PNG) failed");
-            }
-            success = dibOk || pngOk;
-        } else {
-            AppendLog(L"HostHandleCopy: PNG buffer is empty");
-        }
+    bool success = preferSvg ? ClipboardPutSvg(svg) : ClipboardPutPng(png);
+    // Pasting into a text editor then gets the SVG, into an image editor the bitmap.
+    if (success && hasOther && (preferSvg ? ClipboardPutPng(png) : ClipboardPutSvg(svg))) {
+        AppendLog(std::wstring(L"HostHandleCopy: added the ") + (preferSvg ? L"PNG" : L"SVG") +
+                  L" rendered in the background");
     }
 
     CloseClipboard();
@@ -2063,11 +4599,42 @@ static LRESULT CALLBACK HostWndProc(HWND h, UINT m, WPARAM w, LPARAM l){
             host->ctrl->put_Bounds(rc);
         }
     }
+    if(m==kMsgRenderCompleted){
+        auto* host = reinterpret_cast<Host*>(GetWindowLongPtrW(h, GWLP_USERDATA));
+        if(host && !host->closing.load(std::memory_order_acquire)){
+            HostDrainCompletedRenders(host);
+        }
+        return 0;
+    }
+    if(m==kMsgRenderProgress){
+        auto* host = reinterpret_cast<Host*>(GetWindowLongPtrW(h, GWLP_USERDATA));
+        if(host && !host->closing.load(std::memory_order_acquire)){
+            HostDrainRenderProgress(host);
+        }
+        return 0;
+    }
+    if(m==kMsgSourceChanged){
+        auto* host = reinterpret_cast<Host*>(GetWindowLongPtrW(h, GWLP_USERDATA));
+        if(host && !host->closing.load(std::memory_order_acquire)){
+            HostHandleSourceChanged(host);
+        }
+        return 0;
+    }
     if(m==WM_NCDESTROY){
         auto* host = reinterpret_cast<Host*>(GetWindowLongPtrW(h, GWLP_USERDATA));
         if(host){
-            host->closing.store(true, std::memory_order_release);
-            host->hwnd = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(host->stateMutex);
+                host->closing.store(true, std::memory_order_release);
+                host->hwnd = nullptr;
+                host->completedRenders.clear();
+                host->pendingProgress.clear();
+            }
+            // Outside stateMutex: the watcher's callback takes it.
+            host->watcher.reset();
+            // Stops the window's queued render and kills an in-flight one-shot JVM.
+            GetRenderScheduler()->CancelKey(HostRenderKey(host));
+            GetRenderScheduler()->CancelKey(HostOtherFormatKey(host));
             if (host->web && host->navCompletedRegistered) {
                 host->web->remove_NavigationCompleted(host->navCompletedToken);
                 host->navCompletedRegistered = false;
@@ -2240,6 +4807,9 @@ static void InitWebView(struct Host* host){
                                << L", success=" << (isSuccess ? L"true" : L"false")
                                << L", webErrorStatus=" << static_cast<int>(status);
                             AppendLog(os.str());
+                            if (isSuccess) {
+                                HostReplayProgressImages(host);
+                            }
                             return S_OK;
                         });
                     EventRegistrationToken navToken{};
@@ -2254,8 +4824,8 @@ static void InitWebView(struct Host* host){
 
                     {
                         std::lock_guard<std::mutex> lock(host->stateMutex);
-                        if (!host->initialHtml.empty()){
-                            AppendLog(L"InitWebView: navigating to initial HTML (" + std::to_wstring(host->initialHtml.size()) + L" chars)");
+                        if (host->initialHtml){
+                            AppendLog(L"InitWebView: navigating to initial HTML (" + std::to_wstring(host->initialHtml->Size()) + L" bytes)");
                         }
                     }
                     HostNavigateToInitialHtml(host);
@@ -2317,18 +4887,32 @@ __declspec(dllexport) HWND __stdcall ListLoadW(HWND ParentWin, wchar_t* FileToLo
         host->activeRenderer = renderer;
         host->lastPreferSvg = preferSvg;
         host->firstErrorMessage.clear();
-        host->lastSvg.clear();
-        host->lastPng.clear();
+        host->lastSvg.reset();
+        host->lastPng.reset();
         host->hasRender = false;
     }
 
+    // Render on a worker while WebView2 starts up; whichever finishes last
+    // triggers the first navigation.
     const std::wstring failureMessage = L"Unable to render the diagram. Check the log for details.";
     HostRenderAndReload(host,
+                        puml::RenderPriority::Foreground,
                         preferSvg,
                         L"ListLoadW",
                         failureMessage,
+                        false,
                         false);
 
+    // Included files join the watch once the first render has scanned them.
+    if (FileToLoad && g_autoRefresh) {
+        HostWatchFiles(host, {ToUtf8(FileToLoad)}, L"ListLoadW");
+    }
+
+    if (FileToLoad) {
+        SchedulePrefetch(FileToLoad, renderer, preferSvg);
+        if (g_prefetchDepth > 0) LogPrefetchStats(L"ListLoadW");
+    }
+
     InitWebView(host);
     AppendLog(L"ListLoadW: InitWebView invoked");
     return host->hwnd;
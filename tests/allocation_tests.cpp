@@ -0,0 +1,226 @@
+// Heap allocations of the render path. This executable replaces the global
+// operator new with a counting one, so a render of PNG output into page
+// markup can be shown to allocate nothing once the buffer pool and the
+// caller's strings are warm, and a warm render through a PlantUmlDaemon on
+// plantuml_pipe_simulator (sim=PATH) to allocate only its cache key.
+
+#include "test_support.h"
+
+#include "core/buffer_pool.h"
+#include "core/cancellation.h"
+#include "core/concurrency_limiter.h"
+#include "core/diagram_markup.h"
+#include "core/plantuml_daemon.h"
+#include "core/render_arena.h"
+#include "core/render_cache_key.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace {
+std::atomic<uint64_t> g_allocations{0};
+} // namespace
+
+void* operator new(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept {
+    return operator new(size, tag);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+// Signature, an IHDR-sized chunk, a data chunk of the given size and IEND:
+// enough structure for the splitter, which only follows chunk lengths.
+void AppendFakePng(std::vector<unsigned char>& out, size_t dataBytes, unsigned char fill) {
+    static const unsigned char kSignature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    out.insert(out.end(), kSignature, kSignature + sizeof(kSignature));
+    auto chunk = [&out](const char* type, size_t length, unsigned char value) {
+        out.push_back(static_cast<unsigned char>(length >> 24));
+        out.push_back(static_cast<unsigned char>(length >> 16));
+        out.push_back(static_cast<unsigned char>(length >> 8));
+        out.push_back(static_cast<unsigned char>(length));
+        out.insert(out.end(), type, type + 4);
+        out.insert(out.end(), length, value);
+        out.insert(out.end(), 4, 0);   // CRC, not checked
+    };
+    chunk("IHDR", 13, 0);
+    chunk("IDAT", dataBytes, fill);
+    chunk("IEND", 0, 0);
+}
+
+std::vector<unsigned char> Corpus() {
+    std::vector<unsigned char> png;
+    AppendFakePng(png, 200 * 1024, 'a');
+    AppendFakePng(png, 30 * 1024, 'b');
+    AppendFakePng(png, 1000, 'c');
+    return png;
+}
+
+// One render's markup step, the way the viewer runs it: scratch from an
+// arena of its own, output appended to strings the caller reuses.
+void RenderMarkup(puml::BufferPool& pool, const std::vector<unsigned char>& png,
+                  std::string& images, std::string& page) {
+    puml::RenderArena arena(pool);
+    puml::RenderArenaScope scope(&arena);
+    images.clear();
+    page.clear();
+    puml::AppendPngImagesMarkup(images, png.data(), png.size());
+    puml::AppendDiagramSlotMarkup(page, 0, images);
+}
+
+} // namespace
+
+TEST(Base64KnownVectors) {
+    const auto encode = [](const std::string& text) {
+        std::string out = "=>";
+        puml::AppendBase64(out, reinterpret_cast<const unsigned char*>(text.data()), text.size());
+        return out;
+    };
+    CHECK_EQ(encode(""), std::string("=>"));
+    CHECK_EQ(encode("f"), std::string("=>Zg=="));
+    CHECK_EQ(encode("fo"), std::string("=>Zm8="));
+    CHECK_EQ(encode("foo"), std::string("=>Zm9v"));
+    CHECK_EQ(encode("foobar"), std::string("=>Zm9vYmFy"));
+}
+
+TEST(SplitFindsEachImage) {
+    const std::vector<unsigned char> png = Corpus();
+    const auto images = puml::SplitConcatenatedPngs(png.data(), png.size());
+    REQUIRE(images.size() == 3);
+    CHECK_EQ(images[0].first, size_t{0});
+    CHECK_EQ(images[1].first, images[0].second);
+    CHECK_EQ(images[2].first + images[2].second, png.size());
+}
+
+TEST(SplitKeepsTruncatedTail) {
+    std::vector<unsigned char> png;
+    AppendFakePng(png, 100, 'a');
+    const size_t first = png.size();
+    AppendFakePng(png, 100, 'b');
+    png.resize(png.size() - 20);
+    const auto images = puml::SplitConcatenatedPngs(png.data(), png.size());
+    REQUIRE(images.size() == 2);
+    CHECK_EQ(images[1].first, first);
+    CHECK_EQ(images[1].second, png.size() - first);
+}
+
+TEST(SecondRenderAllocatesNothing) {
+    puml::BufferPool pool(64ull * 1024 * 1024);
+    const std::vector<unsigned char> png = Corpus();
+    std::string images;
+    std::string page;
+
+    RenderMarkup(pool, png, images, page);
+    const std::string firstPage = page;
+    const puml::BufferPoolStats warm = pool.Stats();
+    CHECK(warm.allocated > 0);
+
+    const uint64_t before = g_allocations.load();
+    RenderMarkup(pool, png, images, page);
+    const uint64_t allocations = g_allocations.load() - before;
+    const puml::BufferPoolStats after = pool.Stats();
+
+    CHECK_EQ(allocations, uint64_t{0});
+    CHECK_EQ(after.allocated, warm.allocated);
+    CHECK(after.reused > warm.reused);
+    CHECK_EQ(after.reused - warm.reused, after.acquired - warm.acquired);
+    CHECK(page == firstPage);
+}
+
+// Past kInlineChunks the arena lists chunks in a vector; they still all go
+// back to the pool.
+TEST(LargeRenderReturnsEveryChunk) {
+    puml::BufferPool pool(64ull * 1024 * 1024);
+    const auto render = [&pool] {
+        puml::RenderArena arena(pool);
+        for (size_t i = 0; i < puml::RenderArena::kInlineChunks + 4; ++i) {
+            CHECK(arena.allocate(puml::RenderArena::kChunkBytes, 8) != nullptr);
+        }
+        CHECK(arena.allocate(3 * puml::RenderArena::kChunkBytes, 8) != nullptr);
+        CHECK_EQ(arena.ChunkCount(), puml::RenderArena::kInlineChunks + 5);
+    };
+    render();
+    const puml::BufferPoolStats warm = pool.Stats();
+    CHECK_EQ(warm.discarded, uint64_t{0});
+    render();
+    const puml::BufferPoolStats after = pool.Stats();
+    CHECK_EQ(after.allocated, warm.allocated);
+    CHECK_EQ(after.reused - warm.reused, uint64_t{puml::RenderArena::kInlineChunks + 5});
+    CHECK_EQ(after.pooledBytes, warm.pooledBytes);
+}
+
+// The viewer's render of a file that misses the caches: its key, the daemon
+// run under a cancellation token and a concurrency slot, and the page, all
+// inside the render's arena.
+TEST(WarmDaemonRenderAllocatesOnlyItsKey) {
+    const std::string simulator = puml_test::Arg("sim");
+    if (simulator.empty()) SKIP("no simulator (pass sim=PATH)");
+    puml::ConcurrencyLimiter limiter(4);
+    puml::DaemonOptions options;
+    options.process.executable = simulator;
+    options.process.arguments = {"-jar", "plantuml.jar", "-charset", "UTF-8", "-pipe", "-tpng"};
+    options.name = "test";
+    options.limiter = &limiter;
+    puml::PlantUmlDaemon daemon(options);
+
+    puml::BufferPool pool(64ull * 1024 * 1024);
+    const std::string source = "@startuml\nA -> B\n@enduml\n@startuml\nC -> D\n@enduml\nE -> F\n";
+    const std::string identity = "plantuml.jar|1234|5678";
+    std::vector<unsigned char> out;
+    std::string error;
+    std::string images;
+    std::string page;
+    const auto render = [&]() {
+        puml::RenderArena arena(pool);
+        puml::RenderArenaScope scope(&arena);
+        puml::CancellationToken cancel;
+        puml::RenderCacheKeyInput input;
+        input.source = source.data();
+        input.sourceSize = source.size();
+        input.format = "png";
+        input.rendererIdentity = identity;
+        input.settings = "renderer=java;charset=UTF-8;mode=pipe";
+        const std::string key = puml::DeriveRenderCacheKey(input);
+        CHECK_EQ(key.size(), size_t{32});
+        REQUIRE(daemon.Render(source, 10000, out, &error, &cancel));
+        images.clear();
+        page.clear();
+        puml::AppendPngImagesMarkup(images, out.data(), out.size());
+        puml::AppendDiagramSlotMarkup(page, 0, images);
+    };
+    // The first renders start the process and size every reused buffer.
+    // The simulator numbers its diagrams, so its images grow a byte at the
+    // 10th and the 100th; past those they keep their size.
+    for (int i = 0; i < 40; ++i) render();
+
+    // The key, and the list of callbacks of the render's new token.
+    const uint64_t kPerRender = 2;
+    for (int i = 0; i < 20; ++i) {
+        const uint64_t before = g_allocations.load();
+        render();
+        CHECK_EQ(g_allocations.load() - before, kPerRender);
+    }
+    CHECK_EQ(daemon.Stats().starts, uint64_t{1});
+    CHECK_EQ(daemon.Stats().renders, uint64_t{60});
+}
@@ -0,0 +1,242 @@
+// Cache key derivation and the on-disk render cache.
+
+#include "test_support.h"
+
+#include "core/content_hash.h"
+#include "core/disk_cache.h"
+#include "core/lru_cache.h"
+#include "core/render_cache_key.h"
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+std::string Text(const std::vector<unsigned char>& bytes) {
+    return std::string(bytes.begin(), bytes.end());
+}
+
+puml::RenderCacheKeyInput SampleInput(const std::string& source) {
+    puml::RenderCacheKeyInput input;
+    input.source = source.data();
+    input.sourceSize = source.size();
+    input.format = "svg";
+    input.rendererIdentity = "plantuml.jar|123|456";
+    input.settings = "charset=utf-8";
+    input.dependencyHash = 42;
+    return input;
+}
+
+} // namespace
+
+// Published XXH64 test vectors.
+TEST(Xxh64KnownVectors) {
+    CHECK_EQ(puml::Hash64("", 0), 0xEF46DB3751D8E999ull);
+    CHECK_EQ(puml::Hash64("a", 1), 0xD24EC4F1A98C6E5Bull);
+    CHECK_EQ(puml::Hash64("abc", 3), 0x44BC2CF5AD770999ull);
+    const std::string sentence = "Nobody inspects the spammish repetition";
+    CHECK_EQ(puml::Hash64(sentence.data(), sentence.size()), 0xFBCEA83C8A378BF1ull);
+    CHECK_EQ(puml::Hash64("abc", 3, 1), 0xBEA9CA8199328908ull);
+}
+
+// Long inputs go through the 32-byte stripe loop.
+TEST(Xxh64StreamingMatchesOneShot) {
+    std::vector<unsigned char> data(1024);
+    for (size_t i = 0; i < data.size(); ++i) data[i] = static_cast<unsigned char>(i);
+    CHECK_EQ(puml::Hash64(data.data(), data.size()), 0x6F3914F18FE4DF57ull);
+    for (size_t split : {1u, 7u, 31u, 32u, 33u, 500u}) {
+        puml::Hasher64 hasher;
+        hasher.Update(data.data(), split);
+        hasher.Update(data.data() + split, data.size() - split);
+        CHECK_EQ(hasher.Digest(), 0x6F3914F18FE4DF57ull);
+    }
+    CHECK_EQ(puml::HashToHex(0xABCull), std::string("0000000000000abc"));
+}
+
+TEST(RenderCacheKeyIsStableHex) {
+    const std::string source = "@startuml\nA -> B\n@enduml\n";
+    const std::string key = puml::DeriveRenderCacheKey(SampleInput(source));
+    CHECK_EQ(key.size(), size_t(32));
+    CHECK(key.find_first_not_of("0123456789abcdef") == std::string::npos);
+    CHECK_EQ(puml::DeriveRenderCacheKey(SampleInput(source)), key);
+}
+
+TEST(RenderCacheKeyCoversEveryField) {
+    const std::string source = "@startuml\nA -> B\n@enduml\n";
+    const std::string base = puml::DeriveRenderCacheKey(SampleInput(source));
+
+    const std::string edited = source + " ";
+    CHECK(puml::DeriveRenderCacheKey(SampleInput(edited)) != base);
+    puml::RenderCacheKeyInput input = SampleInput(source);
+    input.format = "png";
+    CHECK(puml::DeriveRenderCacheKey(input) != base);
+    input = SampleInput(source);
+    const std::string identity = std::string(input.rendererIdentity) + "x";
+    input.rendererIdentity = identity;
+    CHECK(puml::DeriveRenderCacheKey(input) != base);
+    input = SampleInput(source);
+    input.settings = {};
+    CHECK(puml::DeriveRenderCacheKey(input) != base);
+    input = SampleInput(source);
+    input.dependencyHash = 43;
+    CHECK(puml::DeriveRenderCacheKey(input) != base);
+
+    // Fields are length-prefixed: moving bytes between them changes the key.
+    input = SampleInput(source);
+    input.format = "sv";
+    const std::string shifted = "g" + std::string(input.rendererIdentity);
+    input.rendererIdentity = shifted;
+    CHECK(puml::DeriveRenderCacheKey(input) != base);
+}
+
+TEST(DiskCachePutGet) {
+    puml_test::TempDir directory("putget");
+    puml::DiskRenderCache cache(directory.Path(), 1024 * 1024);
+    std::vector<unsigned char> out;
+    CHECK(!cache.Get("k1", "svg", out));
+    CHECK(!cache.Contains("k1", "svg"));
+    REQUIRE(cache.Put("k1", "svg", "<svg/>", 6));
+    CHECK(cache.Contains("k1", "svg"));
+    CHECK(!cache.Contains("k1", "png"));
+    REQUIRE(cache.Get("k1", "svg", out));
+    CHECK_EQ(Text(out), std::string("<svg/>"));
+
+    const puml::DiskCacheStats stats = cache.Stats();
+    CHECK_EQ(stats.hits, uint64_t(1));
+    CHECK_EQ(stats.misses, uint64_t(1));
+    CHECK_EQ(stats.writes, uint64_t(1));
+    CHECK_EQ(stats.entries, uint64_t(1));
+    CHECK_EQ(stats.bytes, uint64_t(6));
+}
+
+// Previews read through Peek, which must not skew the hit ratio.
+TEST(DiskCachePeekIsNotALookup) {
+    puml_test::TempDir directory("peek");
+    puml::DiskRenderCache cache(directory.Path(), 1024 * 1024);
+    std::vector<unsigned char> out;
+    CHECK(!cache.Peek("k", "svg", out));
+    REQUIRE(cache.Put("k", "svg", "<svg/>", 6));
+    REQUIRE(cache.Peek("k", "svg", out));
+    CHECK_EQ(Text(out), std::string("<svg/>"));
+    const puml::DiskCacheStats stats = cache.Stats();
+    CHECK_EQ(stats.hits, uint64_t(0));
+    CHECK_EQ(stats.misses, uint64_t(0));
+}
+
+TEST(MemoryCachePeekIsNotALookup) {
+    puml::ByteBudgetLruCache<int> cache(100);
+    int value = 0;
+    CHECK(!cache.Peek("a", value));
+    cache.Put("a", 1, 40);
+    cache.Put("b", 2, 40);
+    REQUIRE(cache.Peek("a", value));
+    CHECK_EQ(value, 1);
+    // Peek left "a" least recently used, so it goes first.
+    cache.Put("c", 3, 40);
+    CHECK(!cache.Contains("a"));
+    CHECK(cache.Contains("b"));
+    const puml::LruCacheStats stats = cache.Stats();
+    CHECK_EQ(stats.hits, uint64_t(0));
+    CHECK_EQ(stats.misses, uint64_t(0));
+}
+
+// Put is content-addressed: a second Put under the same key keeps the first bytes.
+TEST(DiskCachePutKeepsExistingEntry) {
+    puml_test::TempDir directory("keep");
+    puml::DiskRenderCache cache(directory.Path(), 1024 * 1024);
+    REQUIRE(cache.Put("k", "svg", "AAAA", 4));
+    REQUIRE(cache.Put("k", "svg", "BBBB", 4));
+    std::vector<unsigned char> out;
+    REQUIRE(cache.Get("k", "svg", out));
+    CHECK_EQ(Text(out), std::string("AAAA"));
+}
+
+// The last-render reference of a path changes with every render.
+TEST(DiskCacheReplaceOverwritesReference) {
+    puml_test::TempDir temp("ref");
+    const std::string& directory = temp.Path();
+    {
+        puml::DiskRenderCache cache(directory, 1024 * 1024);
+        REQUIRE(cache.Replace("path", "ref", "AAAA", 4));
+        REQUIRE(cache.Replace("path", "ref", "BBBBBB", 6));
+        std::vector<unsigned char> out;
+        REQUIRE(cache.Get("path", "ref", out));
+        CHECK_EQ(Text(out), std::string("BBBBBB"));
+        CHECK_EQ(cache.Stats().bytes, uint64_t(6));
+    }
+    // A new process sees the last reference, not the first.
+    puml::DiskRenderCache reopened(directory, 1024 * 1024);
+    std::vector<unsigned char> out;
+    REQUIRE(reopened.Get("path", "ref", out));
+    CHECK_EQ(Text(out), std::string("BBBBBB"));
+}
+
+TEST(DiskCacheEvictsLeastRecentlyUsed) {
+    puml_test::TempDir directory("evict");
+    puml::DiskRenderCache cache(directory.Path(), 10 * 1000);
+    const std::string blob(3000, 'x');
+    REQUIRE(cache.Put("old", "png", blob.data(), blob.size()));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    REQUIRE(cache.Put("mid", "png", blob.data(), blob.size()));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    REQUIRE(cache.Put("new", "png", blob.data(), blob.size()));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    // A hit makes "old" the most recently used.
+    std::vector<unsigned char> out;
+    REQUIRE(cache.Get("old", "png", out));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    REQUIRE(cache.Put("last", "png", blob.data(), blob.size()));
+
+    CHECK(cache.Contains("old", "png"));
+    CHECK(!cache.Contains("mid", "png"));
+    CHECK(cache.Contains("last", "png"));
+    const puml::DiskCacheStats stats = cache.Stats();
+    CHECK(stats.bytes <= 9000);
+    CHECK(stats.evictions >= 1);
+}
+
+// Two caches on one directory stand in for two Lister processes.
+TEST(DiskCacheSeesEntriesFromOtherInstances) {
+    puml_test::TempDir temp("shared");
+    const std::string& directory = temp.Path();
+    puml::DiskRenderCache reader(directory, 1024 * 1024);
+    puml::DiskRenderCache writer(directory, 1024 * 1024);
+    std::vector<unsigned char> out;
+    CHECK(!reader.Get("k", "svg", out));   // indexes the still empty directory
+
+    REQUIRE(writer.Put("k", "svg", "<svg/>", 6));
+    CHECK(reader.Contains("k", "svg"));
+    REQUIRE(reader.Get("k", "svg", out));
+    CHECK_EQ(Text(out), std::string("<svg/>"));
+    CHECK_EQ(reader.Stats().bytes, uint64_t(6));
+
+    // Removed elsewhere: a miss, and gone from the index.
+    fs::remove(fs::u8path(directory) / "k.svg");
+    CHECK(!reader.Get("k", "svg", out));
+    CHECK(!reader.Contains("k", "svg"));
+    CHECK_EQ(reader.Stats().bytes, uint64_t(0));
+}
+
+// Eviction copes with victims another process already deleted.
+TEST(DiskCacheEvictionToleratesRemovedEntries) {
+    puml_test::TempDir temp("removed");
+    const std::string& directory = temp.Path();
+    puml::DiskRenderCache cache(directory, 10 * 1000);
+    const std::string blob(4000, 'x');
+    REQUIRE(cache.Put("a", "png", blob.data(), blob.size()));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    REQUIRE(cache.Put("b", "png", blob.data(), blob.size()));
+    fs::remove(fs::u8path(directory) / "a.png");
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    REQUIRE(cache.Put("c", "png", blob.data(), blob.size()));
+
+    CHECK(cache.Contains("b", "png"));
+    CHECK(cache.Contains("c", "png"));
+    CHECK_EQ(cache.Stats().bytes, uint64_t(8000));
+    CHECK_EQ(cache.Stats().evictions, uint64_t(0));
+}
@@ -0,0 +1,89 @@
+// SplitDiagramBlocks and the text PlantUML reads for each block: a byte
+// order mark, text between blocks, newpage, non-UML diagram types and the
+// @start and @end lines PlantUML supplies when they are missing.
+
+#include "test_support.h"
+
+#include "core/diagram_splitter.h"
+
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+namespace {
+
+// The text of every block, in order.
+std::vector<std::string> Blocks(const std::string& source) {
+    std::vector<std::string> texts;
+    for (const puml::DiagramBlock& block : puml::SplitDiagramBlocks(source)) {
+        texts.emplace_back();
+        puml::AppendBlockText(texts.back(), source, block);
+    }
+    return texts;
+}
+
+} // namespace
+
+TEST(SplitsBlocksAndDropsTextBetweenThem) {
+    const std::string source = "title notes\n"
+                               "@startuml\nA -> B\n@enduml\n"
+                               "\nnot a diagram\n"
+                               "@startuml\nB -> C\n@enduml\n";
+    CHECK((Blocks(source) == std::vector<std::string>{"@startuml\nA -> B\n@enduml\n", "@startuml\nB -> C\n@enduml\n"}));
+    const std::pmr::vector<puml::DiagramBlock> blocks = puml::SplitDiagramBlocks(source);
+    REQUIRE(blocks.size() == 2);
+    CHECK_EQ(blocks[0].firstLine, size_t{2});
+    CHECK_EQ(blocks[1].firstLine, size_t{7});
+    CHECK(!blocks[1].addStart && !blocks[1].addEnd && !blocks[1].addNewline);
+    // The range is the caller's text, not a copy.
+    CHECK_EQ(puml::BlockText(source, blocks[1]).body.data(), source.data() + blocks[1].offset);
+}
+
+TEST(SkipsTheByteOrderMark) {
+    const std::string source = "\xEF\xBB\xBF@startuml\nA -> B\n@enduml\n";
+    const std::pmr::vector<puml::DiagramBlock> blocks = puml::SplitDiagramBlocks(source);
+    REQUIRE(blocks.size() == 1);
+    CHECK_EQ(blocks[0].offset, size_t{3});
+    CHECK((Blocks(source) == std::vector<std::string>{"@startuml\nA -> B\n@enduml\n"}));
+    // Also before content without an @start line.
+    CHECK((Blocks("\xEF\xBB\xBF" "A -> B\n") == std::vector<std::string>{"@startuml\nA -> B\n@enduml\n"}));
+    CHECK(Blocks("\xEF\xBB\xBF").empty());
+}
+
+TEST(CountsNewpageLines) {
+    const std::string source = "@startuml\nA -> B\nnewpage Second page\nB -> C\n  newpage\nC -> D\n"
+                               "newpages are not pages\n@enduml\n@startuml\nX -> Y\n@enduml\n";
+    const std::pmr::vector<puml::DiagramBlock> blocks = puml::SplitDiagramBlocks(source);
+    REQUIRE(blocks.size() == 2);
+    CHECK_EQ(blocks[0].pages, size_t{3});
+    CHECK_EQ(blocks[1].pages, size_t{1});
+}
+
+TEST(KeepsOtherDiagramTypes) {
+    const std::string source = "@startjson\n{\"a\": [1, 2]}\n@endjson\n@startmindmap\n* root\n@endmindmap";
+    CHECK((Blocks(source) == std::vector<std::string>{"@startjson\n{\"a\": [1, 2]}\n@endjson\n",
+                                                      "@startmindmap\n* root\n@endmindmap\n"}));
+    const std::pmr::vector<puml::DiagramBlock> blocks = puml::SplitDiagramBlocks(source);
+    REQUIRE(blocks.size() == 2);
+    CHECK(!blocks[1].addEnd);
+    CHECK(blocks[1].addNewline);
+}
+
+TEST(AddsAMissingEndLine) {
+    CHECK((Blocks("@startuml\nA -> B\n") == std::vector<std::string>{"@startuml\nA -> B\n@enduml\n"}));
+    CHECK((Blocks("@startuml\nA -> B") == std::vector<std::string>{"@startuml\nA -> B\n@enduml\n"}));
+    CHECK((Blocks("@startuml\nA -> B\n@enduml\n@startuml\nB -> C\n") ==
+           std::vector<std::string>{"@startuml\nA -> B\n@enduml\n", "@startuml\nB -> C\n@enduml\n"}));
+}
+
+TEST(AddsAMissingStartLine) {
+    CHECK((Blocks("A -> B\n") == std::vector<std::string>{"@startuml\nA -> B\n@enduml\n"}));
+    // Closed by an @end line too.
+    CHECK((Blocks("A -> B\n@enduml\n") == std::vector<std::string>{"@startuml\nA -> B\n@enduml\n"}));
+    CHECK((Blocks("@startuml\nA -> B\n@enduml\nB -> C\n@enduml\n") ==
+           std::vector<std::string>{"@startuml\nA -> B\n@enduml\n", "@startuml\nB -> C\n@enduml\n"}));
+    // An @end line with nothing to close is not a diagram.
+    CHECK((Blocks("@startuml\nA -> B\n@enduml\n\n@enduml\n") ==
+           std::vector<std::string>{"@startuml\nA -> B\n@enduml\n"}));
+    CHECK(Blocks("\n  \r\n").empty());
+}
@@ -0,0 +1,152 @@
+// StartFileWatcher on files in a temporary directory: a burst of writes
+// reported once after the debounce, a save through a temporary file renamed
+// over the original, an unrelated file in the same directory, and the
+// destructor with a change still waiting out its debounce.
+
+#include "test_support.h"
+
+#include "core/file_watcher.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const uint32_t kDebounceMs = 200;
+
+void Write(const std::string& path, const std::string& text) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << text;
+}
+
+// Counts onChange calls, which arrive on the watcher's thread.
+class Changes {
+public:
+    std::function<void()> Callback() {
+        return [this]() {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                ++count_;
+                last_ = Clock::now();
+            }
+            cv_.notify_all();
+        };
+    }
+
+    // The count once it reaches count, or what it is after 5 s.
+    int Wait(int count) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait_for(lock, std::chrono::seconds(5), [&]() { return count_ >= count; });
+        return count_;
+    }
+
+    // The count after the watcher has had time to report anything left.
+    int Settle() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(kDebounceMs * 4));
+        std::lock_guard<std::mutex> lock(mutex_);
+        return count_;
+    }
+
+    Clock::time_point Last() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return last_;
+    }
+
+private:
+    std::mutex              mutex_;
+    std::condition_variable cv_;
+    int                     count_ = 0;
+    Clock::time_point       last_;
+};
+
+std::unique_ptr<puml::FileWatcher> Watch(const std::string& path, Changes& changes,
+                                         uint32_t debounceMs = kDebounceMs) {
+    std::string error;
+    std::unique_ptr<puml::FileWatcher> watcher = puml::StartFileWatcher({path}, debounceMs, changes.Callback(), &error);
+    if (!watcher) puml_test::Fail(__FILE__, __LINE__, "StartFileWatcher: " + error);
+    return watcher;
+}
+
+} // namespace
+
+TEST(BurstOfWritesIsReportedOnceAfterTheDebounce) {
+    puml_test::TempDir dir("watcher");
+    const std::string path = dir.Path() + "/diagram.puml";
+    Write(path, "@startuml\n@enduml\n");
+    Changes changes;
+    const auto watcher = Watch(path, changes);
+    REQUIRE(watcher);
+
+    Clock::time_point lastWrite;
+    for (int i = 0; i < 10; ++i) {
+        if (i) std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        lastWrite = Clock::now();
+        Write(path, "@startuml\nA -> B : " + std::to_string(i) + "\n@enduml\n");
+    }
+    CHECK_EQ(changes.Wait(1), 1);
+    CHECK(changes.Last() - lastWrite >= std::chrono::milliseconds(kDebounceMs));
+    CHECK_EQ(changes.Settle(), 1);
+}
+
+// What editors do: write a temporary file next to the original, then rename
+// it over the original, which replaces the watched file's inode.
+TEST(SaveThroughRenamedTemporaryFileIsSeen) {
+    puml_test::TempDir dir("watcher");
+    const std::string path = dir.Path() + "/diagram.puml";
+    Write(path, "@startuml\n@enduml\n");
+    Changes changes;
+    const auto watcher = Watch(path, changes);
+    REQUIRE(watcher);
+
+    const std::string temporary = dir.Path() + "/diagram.puml.tmp";
+    Write(temporary, "@startuml\nA -> B\n@enduml\n");
+    REQUIRE(std::rename(temporary.c_str(), path.c_str()) == 0);
+    CHECK_EQ(changes.Wait(1), 1);
+    CHECK_EQ(changes.Settle(), 1);
+
+    // Still watched after the rename.
+    Write(path, "@startuml\nB -> A\n@enduml\n");
+    CHECK_EQ(changes.Wait(2), 2);
+}
+
+TEST(UnrelatedFileInTheDirectoryIsIgnored) {
+    puml_test::TempDir dir("watcher");
+    const std::string path = dir.Path() + "/diagram.puml";
+    Write(path, "@startuml\n@enduml\n");
+    Changes changes;
+    const auto watcher = Watch(path, changes);
+    REQUIRE(watcher);
+
+    Write(dir.Path() + "/notes.txt", "unrelated");
+    Write(dir.Path() + "/diagram.png", "unrelated");
+    CHECK_EQ(changes.Settle(), 0);
+
+    Write(path, "@startuml\nA -> B\n@enduml\n");
+    CHECK_EQ(changes.Wait(1), 1);
+}
+
+// Destroying the watcher while a change waits out its debounce returns at
+// once and never reports it.
+TEST(DestructorJoinsWithAChangePending) {
+    puml_test::TempDir dir("watcher");
+    const std::string path = dir.Path() + "/diagram.puml";
+    Write(path, "@startuml\n@enduml\n");
+    Changes changes;
+    auto watcher = Watch(path, changes, 10000);
+    REQUIRE(watcher);
+
+    Write(path, "@startuml\nA -> B\n@enduml\n");
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    const auto destroying = Clock::now();
+    watcher.reset();
+    CHECK(Clock::now() - destroying < std::chrono::seconds(2));
+    CHECK_EQ(changes.Settle(), 0);
+}
@@ -0,0 +1,231 @@
+// RunHedged with the backends the viewer hedges between: a PlantUmlDaemon
+// on plantuml_pipe_simulator (sim=PATH) as the primary and a PlantUML
+// server, here a local HTTP stand-in, as the secondary. Checks who wins and
+// that a loser's cut-short render is counted as censored, not as a latency.
+
+#include "test_support.h"
+
+#include "core/hedged_render.h"
+#include "core/http_client.h"
+#include "core/latency_histogram.h"
+#include "core/plantuml_daemon.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Answers every POST with an SVG after a delay, one thread per connection.
+class StandInServer {
+public:
+    explicit StandInServer(uint32_t delayMs) : delayMs_(delayMs) {
+        listener_ = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(address);
+        if (listener_ < 0 || bind(listener_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            listen(listener_, 16) != 0 ||
+            getsockname(listener_, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+            return;
+        }
+        url_ = "http://127.0.0.1:" + std::to_string(ntohs(address.sin_port)) + "/svg";
+        acceptor_ = std::thread([this]() { AcceptLoop(); });
+    }
+
+    ~StandInServer() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        if (listener_ >= 0) {
+            shutdown(listener_, SHUT_RDWR);
+            close(listener_);
+        }
+        if (acceptor_.joinable()) acceptor_.join();
+        for (std::thread& connection : connections_) connection.join();
+    }
+
+    const std::string& Url() const { return url_; }   // empty if it could not listen
+    int Requests() const { return requests_.load(); }
+
+private:
+    void AcceptLoop() {
+        for (;;) {
+            const int client = accept(listener_, nullptr, nullptr);
+            if (client < 0) return;
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_) {
+                close(client);
+                return;
+            }
+            connections_.emplace_back([this, client]() { Serve(client); });
+        }
+    }
+
+    void Serve(int client) {
+        std::string request;
+        char buffer[4096];
+        size_t bodyEnd = std::string::npos;
+        while (bodyEnd == std::string::npos || request.size() < bodyEnd) {
+            const ssize_t got = recv(client, buffer, sizeof(buffer), 0);
+            if (got <= 0) break;
+            request.append(buffer, static_cast<size_t>(got));
+            const size_t headerEnd = request.find("\r\n\r\n");
+            if (bodyEnd == std::string::npos && headerEnd != std::string::npos) {
+                const size_t field = request.find("Content-Length:");
+                const size_t length = field < headerEnd ? std::strtoul(request.c_str() + field + 15, nullptr, 10) : 0;
+                bodyEnd = headerEnd + 4 + length;
+            }
+        }
+        ++requests_;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait_for(lock, std::chrono::milliseconds(delayMs_), [this]() { return stopping_; });
+        }
+        const std::string body = "<svg xmlns=\"http://www.w3.org/2000/svg\"><text>server</text></svg>";
+        const std::string response = "HTTP/1.1 200 OK\r\nContent-Type: image/svg+xml\r\nContent-Length: " +
+                                     std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+        send(client, response.data(), response.size(), MSG_NOSIGNAL);
+        close(client);
+    }
+
+    const uint32_t           delayMs_;
+    int                      listener_ = -1;
+    std::string              url_;
+    std::thread              acceptor_;
+    std::mutex               mutex_;
+    std::condition_variable  cv_;
+    bool                     stopping_ = false;
+    std::vector<std::thread> connections_;
+    std::atomic<int>         requests_{0};
+};
+
+puml::DaemonOptions SimulatorDaemon() {
+    const std::string simulator = puml_test::Arg("sim");
+    if (simulator.empty()) SKIP("no simulator (pass sim=PATH)");
+    puml::DaemonOptions options;
+    options.process.executable = simulator;
+    options.process.arguments = {"-jar", "plantuml.jar", "-charset", "UTF-8", "-pipe", "-tsvg"};
+    options.name = "test";
+    return options;
+}
+
+// The daemon as the primary, the stand-in server as the secondary.
+struct Backends {
+    explicit Backends(uint32_t serverDelayMs) : daemon(SimulatorDaemon()), server(serverDelayMs) {
+        REQUIRE(!server.Url().empty());
+        primary.name = "jar";
+        primary.latency = &primaryLatency;
+        secondary.name = "web";
+        secondary.latency = &secondaryLatency;
+        secondary.render = [this](const puml::CancellationToken& cancel, std::string& error) {
+            puml::HttpResponse response;
+            return puml::HttpPost(server.Url(), "text/plain", source, 10000, 1 << 20, response, &error, &cancel) &&
+                   response.status == 200;
+        };
+        primary.render = [this](const puml::CancellationToken& cancel, std::string& error) {
+            std::vector<unsigned char> out;
+            return daemon.Render(source, 10000, out, &error, &cancel);
+        };
+    }
+
+    // Started ahead of the timed runs, so JVM start-up is not part of them.
+    void Warm() {
+        std::vector<unsigned char> out;
+        std::string error;
+        REQUIRE(daemon.Render("@startuml\nA -> B\n@enduml\n", 10000, out, &error));
+    }
+
+    std::string            source;
+    puml::PlantUmlDaemon   daemon;
+    StandInServer          server;
+    puml::LatencyHistogram primaryLatency;
+    puml::LatencyHistogram secondaryLatency;
+    puml::HedgeBackend     primary;
+    puml::HedgeBackend     secondary;
+};
+
+puml::HedgePolicy Policy(uint32_t delayMs) {
+    puml::HedgePolicy policy;
+    policy.initialDelayMs = delayMs;
+    return policy;
+}
+
+} // namespace
+
+TEST(FastPrimaryIsNotHedged) {
+    Backends backends(0);
+    backends.Warm();
+    backends.source = "@startuml\nA -> B\n@enduml\n";
+    const puml::HedgeOutcome outcome = puml::RunHedged(backends.primary, backends.secondary, Policy(2000), nullptr);
+    CHECK(outcome.winner == puml::HedgeWinner::Primary);
+    CHECK(!outcome.hedged);
+    CHECK_EQ(backends.server.Requests(), 0);
+    CHECK_EQ(backends.primaryLatency.Count(), uint32_t{1});
+    CHECK_EQ(backends.primaryLatency.Censored(), uint64_t{0});
+}
+
+// The slow primary is hedged, loses, and is cancelled: its cut-short time
+// must not enter the histogram the hedge delay is taken from.
+TEST(CancelledPrimaryIsCensored) {
+    Backends backends(0);
+    backends.Warm();
+    backends.source = "@startuml\n' sim: sleep 3000\nA -> B\n@enduml\n";
+    const auto start = std::chrono::steady_clock::now();
+    const puml::HedgeOutcome outcome = puml::RunHedged(backends.primary, backends.secondary, Policy(100), nullptr);
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(2500));
+    CHECK(outcome.winner == puml::HedgeWinner::Secondary);
+    CHECK(outcome.hedged);
+    CHECK_EQ(backends.primaryLatency.Count(), uint32_t{0});
+    CHECK_EQ(backends.primaryLatency.Censored(), uint64_t{1});
+    CHECK_EQ(backends.secondaryLatency.Count(), uint32_t{1});
+    CHECK_EQ(backends.daemon.Stats().cancellations, uint64_t{1});
+}
+
+TEST(CancelledSecondaryIsCensored) {
+    Backends backends(3000);
+    backends.Warm();
+    backends.source = "@startuml\n' sim: sleep 400\nA -> B\n@enduml\n";
+    const puml::HedgeOutcome outcome = puml::RunHedged(backends.primary, backends.secondary, Policy(100), nullptr);
+    CHECK(outcome.winner == puml::HedgeWinner::Primary);
+    CHECK(outcome.hedged);
+    CHECK_EQ(backends.server.Requests(), 1);
+    CHECK_EQ(backends.primaryLatency.Count(), uint32_t{1});
+    CHECK_EQ(backends.secondaryLatency.Count(), uint32_t{0});
+    CHECK_EQ(backends.secondaryLatency.Censored(), uint64_t{1});
+}
+
+// A primary that fails is replaced at once instead of after the delay.
+TEST(FailedPrimaryHedgesAtOnce) {
+    Backends backends(0);
+    backends.Warm();
+    backends.source = "@startuml\n' sim: crash\nA -> B\n@enduml\n";
+    const puml::HedgeOutcome outcome = puml::RunHedged(backends.primary, backends.secondary, Policy(5000), nullptr);
+    CHECK(outcome.winner == puml::HedgeWinner::Secondary);
+    CHECK(!outcome.primaryError.empty());
+    CHECK(outcome.elapsedMs < 4000);
+    CHECK_EQ(backends.primaryLatency.Censored(), uint64_t{0});
+}
+
+TEST(CensoredRendersShowInDescribe) {
+    puml::LatencyHistogram latency;
+    latency.Record(100);
+    CHECK(latency.Describe().find("censored") == std::string::npos);
+    latency.RecordCensored();
+    CHECK(latency.Describe().find(" censored=1") != std::string::npos);
+    CHECK_EQ(latency.Count(), uint32_t{1});
+}
@@ -0,0 +1,140 @@
+// AbsolutizeReferences on each kind of reference, and DependencyScanner on
+// files in a temporary directory: nested includes, cycles and the combined
+// hash following a change in a nested include.
+
+#include "test_support.h"
+
+#include "core/include_scanner.h"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char kBase[] = "/work/diagrams/";
+
+// The source with its references made absolute, or "(unchanged)".
+std::string Absolutized(const std::string& source) {
+    std::string out = "(unchanged)";
+    return puml::AbsolutizeReferences(source, kBase, out) ? out : "(unchanged)";
+}
+
+void Write(const std::string& directory, const std::string& name, const std::string& text) {
+    const fs::path path = fs::u8path(directory) / fs::u8path(name);
+    fs::create_directories(path.parent_path());
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << text;
+}
+
+// The path the scanner reports for name under directory.
+std::string Normalized(const std::string& directory, const std::string& name) {
+    return (fs::u8path(directory) / fs::u8path(name)).lexically_normal().u8string();
+}
+
+} // namespace
+
+TEST(AbsolutizesQuotedAndUnquotedIncludes) {
+    CHECK_EQ(Absolutized("@startuml\n!include common.puml\n  !include_once \"my styles/skin.iuml\"\n@enduml\n"),
+             std::string("@startuml\n!include /work/diagrams/common.puml\n"
+                         "  !include_once \"/work/diagrams/my styles/skin.iuml\"\n@enduml\n"));
+    CHECK_EQ(Absolutized("!include ../shared/./defs.puml\n"), std::string("!include /work/shared/defs.puml\n"));
+    CHECK_EQ(Absolutized("!import lib/archive.zip\n"), std::string("!import /work/diagrams/lib/archive.zip\n"));
+}
+
+// The part selector stays after the rewritten file name.
+TEST(AbsolutizesIncludesubKeepingTheTag) {
+    CHECK_EQ(Absolutized("!includesub parts.puml!BASIC\n"), std::string("!includesub /work/diagrams/parts.puml!BASIC\n"));
+    CHECK_EQ(Absolutized("!include multi.puml!2\n"), std::string("!include /work/diagrams/multi.puml!2\n"));
+}
+
+// Only the directory after "from" is rewritten; built-in themes are left alone.
+TEST(AbsolutizesThemeFromDirectory) {
+    CHECK_EQ(Absolutized("!theme corporate from themes\n"),
+             std::string("!theme corporate from /work/diagrams/themes\n"));
+    CHECK_EQ(Absolutized("!theme cerulean\n"), std::string("(unchanged)"));
+}
+
+TEST(AbsolutizesImages) {
+    CHECK_EQ(Absolutized("A : <img:pics/logo.png>\nB : <img:icon.svg{scale=2}> and <img:pics/x.png>\n"),
+             std::string("A : <img:/work/diagrams/pics/logo.png>\n"
+                         "B : <img:/work/diagrams/icon.svg{scale=2}> and <img:/work/diagrams/pics/x.png>\n"));
+    // A commented-out line is not a reference.
+    CHECK_EQ(Absolutized("' <img:pics/logo.png>\n"), std::string("(unchanged)"));
+}
+
+TEST(LeavesUrlsAbsolutePathsAndLibrariesAlone) {
+    CHECK_EQ(Absolutized("@startuml\n"
+                         "!include https://example.com/common.puml\n"
+                         "!include /etc/plantuml/common.puml\n"
+                         "!include <C4/C4_Container>\n"
+                         "!include $DIR/common.puml\n"
+                         "!theme corporate from https://example.com/themes\n"
+                         "A : <img:http://example.com/logo.png>\n"
+                         "B : <img:/srv/logo.png>\n"
+                         "@enduml\n"),
+             std::string("(unchanged)"));
+    // Nothing to rewrite without a base directory.
+    std::string out = "(unchanged)";
+    CHECK(!puml::AbsolutizeReferences("!include common.puml\n", "", out));
+    CHECK_EQ(out, std::string("(unchanged)"));
+    // Relative references are rewritten next to absolute ones left as written.
+    CHECK_EQ(Absolutized("!include /etc/a.puml\n!include b.puml\n"),
+             std::string("!include /etc/a.puml\n!include /work/diagrams/b.puml\n"));
+}
+
+// Included files are resolved against their own directory, and files that
+// include each other are listed once each.
+TEST(ScansNestedIncludesAndCycles) {
+    puml_test::TempDir dir("scanner");
+    Write(dir.Path(), "a.puml", "!include sub/b.puml\nA : <img:logo.png>\n");
+    Write(dir.Path(), "sub/b.puml", "!include ../a.puml\n!includesub parts.puml!BASIC\n");
+    Write(dir.Path(), "sub/parts.puml", "!startsub BASIC\nA -> B\n!endsub\n");
+
+    puml::DependencyScanner scanner;
+    const puml::DependencyGraph graph = scanner.Scan("@startuml\n!include a.puml\n@enduml\n", dir.Path());
+    REQUIRE(graph.files.size() == 4);
+    CHECK_EQ(graph.files[0].path, Normalized(dir.Path(), "a.puml"));
+    CHECK_EQ(graph.files[1].path, Normalized(dir.Path(), "sub/b.puml"));
+    CHECK_EQ(graph.files[2].path, Normalized(dir.Path(), "logo.png"));
+    CHECK_EQ(graph.files[3].path, Normalized(dir.Path(), "sub/parts.puml"));
+    CHECK(graph.roots == std::vector<size_t>{0});
+    CHECK((graph.files[0].dependencies == std::vector<size_t>{1, 2}));
+    CHECK((graph.files[1].dependencies == std::vector<size_t>{0, 3}));
+    CHECK(graph.files[0].exists);
+    CHECK(!graph.files[2].exists);
+    CHECK(graph.files[3].exists);
+    CHECK(!graph.truncated);
+    CHECK(graph.combinedHash != 0);
+
+    CHECK_EQ(scanner.Scan("@startuml\nA -> B\n@enduml\n", dir.Path()).combinedHash, uint64_t{0});
+}
+
+TEST(CombinedHashFollowsNestedIncludes) {
+    puml_test::TempDir dir("scanner");
+    Write(dir.Path(), "a.puml", "!include sub/b.puml\n");
+    Write(dir.Path(), "sub/b.puml", "A -> B\n");
+    const std::string source = "@startuml\n!include a.puml\n@enduml\n";
+
+    puml::DependencyScanner scanner;
+    const uint64_t original = scanner.Scan(source, dir.Path()).combinedHash;
+    CHECK_EQ(scanner.Scan(source, dir.Path()).combinedHash, original);
+
+    // A different size, so the change shows whatever the timestamp resolution.
+    Write(dir.Path(), "sub/b.puml", "A -> B : changed\n");
+    const uint64_t changed = scanner.Scan(source, dir.Path()).combinedHash;
+    CHECK(changed != original);
+
+    // The hash is of the contents: restoring them restores it.
+    Write(dir.Path(), "sub/b.puml", "A -> B\n");
+    CHECK_EQ(scanner.Scan(source, dir.Path()).combinedHash, original);
+
+    // A file the diagram references appearing changes it too.
+    Write(dir.Path(), "sub/b.puml", "A -> B\n!include c.puml\n");
+    const uint64_t missing = scanner.Scan(source, dir.Path()).combinedHash;
+    Write(dir.Path(), "sub/c.puml", "B -> C\n");
+    CHECK(scanner.Scan(source, dir.Path()).combinedHash != missing);
+}
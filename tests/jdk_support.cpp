@@ -0,0 +1,67 @@
+#include "jdk_support.h"
+
+#include "test_support.h"
+
+#include "core/jvm_renderer.h"
+
+#include <cstdlib>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+namespace puml_test {
+
+namespace {
+
+std::string Env(const char* name) {
+    const char* value = std::getenv(name);
+    return value ? value : "";
+}
+
+std::string FindOnPath(const std::string& program) {
+    const std::string path = Env("PATH");
+    size_t start = 0;
+    while (start <= path.size()) {
+        size_t end = path.find(':', start);
+        if (end == std::string::npos) end = path.size();
+        if (end > start) {
+            const fs::path candidate = fs::path(path.substr(start, end - start)) / program;
+            std::error_code ec;
+            if (fs::is_regular_file(candidate, ec)) return candidate.string();
+        }
+        start = end + 1;
+    }
+    return "";
+}
+
+} // namespace
+
+Jdk FindJdk(std::string* reason) {
+    Jdk jdk;
+    jdk.java = Arg("java");
+    if (jdk.java.empty() && !Env("JAVA_HOME").empty()) {
+        jdk.java = (fs::path(Env("JAVA_HOME")) / "bin" / "java").string();
+    }
+    if (jdk.java.empty()) jdk.java = FindOnPath("java");
+    jdk.jvmLibrary = jdk.java.empty() ? "" : puml::FindJvmLibrary(jdk.java);
+    jdk.jar = Arg("jar");
+    if (jdk.jar.empty()) jdk.jar = Env("PLANTUML_JAR");
+
+    std::error_code ec;
+    if (jdk.java.empty() || jdk.jvmLibrary.empty()) {
+        *reason = "no JDK found (set JAVA_HOME or pass java=)";
+    } else if (jdk.jar.empty() || !fs::is_regular_file(jdk.jar, ec)) {
+        *reason = "no plantuml.jar (set PLANTUML_JAR or pass jar=)";
+    }
+    return jdk;
+}
+
+bool HaveJni() {
+#ifdef PUML_HAVE_JNI
+    return true;
+#else
+    return false;
+#endif
+}
+
+} // namespace puml_test
@@ -0,0 +1,24 @@
+// The Java installation and plantuml.jar the JVM tests run against. They
+// come from java=/jar= on the command line, else JAVA_HOME (or java on PATH)
+// and PLANTUML_JAR; a test without them, or built without the JNI headers,
+// is skipped.
+
+#pragma once
+
+#include <string>
+
+namespace puml_test {
+
+struct Jdk {
+    std::string java;         // the java executable
+    std::string jvmLibrary;   // its libjvm.so
+    std::string jar;          // plantuml.jar
+};
+
+// Empty fields where nothing was found; reason says what is missing.
+Jdk FindJdk(std::string* reason);
+
+// True if the engine was built with the JNI headers (PUML_HAVE_JNI).
+bool HaveJni();
+
+} // namespace puml_test
@@ -0,0 +1,88 @@
+// JvmRenderer against a real JDK and plantuml.jar; skipped without them.
+// A process can host one JVM, so every case shares one renderer.
+
+#include "test_support.h"
+#include "jdk_support.h"
+
+#include "core/cancellation.h"
+#include "core/jvm_renderer.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+// The shared renderer, or SKIP if this machine cannot run one.
+puml::JvmRenderer& Renderer() {
+    static std::unique_ptr<puml::JvmRenderer> renderer;
+    static std::string skipped;
+    if (!renderer && skipped.empty()) {
+        const puml_test::Jdk jdk = puml_test::FindJdk(&skipped);
+        if (skipped.empty() && !puml_test::HaveJni()) skipped = "built without the JNI headers";
+        if (skipped.empty()) {
+            puml::JvmRendererOptions options;
+            options.jvmLibrary = jdk.jvmLibrary;
+            options.jarPath = jdk.jar;
+            options.jvmOptions = {"-Xmx512m"};
+            options.name = "test";
+            renderer = std::make_unique<puml::JvmRenderer>(options);
+        }
+    }
+    if (!renderer) SKIP(skipped);
+    return *renderer;
+}
+
+std::string Text(const std::vector<unsigned char>& bytes) {
+    return std::string(bytes.begin(), bytes.end());
+}
+
+size_t Count(const std::string& text, const std::string& what) {
+    size_t count = 0;
+    for (size_t pos = text.find(what); pos != std::string::npos; pos = text.find(what, pos + 1)) ++count;
+    return count;
+}
+
+const uint32_t kTimeoutMs = 60000;   // the first render starts the JVM
+
+} // namespace
+
+TEST(RendersSvg) {
+    std::vector<unsigned char> out;
+    std::string error;
+    REQUIRE(Renderer().Render("@startuml\nAlice -> Bob : hello\n@enduml\n", true, 0, kTimeoutMs, out, &error));
+    const std::string svg = Text(out);
+    CHECK_EQ(Count(svg, "<svg"), size_t{1});
+    CHECK(svg.find("Alice") != std::string::npos);
+    CHECK(Renderer().Stats().started);
+}
+
+TEST(RendersPng) {
+    std::vector<unsigned char> out;
+    std::string error;
+    REQUIRE(Renderer().Render("@startuml\nA -> B\n@enduml\n", false, 0, kTimeoutMs, out, &error));
+    REQUIRE(out.size() > 8);
+    CHECK(out[1] == 'P' && out[2] == 'N' && out[3] == 'G');
+}
+
+// Every diagram of a source, concatenated in order.
+TEST(RendersEveryDiagram) {
+    std::vector<unsigned char> out;
+    std::string error;
+    REQUIRE(Renderer().Render("@startuml\nFirst -> B\n@enduml\n@startuml\nSecond -> B\n@enduml\n",
+                              true, 0, kTimeoutMs, out, &error));
+    const std::string svg = Text(out);
+    CHECK_EQ(Count(svg, "<svg"), size_t{2});
+    CHECK(svg.find("First") < svg.find("Second"));
+}
+
+TEST(CancelledRequestReturnsAtOnce) {
+    puml::JvmRenderer& renderer = Renderer();
+    puml::CancellationToken cancel;
+    cancel.Cancel();
+    const uint64_t before = renderer.Stats().cancellations;
+    std::vector<unsigned char> out;
+    std::string error;
+    CHECK(!renderer.Render("@startuml\nA -> B\n@enduml\n", true, 0, kTimeoutMs, out, &error, &cancel));
+    CHECK_EQ(renderer.Stats().cancellations, before + 1);
+}
@@ -0,0 +1,211 @@
+// PlantUmlDaemon against plantuml_pipe_simulator, which CTest passes as
+// sim=PATH: pipelining, a retry on a fresh process after a crash, the
+// watchdog and cancellation of a request in flight.
+
+#include "test_support.h"
+
+#include "core/cancellation.h"
+#include "core/plantuml_daemon.h"
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// A daemon on the simulator; settings are -Dsim.<name>=<value> options.
+puml::DaemonOptions SimulatorDaemon(const std::vector<std::string>& settings = {}) {
+    const std::string simulator = puml_test::Arg("sim");
+    if (simulator.empty()) SKIP("no simulator (pass sim=PATH)");
+    puml::DaemonOptions options;
+    options.process.executable = simulator;
+    options.process.arguments = settings;
+    for (const char* arg : {"-jar", "plantuml.jar", "-charset", "UTF-8", "-pipe", "-tsvg"}) {
+        options.process.arguments.push_back(arg);
+    }
+    options.name = "test";
+    return options;
+}
+
+std::string Text(const std::vector<unsigned char>& bytes) {
+    return std::string(bytes.begin(), bytes.end());
+}
+
+size_t Count(const std::string& text, const std::string& what) {
+    size_t count = 0;
+    for (size_t pos = text.find(what); pos != std::string::npos; pos = text.find(what, pos + 1)) ++count;
+    return count;
+}
+
+const uint32_t kTimeoutMs = 10000;
+
+} // namespace
+
+TEST(RendersEveryDiagramInOrder) {
+    puml::PlantUmlDaemon daemon(SimulatorDaemon());
+    std::vector<unsigned char> out;
+    std::string error;
+    REQUIRE(daemon.Render("@startuml\nA -> B\n@enduml\n@startuml\nC -> D\n@enduml\n", kTimeoutMs, out, &error));
+    const std::string svg = Text(out);
+    CHECK_EQ(Count(svg, "<svg"), size_t{2});
+    CHECK(svg.find("sim diagram 1") < svg.find("sim diagram 2"));
+    CHECK(daemon.IsRunning());
+    daemon.Shutdown();
+    CHECK(!daemon.IsRunning());
+}
+
+// Images of about the pipe's read size, so delimiters fall across reads at
+// varying offsets: every byte lands in its own image and none is lost.
+TEST(SplitsImagesAcrossReads) {
+    puml::PlantUmlDaemon daemon(SimulatorDaemon());
+    std::string source;
+    size_t expected = 0;
+    for (size_t size = 65500; size < 65600; size += 9) {
+        source += "@startuml\n' sim: size " + std::to_string(size) + "\nA -> B\n@enduml\n";
+        expected += size;
+    }
+    std::vector<unsigned char> out;
+    std::string error;
+    REQUIRE(daemon.Render(source, kTimeoutMs, out, &error));
+    CHECK_EQ(out.size(), expected);
+    CHECK_EQ(Count(Text(out), "<svg"), size_t{12});
+    CHECK_EQ(Count(Text(out), "~~"), size_t{0});
+}
+
+// Concurrent requests share one process and each gets its own image back.
+TEST(PipelinesConcurrentRequests) {
+    puml::PlantUmlDaemon daemon(SimulatorDaemon({"-Dsim.latency=uniform:5:30"}));
+    const size_t kThreads = 8;
+    std::vector<std::string> results(kThreads);
+    std::vector<char> ok(kThreads, 0);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < kThreads; ++i) {
+        threads.emplace_back([&, i] {
+            std::vector<unsigned char> out;
+            std::string error;
+            const std::string source = "@startuml\nnode" + std::to_string(i) + " -> x\n@enduml\n";
+            ok[i] = daemon.Render(source, kTimeoutMs, out, &error);
+            results[i] = Text(out);
+        });
+    }
+    for (std::thread& thread : threads) thread.join();
+    for (size_t i = 0; i < kThreads; ++i) {
+        CHECK(ok[i]);
+        CHECK_EQ(Count(results[i], "<svg"), size_t{1});
+    }
+    const puml::DaemonStats stats = daemon.Stats();
+    CHECK_EQ(stats.starts, uint64_t{1});
+    CHECK_EQ(stats.renders, uint64_t{kThreads});
+}
+
+// The process dies on its second diagram; the request is retried on a
+// fresh process, whose count starts over, and succeeds.
+TEST(RetriesOnFreshProcessAfterCrash) {
+    puml::PlantUmlDaemon daemon(SimulatorDaemon({"-Dsim.crash_after=1"}));
+    std::vector<unsigned char> out;
+    std::string error;
+    REQUIRE(daemon.Render("@startuml\nfirst -> x\n@enduml\n", kTimeoutMs, out, &error));
+    REQUIRE(daemon.Render("@startuml\nsecond -> x\n@enduml\n", kTimeoutMs, out, &error));
+    CHECK_EQ(Count(Text(out), "<svg"), size_t{1});
+    const puml::DaemonStats stats = daemon.Stats();
+    CHECK_EQ(stats.starts, uint64_t{2});
+    CHECK_EQ(stats.crashes, uint64_t{1});
+    CHECK_EQ(stats.renders, uint64_t{2});
+    CHECK_EQ(stats.failures, uint64_t{0});
+}
+
+// A diagram that crashes every process is given up after the retry.
+TEST(GivesUpAfterSecondCrash) {
+    puml::PlantUmlDaemon daemon(SimulatorDaemon());
+    std::vector<unsigned char> out;
+    std::string error;
+    CHECK(!daemon.Render("@startuml\n' sim: crash\nA -> B\n@enduml\n", kTimeoutMs, out, &error));
+    CHECK(!error.empty());
+    const puml::DaemonStats stats = daemon.Stats();
+    CHECK_EQ(stats.starts, uint64_t{2});
+    CHECK_EQ(stats.failures, uint64_t{1});
+}
+
+// The watchdog kills a hung process at the deadline; the next request gets
+// a fresh one.
+TEST(WatchdogKillsHungProcess) {
+    puml::PlantUmlDaemon daemon(SimulatorDaemon());
+    std::vector<unsigned char> out;
+    std::string error;
+    const auto start = std::chrono::steady_clock::now();
+    CHECK(!daemon.Render("@startuml\n' sim: hang\nA -> B\n@enduml\n", 300, out, &error));
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+    CHECK_EQ(error, std::string("timed out"));
+    CHECK_EQ(daemon.Stats().timeouts, uint64_t{1});
+
+    REQUIRE(daemon.Render("@startuml\nA -> B\n@enduml\n", kTimeoutMs, out, &error));
+    CHECK_EQ(daemon.Stats().starts, uint64_t{2});
+}
+
+// Processes die under concurrent writers: a request waiting for a dying
+// process's stdin must move to its replacement, and none may hang.
+TEST(SurvivesCrashesUnderConcurrentLoad) {
+    puml::PlantUmlDaemon daemon(SimulatorDaemon({"-Dsim.crash_rate=0.1", "-Dsim.seed=7", "-Dsim.latency=uniform:0:5"}));
+    const size_t kThreads = 8;
+    const size_t kRenders = 12;
+    std::vector<size_t> succeeded(kThreads, 0);
+    std::vector<std::thread> threads;
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&, t] {
+            for (size_t i = 0; i < kRenders; ++i) {
+                std::vector<unsigned char> out;
+                std::string error;
+                const std::string source = "@startuml\nn" + std::to_string(t) + "_" + std::to_string(i) + " -> x\n@enduml\n";
+                if (daemon.Render(source, kTimeoutMs, out, &error)) {
+                    ++succeeded[t];
+                    CHECK_EQ(Count(Text(out), "<svg"), size_t{1});
+                } else {
+                    CHECK(!error.empty());
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) thread.join();
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(30));
+    size_t total = 0;
+    for (size_t count : succeeded) total += count;
+    const puml::DaemonStats stats = daemon.Stats();
+    CHECK(stats.starts > 1);
+    CHECK_EQ(stats.renders, uint64_t{total});
+    CHECK_EQ(stats.renders + stats.failures, uint64_t{kThreads * kRenders});
+    CHECK_EQ(stats.timeouts, uint64_t{0});
+}
+
+TEST(CancelWhileInFlightReturnsAtOnce) {
+    puml::PlantUmlDaemon daemon(SimulatorDaemon());
+    puml::CancellationToken cancel;
+    std::thread canceller([&cancel] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        cancel.Cancel();
+    });
+    std::vector<unsigned char> out;
+    std::string error;
+    const auto start = std::chrono::steady_clock::now();
+    const bool ok = daemon.Render("@startuml\n' sim: sleep 5000\nA -> B\n@enduml\n", kTimeoutMs, out, &error, &cancel);
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    canceller.join();
+    CHECK(!ok);
+    CHECK_EQ(error, std::string("cancelled"));
+    CHECK(elapsed < std::chrono::seconds(3));
+    const puml::DaemonStats stats = daemon.Stats();
+    CHECK_EQ(stats.cancellations, uint64_t{1});
+    CHECK_EQ(stats.failures, uint64_t{0});
+}
+
+TEST(CancelledBeforeWriteIsNotSent) {
+    puml::PlantUmlDaemon daemon(SimulatorDaemon());
+    puml::CancellationToken cancel;
+    cancel.Cancel();
+    std::vector<unsigned char> out;
+    std::string error;
+    CHECK(!daemon.Render("@startuml\nA -> B\n@enduml\n", kTimeoutMs, out, &error, &cancel));
+    CHECK_EQ(daemon.Stats().cancellations, uint64_t{1});
+    CHECK_EQ(daemon.Stats().starts, uint64_t{0});
+}
@@ -0,0 +1,167 @@
+// RunProcessPump against stand-in children from the base system (cat, sleep,
+// head, tail): a large exchange, a child that never reads, the deadline,
+// cancellation and the memory limit of a process group.
+
+#include "test_support.h"
+
+#include "core/cancellation.h"
+#include "core/process_pump.h"
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+puml::ProcessSpec Shell(const std::string& command) {
+    puml::ProcessSpec spec;
+    spec.executable = "/bin/sh";
+    spec.arguments = {"-c", command};
+    return spec;
+}
+
+// Bytes that are not all alike, so a reordered or dropped block shows.
+std::string Pattern(size_t size) {
+    std::string text(size, '\0');
+    for (size_t i = 0; i < size; ++i) text[i] = static_cast<char>('a' + (i * 7 + i / 4096) % 26);
+    return text;
+}
+
+// Compared by name, so a failure reports the status it got.
+std::string Status(const puml::PumpResult& result) {
+    return puml::PumpStatusName(result.status);
+}
+
+std::string Text(const std::vector<unsigned char>& bytes) {
+    return std::string(bytes.begin(), bytes.end());
+}
+
+} // namespace
+
+// Far more than a pipe holds in both directions: written and read one after
+// the other, the child would block on a full stdout while we block on its
+// full stdin.
+TEST(LargeExchangeDoesNotDeadlock) {
+    const std::string input = Pattern(8 * 1024 * 1024);
+    puml::PumpOptions options;
+    options.timeoutMs = 20000;
+    puml::SpillableBuffer output(256ull * 1024 * 1024, "");
+    std::string error;
+    const puml::PumpResult result = puml::RunProcessPump(Shell("cat"), input, options, output, &error);
+    CHECK_EQ(Status(result), std::string("completed"));
+    CHECK_EQ(result.exitCode, 0);
+    CHECK(result.stdinComplete);
+    CHECK_EQ(result.outputBytes, static_cast<uint64_t>(input.size()));
+    std::vector<unsigned char> bytes;
+    REQUIRE(output.ReadAll(bytes));
+    CHECK(Text(bytes) == input);
+}
+
+TEST(OutputSpillsPastTheMemoryLimit) {
+    puml_test::TempDir directory("spill");
+    const std::string input = Pattern(1024 * 1024);
+    puml::PumpOptions options;
+    options.timeoutMs = 20000;
+    puml::SpillableBuffer output(128 * 1024, directory.Path());
+    std::string error;
+    const puml::PumpResult result = puml::RunProcessPump(Shell("cat"), input, options, output, &error);
+    CHECK_EQ(Status(result), std::string("completed"));
+    CHECK(output.Spilled());
+    std::vector<unsigned char> bytes;
+    REQUIRE(output.ReadAll(bytes));
+    CHECK(Text(bytes) == input);
+}
+
+// A child that exits without reading everything is not a failure.
+TEST(ChildThatStopsReadingEarly) {
+    const std::string input = Pattern(4 * 1024 * 1024);
+    puml::PumpOptions options;
+    options.timeoutMs = 20000;
+    puml::SpillableBuffer output(1024 * 1024, "");
+    std::string error;
+    const puml::PumpResult result = puml::RunProcessPump(Shell("head -c 10"), input, options, output, &error);
+    CHECK_EQ(Status(result), std::string("completed"));
+    CHECK(!result.stdinComplete);
+    std::vector<unsigned char> bytes;
+    REQUIRE(output.ReadAll(bytes));
+    CHECK_EQ(Text(bytes), input.substr(0, 10));
+}
+
+// The child never reads, so the write of the input blocks on a full pipe;
+// the deadline still has to kill it.
+TEST(DeadlineKillsHungChild) {
+    const std::string input = Pattern(1024 * 1024);
+    puml::PumpOptions options;
+    options.timeoutMs = 300;
+    puml::SpillableBuffer output(1024 * 1024, "");
+    std::string error;
+    const auto start = std::chrono::steady_clock::now();
+    const puml::PumpResult result = puml::RunProcessPump(Shell("exec sleep 30"), input, options, output, &error);
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    CHECK_EQ(Status(result), std::string("timed out"));
+    CHECK(!error.empty());
+    CHECK(elapsed < std::chrono::seconds(10));
+}
+
+TEST(CancellationKillsChild) {
+    puml::CancellationToken cancel;
+    std::thread canceller([&cancel] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        cancel.Cancel();
+    });
+    puml::PumpOptions options;
+    options.timeoutMs = 30000;
+    puml::SpillableBuffer output(1024 * 1024, "");
+    std::string error;
+    const auto start = std::chrono::steady_clock::now();
+    const puml::PumpResult result =
+        puml::RunProcessPump(Shell("exec sleep 30"), Pattern(1024 * 1024), options, output, &error, &cancel);
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    canceller.join();
+    CHECK_EQ(Status(result), std::string("cancelled"));
+    CHECK(elapsed < std::chrono::seconds(10));
+}
+
+TEST(CancelledBeforeStartDoesNotRun) {
+    puml::CancellationToken cancel;
+    cancel.Cancel();
+    puml::PumpOptions options;
+    puml::SpillableBuffer output(1024 * 1024, "");
+    std::string error;
+    const puml::PumpResult result =
+        puml::RunProcessPump(Shell("echo ran"), "", options, output, &error, &cancel);
+    CHECK_EQ(Status(result), std::string("cancelled"));
+    CHECK_EQ(output.Size(), 0ull);
+}
+
+TEST(OutputLimitStopsTheRun) {
+    puml::PumpOptions options;
+    options.timeoutMs = 20000;
+    options.maxOutputBytes = 64 * 1024;
+    puml::SpillableBuffer output(1024 * 1024, "");
+    std::string error;
+    const puml::PumpResult result =
+        puml::RunProcessPump(Shell("cat"), Pattern(1024 * 1024), options, output, &error);
+    CHECK_EQ(Status(result), std::string("output too large"));
+}
+
+#if defined(__linux__)
+// Two grandchildren, each under the limit and the rlimit, over it together:
+// the limit is on the child and everything it starts, so the whole group
+// goes.
+TEST(MemoryLimitCountsTheWholeProcessGroup) {
+    puml::ProcessSpec spec = Shell(
+        "for i in 1 2; do { head -c 40000000 /dev/zero; sleep 10; } | tail -c 40000000 >/dev/null & done; wait");
+    spec.limits.memoryBytes = 64ull * 1024 * 1024;
+    puml::PumpOptions options;
+    options.timeoutMs = 30000;
+    puml::SpillableBuffer output(1024 * 1024, "");
+    std::string error;
+    const auto start = std::chrono::steady_clock::now();
+    const puml::PumpResult result = puml::RunProcessPump(spec, "", options, output, &error);
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    CHECK_EQ(Status(result), std::string("memory limit exceeded"));
+    CHECK(elapsed < std::chrono::seconds(8));
+}
+#endif
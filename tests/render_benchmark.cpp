@@ -0,0 +1,215 @@
+// Renders the same corpus through the in-process JvmRenderer and through a
+// resident "java -jar plantuml.jar -pipe" PlantUmlDaemon and prints their
+// latencies side by side. Needs a JDK and plantuml.jar (see jdk_support.h);
+// corpus=DIR renders the .puml files of a directory instead of the built-in
+// diagrams, rounds=N repeats the corpus (default 5). With sim=PATH, which
+// CTest passes, the daemon and a daemon pool under concurrent clients are
+// also timed on plantuml_pipe_simulator, its per-diagram latency set by
+// latency=SPEC (default lognormal:20:0.5), so the engine's own overhead can
+// be tracked on machines without Java. Labelled "benchmark" in CTest, so
+// "ctest -L benchmark" runs it alone and "-LE benchmark" leaves it out.
+
+#include "test_support.h"
+#include "jdk_support.h"
+
+#include "core/jvm_renderer.h"
+#include "core/plantuml_daemon.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char* const kBuiltInCorpus[] = {
+    "@startuml\nAlice -> Bob : request\nBob --> Alice : response\n@enduml\n",
+    "@startuml\nclass Order {\n  +id : long\n  +total() : Money\n}\nclass Line\nOrder \"1\" *-- \"many\" Line\n@enduml\n",
+    "@startuml\nstart\n:read;\nif (valid?) then (yes)\n  :render;\nelse (no)\n  :report;\nendif\nstop\n@enduml\n",
+    "@startuml\n[*] --> Idle\nIdle --> Busy : start\nBusy --> Idle : done\nBusy --> [*] : crash\n@enduml\n",
+    "@startuml\npackage Viewer {\n  [Window] --> [Cache]\n  [Cache] --> [Renderer]\n}\n[Renderer] ..> [JVM]\n@enduml\n",
+};
+
+std::vector<std::string> Corpus() {
+    std::vector<std::string> corpus;
+    const std::string directory = puml_test::Arg("corpus");
+    if (directory.empty()) {
+        corpus.assign(std::begin(kBuiltInCorpus), std::end(kBuiltInCorpus));
+        return corpus;
+    }
+    std::vector<fs::path> files;
+    std::error_code ec;
+    for (const fs::directory_entry& entry : fs::directory_iterator(directory, ec)) {
+        if (entry.path().extension() == ".puml") files.push_back(entry.path());
+    }
+    std::sort(files.begin(), files.end());
+    for (const fs::path& file : files) {
+        std::ifstream in(file, std::ios::binary);
+        corpus.emplace_back(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    return corpus;
+}
+
+struct Timings {
+    double              firstMs = 0;   // includes starting the JVM
+    std::vector<double> ms;            // every later render
+    size_t              failures = 0;
+};
+
+// The first render on its own, then rounds over the corpus.
+Timings Measure(const std::vector<std::string>& corpus, size_t rounds,
+                const std::function<bool(const std::string&, std::string*)>& render) {
+    Timings timings;
+    const auto timed = [&](const std::string& source) {
+        std::string error;
+        const auto start = std::chrono::steady_clock::now();
+        const bool ok = render(source, &error);
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (!ok) {
+            ++timings.failures;
+            std::printf("  render failed: %s\n", error.c_str());
+        }
+        return ms;
+    };
+    timings.firstMs = timed(corpus.front());
+    for (size_t round = 0; round < rounds; ++round) {
+        for (const std::string& source : corpus) timings.ms.push_back(timed(source));
+    }
+    return timings;
+}
+
+// The first render on its own, then clients threads each running rounds
+// over the corpus at the same time.
+Timings MeasureConcurrent(const std::vector<std::string>& corpus, size_t rounds, size_t clients,
+                          const std::function<bool(const std::string&, std::string*)>& render) {
+    Timings timings = Measure(corpus, 0, render);
+    std::mutex mutex;
+    std::vector<std::thread> threads;
+    for (size_t client = 0; client < clients; ++client) {
+        threads.emplace_back([&]() {
+            const Timings own = Measure(corpus, rounds, render);
+            std::lock_guard<std::mutex> lock(mutex);
+            // Warm by now, so a client's first render counts like the rest.
+            timings.ms.push_back(own.firstMs);
+            timings.ms.insert(timings.ms.end(), own.ms.begin(), own.ms.end());
+            timings.failures += own.failures;
+        });
+    }
+    for (std::thread& thread : threads) thread.join();
+    return timings;
+}
+
+size_t Rounds() {
+    const std::string rounds = puml_test::Arg("rounds");
+    return rounds.empty() ? 5 : std::stoul(rounds);
+}
+
+double Quantile(std::vector<double> values, double q) {
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    return values[static_cast<size_t>(q * (values.size() - 1) + 0.5)];
+}
+
+void Report(const char* name, const Timings& timings) {
+    double total = 0;
+    for (double ms : timings.ms) total += ms;
+    std::printf("  %-9s first %8.1f ms  p50 %7.1f ms  p95 %7.1f ms  mean %7.1f ms  (%zu renders, %zu failed)\n",
+                name, timings.firstMs, Quantile(timings.ms, 0.5), Quantile(timings.ms, 0.95),
+                timings.ms.empty() ? 0.0 : total / timings.ms.size(), timings.ms.size() + 1, timings.failures);
+}
+
+} // namespace
+
+TEST(JvmRendererVersusDaemon) {
+    std::string skipped;
+    const puml_test::Jdk jdk = puml_test::FindJdk(&skipped);
+    if (skipped.empty() && !puml_test::HaveJni()) skipped = "built without the JNI headers";
+    if (!skipped.empty()) SKIP(skipped);
+
+    const std::vector<std::string> corpus = Corpus();
+    REQUIRE(!corpus.empty());
+    const size_t rounds = Rounds();
+    const uint32_t timeoutMs = 60000;
+
+    puml::JvmRendererOptions jvmOptions;
+    jvmOptions.jvmLibrary = jdk.jvmLibrary;
+    jvmOptions.jarPath = jdk.jar;
+    jvmOptions.jvmOptions = {"-Xmx512m"};
+    jvmOptions.name = "benchmark";
+    puml::JvmRenderer jvm(jvmOptions);
+    const Timings inProcess = Measure(corpus, rounds, [&](const std::string& source, std::string* error) {
+        std::vector<unsigned char> out;
+        return jvm.Render(source, true, 0, timeoutMs, out, error);
+    });
+
+    puml::DaemonOptions daemonOptions;
+    daemonOptions.process.executable = jdk.java;
+    daemonOptions.process.arguments = {"-Djava.awt.headless=true", "-Xmx512m", "-jar", jdk.jar,
+                                       "-charset", "UTF-8", "-pipe", "-tsvg"};
+    daemonOptions.name = "benchmark";
+    puml::PlantUmlDaemon daemon(daemonOptions);
+    const Timings piped = Measure(corpus, rounds, [&](const std::string& source, std::string* error) {
+        std::vector<unsigned char> out;
+        return daemon.Render(source, timeoutMs, out, error);
+    });
+    daemon.Shutdown();
+
+    std::printf("%zu diagram(s) x %zu round(s), SVG\n", corpus.size(), rounds);
+    Report("jni", inProcess);
+    Report("daemon", piped);
+    CHECK_EQ(inProcess.failures, size_t{0});
+    CHECK_EQ(piped.failures, size_t{0});
+}
+
+// The engine's share of a render: framing, pipelining several clients into
+// one daemon and the pool spreading them, over a renderer of known latency.
+TEST(DaemonOnSimulator) {
+    const std::string simulator = puml_test::Arg("sim");
+    if (simulator.empty()) SKIP("no simulator (pass sim=PATH)");
+    const std::vector<std::string> corpus = Corpus();
+    REQUIRE(!corpus.empty());
+    const size_t rounds = Rounds();
+    std::string latency = puml_test::Arg("latency");
+    if (latency.empty()) latency = "lognormal:20:0.5";
+    const uint32_t timeoutMs = 60000;
+    const size_t kClients = 4;
+
+    puml::DaemonOptions options;
+    options.process.executable = simulator;
+    options.process.arguments = {"-Dsim.latency=" + latency, "-Dsim.seed=1", "-jar", "plantuml.jar",
+                                 "-charset", "UTF-8", "-pipe", "-tsvg"};
+    options.name = "benchmark";
+    puml::PlantUmlDaemon daemon(options);
+    const auto viaDaemon = [&](const std::string& source, std::string* error) {
+        std::vector<unsigned char> out;
+        return daemon.Render(source, timeoutMs, out, error);
+    };
+    const Timings serial = Measure(corpus, rounds, viaDaemon);
+    const Timings pipelined = MeasureConcurrent(corpus, rounds, kClients, viaDaemon);
+    daemon.Shutdown();
+
+    puml::PlantUmlDaemonPool pool(options, kClients);
+    const Timings pooled = MeasureConcurrent(corpus, rounds, kClients, [&](const std::string& source, std::string* error) {
+        std::vector<unsigned char> out;
+        return pool.Render(source, timeoutMs, out, error);
+    });
+    pool.Shutdown();
+
+    std::printf("%zu diagram(s) x %zu round(s), SVG, simulated latency %s, %zu clients\n",
+                corpus.size(), rounds, latency.c_str(), kClients);
+    Report("daemon", serial);
+    Report("pipelined", pipelined);
+    Report("pool", pooled);
+    CHECK_EQ(serial.failures, size_t{0});
+    CHECK_EQ(pipelined.failures, size_t{0});
+    CHECK_EQ(pooled.failures, size_t{0});
+}
@@ -0,0 +1,219 @@
+// RenderScheduler with tasks that render through a PlantUmlDaemon on
+// plantuml_pipe_simulator (sim=PATH): priority order, latest-wins
+// coalescing, the cap on speculative tasks and CancelKey.
+
+#include "test_support.h"
+
+#include "core/cancellation.h"
+#include "core/plantuml_daemon.h"
+#include "core/render_scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const uint32_t kTimeoutMs = 10000;
+
+puml::DaemonOptions SimulatorDaemon() {
+    const std::string simulator = puml_test::Arg("sim");
+    if (simulator.empty()) SKIP("no simulator (pass sim=PATH)");
+    puml::DaemonOptions options;
+    options.process.executable = simulator;
+    options.process.arguments = {"-jar", "plantuml.jar", "-charset", "UTF-8", "-pipe", "-tsvg"};
+    options.name = "test";
+    return options;
+}
+
+std::string Diagram(const std::string& name, uint32_t sleepMs = 0) {
+    std::string source = "@startuml\n";
+    if (sleepMs) source += "' sim: sleep " + std::to_string(sleepMs) + "\n";
+    return source + name + " -> x\n@enduml\n";
+}
+
+// What the tasks did, in the order they did it.
+class Journal {
+public:
+    void Add(const std::string& entry) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            entries_.push_back(entry);
+        }
+        cv_.notify_all();
+    }
+
+    // The entries once there are count of them, or what there is after 10 s.
+    std::vector<std::string> Wait(size_t count) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait_for(lock, std::chrono::seconds(10), [&]() { return entries_.size() >= count; });
+        return entries_;
+    }
+
+private:
+    std::mutex               mutex_;
+    std::condition_variable  cv_;
+    std::vector<std::string> entries_;
+};
+
+// Held by a task until opened, to fill the queue behind it.
+class Gate {
+public:
+    void Open() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            open_ = true;
+        }
+        cv_.notify_all();
+    }
+    void Pass() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this]() { return open_; });
+    }
+
+private:
+    std::mutex              mutex_;
+    std::condition_variable cv_;
+    bool                    open_ = false;
+};
+
+// A task rendering name through the daemon; the journal gets "name" or
+// "name cancelled".
+puml::RenderTask RenderTask(puml::PlantUmlDaemon& daemon, Journal& journal, const std::string& name,
+                            uint32_t sleepMs = 0) {
+    return [&daemon, &journal, name, sleepMs](const puml::CancellationToken& cancel) {
+        std::vector<unsigned char> out;
+        std::string error;
+        const bool ok = daemon.Render(Diagram(name, sleepMs), kTimeoutMs, out, &error, &cancel);
+        journal.Add(ok ? name : name + " " + error);
+    };
+}
+
+} // namespace
+
+TEST(RunsHigherPrioritiesFirst) {
+    puml::PlantUmlDaemon daemon(SimulatorDaemon());
+    puml::RenderScheduler scheduler(1, "test");
+    Journal journal;
+    Gate gate;
+    scheduler.Submit(puml::RenderPriority::Foreground, "", [&](const puml::CancellationToken&) {
+        gate.Pass();
+        journal.Add("first");
+    });
+    scheduler.Submit(puml::RenderPriority::Speculative, "", RenderTask(daemon, journal, "speculative1"));
+    scheduler.Submit(puml::RenderPriority::FormatSwitch, "", RenderTask(daemon, journal, "switch"));
+    scheduler.Submit(puml::RenderPriority::Speculative, "", RenderTask(daemon, journal, "speculative2"));
+    scheduler.Submit(puml::RenderPriority::Foreground, "", RenderTask(daemon, journal, "foreground"));
+    gate.Open();
+
+    const std::vector<std::string> order = journal.Wait(5);
+    const std::vector<std::string> expected = {"first", "foreground", "switch", "speculative1", "speculative2"};
+    CHECK(order == expected);
+    const puml::RenderSchedulerStats stats = scheduler.Stats();
+    CHECK_EQ(stats.startedByPriority[0], uint64_t{2});
+    CHECK_EQ(stats.startedByPriority[1], uint64_t{1});
+    CHECK_EQ(stats.startedByPriority[2], uint64_t{2});
+    CHECK_EQ(daemon.Stats().renders, uint64_t{4});
+}
+
+// Three requests for the same window while a slow one renders: the running
+// render is cancelled, the queued ones are dropped unrun, and only the last
+// is rendered.
+TEST(LatestRequestForAKeyWins) {
+    puml::PlantUmlDaemon daemon(SimulatorDaemon());
+    puml::RenderScheduler scheduler(1, "test");
+    Journal journal;
+    Journal started;
+    scheduler.Submit(puml::RenderPriority::Foreground, "window", [&](const puml::CancellationToken& cancel) {
+        started.Add("slow");
+        RenderTask(daemon, journal, "slow", 5000)(cancel);
+    });
+    started.Wait(1);
+    const auto submitted = Clock::now();
+    for (const char* name : {"a", "b", "c"}) {
+        scheduler.Submit(puml::RenderPriority::Foreground, "window", RenderTask(daemon, journal, name));
+    }
+
+    journal.Wait(1);
+    CHECK(Clock::now() - submitted < std::chrono::seconds(3));
+    const std::vector<std::string> order = journal.Wait(2);
+    const std::vector<std::string> expected = {"slow cancelled", "c"};
+    CHECK(order == expected);
+    const puml::RenderSchedulerStats stats = scheduler.Stats();
+    CHECK_EQ(stats.coalesced, uint64_t{2});
+    CHECK_EQ(stats.started, uint64_t{2});
+    CHECK_EQ(daemon.Stats().cancellations, uint64_t{1});
+    CHECK_EQ(daemon.Stats().renders, uint64_t{1});
+}
+
+// Speculative work capped at one task leaves the other threads to a
+// foreground render, which does not wait for the prefetch queue.
+TEST(SpeculativeLimitLeavesThreadsForeground) {
+    puml::PlantUmlDaemonPool pool(SimulatorDaemon(), 3);
+    puml::RenderScheduler scheduler(3, "test");
+    scheduler.SetConcurrencyLimit(puml::RenderPriority::Speculative, 1);
+    Journal journal;
+    std::mutex mutex;
+    size_t running = 0;
+    size_t maxRunning = 0;
+    for (int i = 0; i < 4; ++i) {
+        scheduler.Submit(puml::RenderPriority::Speculative, "", [&, i](const puml::CancellationToken& cancel) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                maxRunning = std::max(maxRunning, ++running);
+            }
+            std::vector<unsigned char> out;
+            std::string error;
+            pool.Render(Diagram("prefetch" + std::to_string(i), 150), kTimeoutMs, out, &error, &cancel, true);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                --running;
+            }
+            journal.Add("prefetch");
+        });
+    }
+    scheduler.Submit(puml::RenderPriority::Foreground, "", [&](const puml::CancellationToken& cancel) {
+        std::vector<unsigned char> out;
+        std::string error;
+        journal.Add(pool.Render(Diagram("shown"), kTimeoutMs, out, &error, &cancel) ? "shown" : error);
+    });
+
+    const std::vector<std::string> order = journal.Wait(5);
+    REQUIRE(order.size() == 5);
+    CHECK_EQ(order.front(), std::string("shown"));
+    CHECK_EQ(maxRunning, size_t{1});
+    CHECK_EQ(pool.Stats().renders, uint64_t{5});
+}
+
+TEST(CancelKeyStopsRunningAndQueuedTasks) {
+    puml::PlantUmlDaemon daemon(SimulatorDaemon());
+    puml::RenderScheduler scheduler(1, "test");
+    Journal journal;
+    Journal started;
+    scheduler.Submit(puml::RenderPriority::Foreground, "window", [&](const puml::CancellationToken& cancel) {
+        started.Add("slow");
+        RenderTask(daemon, journal, "slow", 5000)(cancel);
+    });
+    started.Wait(1);
+    scheduler.Submit(puml::RenderPriority::Speculative, "other", RenderTask(daemon, journal, "other"));
+    // Without a key, so neither CancelKey touches it.
+    scheduler.Submit(puml::RenderPriority::Speculative, "", RenderTask(daemon, journal, "unkeyed"));
+    const auto cancelled = Clock::now();
+    scheduler.CancelKey("window");
+    scheduler.CancelKey("other");
+
+    journal.Wait(1);
+    CHECK(Clock::now() - cancelled < std::chrono::seconds(3));
+    const std::vector<std::string> order = journal.Wait(2);
+    const std::vector<std::string> expected = {"slow cancelled", "unkeyed"};
+    CHECK(order == expected);
+    const puml::RenderSchedulerStats stats = scheduler.Stats();
+    CHECK_EQ(stats.cancelled, uint64_t{2});
+    CHECK_EQ(stats.coalesced, uint64_t{0});
+    CHECK_EQ(daemon.Stats().cancellations, uint64_t{1});
+}
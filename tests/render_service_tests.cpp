@@ -0,0 +1,324 @@
+// The render service protocol and server over a Unix socket: payload
+// encoding, version mismatches, concurrent clients rendering through a
+// PlantUmlDaemon on plantuml_pipe_simulator (sim=PATH), the single owner of
+// an endpoint, the idle exit and a client that cancels.
+
+#include "test_support.h"
+
+#include "core/cancellation.h"
+#include "core/local_channel.h"
+#include "core/plantuml_daemon.h"
+#include "core/render_service.h"
+
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Endpoints are per user; the pid keeps parallel test runs apart.
+std::string UniqueEndpoint() {
+    static std::atomic<unsigned> counter{0};
+    return "puml-test-" + std::to_string(getpid()) + "-" + std::to_string(++counter);
+}
+
+puml::RenderServiceRequest SampleRequest() {
+    puml::RenderServiceRequest request;
+    request.source = "@startuml\nA -> B\n@enduml\n";
+    request.workingDirectory = "/home/user/diagrams";
+    request.svg = false;
+    request.imageIndex = 3;
+    request.timeoutMs = 1234;
+    request.background = true;
+    return request;
+}
+
+std::string Text(const std::vector<unsigned char>& bytes) {
+    return std::string(bytes.begin(), bytes.end());
+}
+
+puml::DaemonOptions SimulatorDaemon() {
+    const std::string simulator = puml_test::Arg("sim");
+    if (simulator.empty()) SKIP("no simulator (pass sim=PATH)");
+    puml::DaemonOptions options;
+    options.process.executable = simulator;
+    options.process.arguments = {"-Dsim.latency=uniform:5:20", "-jar", "plantuml.jar", "-charset", "UTF-8",
+                                 "-pipe", "-tsvg"};
+    options.name = "test";
+    return options;
+}
+
+// A server whose handler renders through a daemon on the simulator, the
+// way plantuml_render_service does.
+struct SimulatorService {
+    SimulatorService() : daemon(SimulatorDaemon()) {}
+
+    std::unique_ptr<puml::RenderServiceServer> Serve(const std::string& endpoint) {
+        puml::RenderServiceServerOptions options;
+        options.endpoint = endpoint;
+        auto server = std::make_unique<puml::RenderServiceServer>(options,
+            [this](const puml::RenderServiceRequest& request, const puml::CancellationToken& cancel) {
+                puml::RenderServiceResponse response;
+                response.status = daemon.Render(request.source, request.timeoutMs, response.image,
+                                                &response.error, &cancel)
+                    ? puml::RenderServiceStatus::Rendered
+                    : puml::RenderServiceStatus::Failed;
+                return response;
+            });
+        bool inUse = false;
+        std::string error;
+        REQUIRE(server->Start(&inUse, &error));
+        return server;
+    }
+
+    puml::PlantUmlDaemon daemon;
+};
+
+// Waits for a count that another thread updates.
+template <typename Fn>
+bool Eventually(Fn condition) {
+    const Clock::time_point until = Clock::now() + std::chrono::seconds(5);
+    while (!condition()) {
+        if (Clock::now() >= until) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return true;
+}
+
+} // namespace
+
+TEST(RequestRoundTrip) {
+    const puml::RenderServiceRequest request = SampleRequest();
+    const std::vector<unsigned char> payload = puml::EncodeRenderRequest(request);
+    puml::RenderServiceRequest decoded;
+    REQUIRE(puml::DecodeRenderRequest(payload.data(), payload.size(), decoded));
+    CHECK_EQ(decoded.source, request.source);
+    CHECK_EQ(decoded.workingDirectory, request.workingDirectory);
+    CHECK(!decoded.svg);
+    CHECK_EQ(decoded.imageIndex, uint32_t{3});
+    CHECK_EQ(decoded.timeoutMs, uint32_t{1234});
+    CHECK(decoded.background);
+}
+
+TEST(ResponseRoundTrip) {
+    puml::RenderServiceResponse response;
+    response.status = puml::RenderServiceStatus::Failed;
+    response.error = "syntax error";
+    response.image = {1, 2, 3, 0, 255};
+    const std::vector<unsigned char> payload = puml::EncodeRenderResponse(response);
+    puml::RenderServiceResponse decoded;
+    REQUIRE(puml::DecodeRenderResponse(payload.data(), payload.size(), decoded));
+    CHECK(decoded.status == puml::RenderServiceStatus::Failed);
+    CHECK_EQ(decoded.error, response.error);
+    CHECK(decoded.image == response.image);
+}
+
+TEST(DecodingRejectsTruncatedAndTrailingBytes) {
+    std::vector<unsigned char> request = puml::EncodeRenderRequest(SampleRequest());
+    puml::RenderServiceResponse sample;
+    sample.status = puml::RenderServiceStatus::Rendered;
+    sample.image = {'<', 's', 'v', 'g', '>'};
+    std::vector<unsigned char> response = puml::EncodeRenderResponse(sample);
+    for (size_t size = 0; size < request.size(); ++size) {
+        puml::RenderServiceRequest decoded;
+        CHECK(!puml::DecodeRenderRequest(request.data(), size, decoded));
+    }
+    for (size_t size = 0; size < response.size(); ++size) {
+        puml::RenderServiceResponse decoded;
+        CHECK(!puml::DecodeRenderResponse(response.data(), size, decoded));
+    }
+    request.push_back(0);
+    response.push_back(0);
+    puml::RenderServiceRequest decodedRequest;
+    CHECK(!puml::DecodeRenderRequest(request.data(), request.size(), decodedRequest));
+    puml::RenderServiceResponse decodedResponse;
+    CHECK(!puml::DecodeRenderResponse(response.data(), response.size(), decodedResponse));
+}
+
+TEST(UnknownFlagsAndStatusAreRejected) {
+    std::vector<unsigned char> request = puml::EncodeRenderRequest(SampleRequest());
+    request[0] = 4;
+    puml::RenderServiceRequest decodedRequest;
+    CHECK(!puml::DecodeRenderRequest(request.data(), request.size(), decodedRequest));
+    std::vector<unsigned char> response = puml::EncodeRenderResponse(puml::RenderServiceResponse());
+    response[0] = 3;
+    puml::RenderServiceResponse decodedResponse;
+    CHECK(!puml::DecodeRenderResponse(response.data(), response.size(), decodedResponse));
+}
+
+// A service of another plugin version answers in its own protocol: the
+// client renders locally instead of misreading the answer.
+TEST(OtherProtocolVersionIsUnavailable) {
+    const std::string endpoint = UniqueEndpoint();
+    bool inUse = false;
+    std::string error;
+    std::unique_ptr<puml::LocalListener> listener = puml::ListenLocalEndpoint(endpoint, &inUse, &error);
+    REQUIRE(listener);
+    std::thread server([&listener]() {
+        std::unique_ptr<puml::LocalConnection> connection = listener->Accept();
+        if (!connection) return;
+        unsigned char header[12];
+        if (!connection->ReadAll(header, sizeof(header), Clock::now() + std::chrono::seconds(5))) return;
+        const uint32_t size = header[8] | (header[9] << 8) | (header[10] << 16) | (uint32_t{header[11]} << 24);
+        std::vector<unsigned char> payload(size);
+        if (size && !connection->ReadAll(payload.data(), size, Clock::now() + std::chrono::seconds(5))) return;
+        puml::RenderServiceResponse response;
+        response.status = puml::RenderServiceStatus::Rendered;
+        response.image = {'x'};
+        const std::vector<unsigned char> body = puml::EncodeRenderResponse(response);
+        unsigned char reply[12] = {'P', 'U', 'M', 'R', 0, 0, 2, 0};
+        reply[4] = static_cast<unsigned char>(puml::kRenderServiceProtocolVersion + 1);
+        for (int i = 0; i < 4; ++i) reply[8 + i] = static_cast<unsigned char>(body.size() >> (8 * i));
+        connection->WriteAll(reply, sizeof(reply));
+        connection->WriteAll(body.data(), body.size());
+    });
+    std::vector<unsigned char> out;
+    const puml::RenderServiceOutcome outcome =
+        puml::RequestRender(endpoint, SampleRequest(), 1000, out, &error);
+    server.join();
+    CHECK_EQ(std::string(puml::RenderServiceOutcomeName(outcome)), std::string("unavailable"));
+    CHECK(out.empty());
+}
+
+TEST(NoServiceIsUnavailable) {
+    std::vector<unsigned char> out;
+    std::string error;
+    const puml::RenderServiceOutcome outcome =
+        puml::RequestRender(UniqueEndpoint(), SampleRequest(), 200, out, &error);
+    CHECK_EQ(std::string(puml::RenderServiceOutcomeName(outcome)), std::string("unavailable"));
+    CHECK(!error.empty());
+}
+
+TEST(SecondStartReportsInUse) {
+    const std::string endpoint = UniqueEndpoint();
+    const auto handler = [](const puml::RenderServiceRequest&, const puml::CancellationToken&) {
+        return puml::RenderServiceResponse();
+    };
+    puml::RenderServiceServerOptions options;
+    options.endpoint = endpoint;
+    puml::RenderServiceServer first(options, handler);
+    bool inUse = false;
+    std::string error;
+    REQUIRE(first.Start(&inUse, &error));
+    CHECK(!inUse);
+
+    puml::RenderServiceServer second(options, handler);
+    CHECK(!second.Start(&inUse, &error));
+    CHECK(inUse);
+
+    // Once the first owner has gone, the endpoint can be taken over.
+    first.Stop();
+    puml::RenderServiceServer third(options, handler);
+    CHECK(third.Start(&inUse, &error));
+    CHECK(!inUse);
+}
+
+TEST(WaitReturnsAfterIdlePeriod) {
+    puml::RenderServiceServerOptions options;
+    options.endpoint = UniqueEndpoint();
+    options.idleExitMs = 300;
+    puml::RenderServiceServer server(options, [](const puml::RenderServiceRequest&, const puml::CancellationToken&) {
+        puml::RenderServiceResponse response;
+        response.status = puml::RenderServiceStatus::Rendered;
+        response.image = {'x'};
+        return response;
+    });
+    bool inUse = false;
+    std::string error;
+    REQUIRE(server.Start(&inUse, &error));
+    const Clock::time_point start = Clock::now();
+    // A request in the middle of the period starts it over.
+    std::thread client([&options]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        std::vector<unsigned char> out;
+        std::string clientError;
+        puml::RequestRender(options.endpoint, SampleRequest(), 1000, out, &clientError);
+    });
+    server.Wait();
+    const auto idle = Clock::now() - start;
+    client.join();
+    CHECK(idle >= std::chrono::milliseconds(450));
+    CHECK(idle < std::chrono::seconds(5));
+    CHECK_EQ(server.Stats().requests, uint64_t{1});
+}
+
+TEST(ServesConcurrentClients) {
+    SimulatorService service;
+    const std::string endpoint = UniqueEndpoint();
+    std::unique_ptr<puml::RenderServiceServer> server = service.Serve(endpoint);
+    const size_t kClients = 8;
+    const size_t kRequests = 4;
+    std::vector<size_t> rendered(kClients, 0);
+    std::vector<std::thread> clients;
+    for (size_t c = 0; c < kClients; ++c) {
+        clients.emplace_back([&, c]() {
+            for (size_t i = 0; i < kRequests; ++i) {
+                puml::RenderServiceRequest request;
+                request.source = "@startuml\nclient" + std::to_string(c) + " -> r" + std::to_string(i) + "\n@enduml\n";
+                request.timeoutMs = 10000;
+                std::vector<unsigned char> out;
+                std::string error;
+                if (puml::RequestRender(endpoint, request, 2000, out, &error) ==
+                        puml::RenderServiceOutcome::Rendered &&
+                    Text(out).find("<svg") != std::string::npos) {
+                    ++rendered[c];
+                }
+            }
+        });
+    }
+    for (std::thread& client : clients) client.join();
+    for (size_t c = 0; c < kClients; ++c) CHECK_EQ(rendered[c], kRequests);
+    const puml::RenderServiceStats stats = server->Stats();
+    CHECK_EQ(stats.connections, uint64_t{kClients * kRequests});
+    CHECK_EQ(stats.requests, uint64_t{kClients * kRequests});
+    CHECK_EQ(stats.failures, uint64_t{0});
+    CHECK_EQ(service.daemon.Stats().renders, uint64_t{kClients * kRequests});
+}
+
+TEST(FailedRenderIsReportedAsFailed) {
+    SimulatorService service;
+    const std::string endpoint = UniqueEndpoint();
+    std::unique_ptr<puml::RenderServiceServer> server = service.Serve(endpoint);
+    puml::RenderServiceRequest request;
+    request.source = "@startuml\n' sim: crash\nA -> B\n@enduml\n";
+    request.timeoutMs = 10000;
+    std::vector<unsigned char> out;
+    std::string error;
+    const puml::RenderServiceOutcome outcome = puml::RequestRender(endpoint, request, 2000, out, &error);
+    CHECK_EQ(std::string(puml::RenderServiceOutcomeName(outcome)), std::string("failed"));
+    CHECK(!error.empty());
+    CHECK_EQ(server->Stats().failures, uint64_t{1});
+}
+
+// The client gives up (cancelled, or replaced by a newer request of its
+// window): the service must stop rendering for it, not finish the diagram.
+TEST(ClientCancellationStopsTheRender) {
+    SimulatorService service;
+    const std::string endpoint = UniqueEndpoint();
+    std::unique_ptr<puml::RenderServiceServer> server = service.Serve(endpoint);
+    puml::RenderServiceRequest request;
+    request.source = "@startuml\n' sim: sleep 5000\nA -> B\n@enduml\n";
+    request.timeoutMs = 10000;
+    puml::CancellationToken cancel;
+    std::thread canceller([&cancel]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        cancel.Cancel();
+    });
+    std::vector<unsigned char> out;
+    std::string error;
+    const Clock::time_point start = Clock::now();
+    const puml::RenderServiceOutcome outcome = puml::RequestRender(endpoint, request, 2000, out, &error, &cancel);
+    canceller.join();
+    CHECK_EQ(std::string(puml::RenderServiceOutcomeName(outcome)), std::string("cancelled"));
+    CHECK(Eventually([&]() { return server->Stats().abandoned == 1; }));
+    CHECK(Clock::now() - start < std::chrono::seconds(3));
+    CHECK_EQ(service.daemon.Stats().cancellations, uint64_t{1});
+    CHECK_EQ(server->Stats().failures, uint64_t{0});
+}
@@ -0,0 +1,157 @@
+// SingleFlight over renders through a PlantUmlDaemon on
+// plantuml_pipe_simulator (sim=PATH): callers joining a render in flight,
+// a caller abandoning it while others still wait, and the render being
+// cancelled once every caller has gone.
+
+#include "test_support.h"
+
+#include "core/cancellation.h"
+#include "core/plantuml_daemon.h"
+#include "core/single_flight.h"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using Image = std::vector<unsigned char>;
+
+puml::DaemonOptions SimulatorDaemon() {
+    const std::string simulator = puml_test::Arg("sim");
+    if (simulator.empty()) SKIP("no simulator (pass sim=PATH)");
+    puml::DaemonOptions options;
+    options.process.executable = simulator;
+    options.process.arguments = {"-jar", "plantuml.jar", "-charset", "UTF-8", "-pipe", "-tsvg"};
+    options.name = "test";
+    return options;
+}
+
+// The work every caller of a flight asks for: one slow render, counted.
+struct SlowRender {
+    explicit SlowRender(uint32_t sleepMs) : daemon(SimulatorDaemon()) {
+        source = "@startuml\n' sim: sleep " + std::to_string(sleepMs) + "\nA -> B\n@enduml\n";
+        work = [this](const puml::CancellationToken& cancel) {
+            ++started;
+            Image out;
+            std::string error;
+            daemon.Render(source, 10000, out, &error, &cancel);
+            return out;
+        };
+    }
+
+    // Until the leader's work is running, so the next caller joins it.
+    void WaitStarted() {
+        const auto deadline = Clock::now() + std::chrono::seconds(5);
+        while (started.load() == 0 && Clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
+
+    puml::PlantUmlDaemon              daemon;
+    std::string                       source;
+    std::atomic<int>                  started{0};
+    puml::SingleFlight<Image>::Work   work;
+};
+
+} // namespace
+
+TEST(ConcurrentCallersShareOneRender) {
+    SlowRender render(300);
+    puml::SingleFlight<Image> flights;
+    const size_t kCallers = 4;
+    std::vector<Image> results(kCallers);
+    std::vector<char> ok(kCallers, 0);
+    std::vector<char> joined(kCallers, 0);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < kCallers; ++i) {
+        if (i == 1) render.WaitStarted();
+        threads.emplace_back([&, i]() {
+            bool wasJoined = false;
+            ok[i] = flights.Do("key", nullptr, render.work, results[i], &wasJoined);
+            joined[i] = wasJoined;
+        });
+    }
+    for (std::thread& thread : threads) thread.join();
+
+    for (size_t i = 0; i < kCallers; ++i) {
+        CHECK(ok[i]);
+        CHECK(!results[i].empty());
+        CHECK(results[i] == results[0]);
+        CHECK_EQ(joined[i] != 0, i != 0);
+    }
+    CHECK_EQ(render.started.load(), 1);
+    CHECK_EQ(render.daemon.Stats().renders, uint64_t{1});
+    const puml::SingleFlightStats stats = flights.Stats();
+    CHECK_EQ(stats.executed, uint64_t{1});
+    CHECK_EQ(stats.joined, uint64_t{kCallers - 1});
+    CHECK_EQ(stats.inFlight, uint64_t{0});
+}
+
+// The window that started the render moves on; the one that joined it
+// still gets the image, from the same single render.
+TEST(AbandonedByOneCallerStillServesTheOthers) {
+    SlowRender render(300);
+    puml::SingleFlight<Image> flights;
+    puml::CancellationToken leaderCancel;
+    bool leaderOk = true;
+    Image leaderResult;
+    std::thread leader([&]() { leaderOk = flights.Do("key", &leaderCancel, render.work, leaderResult); });
+    render.WaitStarted();
+
+    Image result;
+    bool followerOk = false;
+    std::thread follower([&]() { followerOk = flights.Do("key", nullptr, render.work, result); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    leaderCancel.Cancel();
+    leader.join();
+    follower.join();
+
+    CHECK(!leaderOk);
+    CHECK(followerOk);
+    CHECK(!result.empty());
+    CHECK_EQ(render.started.load(), 1);
+    CHECK_EQ(render.daemon.Stats().renders, uint64_t{1});
+    CHECK_EQ(render.daemon.Stats().cancellations, uint64_t{0});
+    const puml::SingleFlightStats stats = flights.Stats();
+    CHECK_EQ(stats.abandoned, uint64_t{1});
+    CHECK_EQ(stats.joined, uint64_t{1});
+}
+
+// Once every caller has gone the render itself is cancelled, and the next
+// caller for the key starts a fresh one instead of joining the dead flight.
+TEST(AbandonedByEveryCallerCancelsTheRender) {
+    SlowRender render(5000);
+    puml::SingleFlight<Image> flights;
+    puml::CancellationToken first;
+    puml::CancellationToken second;
+    Image result;
+    bool firstOk = true;
+    bool secondOk = true;
+    std::thread leader([&]() { firstOk = flights.Do("key", &first, render.work, result); });
+    render.WaitStarted();
+    Image joinedResult;
+    std::thread joiner([&]() { secondOk = flights.Do("key", &second, render.work, joinedResult); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    const auto cancelled = Clock::now();
+    first.Cancel();
+    second.Cancel();
+    leader.join();
+    joiner.join();
+    CHECK(Clock::now() - cancelled < std::chrono::seconds(3));
+    CHECK(!firstOk);
+    CHECK(!secondOk);
+    CHECK_EQ(render.daemon.Stats().cancellations, uint64_t{1});
+    CHECK_EQ(flights.Stats().abandoned, uint64_t{2});
+
+    SlowRender quick(0);
+    bool joined = true;
+    CHECK(flights.Do("key", nullptr, quick.work, result, &joined));
+    CHECK(!joined);
+    CHECK(!result.empty());
+    CHECK_EQ(flights.Stats().executed, uint64_t{2});
+}
@@ -0,0 +1,105 @@
+#include "test_support.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <map>
+#include <vector>
+
+namespace puml_test {
+
+namespace {
+
+struct State {
+    std::map<std::string, TestFn> tests;   // by name, so runs are ordered
+    std::map<std::string, std::string> args;
+    int failures = 0;                        // in the running case
+};
+
+State& GetState() {
+    static State* state = new State();
+    return *state;
+}
+
+} // namespace
+
+Registrar::Registrar(const char* name, TestFn fn) {
+    GetState().tests[name] = fn;
+}
+
+void Fail(const char* file, int line, const std::string& message) {
+    std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, message.c_str());
+    ++GetState().failures;
+}
+
+std::string Arg(const std::string& name) {
+    const auto it = GetState().args.find(name);
+    return it == GetState().args.end() ? std::string() : it->second;
+}
+
+TempDir::TempDir(const std::string& name) {
+    static std::atomic<unsigned> counter{0};
+    const auto stamp = static_cast<unsigned long long>(std::chrono::steady_clock::now().time_since_epoch().count());
+    const std::filesystem::path path = std::filesystem::temp_directory_path() /
+        ("puml-test-" + name + "-" + std::to_string(stamp) + "-" + std::to_string(++counter));
+    std::error_code ec;
+    std::filesystem::create_directories(path, ec);
+    path_ = path.u8string();
+}
+
+TempDir::~TempDir() {
+    std::error_code ec;
+    std::filesystem::remove_all(std::filesystem::u8path(path_), ec);
+}
+
+} // namespace puml_test
+
+int main(int argc, char** argv) {
+    using namespace puml_test;
+    State& state = GetState();
+    std::vector<std::string> selected;
+    for (int i = 1; i < argc; ++i) {
+        const char* equals = std::strchr(argv[i], '=');
+        if (equals) {
+            state.args[std::string(argv[i], static_cast<size_t>(equals - argv[i]))] = equals + 1;
+        } else {
+            selected.push_back(argv[i]);
+        }
+    }
+
+    int failed = 0, passed = 0, skipped = 0;
+    for (const auto& test : state.tests) {
+        if (!selected.empty() && std::find(selected.begin(), selected.end(), test.first) == selected.end()) {
+            continue;
+        }
+        state.failures = 0;
+        std::string note;
+        bool skip = false;
+        try {
+            test.second();
+        } catch (const Abort&) {
+        } catch (const Skipped& s) {
+            skip = true;
+            note = s.reason;
+        } catch (const std::exception& e) {
+            Fail(__FILE__, __LINE__, std::string("exception: ") + e.what());
+        }
+        if (state.failures) {
+            ++failed;
+            std::printf("FAIL %s\n", test.first.c_str());
+        } else if (skip) {
+            ++skipped;
+            std::printf("SKIP %s: %s\n", test.first.c_str(), note.c_str());
+        } else {
+            ++passed;
+            std::printf("ok   %s\n", test.first.c_str());
+        }
+    }
+    std::printf("%d passed, %d failed, %d skipped\n", passed, failed, skipped);
+    if (failed) return 1;
+    return passed == 0 && skipped > 0 ? kSkipExitCode : 0;
+}
@@ -0,0 +1,89 @@
+// Minimal test harness for the engine tests: TEST registers a case, CHECK
+// and CHECK_EQ record a failure and carry on, REQUIRE stops the case, and
+// SKIP ends it without failing (e.g. no JDK on this machine). Every test
+// executable links test_main.cpp, which runs the cases named on the
+// command line, or all of them, and exits with kSkipExitCode when every
+// case that ran was skipped.
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <sstream>
+#include <string>
+
+namespace puml_test {
+
+constexpr int kSkipExitCode = 77;
+
+using TestFn = void (*)();
+
+struct Registrar {
+    Registrar(const char* name, TestFn fn);
+};
+
+// Thrown by REQUIRE and SKIP to leave the running case.
+struct Abort {};
+struct Skipped {
+    std::string reason;
+};
+
+void Fail(const char* file, int line, const std::string& message);
+
+// A path given to the test as NAME=VALUE on the command line (CTest passes
+// e.g. the simulator's location this way), or empty.
+std::string Arg(const std::string& name);
+
+// A fresh, empty directory under the system temp directory, removed with
+// everything in it when the object goes away.
+class TempDir {
+public:
+    explicit TempDir(const std::string& name);
+    ~TempDir();
+    TempDir(const TempDir&) = delete;
+    TempDir& operator=(const TempDir&) = delete;
+
+    const std::string& Path() const { return path_; }   // UTF-8
+
+private:
+    std::string path_;
+};
+
+template <typename A, typename B>
+std::string Describe(const A& a, const B& b) {
+    std::ostringstream os;
+    os << "expected " << b << ", got " << a;
+    return os.str();
+}
+
+} // namespace puml_test
+
+#define TEST(name)                                                        \
+    static void name();                                                   \
+    static const puml_test::Registrar name##_registrar(#name, &name);     \
+    static void name()
+
+#define CHECK(condition)                                                  \
+    do {                                                                  \
+        if (!(condition)) puml_test::Fail(__FILE__, __LINE__, #condition); \
+    } while (0)
+
+#define CHECK_EQ(actual, expected)                                        \
+    do {                                                                  \
+        const auto& check_a_ = (actual);                                  \
+        const auto& check_b_ = (expected);                                \
+        if (!(check_a_ == check_b_)) {                                    \
+            puml_test::Fail(__FILE__, __LINE__, std::string(#actual " == " #expected ": ") + \
+                            puml_test::Describe(check_a_, check_b_));     \
+        }                                                                 \
+    } while (0)
+
+#define REQUIRE(condition)                                                \
+    do {                                                                  \
+        if (!(condition)) {                                               \
+            puml_test::Fail(__FILE__, __LINE__, #condition);              \
+            throw puml_test::Abort();                                     \
+        }                                                                 \
+    } while (0)
+
+#define SKIP(reason) throw puml_test::Skipped{reason}